@@ -50,7 +50,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /machine:I386
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib ws2_32.lib macRTcomStatic.lib /nologo /subsystem:console /machine:I386 /libpath:".\sdk\lib"
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib ws2_32.lib winmm.lib macRTcomStatic.lib /nologo /subsystem:console /machine:I386 /libpath:".\sdk\lib"
 
 !ELSEIF  "$(CFG)" == "EVaRTSDKExample - Win32 Debug"
 
@@ -74,7 +74,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib ws2_32.lib macRTcomStatic.lib /nologo /subsystem:console /debug /machine:I386 /nodefaultlib:"libc" /pdbtype:sept /libpath:".\sdk\lib"
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib ws2_32.lib winmm.lib macRTcomStatic.lib /nologo /subsystem:console /debug /machine:I386 /nodefaultlib:"libc" /pdbtype:sept /libpath:".\sdk\lib"
 # SUBTRACT LINK32 /nodefaultlib
 
 !ENDIF 
@@ -88,18 +88,114 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\src\archive.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\arena.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\assembler.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\bodytracker.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\bufferpool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\c3d.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\continuity.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\decimator.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\filter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\forceplate.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\gapfill.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\jitterbuffer.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\main.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\outputscheduler.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\pipeline.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\precisetimer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\predictor.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\recorders.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\rigidbody.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sessionflush.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sessionreader.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\stages.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\streams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\threadpool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\transform.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\utils.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\validator.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\wrappers.cpp
 # End Source File
 # End Group
@@ -112,10 +208,78 @@ SOURCE=.\sdk\include\EVART.H
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\archive.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\arena.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\assembler.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\bodytracker.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\bufferpool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\c3d.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\continuity.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\decimator.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\fifo.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\filter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\forceplate.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\gapfill.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\jitterbuffer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\mathutil.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\outputscheduler.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\pipeline.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\precisetimer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\predictor.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\recorderbase.h
 # End Source File
 # Begin Source File
@@ -124,10 +288,50 @@ SOURCE=.\include\recorders.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\rigidbody.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\ringbuffer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\rollingwriter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\sessionflush.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\sessionreader.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\stages.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\streams.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\threadpool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\transform.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\utils.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\validator.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\wrappers.h
 # End Source File
 # End Group
@@ -0,0 +1,258 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: archive.h
+%%%
+%%% Description:
+%%%
+%%% Compressed, columnar archive files for long-term storage of TRC data.
+%%%
+%%% Frames are grouped into chunks. Inside a chunk, every marker axis is stored
+%%% as its own column: the values are quantized to a fixed-point grid, then
+%%% delta-of-delta encoded and written as zigzag varints. Marker trajectories
+%%% are smooth, so almost every value ends up as a single byte. Occluded
+%%% samples (XEMPTY) are not stored in the columns at all; each marker has a
+%%% run-length encoded visibility mask instead.
+%%%
+%%% File layout (all integers little-endian):
+%%%
+%%%   header     "MCA1", version, marker count, frames per chunk, resolution,
+%%%              size of the marker names block, NUL separated marker names
+%%%   chunks     first frame, frame count, payload size, payload
+%%%   directory  offset, first frame and frame count of each chunk
+%%%   trailer    chunk count, directory offset, "MCAX"
+%%%
+%%% Every chunk starts its predictors from zero, so chunks can be decoded
+%%% independently of each other and in parallel.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+//
+// Project headers
+//
+#include "wrappers.h"
+#include "threadpool.h"
+
+#define ARCHIVE_FRAMES_PER_CHUNK	1024		// default number of frames in one chunk
+#define ARCHIVE_RESOLUTION			0.01f		// default quantization step, in calibration units
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: ArchiveChunk
+%%%
+%%% Description:
+%%%
+%%% One decoded chunk of an archive. Values are kept column by column, so all
+%%% samples of one marker axis are contiguous. Occluded samples hold XEMPTY.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class ArchiveChunk
+{
+public:
+
+	//
+	// Constructor
+	//
+	ArchiveChunk();
+
+	//
+	// Get methods
+	//
+	int				Size				()								const;	// number of frames in this chunk
+	int				Markers				()								const;	// number of markers per frame
+	int				Frame				( int row )						const;	// frame number of the frame at row
+	const float*	Column				( int marker, int axis )		const;	// all samples of one marker axis
+	void			GetMarkerLocation	( int row, int marker, Point3 loc )	const;	// 3-D position of a marker at row
+	void			GetFrame			( int row, TrcFrameWrapper& frame )	const;	// whole frame at row
+
+	void			Resize				( int frames, int markers );	// used by the reader
+
+	std::vector<int>	mFrames;		// frame numbers, one per row
+	std::vector<float>	mColumns;		// marker*3+axis major, row minor
+
+private:
+
+	int		mMarkers;
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: TrcArchiveWriter
+%%%
+%%% Description:
+%%%
+%%% Writes TRC frames to an archive file. Frames are buffered until a chunk is
+%%% full, then the chunk is encoded and appended to the file. Close() must be
+%%% called to write the chunk directory, otherwise the file can not be read.
+%%%
+%%% Usage Notes:
+%%%
+%%% The quantization step sets the precision of the stored positions; with the
+%%% default of 0.01 every coordinate is reproduced to within 0.005 calibration
+%%% units.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class TrcArchiveWriter
+{
+public:
+
+	//
+	// Constructor
+	//
+	TrcArchiveWriter();
+
+	//
+	// Destructor
+	//
+	~TrcArchiveWriter();		// closes the file if it is still open
+
+	bool	Open		( const char* filename, const MarkerListWrapper& markers,
+						  int framesPerChunk = ARCHIVE_FRAMES_PER_CHUNK, float resolution = ARCHIVE_RESOLUTION );
+	bool	Add			( const TrcFrameWrapper& frame );		// append a frame
+	bool	Close		();										// flush the last chunk and write the directory
+	bool	IsOpen		() const;
+
+	unsigned long	Frames			() const;		// number of frames added so far
+	__int64			BytesWritten	() const;		// size of the file so far
+
+private:
+
+	struct ChunkInfo
+	{
+		__int64		offset;
+		int			firstFrame;
+		int			frames;
+	};
+
+	FILE*					mFile;
+	int						mMarkers;
+	int						mFramesPerChunk;
+	float					mResolution;
+	int						mRows;				// frames buffered in the current chunk
+	unsigned long			mFrameCount;
+	__int64					mOffset;			// current end of the file
+
+	std::vector<int>			mFrames;		// frame numbers of buffered rows
+	std::vector<int>			mValues;		// quantized values, column major
+	std::vector<unsigned char>	mVisible;		// visibility of each marker, marker major
+	std::vector<unsigned char>	mBuffer;		// encoded chunk payload
+	std::vector<ChunkInfo>		mDirectory;
+
+	bool	FlushChunk	();
+	bool	Write		( const void* data, size_t size );
+
+	// not copyable
+	TrcArchiveWriter( const TrcArchiveWriter& );
+	TrcArchiveWriter& operator = ( const TrcArchiveWriter& );
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: TrcArchiveReader
+%%%
+%%% Description:
+%%%
+%%% Reads an archive written by TrcArchiveWriter. The file is mapped into
+%%% memory read-only, and DecodeChunk() only touches its own output, so any
+%%% number of threads may decode different chunks at the same time.
+%%%
+%%% Usage Notes:
+%%%
+%%%		TrcArchiveReader reader;
+%%%		std::vector<ArchiveChunk> chunks;
+%%%
+%%%		if (reader.Open( "session.mca" ))
+%%%		{
+%%%			reader.DecodeAll( chunks );		// one chunk per pool thread at a time
+%%%		}
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class TrcArchiveReader
+{
+public:
+
+	//
+	// Constructor
+	//
+	TrcArchiveReader();
+
+	//
+	// Destructor
+	//
+	~TrcArchiveReader();
+
+	bool	Open		( const char* filename );
+	void	Close		();
+	bool	IsOpen		() const;
+
+	//
+	// Get methods
+	//
+	int							Chunks			()				const;	// number of chunks in the file
+	int							Frames			()				const;	// total number of frames in the file
+	int							Markers			()				const;	// number of markers per frame
+	float						Resolution		()				const;	// quantization step used by the writer
+	const MarkerListWrapper&	MarkerList		()				const;	// marker names
+	int							ChunkFirstFrame	( int chunk )	const;	// frame number of the first frame in a chunk
+	int							ChunkFrames		( int chunk )	const;	// number of frames in a chunk
+
+	bool	DecodeChunk	( int chunk, ArchiveChunk& out ) const;						// decode one chunk
+	bool	DecodeAll	( std::vector<ArchiveChunk>& out, WorkerPool* pool = NULL ) const;	// decode every chunk in parallel
+
+private:
+
+	struct ChunkInfo
+	{
+		__int64		offset;
+		int			firstFrame;
+		int			frames;
+	};
+
+	HANDLE					mFile;
+	HANDLE					mMapping;
+	const unsigned char*	mData;
+	__int64					mSize;
+
+	int						mMarkers;
+	int						mFrames;
+	float					mResolution;
+	MarkerListWrapper		mMarkerList;
+	std::vector<ChunkInfo>	mDirectory;
+
+	bool	ReadIndex	();
+
+	// not copyable
+	TrcArchiveReader( const TrcArchiveReader& );
+	TrcArchiveReader& operator = ( const TrcArchiveReader& );
+};
+
+#endif
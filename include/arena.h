@@ -0,0 +1,117 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: arena.h
+%%%
+%%% Description:
+%%%
+%%% An append-only store of variable sized records, carved out of large chunks
+%%% of memory of a fixed size. Records are laid out back to back inside a
+%%% chunk, each preceded by its size, so appending never allocates unless the
+%%% current chunk is full, and the records can be read back in order. All of
+%%% the memory is given back in a single Release() call.
+%%%
+%%% The arena does no locking of its own; users that append on one thread and
+%%% read on another must serialize access themselves.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+//
+// Standard headers
+//
+#include <vector>
+
+#define ARENA_CHUNK_SIZE	(4*1024*1024)		// default chunk size in bytes
+
+
+//
+// Position of a reader in a ChunkArena
+//
+struct ArenaCursor
+{
+	unsigned long	chunk;		// number of the chunk being read, counted from the last Release()
+	unsigned long	offset;		// byte offset of the next record in that chunk
+
+	ArenaCursor() : chunk(0), offset(0) {}
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: ChunkArena
+%%%
+%%% Usage Notes:
+%%%
+%%%		ChunkArena arena;
+%%%		ArenaCursor cursor;
+%%%		const void* data;
+%%%		unsigned long size;
+%%%
+%%%		memcpy( arena.Append( 12 ), src, 12 );
+%%%
+%%%		while (arena.Next( cursor, data, size ))
+%%%		{
+%%%			// use the record
+%%%		}
+%%%		arena.Release();
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class ChunkArena
+{
+public:
+
+	//
+	// Constructor
+	//
+	ChunkArena( unsigned long chunkSize = ARENA_CHUNK_SIZE );
+
+	//
+	// Destructor
+	//
+	~ChunkArena();
+
+	void*	Append		( unsigned long size );		// reserve space for a new record, returns NULL if out of memory
+	bool	Next		( ArenaCursor& cursor, const void*& data, unsigned long& size ) const;	// read the record at the cursor and advance it
+	void	Trim		( const ArenaCursor& cursor );	// free the chunks that lie entirely before the cursor
+	void	Release		();							// free every chunk
+
+	unsigned long	Records		() const;		// number of records appended since the last Release()
+	unsigned long	Chunks		() const;		// number of chunks still allocated
+	double			Bytes		() const;		// bytes of chunk memory allocated
+
+private:
+
+	struct Chunk
+	{
+		char*			data;
+		unsigned long	size;		// capacity in bytes
+		unsigned long	used;		// bytes holding records
+	};
+
+	std::vector<Chunk>	mChunks;			// chunks not yet trimmed, oldest first
+	unsigned long		mFirst;				// number of mChunks[0], chunks before it have been trimmed
+	unsigned long		mChunkSize;
+	unsigned long		mRecords;
+	double				mBytes;
+
+	// not copyable
+	ChunkArena( const ChunkArena& );
+	ChunkArena& operator = ( const ChunkArena& );
+};
+
+#endif
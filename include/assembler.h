@@ -0,0 +1,189 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: assembler.h
+%%%
+%%% Description:
+%%%
+%%% Joins the data types of one capture instant into a composite frame. The
+%%% SDK delivers each data type of a frame in a callback of its own, and the
+%%% types then travel through queues and threads of their own, so the parts
+%%% of a frame reach the assembler separately and in no particular order.
+%%%
+%%% Parts are collected by iFrame in a reorder window of ASSEMBLER_WINDOW
+%%% frames. Each frame of the window has room for every type wanted, set
+%%% aside once by SetTypes(), and parts are copied into it as they arrive,
+%%% so nothing is allocated per frame. Frames leave in frame order from the
+%%% assembler's own thread: the oldest frame in the window is emitted as
+%%% soon as every type wanted is there, or when it has waited the timeout
+%%% since its first part arrived, with the missing types left out. A part
+%%% that arrives after its frame was emitted is dropped, and so is a part
+%%% whose place in the window is still held by a frame ASSEMBLER_WINDOW
+%%% frames older.
+%%%
+%%% A part more than ASSEMBLER_WINDOW frames older than the last frame
+%%% emitted means EVaRT restarted its frame numbers, for a new take or after
+%%% a reconnect. The assembler then starts over with the new numbers; the
+%%% frames still in the window from before are emitted first.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __ASSEMBLER_H__
+#define __ASSEMBLER_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+
+//
+// Project headers
+//
+#include "streams.h"
+#include "utils.h"
+
+#define ASSEMBLER_WINDOW		32			// frames being assembled at once
+#define ASSEMBLER_TIMEOUT		0.01		// seconds a frame waits for its missing types
+#define ASSEMBLER_TYPES			10			// bit positions of the EVaRT data types
+
+
+//
+// The parts of one frame, as they are handed to a CompositeSink
+//
+struct CompositeFrame
+{
+	int			frame;						// iFrame
+	int			types;						// data types present, ORed together
+	int			missing;					// data types wanted that did not arrive in time
+	double		wait;						// seconds from the first part arriving to the frame leaving
+	const void*	parts[ASSEMBLER_TYPES];		// by bit position of the data type, NULL when missing
+
+	const void*	Part		( int type )	const;		// a type's frame laid out as EVaRT sent it, NULL when missing
+};
+
+
+//
+// Receives the composite frames, on the assembler's thread
+//
+class CompositeSink
+{
+public:
+
+	virtual ~CompositeSink() {}
+
+	virtual void Consume( const CompositeFrame& frame ) = 0;	// the parts are valid until this returns
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: FrameAssembler
+%%%
+%%% Usage Notes:
+%%%
+%%% Add() may be called from any number of threads. The assembler is a
+%%% StreamSink, so it can take the frames of FrameStreams directly; other
+%%% parts, the TRC frames of the pipeline, are passed to Add() laid out as
+%%% EVaRT sends them. SetTypes() must be called before Start().
+%%%
+%%%		FrameAssembler assembler;
+%%%
+%%%		assembler.SetTypes( TRC_DATA | FORCE_DATA );
+%%%		assembler.SetSink( &sink );
+%%%		router.Add( FORCE_DATA, &assembler );
+%%%		assembler.Start();
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class FrameAssembler : public StreamSink
+{
+public:
+
+	//
+	// Constructor
+	//
+	FrameAssembler();
+
+	//
+	// Destructor
+	//
+	virtual ~FrameAssembler();
+
+	void	SetTypes		( int types );					// data types of a complete frame, ORed together
+	void	SetTimeout		( double seconds );				// how long a frame waits for its missing types
+	void	SetSink			( CompositeSink* sink );
+	bool	Start			();								// start the thread that emits the frames
+	void	Stop			();								// emit the frames in the window, then stop the thread
+	bool	Add				( int type, const void* data );	// copy a part into its frame, false if it was dropped
+
+	virtual void	Consume	( int type, const void* data )	{ Add( type, data ); }
+
+	//
+	// Get methods
+	//
+	int				Types		()				const;
+	unsigned long	Complete	()				const;		// frames emitted with every type
+	unsigned long	Partial		()				const;		// frames emitted with types missing
+	unsigned long	Missing		( int type )	const;		// frames emitted without a type
+	unsigned long	Late		()				const;		// parts that arrived after their frame left
+	unsigned long	Overflow	()				const;		// parts with no room in the window
+	unsigned long	Restarts	()				const;		// times the frame numbers started over
+	double			WaitMax		()				const;		// longest a frame waited, seconds
+
+private:
+
+	// a frame being assembled
+	struct Slot
+	{
+		int				frame;						// -1 when free
+		unsigned long	epoch;						// mEpoch when the frame was started
+		int				types;						// parts copied so far
+		double			first;						// mClock time of the first part
+		char*			parts[ASSEMBLER_TYPES];		// room for each type wanted
+	};
+
+	Slot				mWindow[ASSEMBLER_WINDOW];
+	std::vector<char>	mMemory;					// the room for the parts of every slot
+	int					mTypes;
+	double				mTimeout;
+	CompositeSink*		mSink;
+	int					mEmitted;					// frame emitted last
+	bool				mAnyEmitted;
+	unsigned long		mEpoch;						// raised when the frame numbers restart
+	StopWatch			mClock;
+
+	unsigned long		mComplete;
+	unsigned long		mPartial;
+	unsigned long		mMissing[ASSEMBLER_TYPES];
+	unsigned long		mLate;
+	unsigned long		mOverflow;
+	unsigned long		mRestarts;
+	double				mWaitMax;
+
+	CRITICAL_SECTION	mLock;
+	HANDLE				mReady;						// auto-reset event, a frame is complete
+	HANDLE				mStop;						// manual-reset event, stops the thread
+	HANDLE				mThread;
+
+	void	Run				();
+
+	static unsigned __stdcall ThreadProc( void* arg );
+
+	// not copyable
+	FrameAssembler( const FrameAssembler& );
+	FrameAssembler& operator = ( const FrameAssembler& );
+};
+
+#endif
@@ -0,0 +1,138 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: bodytracker.h
+%%%
+%%% Description:
+%%%
+%%% Solves every rigid body of every subject in the volume for each TRC
+%%% frame, and gathers the poses into one packet per frame.
+%%%
+%%% Each body's solve is independent of the others and takes a couple of
+%%% microseconds, so with a handful of bodies it is cheapest to solve them
+%%% inline on the calling thread. From TRACKER_PARALLEL_BODIES bodies on, or
+%%% the count given to SetParallelBodies(), the bodies are split into
+%%% contiguous ranges; all but one range are handed to
+%%% a small WorkerPool and the calling thread solves the last one itself.
+%%% Either way the poses land in the packet in the order the bodies were
+%%% given, so the output does not depend on thread timing.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __BODYTRACKER_H__
+#define __BODYTRACKER_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <vector>
+
+//
+// Project headers
+//
+#include "rigidbody.h"
+#include "threadpool.h"
+#include "wrappers.h"
+
+#define TRACKER_PARALLEL_BODIES		8		// bodies from which solving moves to the worker pool
+#define TRACKER_THREADS				3		// worker threads, the calling thread also solves a range
+
+
+//
+// Poses of all bodies in one frame
+//
+struct PosePacket
+{
+	int						frame;		// iFrame of the TRC frame
+	int						solved;		// number of poses with a status other than kPoseNone
+	std::vector<BodyPose>	poses;		// one per body, in body order
+};
+
+
+class BodyRange;
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: BodyTracker
+%%%
+%%% Usage Notes:
+%%%
+%%% SetBodies() creates the worker threads when they are needed, so it should
+%%% be called before streaming starts rather than from the EVaRT callback.
+%%% Solve() reuses the packet's storage and doesn't allocate memory once the
+%%% packet has seen the body count. Solve() is not reentrant; call it from
+%%% one thread at a time.
+%%%
+%%%		BodyTracker tracker;
+%%%		PosePacket packet;
+%%%
+%%%		tracker.SetBodies( bodies );
+%%%		tracker.Resolve( markerList );
+%%%		tracker.Solve( frame, packet );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class BodyTracker
+{
+public:
+
+	//
+	// Constructor
+	//
+	BodyTracker( int parallelBodies = TRACKER_PARALLEL_BODIES, int numThreads = TRACKER_THREADS );
+
+	//
+	// Destructor
+	//
+	~BodyTracker();
+
+	//
+	// Set methods
+	//
+	void	SetParallelBodies	( int bodies );								// bodies from which the worker pool is used, from the next SetBodies()
+	void	SetBodies		( const std::vector<RigidBody>& bodies );		// bodies to track, in output order
+	bool	Resolve			( const MarkerListWrapper& markers );			// resolve every body, false if any failed
+	void	Clear			();												// remove the bodies and stop the worker threads
+
+	//
+	// Get methods
+	//
+	int					Bodies		()			const;		// number of bodies
+	const RigidBody&	Body		( int i )	const;		// body i
+	bool				IsParallel	()			const;		// bodies are solved on the worker pool
+
+	void	Solve			( const TrcFrameWrapper& frame, PosePacket& packet );	// pose of every body in a frame
+
+private:
+
+	friend class BodyRange;
+
+	std::vector<RigidBody>		mBodies;
+	std::vector<BodyRange*>		mRanges;			// one per worker thread plus one for the caller
+	WorkerPool*					mPool;				// NULL while the bodies are solved inline
+	int							mParallelBodies;
+	int							mThreads;
+
+	void	SolveRange		( int first, int last, const TrcFrameWrapper& frame, PosePacket& packet );
+
+	// not copyable
+	BodyTracker( const BodyTracker& );
+	BodyTracker& operator = ( const BodyTracker& );
+};
+
+#endif
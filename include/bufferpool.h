@@ -0,0 +1,120 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: bufferpool.h
+%%%
+%%% Description:
+%%%
+%%% A pool of memory blocks for data whose size changes from frame to frame,
+%%% such as the samples of analog and force frames. Blocks come in sizes
+%%% doubling from POOL_MIN_BLOCK; a request gets a block of the smallest
+%%% size that holds it. Released blocks are kept on a free list per size and
+%%% handed out again, so once the pool holds as many blocks as are in use at
+%%% the busiest moment, frames come and go without touching the heap.
+%%%
+%%% Requests larger than the largest size are allocated and freed directly.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __BUFFERPOOL_H__
+#define __BUFFERPOOL_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+
+#define POOL_MIN_BLOCK		64			// bytes in the smallest block
+#define POOL_SIZES			16			// block sizes, doubling up to 2 MB
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: BufferPool
+%%%
+%%% Usage Notes:
+%%%
+%%% Acquire() and Release() may be called from any thread. A block must be
+%%% released to the pool it came from, and the pool must outlive its blocks.
+%%%
+%%% Shared() returns a pool for the whole program. It is constructed before
+%%% main() runs, so never by two threads at once. Objects destroyed at exit
+%%% may still hold its blocks, and static objects in other files may be
+%%% destroyed after it, so blocks of the shared pool are given back through
+%%% ReleaseShared(), which frees them to the heap once the pool is gone.
+%%%
+%%%		int capacity;
+%%%		short* data = (short*) BufferPool::Shared().Acquire( bytes, capacity );
+%%%		...
+%%%		BufferPool::ReleaseShared( data );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class BufferPool
+{
+public:
+
+	//
+	// Constructor
+	//
+	BufferPool();
+
+	//
+	// Destructor
+	//
+	~BufferPool();		// frees the blocks on the free lists
+
+	void*	Acquire			( int bytes, int& capacity );	// a block of at least bytes, capacity is its real size
+	void	Release			( void* block );				// give a block back, NULL is ignored
+	void	Trim			();								// free the blocks on the free lists
+
+	//
+	// Get methods
+	//
+	double			Bytes		()	const;		// bytes taken from the heap and not yet freed
+	double			PeakBytes	()	const;		// most bytes ever taken from the heap
+	long			InUse		()	const;		// blocks handed out and not released
+	unsigned long	HeapCalls	()	const;		// blocks allocated from the heap
+
+	static BufferPool&	Shared			();					// pool for the whole program
+	static void			ReleaseShared	( void* block );	// give a block back to Shared(), or to the heap once it is destroyed
+
+private:
+
+	// in front of every block
+	union Header
+	{
+		struct
+		{
+			Header*		next;		// on the free list
+			int			size;		// index of the block size, -1 if allocated directly
+			int			capacity;	// usable bytes after the header
+		} info;
+		double			align;		// keeps the data behind the header aligned for doubles
+		char			pad[16];
+	};
+
+	Header*				mFree[POOL_SIZES];
+	double				mBytes;
+	double				mPeakBytes;
+	long				mInUse;
+	unsigned long		mHeapCalls;
+	mutable CRITICAL_SECTION	mLock;
+
+	// not copyable
+	BufferPool( const BufferPool& );
+	BufferPool& operator = ( const BufferPool& );
+};
+
+#endif
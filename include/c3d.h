@@ -0,0 +1,150 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: c3d.h
+%%%
+%%% Description:
+%%%
+%%% Writes marker (and optionally analog) data to a C3D file, the exchange
+%%% format used by most biomechanics software.
+%%%
+%%% The file is written in floating point format for Intel processors:
+%%%
+%%%   block 1      header
+%%%   block 2..    parameter section, groups POINT, ANALOG and TRIAL
+%%%   following    one record per frame: X,Y,Z,residual for every marker,
+%%%                then samples x channels analog values
+%%%
+%%% Frames are written as they are added; nothing but a small output buffer
+%%% is held in memory. The frame counts in the header and parameters are only
+%%% known at the end, so Close() goes back and fills them in. Sessions longer
+%%% than the 16 bit frame counts of the original format allow are described
+%%% by POINT:LONG_FRAMES and TRIAL:ACTUAL_START_FIELD/ACTUAL_END_FIELD.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __C3D_H__
+#define __C3D_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+//
+// Project headers
+//
+#include "continuity.h"
+#include "wrappers.h"
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: C3dWriter
+%%%
+%%% Usage Notes:
+%%%
+%%% Markers at XEMPTY are written as invalid points, residual -1. Frame
+%%% numbers must increase; when frames are skipped, invalid frames are
+%%% written in their place so the file keeps a constant rate. A frame at or
+%%% a little before the last one written is ignored. A frame more than
+%%% CONTINUITY_RESTART frames before it means EVaRT started its frame
+%%% numbers over: the file is closed and the frames go on in a new file,
+%%% session_2.c3d after session.c3d and so on, with the same parameters.
+%%%
+%%% POINT:UNITS is what SetPointUnits() was given before Open(), mm unless
+%%% the session was captured in other units.
+%%%
+%%% Analog samples are passed in the layout of sAnalogFrame::wData, sample
+%%% major, and stored unscaled.
+%%%
+%%%		C3dWriter c3d;
+%%%
+%%%		c3d.SetPointUnits( "mm" );
+%%%		if (c3d.Open( "session.c3d", markerList, frameRate, analogNames, analogSamples ))
+%%%		{
+%%%			trcRecorder.OutputC3d( c3d, analogRecorder );
+%%%			c3d.Close();
+%%%		}
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class C3dWriter
+{
+public:
+
+	//
+	// Constructor
+	//
+	C3dWriter();
+
+	//
+	// Destructor
+	//
+	~C3dWriter();		// closes the file if it is still open
+
+	void	SetPointUnits	( const std::string& units );		// units of the marker positions, set before Open()
+
+	bool	Open		( const char* filename, const MarkerListWrapper& markers, float frameRate,
+						  const std::vector<std::string>& analogNames = std::vector<std::string>(), int analogSamples = 0 );
+	bool	Add			( const TrcFrameWrapper& frame, const short* analog = NULL );	// append a frame, analog holds analogSamples*channels values
+	bool	Add			( const TrcFrameWrapper& frame, const AnalogFrameWrapper& analog );	// append a frame and its analog samples, zeros if their layout doesn't match
+	bool	Close		();																// flush and fill in the frame counts
+	bool	IsOpen		() const;
+
+	unsigned long	Frames		() const;		// number of frames written to the current file, including filled gaps
+	int				Files		() const;		// number of files opened since Open(), more than one after a restart
+
+private:
+
+	// settings of Open(), kept for the files started after a restart
+	std::string					mFileName;
+	std::vector<std::string>	mLabels;
+	std::vector<std::string>	mAnalogNames;
+	float						mFrameRate;
+	std::string					mUnits;
+	int							mFiles;
+
+	FILE*				mFile;
+	int					mMarkers;
+	int					mChannels;			// analog channels
+	int					mSamples;			// analog samples per frame
+	int					mFirstFrame;		// iFrame of the first frame written
+	int					mLastFrame;			// iFrame of the last frame written
+	unsigned long		mFrames;
+	std::vector<float>	mBuffer;			// frames waiting to be written
+
+	// file offsets of the values filled in by Close()
+	long	mPointFramesOffset;
+	long	mLongFramesOffset;
+	long	mStartFieldOffset;
+	long	mEndFieldOffset;
+
+	bool	Create			( const std::string& filename );
+	bool	Restart			();
+	bool	WriteFrame		( const TrcFrameWrapper* frame, const short* analog );
+	bool	Flush			();
+	bool	Patch			( long offset, const void* data, size_t size );
+
+	// not copyable
+	C3dWriter( const C3dWriter& );
+	C3dWriter& operator = ( const C3dWriter& );
+};
+
+#endif
@@ -0,0 +1,142 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: continuity.h
+%%%
+%%% Description:
+%%%
+%%% Keeps track of the iFrame numbers seen at one point of the data path, so
+%%% lost frames can be found and a recording can be shown to be complete.
+%%%
+%%% Each arriving frame number is compared with the one expected next. A jump
+%%% forward is stored as a gap, a range of missing frame numbers. A frame
+%%% that lands inside a gap arrived out of order and shrinks or splits that
+%%% gap; any other frame that was already seen is a duplicate. Only the gap
+%%% ranges are stored, never one entry per frame.
+%%%
+%%% A frame more than CONTINUITY_RESTART frames behind the last one means
+%%% EVaRT started its frame numbers over. That starts a new epoch: it is
+%%% counted as a restart, not as a gap back to the first frame, and the
+%%% frames after it are compared only with each other. The gaps of every
+%%% epoch are kept, tagged with their epoch.
+%%%
+%%% Frames that arrived but had to be thrown away (the data handler was busy,
+%%% a recorder FIFO was full) are passed to Add() as well, and counted through
+%%% AddDropped(), so each lost frame counts once, as dropped, never as missing.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __CONTINUITY_H__
+#define __CONTINUITY_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <iostream>
+#include <vector>
+
+#define CONTINUITY_RESTART		1000		// frames back from the last one taken as a restart of the frame numbers
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: FrameContinuity
+%%%
+%%% Usage Notes:
+%%%
+%%% Add() and AddDropped() may be called from any thread. The counters are
+%%% updated with interlocked operations and can be read at any time without
+%%% taking the lock, e.g. for a live display.
+%%%
+%%% Output() writes the counters and the gap ranges as text:
+%%%
+%%%		RECEIVED,MISSING,DUPLICATE,OUT_OF_ORDER,DROPPED,FIRST,LAST,RESTARTS
+%%%		<counters>
+%%%		EPOCH,GAP_FIRST,GAP_LAST
+%%%		<one line per gap>
+%%%
+%%% FIRST and LAST are those of the current epoch.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class FrameContinuity
+{
+public:
+
+	//
+	// Constructor
+	//
+	FrameContinuity();
+
+	//
+	// Destructor
+	//
+	~FrameContinuity();
+
+	void	Reset		();						// forget every frame seen so far
+	void	Add			( int frame );			// a frame has arrived
+	void	AddDropped	( long count = 1 );		// frames that arrived but were not kept
+
+	//
+	// Get methods
+	//
+	long	Received	() const;		// number of frames passed to Add()
+	long	Missing		() const;		// frame numbers skipped and not yet seen
+	long	Duplicates	() const;		// frames seen more than once
+	long	OutOfOrder	() const;		// frames that filled a gap
+	long	Dropped		() const;		// frames passed to AddDropped()
+	long	Restarts	() const;		// times the frame numbers started over
+	bool	IsComplete	() const;		// nothing missing and nothing dropped
+
+	int		FirstFrame	() const;		// lowest frame number seen since the last restart, -1 if none
+	int		LastFrame	() const;		// highest frame number seen since the last restart, -1 if none
+	int		Gaps		() const;		// number of gap ranges, of every epoch
+	bool	GetGap		( int i, int& first, int& last, int* epoch = NULL ) const;		// frame range of gap i, and its epoch
+
+	void	Output		( std::ostream& os ) const;		// write the counters and gaps
+
+private:
+
+	struct GapRange
+	{
+		int		epoch;
+		int		first;
+		int		last;
+	};
+
+	std::vector<GapRange>	mGaps;			// sorted by epoch then frame, never overlapping
+	int						mEpochStart;	// first gap of the current epoch
+	int						mEpoch;
+	int						mFirst;
+	int						mLast;
+	bool					mStarted;
+
+	volatile LONG	mReceived;
+	volatile LONG	mMissing;
+	volatile LONG	mDuplicates;
+	volatile LONG	mOutOfOrder;
+	volatile LONG	mDropped;
+	volatile LONG	mRestarts;
+
+	mutable CRITICAL_SECTION	mLock;		// guards the gaps and frame range
+
+	bool	FillGap		( int frame );
+
+	// not copyable
+	FrameContinuity( const FrameContinuity& );
+	FrameContinuity& operator = ( const FrameContinuity& );
+};
+
+#endif
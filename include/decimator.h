@@ -0,0 +1,147 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: decimator.h
+%%%
+%%% Description:
+%%%
+%%% Brings analog channels down from the analog rate to a lower rate, such as
+%%% the capture rate, with a low pass FIR filter so the dropped samples don't
+%%% alias into the kept ones.
+%%%
+%%% Samples arrive as in sAnalogFrame::wData, shorts with the channels of a
+%%% sample side by side. They are converted to floats and moved into one row
+%%% per channel in the same pass, four channels of four samples at a time
+%%% with SSE. The rows are what the filter runs over: each kept output is a
+%%% dot product of the coefficients with a stretch of one row, four taps at
+%%% a time. Only the kept outputs are computed, so every output touches each
+%%% phase of the filter once, the same work as a polyphase decimator.
+%%%
+%%% The end of every row is kept for the next frame, so frames of any number
+%%% of samples can be fed one after the other as if they were one stream.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __DECIMATOR_H__
+#define __DECIMATOR_H__
+
+//
+// Project headers
+//
+#include "wrappers.h"
+
+#define DECIMATOR_TAPS_PER_PHASE	8			// filter taps for each input sample dropped or kept
+#define DECIMATOR_CUTOFF			0.8			// passband edge, share of the output Nyquist frequency
+#define DECIMATOR_MAX_TAPS			1024		// longest filter
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: AnalogDecimator
+%%%
+%%% Usage Notes:
+%%%
+%%% SetFactor() designs a windowed-sinc low pass for the factor; a filter of
+%%% your own can be given with SetCoefficients() instead. Either one, and
+%%% SetChannels(), forget the stream so far. Process() allocates only when a
+%%% frame has more samples than any frame before it.
+%%%
+%%% The outputs are delayed by Delay() input samples, half the filter length.
+%%% With the factor set to the samples per frame, one output comes out of
+%%% every frame, taken at the frame's last sample.
+%%%
+%%%		AnalogDecimator decimator;
+%%%
+%%%		decimator.SetFactor( frame.Samples() );
+%%%		decimator.SetChannels( frame.Channels() );
+%%%
+%%%		int n = decimator.Process( frame.Data(), frame.Samples() );
+%%%		const float* emg = decimator.Output( 0 );		// n samples of channel 0
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class AnalogDecimator
+{
+public:
+
+	//
+	// Constructor
+	//
+	AnalogDecimator();
+
+	//
+	// Destructor
+	//
+	~AnalogDecimator();
+
+	//
+	// Set methods
+	//
+	bool	SetFactor			( int factor );										// keep one sample in factor, 1 keeps them all
+	bool	SetCoefficients		( const float* taps, int count, int factor );		// a filter of your own
+	void	SetChannels			( int count );
+	void	Reset				();													// start the stream over
+
+	//
+	// Get methods
+	//
+	int				Factor			()								const;
+	int				Taps			()								const;		// filter length
+	int				Channels		()								const;
+	double			Delay			()								const;		// group delay, input samples
+	int				Samples			()								const;		// outputs of the last Process()
+	const float*	Output			( int channel )					const;		// Samples() outputs of a channel
+	float			Value			( int sample, int channel )		const;		// one output
+	void			GetInterleaved	( short* dst )					const;		// outputs in the layout of sAnalogFrame::wData, rounded
+	double			CostAverage		()								const;		// microseconds per Process()
+	double			CostMax			()								const;		// microseconds of the slowest Process()
+	double			Throughput		()								const;		// channels times input samples per second of processing
+
+	int		Process			( const short* data, int samples );		// filter samples*Channels() values, returns the number of outputs
+
+private:
+
+	int				mFactor;
+	int				mTaps;				// filter length
+	int				mPadded;			// mTaps rounded up to a multiple of four, zeros in front
+	int				mChannels;
+	int				mCapacity;			// input samples a row has room for
+	int				mRowStride;			// floats per history row
+	int				mOutStride;			// floats per output row
+	int				mSkip;				// input samples before the next output
+	int				mSamples;			// outputs of the last Process()
+	float			mDesign[DECIMATOR_MAX_TAPS];	// the filter as set
+
+	// 16-byte aligned, carved from one block
+	float*			mBlock;
+	float*			mCoefficients;		// reversed, so they line up with the rows
+	float*			mHistory;			// per channel, mPadded old samples followed by the new ones
+	float*			mOutput;			// per channel
+
+	double			mCostTotal;
+	double			mCostMax;
+	unsigned long	mCalls;
+	double			mChannelSamples;	// channels times input samples processed
+	double			mSeconds;			// spent processing them
+
+	void	Allocate		( int capacity );
+	void	Convert			( const short* data, int samples );
+	void	Free			();
+
+	// not copyable
+	AnalogDecimator( const AnalogDecimator& );
+	AnalogDecimator& operator = ( const AnalogDecimator& );
+};
+
+#endif
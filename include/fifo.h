@@ -33,6 +33,7 @@
 //
 #include <windows.h>
 #include <queue>
+#include <vector>
 
 // How to deal with additions when the FIFO gets full
 enum FifoReplaceStrategy
@@ -60,9 +61,10 @@ public:
 	//
 	// Methods
 	//
-	void	Add			( const T& element );		// add a new element to the fifo
+	bool	Add			( const T& element, unsigned long* removed = NULL );	// add a new element to the fifo, false if it was not added
 	bool	GetNext		( T& next );				// get the element at the front of the fifo, the item is removed
 	bool	PeekNext	( T& next );				// get the element at the front of the fifo, the item is not removed
+	unsigned long	GetBatch	( std::vector<T>& out, unsigned long maxCount );	// move up to maxCount elements to the end of out
 	void	Clear		();							// clear the fifo
 
 
@@ -221,16 +223,22 @@ void FIFO<T>::SetReplaceStrategy( FifoReplaceStrategy replaceStrategy )
 	}
 }
 
-// Add a new element to the fifo
+// Add a new element to the fifo, returns false if the element was not added
+// If removed is given, it gets the number of old elements removed to make room
 template<class T>
-void FIFO<T>::Add( const T& element )
+bool FIFO<T>::Add( const T& element, unsigned long* removed )
 {
+	bool rc = false;
+
+	if (removed)	*removed = 0;
+
 	if (mMaxSize > 0 && !mLocked && SemWait())
 	{
 		// add the new element, since we know we have room, we don't have to do anything else
 		if (mQ.size() < mMaxSize)
 		{
 			mQ.push( element );
+			rc = true;
 		}
 		else
 		{
@@ -242,14 +250,18 @@ void FIFO<T>::Add( const T& element )
 				while (mQ.size() >= mMaxSize)
 				{
 					mQ.pop();
+					if (removed)	(*removed)++;
 				}
 
 				// add the new element
 				mQ.push( element );
+				rc = true;
 			}
 		}
 		SemRelease();
 	}
+
+	return rc;
 }
 
 // Get the next item in the fifo, returns true if an item exists, false otherwise
@@ -274,6 +286,28 @@ bool FIFO<T>::GetNext( T& next )
 	return rc;
 }
 
+// Move up to maxCount items from the front of the fifo to the end of out,
+// returns the number of items moved. The semaphore is taken once for all of them.
+template<class T>
+unsigned long FIFO<T>::GetBatch( std::vector<T>& out, unsigned long maxCount )
+{
+	unsigned long count = 0;
+
+	if (SemWait())
+	{
+		while (count < maxCount && mQ.empty() == false)
+		{
+			out.push_back( mQ.front() );
+			mQ.pop();
+			count++;
+		}
+
+		SemRelease();
+	}
+
+	return count;
+}
+
 // Get the next item in the fifo, returns true if an item exists, false otherwise
 // The item is NOT removed from the fifo
 template<class T>
@@ -0,0 +1,264 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: filter.h
+%%%
+%%% Description:
+%%%
+%%% Low-latency smoothing of marker positions and rigid body poses.
+%%%
+%%% A FilterBank filters many independent scalar channels, one per marker
+%%% coordinate or pose component, with either a One-Euro filter (a low pass
+%%% whose cutoff rises with speed, so slow movement is smoothed and fast
+%%% movement is not held back) or a constant-velocity Kalman filter. The
+%%% state is kept as one array per quantity, so a frame is filtered four
+%%% channels at a time with SSE and every step is the same for every channel.
+%%% Parameters are per channel, which is how bodies get their own settings
+%%% without a separate pass.
+%%%
+%%% Each bank measures what it costs: the processor time per frame, and the
+%%% lag it adds, estimated by fitting how far the output trails the input to
+%%% the speed of the input, over all channels.
+%%%
+%%% A quaternion component moves by about one unit per second where a marker
+%%% moves by a thousand millimetres, so the rotation of a body has defaults
+%%% of its own. The settings can be read from a text file:
+%%%
+%%%		# One-Euro for everything, the head turns quicker than the rest
+%%%		TYPE		oneeuro
+%%%		MARKERS		1.0	0.007	1.0	5e5	0.25
+%%%		BODY		head
+%%%		POSITION	1.0	0.007	1.0	5e5	0.25
+%%%		ROTATION	1.5	8.0	1.0	2.0	1e-6
+%%%
+%%% TYPE is oneeuro, kalman or off. Every line of values is the minimum
+%%% cutoff, beta and speed cutoff of the One-Euro filter, then the process
+%%% and measurement noise of the Kalman filter. POSITION and ROTATION apply
+%%% to the BODY named before them. Every keyword is optional.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "wrappers.h"
+
+#define FILTER_MIN_CUTOFF		1.0f		// One-Euro cutoff at rest, Hz
+#define FILTER_BETA				0.007f		// One-Euro cutoff increase per mm/s of speed
+#define FILTER_D_CUTOFF			1.0f		// One-Euro cutoff of the speed estimate, Hz
+#define FILTER_PROCESS_NOISE	5.0e5f		// Kalman acceleration noise density, mm^2/s^3
+#define FILTER_MEASURE_NOISE	0.25f		// Kalman measurement variance, mm^2
+#define FILTER_ROT_MIN_CUTOFF	1.0f		// the same for a quaternion component, Hz
+#define FILTER_ROT_BETA			5.0f		// per unit/s
+#define FILTER_ROT_D_CUTOFF		1.0f		// Hz
+#define FILTER_ROT_PROCESS_NOISE	2.0f	// 1/s^3
+#define FILTER_ROT_MEASURE_NOISE	1.0e-6f	// unitless
+
+
+// Kind of filter run by a bank
+enum FilterType
+{
+	kFilterNone = 0,		// output is the input
+	kFilterOneEuro,
+	kFilterKalman			// constant velocity
+};
+
+
+// What a channel holds, which picks its default parameters
+enum FilterQuantity
+{
+	kFilterPosition = 0,	// millimetres
+	kFilterRotation			// a quaternion component
+};
+
+
+//
+// Settings of one channel, the unused half depends on the bank's type
+//
+struct FilterParams
+{
+	float	minCutoff;			// One-Euro
+	float	beta;
+	float	dCutoff;
+	float	processNoise;		// Kalman
+	float	measureNoise;
+
+	FilterParams( FilterQuantity quantity = kFilterPosition );
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: FilterBank
+%%%
+%%% Usage Notes:
+%%%
+%%% An input of XEMPTY means the channel has no value in this frame; its
+%%% output is then XEMPTY too, and the channel starts over from its next
+%%% value. SetChannels() allocates, Filter() does not.
+%%%
+%%%		FilterBank bank;
+%%%
+%%%		bank.SetType( kFilterOneEuro );
+%%%		bank.SetRate( 120.0f );
+%%%		bank.SetChannels( 3 * nMarkers );
+%%%		bank.Filter( in, out );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class FilterBank
+{
+public:
+
+	//
+	// Constructor
+	//
+	FilterBank();
+
+	//
+	// Destructor
+	//
+	~FilterBank();
+
+	//
+	// Set methods
+	//
+	void	SetType			( FilterType type );
+	void	SetRate			( float rate );										// frames per second
+	void	SetChannels		( int count );										// resets every channel to the default parameters
+	void	SetParams		( int first, int count, const FilterParams& params );	// parameters of a range of channels
+	void	Reset			();													// forget the state of every channel
+
+	//
+	// Get methods
+	//
+	FilterType	Type			()	const;
+	int			Channels		()	const;
+	double		CostAverage		()	const;		// microseconds per frame, averaged over all frames
+	double		CostMax			()	const;		// microseconds of the slowest frame
+	double		Latency			()	const;		// estimated lag of the output, milliseconds
+
+	void	Filter			( const float* in, float* out );		// one frame, Channels() values each, in and out may be the same
+
+private:
+
+	FilterType		mType;
+	float			mRate;
+	int				mChannels;
+	int				mPadded;			// mChannels rounded up to a multiple of four
+
+	// one array per quantity, 16-byte aligned, carved from one block
+	float*			mBlock;
+	float*			mIn;				// input copied here, padded with XEMPTY
+	float*			mX;					// filtered value, Kalman position
+	float*			mD;					// filtered speed, Kalman velocity
+	float*			mPrev;				// last input, for the lag estimate
+	float*			mValid;				// all bits set where the channel had a value last frame
+	float*			mP00;				// Kalman covariance
+	float*			mP01;
+	float*			mP11;
+	float*			mMinCutoff;			// parameters
+	float*			mBeta;
+	float*			mDCutoff;
+	float*			mQ;
+	float*			mR;
+
+	double			mCostTotal;
+	double			mCostMax;
+	unsigned long	mFrames;
+	double			mLatency;			// smoothed lag, seconds
+
+	void	OneEuro			( float& lagNum, float& lagDen );
+	void	Kalman			( float& lagNum, float& lagDen );
+	void	Free			();
+
+	// not copyable
+	FilterBank( const FilterBank& );
+	FilterBank& operator = ( const FilterBank& );
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: FrameFilter
+%%%
+%%% Usage Notes:
+%%%
+%%% Filters the markers of TRC frames and the poses of a BodyTracker's
+%%% packets with two banks of the same type. A pose is filtered as its
+%%% position and its quaternion components, and the quaternion is made unit
+%%% length again afterwards; the tracker already keeps consecutive
+%%% quaternions in the same hemisphere, so this stays close to the true mean.
+%%% Poses that could not be solved are passed through untouched. A body's
+%%% position and rotation have their own parameters. With kFilterNone the
+%%% frames and packets are not touched at all.
+%%%
+%%%		FrameFilter filter;
+%%%
+%%%		filter.SetType( kFilterOneEuro );
+%%%		filter.SetRate( frameRate );
+%%%		filter.SetBodies( tracker.Bodies() );
+%%%		filter.SetBodyParams( 0, headPosition, headRotation );
+%%%		filter.Load( "filter.txt", tracker );		// or all of it from a file
+%%%		filter.Filter( frame );
+%%%		filter.Filter( packet );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class FrameFilter
+{
+public:
+
+	//
+	// Constructor
+	//
+	FrameFilter();
+
+	//
+	// Set methods
+	//
+	void	SetType			( FilterType type );
+	void	SetRate			( float rate );
+	void	SetMarkerParams	( const FilterParams& params );				// every marker
+	void	SetBodies		( int count );								// number of bodies in the packets, each with the defaults
+	void	SetBodyParams	( int body, const FilterParams& position, const FilterParams& rotation );	// one body
+	bool	Load			( const char* filename, const BodyTracker& tracker );	// read the settings, false if they are not valid
+	void	Reset			();
+
+	//
+	// Get methods
+	//
+	const FilterBank&	Markers		()	const;		// the marker bank, for its cost and latency
+	const FilterBank&	Bodies		()	const;		// the pose bank
+
+	void	Filter			( TrcFrameWrapper& frame );		// filter the markers in place
+	void	Filter			( PosePacket& packet );			// filter the poses in place
+
+private:
+
+	FilterBank			mMarkers;
+	FilterBank			mBodies;
+	FilterParams		mMarkerParams;
+	float				mMarkerData[3 * MAX_MARKERS];
+	std::vector<float>	mBodyData;			// seven values per body
+
+	// not copyable
+	FrameFilter( const FrameFilter& );
+	FrameFilter& operator = ( const FrameFilter& );
+};
+
+#endif
@@ -0,0 +1,192 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: forceplate.h
+%%%
+%%% Description:
+%%%
+%%% Turns the samples of sForceFrame into the quantities a gait study uses:
+%%% for each plate its center of pressure, force and free moment in the
+%%% capture volume, and for all plates together the resultant force, the
+%%% combined center of pressure and the free moment about it.
+%%%
+%%% Each plate has a calibration, read from a text file:
+%%%
+%%%		# plate 2 sits 600 mm along X, turned half way round
+%%%		PLATE		2
+%%%		ORIGIN		600	0	0
+%%%		ROTATION	-1	0	0
+%%%					0	-1	0
+%%%					0	0	1
+%%%		SCALE		1.0	1.0
+%%%		ZERO		0	0	0	0
+%%%		THRESHOLD	20
+%%%
+%%% A position p on the plate is at ROTATION * p + ORIGIN in the capture
+%%% volume, and a force f points along ROTATION * f. SCALE takes the forces,
+%%% then the moment, to newtons and newton-millimetres, after the ZERO
+%%% offsets of fX, fY, fZ and MZ are taken off. While the load on a plate,
+%%% its fZ, is below THRESHOLD the center of pressure is not defined; it is
+%%% XEMPTY, and the plate's free moment is 0. Keywords after PLATE apply to
+%%% that plate, every keyword is optional, and plates not in the file keep
+%%% the identity.
+%%%
+%%% sForceFrame already carries each plate's center of pressure as its X,Y,Z,
+%%% so a plate's center of pressure is the one EVaRT reports, only moved into
+%%% the capture volume; it is not derived again from the forces and moments.
+%%% The plates are assumed to be level, their Z axes vertical: a plate's free
+%%% moment is MZ turned by ROTATION's Z,Z entry, up or down, and a tilted
+%%% plate would need the moments about its other axes, which are not sent.
+%%% The combined center of pressure and free moment of all plates together
+%%% are computed, from the plates' forces and centers of pressure.
+%%%
+%%% The values of a frame are laid out sample after sample and plate after
+%%% plate. Four samples of a plate are loaded with two 4x4 transposes, which
+%%% gives each of the seven values in a register of its own, so the whole
+%%% computation runs over four samples at a time with SSE.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __FORCEPLATE_H__
+#define __FORCEPLATE_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <string>
+
+//
+// Project headers
+//
+#include "wrappers.h"
+
+#define MAX_FORCE_PLATES		16			// plates in one frame
+#define FORCE_THRESHOLD			20.0f		// newtons of load below which there is no center of pressure
+#define FORCE_CHANNELS			7			// derived channels of a plate, and of the resultant
+
+
+// Index of each derived channel of a plate or of the resultant
+enum ForceChannel
+{
+	kCopX = 0,			// center of pressure, capture volume
+	kCopY,
+	kCopZ,
+	kResultX,			// force, capture volume
+	kResultY,
+	kResultZ,
+	kFreeMoment			// about the vertical through the center of pressure
+};
+
+
+//
+// How the values of one plate map into the capture volume
+//
+struct PlateCalibration
+{
+	float	origin[3];
+	float	rotation[3][3];		// plate axes to capture volume axes
+	float	forceScale;
+	float	momentScale;
+	float	zero[4];			// offsets of fX, fY, fZ and MZ
+	float	threshold;			// least load with a center of pressure
+
+	PlateCalibration();
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: ForcePlates
+%%%
+%%% Usage Notes:
+%%%
+%%% Process() computes FORCE_CHANNELS channels for every plate, followed by
+%%% the same channels for the resultant, for every sample of a frame. A
+%%% channel's samples are in one row, which Output() returns. Process()
+%%% allocates only when a frame has more samples than any frame before it.
+%%% Load() may not be called while another thread is in Process().
+%%%
+%%%		ForcePlates plates;
+%%%
+%%%		plates.Load( "plates.txt" );
+%%%		plates.Process( frame );
+%%%
+%%%		int total = plates.Plates() * FORCE_CHANNELS;
+%%%		const float* fz = plates.Output( total + kResultZ );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class ForcePlates
+{
+public:
+
+	//
+	// Constructor
+	//
+	ForcePlates();
+
+	//
+	// Destructor
+	//
+	~ForcePlates();
+
+	//
+	// Set methods
+	//
+	void	SetCalibration	( int plate, const PlateCalibration& calibration );
+	bool	Load			( const char* filename );		// read plate calibrations, false if the file is not valid
+
+	//
+	// Get methods
+	//
+	const PlateCalibration&	Calibration		( int plate )				const;
+	int						Plates			()							const;		// plates in the last frame
+	int						Samples			()							const;		// samples in the last frame
+	int						Channels		()							const;		// derived channels of the last frame
+	std::string				ChannelName		( int channel )				const;
+	const float*			Output			( int channel )				const;		// Samples() values of a channel
+	float					Value			( int sample, int channel )	const;		// one value, XEMPTY if out of range
+	double					CostAverage		()							const;		// microseconds per frame
+	double					CostMax			()							const;		// microseconds of the slowest frame
+	double					Throughput		()							const;		// plate samples per second of processing
+
+	int		Process			( const ForceFrameWrapper& frame );		// returns the number of samples
+
+private:
+
+	PlateCalibration	mCalibration[MAX_FORCE_PLATES];
+	int					mPlates;
+	int					mSamples;
+	int					mCapacity;			// samples a row has room for
+	int					mStride;			// floats per row
+	float*				mOutput;			// 16-byte aligned, (MAX_FORCE_PLATES + 1) * FORCE_CHANNELS rows
+
+	double				mCostTotal;
+	double				mCostMax;
+	unsigned long		mFrames;
+	double				mPlateSamples;		// plates times samples processed
+	double				mSeconds;			// spent processing them
+
+	void	Allocate		( int capacity );
+	void	Compute			( const float* data, int sample, int stride );
+
+	// not copyable
+	ForcePlates( const ForcePlates& );
+	ForcePlates& operator = ( const ForcePlates& );
+};
+
+#endif
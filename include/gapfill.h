@@ -0,0 +1,172 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: gapfill.h
+%%%
+%%% Description:
+%%%
+%%% Fills short marker occlusions in live TRC frames, so that an occluded
+%%% marker does not reach the rest of the program as XEMPTY.
+%%%
+%%% Two sources are tried for each missing marker, in this order:
+%%%
+%%%		rigid body		the marker belongs to a body that was fully solved
+%%%						from its other markers; the marker's reference
+%%%						position is carried through the body's pose
+%%%		extrapolation	the marker's own recent track is continued at
+%%%						constant velocity or constant acceleration
+%%%
+%%% Each filled marker has a confidence that starts at one and is multiplied
+%%% by the source's decay factor for every frame of the gap. A marker is left
+%%% empty once its gap is longer than the source's maximum or its confidence
+%%% falls below the minimum. Each marker keeps a few positions of history in
+%%% fixed arrays, so filling a frame costs a constant amount of work per
+%%% marker and never allocates memory.
+%%%
+%%% The limits can be read from a text file:
+%%%
+%%%		# Short gaps only, a body's markers for up to a second
+%%%		EXTRAPOLATE	velocity	5	0.8
+%%%		BODY		on			120	0.99
+%%%		CONFIDENCE	0.2
+%%%
+%%% EXTRAPOLATE is none, velocity or acceleration and BODY on or off, each
+%%% followed by the maximum gap in frames and the confidence kept per frame.
+%%% Every keyword is optional.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __GAPFILL_H__
+#define __GAPFILL_H__
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "wrappers.h"
+
+#define FILL_MAX_GAP			10		// frames a marker is extrapolated
+#define FILL_DECAY				0.85f	// confidence kept per extrapolated frame
+#define FILL_BODY_MAX_GAP		120		// frames a marker is filled from its rigid body
+#define FILL_BODY_DECAY			0.99f	// confidence kept per frame filled from a rigid body
+#define FILL_MIN_CONFIDENCE		0.1f	// markers are left empty below this confidence
+
+
+// How missing markers are continued from their own track
+enum FillMethod
+{
+	kFillNone = 0,			// no extrapolation
+	kFillVelocity,			// constant velocity, needs two consecutive frames of history
+	kFillAcceleration		// constant acceleration, needs three, falls back to velocity
+};
+
+
+// Where the position of a marker in the filled frame came from
+enum FillStatus
+{
+	kMarkerMeasured = 0,	// seen by the cameras
+	kMarkerEmpty,			// missing and could not be filled
+	kMarkerFromBody,		// filled from its rigid body
+	kMarkerExtrapolated		// filled from its own track
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: GapFiller
+%%%
+%%% Usage Notes:
+%%%
+%%% Fill() works on the frame in place; the TRC frame wrapper holds its own
+%%% copy of the markers, so the data from EVaRT is never written. Rigid body
+%%% filling needs the poses solved for the same frame, so the tracker runs on
+%%% the raw frame first. Filled positions from a rigid body become part of the
+%%% marker's track, extrapolated ones do not. The maximum gap of either source
+%%% counts the frames since the marker was last measured.
+%%%
+%%% Reset() must be called when the marker list changes.
+%%%
+%%%		GapFiller filler;
+%%%
+%%%		tracker.Solve( frame, packet );
+%%%		filler.Load( "fill.txt" );		// or SetExtrapolation() and SetBodyFill()
+%%%		filler.Fill( frame, &tracker, &packet );
+%%%		if (filler.Status( 0 ) == kMarkerExtrapolated) ...
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class GapFiller
+{
+public:
+
+	//
+	// Constructor
+	//
+	GapFiller();
+
+	//
+	// Set methods
+	//
+	void	SetExtrapolation	( FillMethod method, int maxGap = FILL_MAX_GAP, float decay = FILL_DECAY );	// filling from the marker's track
+	void	SetBodyFill			( bool enable, int maxGap = FILL_BODY_MAX_GAP, float decay = FILL_BODY_DECAY );	// filling from rigid bodies
+	void	SetMinConfidence	( float confidence );		// lowest confidence of a filled marker
+	bool	Load				( const char* filename );	// read the limits, false if they are not valid
+	void	Reset				();							// forget the history of every marker
+
+	//
+	// Get methods
+	//
+	FillStatus	Status			( int i )	const;		// where marker i of the last frame came from
+	float		Confidence		( int i )	const;		// confidence of marker i of the last frame, 1 when measured, 0 when empty
+	int			Filled			()			const;		// markers filled in the last frame
+	int			Empty			()			const;		// markers left empty in the last frame
+
+	void	Fill				( TrcFrameWrapper& frame, const BodyTracker* tracker = NULL, const PosePacket* packet = NULL );	// fill the missing markers of a frame
+
+private:
+
+	// history of one marker
+	struct Track
+	{
+		float		pos[3][3];		// last positions, most recent first
+		int			count;			// valid entries in pos, all from consecutive frames
+		int			frame;			// frame of pos[0]
+		float		confidence;		// confidence of pos[0]
+		int			measured;		// frame the marker was last seen by the cameras
+		FillStatus	status;			// status in the last frame
+		float		lastConfidence;	// confidence in the last frame
+	};
+
+	Track		mTracks[MAX_MARKERS];
+	int			mCount;				// markers in the last frame
+	int			mFilled;
+	int			mEmpty;
+
+	FillMethod	mMethod;
+	int			mMaxGap;
+	float		mDecay;
+	bool		mBodyFill;
+	int			mBodyMaxGap;
+	float		mBodyDecay;
+	float		mMinConfidence;
+
+	void	Push			( Track& t, int frame, const Point3 pos, float confidence );
+	void	FillFromBodies	( TrcFrameWrapper& frame, const BodyTracker& tracker, const PosePacket& packet );
+	bool	Extrapolate		( const Track& t, int frame, Point3 pos ) const;
+};
+
+
+const char* FillStatusName( FillStatus status );		// short name of a fill status, for printing
+
+#endif
@@ -0,0 +1,178 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: jitterbuffer.h
+%%%
+%%% Description:
+%%%
+%%% Evens out the spacing of frames before they are sent. Frames reach the
+%%% callback at irregular times; a jitter buffer holds each one back until
+%%% its playout time, which is its capture time plus a playout delay, and
+%%% releases it from its own thread at that moment. Frames then leave at the
+%%% capture rate even when they arrived in bursts.
+%%%
+%%% The capture time of a frame comes from its frame number and the capture
+%%% rate, placed on the local clock by the earliest arrivals seen. How late
+%%% each frame arrived after its capture time is kept in a histogram over the
+%%% last JITTER_WINDOW frames, and the playout delay is the lateness at the
+%%% requested percentile: the shortest delay at which that share of frames
+%%% is in time. The delay grows at once when arrivals get later, and shrinks
+%%% slowly so the cadence is not squeezed when they get earlier again.
+%%%
+%%% A frame arriving after its playout time is released at once; one arriving
+%%% after a later frame was already released is dropped.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __JITTERBUFFER_H__
+#define __JITTERBUFFER_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "outputscheduler.h"
+#include "utils.h"
+
+#define JITTER_CAPACITY		64			// frames waiting for their playout time
+#define JITTER_WINDOW		600			// latest frames in the lateness histogram
+#define JITTER_BIN			0.00025		// seconds per histogram bin
+#define JITTER_BINS			400			// bins, the last one holds everything later
+#define JITTER_PERCENTILE	0.99		// share of frames that should be in time
+#define JITTER_SHRINK		0.0001		// seconds the delay may shrink per frame
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: JitterBuffer
+%%%
+%%% Usage Notes:
+%%%
+%%% Frames are released to an OutputSink, the same as the samples of an
+%%% OutputScheduler, on the buffer's thread. SetLayout() sizes the buffer,
+%%% after which Add() doesn't allocate memory. Without a capture rate frames
+%%% are released as they arrive.
+%%%
+%%%		JitterBuffer buffer;
+%%%
+%%%		buffer.SetLayout( 1, tracker.Bodies() );
+%%%		buffer.SetCaptureRate( 120.0 );
+%%%		buffer.SetSink( &sink );
+%%%		buffer.Start();
+%%%
+%%%		buffer.Add( &packet );		// from the capture thread, for every frame
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class JitterBuffer
+{
+public:
+
+	//
+	// Constructor
+	//
+	JitterBuffer();
+
+	//
+	// Destructor
+	//
+	~JitterBuffer();
+
+	//
+	// Set methods
+	//
+	void	SetSink			( OutputSink* sink );
+	void	SetLayout		( int streams, int bodies );		// packets per frame and poses per packet
+	void	SetCaptureRate	( double rate );					// frames per second
+	void	SetPercentile	( double percentile );				// share of frames that should arrive in time, 0 to 1
+	void	SetMaxDelay		( double seconds );					// upper limit of the playout delay
+
+	bool	Start			();									// start the release thread
+	void	Stop			();									// stop it, the sink is not called after this returns
+
+	void	Add				( const PosePacket* packets );		// one packet per stream for a new frame
+
+	//
+	// Get methods
+	//
+	bool			IsRunning		()	const;
+	double			Delay			()	const;		// current playout delay, seconds
+	double			ArrivalMean		()	const;		// mean time between arrivals, seconds
+	double			ArrivalSpread	()	const;		// standard deviation of the time between arrivals
+	unsigned long	Released		()	const;		// frames sent
+	unsigned long	Late			()	const;		// frames sent after their playout time
+	unsigned long	Dropped			()	const;		// frames too late to send, or pushed out of a full buffer
+
+private:
+
+	struct Entry
+	{
+		int						frame;
+		double					time;			// capture time on the buffer's clock
+		std::vector<PosePacket>	packets;
+	};
+
+	OutputSink*			mSink;
+	int					mStreams;
+	double				mCaptureRate;
+	double				mPercentile;
+	double				mMaxDelay;
+
+	Entry				mQueue[JITTER_CAPACITY];	// ring, sorted by frame, oldest at mFirst
+	int					mFirst;
+	int					mCount;
+	int					mLastReleased;		// frame number, to drop frames that come after it
+	bool				mReleasedAny;
+	double				mOffset;			// buffer clock minus frame time
+	bool				mHaveOffset;
+	double				mDelay;
+
+	int					mHistogram[JITTER_BINS];
+	int					mWindow[JITTER_WINDOW];		// bin of each of the latest frames
+	int					mWindowNext;
+	int					mWindowCount;
+
+	double				mLastArrival;
+	double				mArrivalMean;
+	double				mArrivalVar;
+	unsigned long		mArrivals;
+
+	CRITICAL_SECTION	mLock;				// protects everything above
+	std::vector<PosePacket>	mOut;			// release thread only
+	StopWatch			mClock;
+	HANDLE				mThread;
+	HANDLE				mStop;				// manual-reset event
+	HANDLE				mArrived;			// auto-reset event, set by Add()
+
+	unsigned long		mReleased;
+	unsigned long		mLate;
+	unsigned long		mDropped;
+
+	static unsigned __stdcall ThreadProc( void* arg );
+	void	Run				();
+	void	AddLateness		( double lateness );
+	double	PercentileDelay	() const;
+
+	// not copyable
+	JitterBuffer( const JitterBuffer& );
+	JitterBuffer& operator = ( const JitterBuffer& );
+};
+
+#endif
@@ -0,0 +1,278 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: mathutil.h
+%%%
+%%% Description:
+%%%
+%%% Small inline helpers for 3-D vectors, rotation matrices and quaternions.
+%%% Quaternions are stored w,x,y,z and rotation matrices row major. Nothing
+%%% here allocates memory.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __MATHUTIL_H__
+#define __MATHUTIL_H__
+
+#include <math.h>
+
+
+//
+// Quaternion helpers
+//
+
+// Rotation matrix of a unit quaternion
+inline void QuatToMatrix( const double q[4], double m[3][3] )
+{
+	double w = q[0], x = q[1], y = q[2], z = q[3];
+
+	m[0][0] = 1 - 2*(y*y + z*z);	m[0][1] = 2*(x*y - w*z);		m[0][2] = 2*(x*z + w*y);
+	m[1][0] = 2*(x*y + w*z);		m[1][1] = 1 - 2*(x*x + z*z);	m[1][2] = 2*(y*z - w*x);
+	m[2][0] = 2*(x*z - w*y);		m[2][1] = 2*(y*z + w*x);		m[2][2] = 1 - 2*(x*x + y*y);
+}
+
+// Unit quaternion of a rotation matrix (Shepperd's method, stable for any angle)
+inline void QuatFromMatrix( const double m[3][3], double q[4] )
+{
+	double trace = m[0][0] + m[1][1] + m[2][2];
+
+	if (trace >= m[0][0] && trace >= m[1][1] && trace >= m[2][2])
+	{
+		double s = 2.0 * sqrt( 1.0 + trace );
+
+		q[0] = 0.25 * s;
+		q[1] = (m[2][1] - m[1][2]) / s;
+		q[2] = (m[0][2] - m[2][0]) / s;
+		q[3] = (m[1][0] - m[0][1]) / s;
+	}
+	else if (m[0][0] >= m[1][1] && m[0][0] >= m[2][2])
+	{
+		double s = 2.0 * sqrt( 1.0 + m[0][0] - m[1][1] - m[2][2] );
+
+		q[0] = (m[2][1] - m[1][2]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (m[0][1] + m[1][0]) / s;
+		q[3] = (m[0][2] + m[2][0]) / s;
+	}
+	else if (m[1][1] >= m[2][2])
+	{
+		double s = 2.0 * sqrt( 1.0 - m[0][0] + m[1][1] - m[2][2] );
+
+		q[0] = (m[0][2] - m[2][0]) / s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = 0.25 * s;
+		q[3] = (m[1][2] + m[2][1]) / s;
+	}
+	else
+	{
+		double s = 2.0 * sqrt( 1.0 - m[0][0] - m[1][1] + m[2][2] );
+
+		q[0] = (m[1][0] - m[0][1]) / s;
+		q[1] = (m[0][2] + m[2][0]) / s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		q[3] = 0.25 * s;
+	}
+}
+
+// Scale a quaternion to unit length, the identity if it has no length
+inline void QuatNormalize( double q[4] )
+{
+	double len = sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+
+	if (len > 0.0)
+	{
+		q[0] /= len;	q[1] /= len;	q[2] /= len;	q[3] /= len;
+	}
+	else
+	{
+		q[0] = 1.0;		q[1] = q[2] = q[3] = 0.0;
+	}
+}
+
+// Product a*b, the rotation b followed by a
+inline void QuatMultiply( const double a[4], const double b[4], double out[4] )
+{
+	double w = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+	double x = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+	double y = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+	double z = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+
+	out[0] = w;		out[1] = x;		out[2] = y;		out[3] = z;
+}
+
+// Inverse rotation of a unit quaternion
+inline void QuatConjugate( const double q[4], double out[4] )
+{
+	out[0] = q[0];	out[1] = -q[1];	out[2] = -q[2];	out[3] = -q[3];
+}
+
+// Rotation vector (axis times angle in radians) of a unit quaternion, the short way round
+inline void QuatToRotationVector( const double q[4], double r[3] )
+{
+	double s = sqrt( q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+	double w = q[0] < 0.0 ? -q[0] : q[0];
+	double sign = q[0] < 0.0 ? -1.0 : 1.0;
+	double scale = (s > 1e-12) ? sign * 2.0 * atan2( s, w ) / s : sign * 2.0;
+
+	r[0] = q[1] * scale;	r[1] = q[2] * scale;	r[2] = q[3] * scale;
+}
+
+// Unit quaternion of a rotation vector
+inline void QuatFromRotationVector( const double r[3], double q[4] )
+{
+	double angle = sqrt( r[0]*r[0] + r[1]*r[1] + r[2]*r[2] );
+	double scale = (angle > 1e-12) ? sin( angle / 2.0 ) / angle : 0.5;
+
+	q[0] = cos( angle / 2.0 );
+	q[1] = r[0] * scale;	q[2] = r[1] * scale;	q[3] = r[2] * scale;
+}
+
+// Spherical interpolation between unit quaternions, t = 0 gives a, t = 1 gives b
+inline void QuatSlerp( const double a[4], const double b[4], double t, double out[4] )
+{
+	double d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+	double sb = 1.0;
+
+	// the short way round
+	if (d < 0.0)
+	{
+		d = -d;
+		sb = -1.0;
+	}
+
+	double wa = 1.0 - t;
+	double wb = t;
+
+	// nearly the same rotation, a straight line is close enough and well behaved
+	if (d < 0.9995)
+	{
+		double theta = acos( d );
+		double s = sin( theta );
+
+		wa = sin( (1.0 - t) * theta ) / s;
+		wb = sin( t * theta ) / s;
+	}
+
+	for (int k = 0; k < 4; k++)
+	{
+		out[k] = wa * a[k] + sb * wb * b[k];
+	}
+
+	QuatNormalize( out );
+}
+
+// Rotate a vector by a unit quaternion
+inline void QuatRotate( const double q[4], const double v[3], double out[3] )
+{
+	double m[3][3];
+
+	QuatToMatrix( q, m );
+
+	double x = m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2];
+	double y = m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2];
+	double z = m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2];
+
+	out[0] = x;		out[1] = y;		out[2] = z;
+}
+
+
+//
+// Symmetric eigen decomposition
+//
+
+// Eigenvector of the largest eigenvalue of a symmetric 4x4 matrix, by cyclic
+// Jacobi rotations. a is destroyed; its diagonal holds the eigenvalues on return.
+// Returns the gap between the largest and second largest eigenvalue.
+inline double LargestEigenvector4( double a[4][4], double v[4] )
+{
+	double e[4][4] = { {1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1} };
+
+	for (int sweep = 0; sweep < 20; sweep++)
+	{
+		double off = 0.0;
+		double norm = 0.0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				if (i != j)		off += a[i][j]*a[i][j];
+				norm += a[i][j]*a[i][j];
+			}
+		}
+
+		if (off <= 1e-24 * norm)	break;
+
+		for (int p = 0; p < 3; p++)
+		{
+			for (int q = p + 1; q < 4; q++)
+			{
+				if (a[p][q] == 0.0)		continue;
+
+				// rotation angle that zeroes a[p][q]
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs( theta ) + sqrt( theta*theta + 1.0 ));
+				double c = 1.0 / sqrt( t*t + 1.0 );
+				double s = t * c;
+
+				for (int k = 0; k < 4; k++)
+				{
+					double akp = a[k][p];
+					double akq = a[k][q];
+
+					a[k][p] = c*akp - s*akq;
+					a[k][q] = s*akp + c*akq;
+				}
+				for (int k = 0; k < 4; k++)
+				{
+					double apk = a[p][k];
+					double aqk = a[q][k];
+
+					a[p][k] = c*apk - s*aqk;
+					a[q][k] = s*apk + c*aqk;
+				}
+				for (int k = 0; k < 4; k++)
+				{
+					double ekp = e[k][p];
+					double ekq = e[k][q];
+
+					e[k][p] = c*ekp - s*ekq;
+					e[k][q] = s*ekp + c*ekq;
+				}
+			}
+		}
+	}
+
+	int best = 0;
+	for (int i = 1; i < 4; i++)
+	{
+		if (a[i][i] > a[best][best])	best = i;
+	}
+
+	double second = -1e300;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i != best && a[i][i] > second)	second = a[i][i];
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		v[i] = e[i][best];
+	}
+
+	return a[best][best] - second;
+}
+
+#endif
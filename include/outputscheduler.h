@@ -0,0 +1,172 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: outputscheduler.h
+%%%
+%%% Description:
+%%%
+%%% Sends poses at the consumer's rate instead of the capture rate. The capture
+%%% side adds each frame's packets to a short history; a timer thread wakes at
+%%% every consumer tick, samples the history a small delay in the past, and
+%%% hands the sample to an OutputSink.
+%%%
+%%% A sample falls between two frames, so positions are interpolated linearly
+%%% and rotations with slerp. Frames are placed in time by their frame number
+%%% and the capture rate, not by when they arrived; the offset between the two
+%%% clocks follows the earliest arrivals, so frames that arrive late or in a
+%%% burst do not bend the timeline. The delay only has to cover one capture
+%%% interval plus the usual arrival jitter.
+%%%
+%%% The tick thread waits for each tick with a PreciseTimer, so the ticks are
+%%% not tied to the 15.6 ms scheduler quantum.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __OUTPUTSCHEDULER_H__
+#define __OUTPUTSCHEDULER_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "utils.h"
+
+#define OUTPUT_HISTORY		32			// frames kept for interpolation
+#define OUTPUT_JITTER		0.004		// seconds of arrival jitter covered by the automatic delay
+#define OUTPUT_DRIFT		0.001		// how fast the frame clock follows later arrivals
+#define OUTPUT_STALE		0.25		// seconds without frames after which nothing is sent
+
+
+//
+// Receives the samples of an OutputScheduler, on the scheduler's thread
+//
+class OutputSink
+{
+public:
+
+	virtual ~OutputSink() {}
+
+	virtual void Send( const std::vector<PosePacket>& packets ) = 0;		// one packet per stream, interpolated to the tick
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: OutputScheduler
+%%%
+%%% Usage Notes:
+%%%
+%%% A frame can carry more than one packet, for example the poses and their
+%%% predictions; each stream is interpolated on its own. SetLayout() sizes
+%%% the history, after which Add() doesn't allocate memory. Set everything
+%%% up before Start(); Add() may then be called from any one thread.
+%%%
+%%%		OutputScheduler scheduler;
+%%%
+%%%		scheduler.SetLayout( 1, tracker.Bodies() );
+%%%		scheduler.SetTickRate( 90.0 );
+%%%		scheduler.SetCaptureRate( 120.0 );
+%%%		scheduler.SetSink( &sink );
+%%%		scheduler.Start();
+%%%
+%%%		scheduler.Add( &packet );		// from the capture thread, for every frame
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class OutputScheduler
+{
+public:
+
+	//
+	// Constructor
+	//
+	OutputScheduler();
+
+	//
+	// Destructor
+	//
+	~OutputScheduler();
+
+	//
+	// Set methods
+	//
+	void	SetSink			( OutputSink* sink );
+	void	SetLayout		( int streams, int bodies );		// packets per frame and poses per packet
+	void	SetTickRate		( double rate );					// consumer ticks per second
+	void	SetCaptureRate	( double rate );					// frames per second, zero to time frames by arrival
+	void	SetDelay		( double seconds );					// how far behind the tick to sample, zero for automatic
+
+	bool	Start			();									// start the tick thread
+	void	Stop			();									// stop it, the sink is not called after this returns
+
+	void	Add				( const PosePacket* packets );		// one packet per stream for a new frame
+
+	//
+	// Get methods
+	//
+	bool			IsRunning		()	const;
+	double			Delay			()	const;		// sampling delay in use, seconds
+	unsigned long	Ticks			()	const;		// samples sent
+	unsigned long	Skipped			()	const;		// ticks missed because the thread ran late
+	unsigned long	Held			()	const;		// samples newer than the newest frame, which was sent as is
+	double			TickError		()	const;		// average lateness of the ticks, seconds
+
+private:
+
+	struct Entry
+	{
+		double					time;			// capture time on the scheduler clock
+		std::vector<PosePacket>	packets;
+	};
+
+	OutputSink*			mSink;
+	int					mStreams;
+	int					mBodies;
+	double				mTickRate;
+	double				mCaptureRate;
+	double				mDelay;				// zero for automatic
+
+	Entry				mHistory[OUTPUT_HISTORY];
+	int					mNewest;			// index of the newest entry
+	int					mCount;
+	double				mOffset;			// scheduler clock minus frame time
+	bool				mHaveOffset;
+	CRITICAL_SECTION	mLock;				// protects the history
+
+	std::vector<PosePacket>	mSample;		// tick thread only
+	StopWatch			mClock;				// the scheduler clock
+	HANDLE				mThread;
+	HANDLE				mStop;				// manual-reset event
+
+	unsigned long		mTicks;
+	unsigned long		mSkipped;
+	unsigned long		mHeld;
+	double				mLateSum;
+
+	static unsigned __stdcall ThreadProc( void* arg );
+	void	Run				();
+	bool	Sample			( double time );
+
+	// not copyable
+	OutputScheduler( const OutputScheduler& );
+	OutputScheduler& operator = ( const OutputScheduler& );
+};
+
+#endif
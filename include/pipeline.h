@@ -0,0 +1,325 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: pipeline.h
+%%%
+%%% Description:
+%%%
+%%% Runs each TRC frame through a graph of processing stages. The graph is
+%%% read from a text file, so stages can be reordered or moved to their own
+%%% threads without recompiling:
+%%%
+%%%		# stage		thread		runs after
+%%%		ingest		inline
+%%%		record		recorder	ingest
+%%%		validate	inline		ingest		optional
+%%%		solve		inline		validate
+%%%		publish		inline		solve
+%%%
+%%% Each line names a stage type, the thread it runs on, and the stages that
+%%% must have finished with a frame before it may start. "inline" is the
+%%% thread that calls Push(), the EVaRT callback; any other name is a worker
+%%% thread, and stages with the same thread name share it. A stage may only
+%%% run after stages listed above it, which keeps the graph free of cycles.
+%%% The first stage is the only one without predecessors, and must be inline
+%%% because it is the only one that may read the data from EVaRT.
+%%%
+%%% Stages on different threads pass frames to each other through FIFOs.
+%%% Stages that don't depend on each other may work on the same frame at
+%%% the same time, so only one of them may change a given part of it.
+%%% Every stage is timed with the performance counter.
+%%%
+%%% Stages are critical or optional; the program gives each type a default,
+%%% and the word "optional" or "critical" among a line's predecessors
+%%% overrides it. Once the frame rate is known, optional stages are shed
+%%% when the pipeline falls behind:
+%%%
+%%%		deadline	an optional stage is skipped on a frame that has been
+%%%					in the pipeline so long that the stage's usual cost
+%%%					would take it past its deadline, a number of frame
+%%%					periods after it arrived
+%%%		level		each frame that misses its deadline, or finishes with
+%%%					too many frames still in flight, raises the level;
+%%%					at level n optional stages only run on one frame in
+%%%					2^n. The level drops one step after PIPELINE_RECOVER
+%%%					frames in a row are in time
+%%%
+%%% A shed stage counts as done, so the stages after it still run. Critical
+%%% stages always run. Level changes and the first of a run of deadline
+%%% skips are logged with the frame number and time.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <string>
+#include <vector>
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "fifo.h"
+#include "gapfill.h"
+#include "utils.h"
+#include "validator.h"
+#include "wrappers.h"
+
+#define PIPELINE_MAX_STAGES		16		// stages in one graph
+#define PIPELINE_FRAMES			32		// frames in flight, more are dropped
+#define PIPELINE_DEADLINE		1.0		// frame periods a frame may spend in the pipeline
+#define PIPELINE_BACKLOG		4		// frames in flight that count as falling behind
+#define PIPELINE_MAX_LEVEL		4		// at the highest level optional stages run on one frame in 16
+#define PIPELINE_RECOVER		120		// frames in time before the level goes down
+#define PIPELINE_SHED_LOG		256		// latest shedding events kept
+#define PIPELINE_COST_SMOOTHING	0.05	// weight of the newest frame in a stage's cost estimate
+
+
+//
+// Everything the stages know about one frame
+//
+struct PipelineFrame
+{
+	const sTrcFrame*	source;			// the frame from EVaRT, only valid in the first stage
+	TrcFrameWrapper		raw;			// markers as received, not changed after the first stage
+	TrcFrameWrapper		trc;			// markers as the stages leave them
+	PosePacket			packets[2];		// poses of the bodies, and their prediction
+	bool				predicted;		// packets[1] holds a prediction
+	SampleStatus		validated[MAX_MARKERS];	// what the validator did with each marker, valid when it did not run
+	FillStatus			filled[MAX_MARKERS];	// where each marker came from, measured when the filler did not run
+	StopWatch			arrival;		// started when the frame was pushed
+};
+
+
+// Why a stage was shed, or the level changed
+enum ShedReason
+{
+	kShedDeadline = 0,		// the stage would have taken the frame past its deadline
+	kShedLate,				// level raised, a frame missed its deadline
+	kShedBacklog,			// level raised, too many frames in flight
+	kShedRecovered			// level lowered, frames have been in time
+};
+
+
+//
+// An entry in the shedding log
+//
+struct ShedEvent
+{
+	double		time;		// seconds since Start()
+	int			frame;		// iFrame of the frame it happened on
+	int			stage;		// stage skipped, -1 for a change of level
+	int			level;		// level after the event
+	ShedReason	reason;
+};
+
+
+//
+// One processing step, called for every frame from the thread it is configured on
+//
+class Stage
+{
+public:
+
+	virtual ~Stage() {}
+
+	virtual void Process( PipelineFrame& frame ) = 0;
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: Pipeline
+%%%
+%%% Usage Notes:
+%%%
+%%% The program registers the stages it has under their type names, then
+%%% loads a graph that uses them. Each type may appear once in a graph. The
+%%% pipeline never takes ownership of the stages.
+%%%
+%%% Push() runs the inline stages before it returns and queues the frame for
+%%% the worker threads. A fixed set of PIPELINE_FRAMES frames is reused, so
+%%% nothing is allocated per frame; when all of them are still in flight the
+%%% new frame is dropped. Drain() waits until every frame is done, so the
+%%% stages' state can be changed safely, for example when the marker list
+%%% changes.
+%%%
+%%% A stage sees the frames in order, unless it waits for stages on more
+%%% than one thread. SetFrameRate() must be called, for example on
+%%% CONTEXT_FRAME_RATE, before any stage is shed.
+%%%
+%%%		Pipeline pipeline;
+%%%
+%%%		pipeline.AddType( "ingest", &ingest );
+%%%		pipeline.AddType( "filter", &filter, true );	// optional
+%%%		pipeline.AddType( "publish", &publish );
+%%%		pipeline.Load( "pipeline.txt" );
+%%%		pipeline.Start();
+%%%
+%%%		pipeline.Push( (sTrcFrame*) Data );		// in the EVaRT callback
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class Pipeline
+{
+public:
+
+	//
+	// Constructor
+	//
+	Pipeline();
+
+	//
+	// Destructor
+	//
+	~Pipeline();
+
+	//
+	// Set methods
+	//
+	void	AddType			( const char* type, Stage* stage, bool optional = false );	// a stage the graph may use
+	bool	Load			( const char* filename );				// read the graph from a file
+	bool	Parse			( const char* text );					// read the graph from text in the same format
+	void	SetFrameRate	( double rate );						// capture rate, 0 to never shed stages
+	void	SetDeadline		( double periods );						// frame periods a frame may spend in the pipeline
+	bool	Start			();										// start the worker threads
+	void	Stop			();										// finish the frames in flight and stop the threads
+
+	bool	Push			( const sTrcFrame* data );				// run a frame through the graph, false if it was dropped
+	void	Drain			();										// wait until every frame in flight is done
+
+	//
+	// Get methods
+	//
+	const std::string&	Error			()			const;		// why the last Load() or Parse() failed
+	int					Stages			()			const;		// stages in the graph, in the order of the file
+	const std::string&	StageType		( int i )	const;
+	const std::string&	StageThread		( int i )	const;
+	unsigned long		StageCalls		( int i )	const;		// frames processed by stage i
+	double				StageCostAverage( int i )	const;		// microseconds per frame
+	double				StageCostMax	( int i )	const;
+	bool				StageOptional	( int i )	const;
+	unsigned long		StageShed		( int i )	const;		// frames stage i was skipped on
+	int					Level			()			const;		// current shedding level, 0 when every stage runs
+	unsigned long		Late			()			const;		// frames that missed their deadline
+	void				Events			( std::vector<ShedEvent>& events )	const;	// the shedding log, oldest first
+	int					Threads			()			const;		// worker threads
+	unsigned long		Dropped			()			const;		// frames dropped because every frame was in flight
+
+private:
+
+	// a stage the program has
+	struct Type
+	{
+		std::string			name;
+		Stage*				stage;
+		bool				optional;
+	};
+
+	// a stage in the graph
+	struct Node
+	{
+		std::string			type;
+		Stage*				stage;
+		bool				optional;
+		int					lane;			// 0 is inline
+		int					waitFor;		// number of predecessors
+		std::vector<int>	next;			// successors, in the order of the file
+		unsigned long		calls;
+		double				total;			// microseconds
+		double				max;
+		double				estimate;		// smoothed cost, seconds
+		unsigned long		shed;
+		bool				skipping;		// shed by the deadline on the last frame it was up for
+	};
+
+	// a frame and how far it got
+	struct Slot
+	{
+		PipelineFrame		frame;
+		unsigned long		sequence;						// order of the frame, for decimation
+		int					iFrame;							// frame number from EVaRT, for the shedding log
+		volatile LONG		waiting[PIPELINE_MAX_STAGES];	// predecessors not finished with the frame
+		volatile LONG		remaining;						// stages not finished with the frame
+	};
+
+	// a stage to run on a frame
+	struct Task
+	{
+		Slot*	slot;
+		int		node;
+	};
+
+	// a thread and the stages it runs
+	struct Lane
+	{
+		std::string		name;
+		Pipeline*		owner;
+		int				index;
+		HANDLE			thread;
+		HANDLE			available;		// semaphore counting queued tasks
+		FIFO<Task>*		queue;
+	};
+
+	std::vector<Type>	mTypes;
+	std::vector<Node>	mNodes;
+	std::vector<Lane>	mLanes;
+	std::string			mError;
+
+	Slot				mSlots[PIPELINE_FRAMES];
+	int					mFree[PIPELINE_FRAMES];		// indices of the slots not in flight
+	int					mFreeCount;
+	CRITICAL_SECTION	mFreeLock;
+	HANDLE				mIdle;			// manual-reset event, set when no frame is in flight
+	HANDLE				mStop;			// manual-reset event, stops the worker threads
+	unsigned long		mDropped;
+	unsigned long		mSequence;		// of the next frame
+
+	double				mPeriod;		// seconds per frame, 0 when unknown
+	double				mDeadline;		// frame periods
+	volatile LONG		mLevel;
+	unsigned long		mLevelFrom;		// first frame admitted at the current level
+	int					mInTime;		// frames in time since the level last changed or a frame was late
+	unsigned long		mLate;
+	StopWatch			mClock;			// started by Start(), for the log
+	ShedEvent			mLog[PIPELINE_SHED_LOG];
+	int					mLogNext;
+	int					mLogCount;
+	mutable CRITICAL_SECTION	mLogLock;
+
+	static unsigned __stdcall ThreadProc( void* arg );
+	void	RunLane			( Lane& lane );
+	void	Run				( Slot* slot, int node );
+	bool	Admit			( Slot* slot, Node& node, int index );
+	void	Release			( Slot* slot );
+	void	Log				( int frame, int stage, ShedReason reason );
+	void	Clear			();
+
+	// not copyable
+	Pipeline( const Pipeline& );
+	Pipeline& operator = ( const Pipeline& );
+};
+
+
+const char* ShedReasonName( ShedReason reason );		// short name of a shedding reason, for printing
+
+#endif
@@ -0,0 +1,89 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: precisetimer.h
+%%%
+%%% Description:
+%%%
+%%% Waits until a point in time on a StopWatch clock to well under a
+%%% millisecond. Most of the wait is spent asleep on a waitable timer with
+%%% the system timer at 1 ms resolution; the last fraction of a millisecond
+%%% is spent polling the performance counter, so the wake up is not tied to
+%%% the 15.6 ms scheduler quantum.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __PRECISETIMER_H__
+#define __PRECISETIMER_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+
+//
+// Project headers
+//
+#include "utils.h"
+
+#define TIMER_SPIN			0.0005		// seconds before the deadline spent polling instead of sleeping
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: PreciseTimer
+%%%
+%%% Usage Notes:
+%%%
+%%% The system timer resolution is raised for as long as the object exists,
+%%% so create it on the thread that waits, not for the life of the program.
+%%%
+%%%		PreciseTimer timer;
+%%%		HANDLE events[1] = { stopEvent };
+%%%
+%%%		if (timer.WaitUntil( clock, deadline, 1, events ) == 0)
+%%%		{
+%%%			// stopEvent was signaled
+%%%		}
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class PreciseTimer
+{
+public:
+
+	//
+	// Constructor
+	//
+	PreciseTimer();
+
+	//
+	// Destructor
+	//
+	~PreciseTimer();
+
+	// Wait until the clock reaches time or one of the events is signaled.
+	// Returns the index of the event, or -1 when the time was reached.
+	int		WaitUntil		( const StopWatch& clock, double time, int count, const HANDLE* events );
+
+private:
+
+	HANDLE		mTimer;
+
+	// not copyable
+	PreciseTimer( const PreciseTimer& );
+	PreciseTimer& operator = ( const PreciseTimer& );
+};
+
+#endif
@@ -0,0 +1,143 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: predictor.h
+%%%
+%%% Description:
+%%%
+%%% Predicts rigid body poses a short time ahead, to hide the delay between
+%%% the optical capture and the frame the simulator draws with the pose.
+%%%
+%%% Each body's linear and angular velocity are taken from its last two
+%%% poses, and the pose is carried forward at those velocities for the
+%%% prediction horizon. The horizon is either fixed, or measured: the lag of
+%%% the stages before the predictor, reported each frame, plus a fixed
+%%% allowance for the delays outside this program.
+%%%
+%%% Every prediction is kept until the frame it was made for arrives; the
+%%% pose is then interpolated to the exact predicted time and compared, so
+%%% the prediction error of each body is known.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __PREDICTOR_H__
+#define __PREDICTOR_H__
+
+//
+// Standard headers
+//
+#include <vector>
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+
+#define PREDICT_PENDING			64			// predictions per body waiting for their frame
+#define PREDICT_MAX_HORIZON		0.1			// longest horizon, seconds
+#define PREDICT_MAX_STEP		0.1			// longest gap between poses used for a velocity, seconds
+#define PREDICT_SMOOTHING		0.05		// weight of the newest lag in the measured horizon
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: PosePredictor
+%%%
+%%% Usage Notes:
+%%%
+%%% Predict() takes the packet of the current frame and writes the predicted
+%%% poses to a second packet, in the same order. A body gets no prediction
+%%% (kPoseNone) until it has two poses close enough in time to give a velocity.
+%%% Frame numbers and the frame rate are the time base, so the horizon is not
+%%% affected by when the frames happen to arrive.
+%%%
+%%%		PosePredictor predictor;
+%%%
+%%%		predictor.SetBodies( tracker.Bodies() );
+%%%		predictor.SetRate( frameRate );
+%%%		predictor.SetAutoHorizon( 0.015 );		// 15 ms outside this program
+%%%
+%%%		predictor.ReportLatency( filterLag + processingTime );
+%%%		predictor.Predict( packet, predicted );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class PosePredictor
+{
+public:
+
+	//
+	// Constructor
+	//
+	PosePredictor();
+
+	//
+	// Set methods
+	//
+	void	SetBodies			( int count );				// number of bodies in the packets
+	void	SetRate				( float rate );				// frames per second
+	void	SetHorizon			( double seconds );			// fixed horizon, zero turns prediction off
+	void	SetAutoHorizon		( double extra );			// horizon is the reported latency plus extra seconds
+	void	ReportLatency		( double seconds );			// lag of the stages before the predictor in this frame
+	void	Reset				();							// forget the history and errors of every body
+
+	//
+	// Get methods
+	//
+	double	Horizon				()				const;		// current horizon, seconds
+	bool	IsAuto				()				const;		// the horizon is measured
+	double	PositionError		( int body )	const;		// rms position error of the body's predictions
+	double	AngleError			( int body )	const;		// rms rotation error, degrees
+	int		Checked				( int body )	const;		// predictions compared with the frames that arrived
+
+	void	Predict				( const PosePacket& packet, PosePacket& predicted );	// poses one horizon ahead
+
+private:
+
+	// a prediction waiting for its frame
+	struct Pending
+	{
+		double		frame;					// fractional frame the prediction is for
+		double		position[3];
+		double		rotation[4];
+	};
+
+	struct BodyState
+	{
+		int			frame;					// frame of the last pose, -1 if none
+		double		position[3];			// last pose
+		double		rotation[4];
+		double		velocity[3];			// per second
+		double		angular[3];				// rotation vector per second
+		bool		moving;					// velocities are known
+		Pending		pending[PREDICT_PENDING];	// ring of predictions, oldest at first
+		int			first;
+		int			count;
+		double		positionSum;			// sums of squared errors
+		double		angleSum;
+		int			checked;
+	};
+
+	std::vector<BodyState>	mBodies;
+	double					mRate;
+	double					mHorizon;
+	bool					mAuto;
+	double					mExtra;			// seconds added to the measured latency
+	double					mLatency;		// smoothed reported latency
+	bool					mHaveLatency;
+
+	void	Check				( BodyState& s, int frame, const double position[3], const double rotation[4] );
+};
+
+#endif
@@ -29,7 +29,13 @@
 #pragma warning (disable: 4786)
 
 #include "fifo.h"
+#include "ringbuffer.h"
+#include "arena.h"
+#include "continuity.h"
 #include <iostream>
+#include <math.h>
+
+#define PRE_TRIGGER_RATE		240.0		// frames per second the history is sized for until SetFrameRate() is called
 
 /*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %%%
@@ -41,8 +47,38 @@
 %%%
 %%% Usage Notes:
 %%%
+%%% With a pre-trigger set, frames added while the recorder is stopped are kept
+%%% in a fixed-size circular buffer holding the last few seconds of data. When
+%%% recording starts, that history is frozen in place and becomes the head of
+%%% the recording; new frames go to the FIFO, and GetNext() hands out the
+%%% history first. The buffer is sized from the frame rate, so SetFrameRate()
+%%% should be called with the CONTEXT_FRAME_RATE value reported by EVaRT;
+%%% until it is, the history is sized for PRE_TRIGGER_RATE, which errs on
+%%% the side of keeping more than was asked for. Start() freezes the history and
+%%% starts recording under one lock, which Add() takes while the recorder is
+%%% stopped, so a frame added during Start() ends up in one or the other.
+%%%
+%%% By default frames are kept in a FIFO whose size is capped by SetMaxSize().
+%%% SetStorage( kArenaStorage ) switches to an unbounded ChunkArena instead,
+%%% which packs frames back to back into large chunks of memory. This suits
+%%% sessions lasting hours; the whole session is freed in one step once it
+%%% has been output, or when the next recording starts.
+%%%
+%%% Every frame added while recording is checked for continuity. Continuity()
+%%% reports gaps in the frame numbers that arrived, and counts frames lost
+%%% because the FIFO was full, whether the new frame was refused or older
+%%% ones were removed to make room. Frames from the pre-trigger history are
+%%% not checked.
+%%%
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
 
+// Where a recorder keeps its frames
+enum RecorderStorage
+{
+	kFifoStorage = 0,	// FIFO limited to a maximum number of frames
+	kArenaStorage		// unbounded, frames are packed into large chunks of memory
+};
+
 template<class F>
 class RecorderBase
 {
@@ -65,13 +101,42 @@ public:
 	void Start			();								// start recording
 	void Stop			();								// stop recording
 
-	virtual void Output( std::ostream& os, bool header = false ) = 0;	// output recorded data to the output stream
+	void SetFrameRate	( double frameRate	);			// capture rate in frames per second
+	void SetPreTrigger	( double seconds	);			// seconds of history to keep before Start(), zero disables
+	void SetStorage		( RecorderStorage storage );	// choose FIFO or arena storage, ignored while recording
+
+	bool	GetNext		( F& next );					// next recorded frame, pre-trigger history first, the frame is removed
+	unsigned long	GetBatch	( std::vector<F>& frames, unsigned long maxFrames );	// up to maxFrames next frames, the count is returned
+	double	FrameRate	();								// capture rate set by SetFrameRate()
+
+	const FrameContinuity&	Continuity	() const;		// frame numbers added since Start(), and frames lost
+
+	virtual void		Output			( std::ostream& os, bool header = false );	// output recorded data to the output stream
+	virtual void		OutputHeader	( std::ostream& os ) = 0;					// output the names describing the frames
+	virtual void		OutputFrame		( std::ostream& os, const F& frame ) = 0;	// output a single frame
+	virtual const char*	TypeName		() const = 0;								// short name of the recorded data type
 
 protected:
 
-	FIFO<F>	mFifo;
-	bool	mEnabled;
-	bool	mRecording;
+	FIFO<F>			mFifo;
+	RingBuffer<F>	mPreTrigger;			// history kept while not recording
+	bool			mEnabled;
+	volatile LONG	mRecording;				// set and cleared under mStateLock
+	double			mFrameRate;
+	double			mPreTriggerSeconds;
+
+	RecorderStorage		mStorage;
+	ChunkArena			mArena;				// frames, when using arena storage
+	ArenaCursor			mArenaCursor;		// next frame to hand out from the arena
+	unsigned long		mArenaRead;			// frames handed out from the arena
+	CRITICAL_SECTION	mArenaLock;			// serializes arena access between threads
+	CRITICAL_SECTION	mStateLock;			// serializes starting and stopping with the pre-trigger history
+
+	FrameContinuity		mContinuity;		// gaps in the recorded frame numbers
+
+	void SizePreTrigger	();
+	void ReleaseArena	();
+	bool GetPreTrigger	( F& next );
 };
 
 
@@ -81,6 +146,13 @@ RecorderBase<F>::RecorderBase<F>( unsigned long maxSize ) : mFifo( maxSize )
 {
 	mEnabled = true;
 	mRecording = false;
+	mFrameRate = 0.0;
+	mPreTriggerSeconds = 0.0;
+
+	mStorage = kFifoStorage;
+	mArenaRead = 0;
+	InitializeCriticalSection( &mArenaLock );
+	InitializeCriticalSection( &mStateLock );
 }
 
 // RecorderBase destructor
@@ -88,6 +160,9 @@ template<class F>
 RecorderBase<F>::~RecorderBase<F>()
 {
 	mFifo.Clear();	
+	ReleaseArena();
+	DeleteCriticalSection( &mArenaLock );
+	DeleteCriticalSection( &mStateLock );
 }
 
 
@@ -95,7 +170,22 @@ RecorderBase<F>::~RecorderBase<F>()
 template<class F>
 unsigned long RecorderBase<F>::Size()
 {
-	return mFifo.Size();
+	unsigned long size = mFifo.Size();
+
+	if (mStorage == kArenaStorage)
+	{
+		EnterCriticalSection( &mArenaLock );
+		size = mArena.Records() - mArenaRead;
+		LeaveCriticalSection( &mArenaLock );
+	}
+
+	// history only belongs to the recording once it has been frozen by Start()
+	if (mPreTrigger.IsLocked())
+	{
+		size += mPreTrigger.Size();
+	}
+
+	return size;
 }
 
 // Set the max size
@@ -118,11 +208,25 @@ void RecorderBase<F>::Start()
 {
 	if (mEnabled)
 	{
+		EnterCriticalSection( &mStateLock );
+
 		// Clear any old data
 		mFifo.Clear();
 		mFifo.SetLocked(false);
+		ReleaseArena();
+		mContinuity.Reset();
+
+		// Keep the pre-trigger history as the start of this recording. If the
+		// history is still frozen from a take that was never output, it is stale.
+		if (mPreTrigger.IsLocked())
+		{
+			mPreTrigger.Clear();
+		}
+		mPreTrigger.SetLocked(true);
 
-		mRecording = true;
+		InterlockedExchange( &mRecording, 1 );
+
+		LeaveCriticalSection( &mStateLock );
 	}
 }
 
@@ -132,10 +236,14 @@ void RecorderBase<F>::Stop()
 {
 	if (mEnabled)
 	{
+		EnterCriticalSection( &mStateLock );
+
 		// prevent additions
 		mFifo.SetLocked(true);
 
-		mRecording = false;
+		InterlockedExchange( &mRecording, 0 );
+
+		LeaveCriticalSection( &mStateLock );
 	}
 }
 
@@ -143,10 +251,276 @@ void RecorderBase<F>::Stop()
 template<class F>
 void RecorderBase<F>::Add( const F& element )
 {
-	if (mEnabled && mRecording)
+	if (!mEnabled)	return;
+
+	// While stopped the flag is checked again under the lock, so a frame that
+	// arrives during Start() is either kept in the history or recorded
+	if (!mRecording)
+	{
+		bool kept = false;
+
+		EnterCriticalSection( &mStateLock );
+		if (!mRecording)
+		{
+			// does nothing unless a pre-trigger is set and the history is not frozen
+			mPreTrigger.Add( element );
+			kept = true;
+		}
+		LeaveCriticalSection( &mStateLock );
+
+		if (kept)	return;
+	}
+
+	unsigned long removed = 0;
+	bool added;
+
+	if (mStorage == kArenaStorage)
+	{
+		EnterCriticalSection( &mArenaLock );
+
+		void* p = mArena.Append( element.PackedSize() );
+		if (p)
+		{
+			element.Pack( p );
+		}
+		added = (p != NULL);
+
+		LeaveCriticalSection( &mArenaLock );
+	}
+	else
+	{
+		added = mFifo.Add( element, &removed );
+	}
+
+	// every frame is checked, so one that wasn't kept counts as dropped rather than
+	// also leaving a gap, and so do older frames the FIFO threw out to make room
+	mContinuity.Add( element.Frame() );
+	if (!added)
+	{
+		mContinuity.AddDropped();
+	}
+	if (removed > 0)
+	{
+		mContinuity.AddDropped( (long) removed );
+	}
+}
+
+// Set the capture rate, used to size the pre-trigger buffer
+template<class F>
+void RecorderBase<F>::SetFrameRate( double frameRate )
+{
+	if (frameRate != mFrameRate)
+	{
+		mFrameRate = frameRate;
+		SizePreTrigger();
+	}
+}
+
+// Set the number of seconds of history to keep before recording starts
+template<class F>
+void RecorderBase<F>::SetPreTrigger( double seconds )
+{
+	mPreTriggerSeconds = seconds > 0.0 ? seconds : 0.0;
+	SizePreTrigger();
+}
+
+// Get the capture rate in frames per second, zero if unknown
+template<class F>
+double RecorderBase<F>::FrameRate()
+{
+	return mFrameRate;
+}
+
+// Get the continuity of the frames recorded since Start()
+template<class F>
+const FrameContinuity& RecorderBase<F>::Continuity() const
+{
+	return mContinuity;
+}
+
+// Write the header, if requested, followed by every recorded frame
+template<class F>
+void RecorderBase<F>::Output( std::ostream& os, bool header )
+{
+	F f;
+
+	if (header)
+	{
+		OutputHeader( os );
+	}
+
+	while (GetNext(f))
+	{
+		OutputFrame( os, f );
+	}
+}
+
+// Choose where frames are kept, only takes effect while not recording
+template<class F>
+void RecorderBase<F>::SetStorage( RecorderStorage storage )
+{
+	if (!mRecording)
+	{
+		mStorage = storage;
+	}
+}
+
+// Get the next recorded frame, returns true if a frame exists, false otherwise
+// Frames from the pre-trigger history come before frames added after Start()
+template<class F>
+bool RecorderBase<F>::GetNext( F& next )
+{
+	if (GetPreTrigger( next ))
+	{
+		return true;
+	}
+
+	if (mStorage == kArenaStorage)
+	{
+		const void* data;
+		unsigned long size;
+		bool rc;
+
+		EnterCriticalSection( &mArenaLock );
+
+		unsigned long chunk = mArenaCursor.chunk;
+
+		rc = mArena.Next( mArenaCursor, data, size );
+		if (rc)
+		{
+			next.Unpack( data );
+			mArenaRead++;
+		}
+
+		if (mArenaCursor.chunk != chunk)
+		{
+			mArena.Trim( mArenaCursor );
+		}
+
+		LeaveCriticalSection( &mArenaLock );
+
+		// the whole session has been handed out, give the memory back
+		if (!rc && !mRecording)
+		{
+			ReleaseArena();
+		}
+
+		return rc;
+	}
+
+	return mFifo.GetNext( next );
+}
+
+// Get up to maxFrames of the next recorded frames, replacing the contents of frames
+// The storage is locked once for the whole batch rather than once per frame
+template<class F>
+unsigned long RecorderBase<F>::GetBatch( std::vector<F>& frames, unsigned long maxFrames )
+{
+	F f;
+
+	frames.clear();
+
+	// the pre-trigger history is a few seconds at most, take it a frame at a time
+	while (frames.size() < maxFrames && GetPreTrigger( f ))
+	{
+		frames.push_back( f );
+	}
+
+	if (mStorage == kArenaStorage)
+	{
+		const void* data;
+		unsigned long size;
+		bool rc = true;
+
+		EnterCriticalSection( &mArenaLock );
+
+		unsigned long chunk = mArenaCursor.chunk;
+
+		while (frames.size() < maxFrames && (rc = mArena.Next( mArenaCursor, data, size )))
+		{
+			frames.push_back( f );
+			frames.back().Unpack( data );
+			mArenaRead++;
+		}
+
+		if (mArenaCursor.chunk != chunk)
+		{
+			mArena.Trim( mArenaCursor );
+		}
+
+		LeaveCriticalSection( &mArenaLock );
+
+		// the whole session has been handed out, give the memory back
+		if (!rc && !mRecording)
+		{
+			ReleaseArena();
+		}
+	}
+	else
+	{
+		mFifo.GetBatch( frames, maxFrames - (unsigned long) frames.size() );
+	}
+
+	return (unsigned long) frames.size();
+}
+
+// Get the next frame of the frozen pre-trigger history, returns false once it is empty
+template<class F>
+bool RecorderBase<F>::GetPreTrigger( F& next )
+{
+	if (mPreTrigger.IsLocked())
+	{
+		if (mPreTrigger.GetNext( next ))
+		{
+			return true;
+		}
+
+		// history has been output, start collecting it again for the next take
+		EnterCriticalSection( &mStateLock );
+		if (!mRecording)
+		{
+			mPreTrigger.SetLocked(false);
+			SizePreTrigger();
+		}
+		LeaveCriticalSection( &mStateLock );
+	}
+
+	return false;
+}
+
+// Free all arena memory and rewind the read position
+template<class F>
+void RecorderBase<F>::ReleaseArena()
+{
+	EnterCriticalSection( &mArenaLock );
+
+	mArena.Release();
+	mArenaCursor = ArenaCursor();
+	mArenaRead = 0;
+
+	LeaveCriticalSection( &mArenaLock );
+}
+
+// (Re)allocate the pre-trigger buffer for the current frame rate and duration
+template<class F>
+void RecorderBase<F>::SizePreTrigger()
+{
+	unsigned long capacity = 0;
+
+	if (mPreTriggerSeconds > 0.0)
+	{
+		capacity = (unsigned long) ceil( (mFrameRate > 0.0 ? mFrameRate : PRE_TRIGGER_RATE) * mPreTriggerSeconds );
+	}
+
+	// resizing discards the history, so leave a frozen buffer alone until it is output.
+	// Add() may be filling the history on another thread, so it is resized under its lock.
+	EnterCriticalSection( &mStateLock );
+	if (!mRecording && capacity != mPreTrigger.Capacity())
 	{
-		mFifo.Add( element );
+		mPreTrigger.SetCapacity( capacity );
+		mPreTrigger.SetLocked(false);
 	}
+	LeaveCriticalSection( &mStateLock );
 }
 
 #endif
\ No newline at end of file
@@ -27,6 +27,10 @@
 
 #include "recorderbase.h"
 #include "wrappers.h"
+#include "archive.h"
+#include "c3d.h"
+
+class AnalogRecorder;
 
 
 //
@@ -48,7 +52,13 @@ public:
 
 	void SetMarkerList( const MarkerListWrapper& list );
 
-	virtual void Output( std::ostream& os, bool header = false );
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const TrcFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
+
+	void OutputArchive( TrcArchiveWriter& archive );		// output recorded data to a compressed archive
+	void OutputC3d( C3dWriter& c3d );						// output recorded data to a C3D file
+	void OutputC3d( C3dWriter& c3d, AnalogRecorder& analog );	// the same with the analog frames of the same iFrame
 
 protected:
 
@@ -75,11 +85,48 @@ public:
 
 	void SetHierarchy( const HierarchyWrapper& hierarchy );
 
-	virtual void Output( std::ostream& os, bool header = false );
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const SegmentFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
+
+protected:
+
+	HierarchyWrapper	mHierarchy;
+};
+
+
+//
+// Class to record HTR data from EVaRT, the root position and a rotation and
+// length for each segment, under an "HTR,CHILD,PARENT" header. With
+// SetFullLayout(true) the frames are written in the same columns as
+// SegmentRecorder, each segment's translation approximated from the hierarchy
+// and its parent's length; the columns are named ~X,~Y,~Z to say so.
+//
+class HtrRecorder : public RecorderBase<HtrFrameWrapper>
+{
+public:
+
+	//
+	// Constructor
+	//
+	HtrRecorder( unsigned long maxSize = 1024 );
+
+	//
+	// Destructor
+	//
+	virtual ~HtrRecorder();
+
+	void SetHierarchy	( const HierarchyWrapper& hierarchy );
+	void SetFullLayout	( bool full );						// write ~X,~Y,~Z,aX,aY,aZ,Length for every segment
+
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const HtrFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
 
 protected:
 
 	HierarchyWrapper	mHierarchy;
+	bool				mFullLayout;
 };
 
 
@@ -102,11 +149,65 @@ public:
 
 	void SetDofNames( const DofNamesWrapper& names );
 
-	virtual void Output( std::ostream& os, bool header = false );
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const DofFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
 
 protected:
 
 	DofNamesWrapper		mDofNames;
 };
 
+
+//
+// Class to record analog data from EVaRT, one line per sample
+//
+class AnalogRecorder : public RecorderBase<AnalogFrameWrapper>
+{
+public:
+
+	//
+	// Constructor
+	//
+	AnalogRecorder( unsigned long maxSize = 1024 );
+
+	//
+	// Destructor
+	//
+	virtual ~AnalogRecorder();
+
+	void SetAnalogNames( const AnalogNamesWrapper& names );
+
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const AnalogFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
+
+protected:
+
+	AnalogNamesWrapper	mAnalogNames;
+};
+
+
+//
+// Class to record force plate data from EVaRT, one line per plate and sample
+//
+class ForceRecorder : public RecorderBase<ForceFrameWrapper>
+{
+public:
+
+	//
+	// Constructor
+	//
+	ForceRecorder( unsigned long maxSize = 1024 );
+
+	//
+	// Destructor
+	//
+	virtual ~ForceRecorder();
+
+	virtual void		OutputHeader	( std::ostream& os );
+	virtual void		OutputFrame		( std::ostream& os, const ForceFrameWrapper& frame );
+	virtual const char*	TypeName		() const;
+};
+
 #endif
\ No newline at end of file
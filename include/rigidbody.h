@@ -0,0 +1,154 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: rigidbody.h
+%%%
+%%% Description:
+%%%
+%%% Solves the 6-DOF pose of rigid bodies from TRC frames. A body is a named
+%%% set of markers with a reference geometry, the marker positions in the
+%%% body's own coordinate system. Each frame, the rotation and translation
+%%% that best map the reference onto the measured markers (least squares) is
+%%% found in closed form with Horn's quaternion method.
+%%%
+%%% Bodies are defined in a text file:
+%%%
+%%%		# comment
+%%%		BODY head
+%%%		LFHD	-80.0	0.0		0.0
+%%%		RFHD	 80.0	0.0		0.0
+%%%		LBHD	-70.0	-150.0	0.0
+%%%
+%%% Each marker line gives the marker name and its reference position. When
+%%% the positions are left out, the reference is taken from the first frame
+%%% in which every marker of the body is visible; the body's axes are then
+%%% those of the capture volume and its origin is the centroid of its markers.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __RIGIDBODY_H__
+#define __RIGIDBODY_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <string>
+#include <vector>
+
+//
+// Project headers
+//
+#include "wrappers.h"
+
+#define MAX_BODY_MARKERS	16		// markers in one rigid body
+
+
+// How a pose was obtained
+enum PoseStatus
+{
+	kPoseNone = 0,		// never solved, the pose is meaningless
+	kPoseHeld,			// no markers visible, the last pose is repeated
+	kPosePartial,		// fewer than three usable markers, last rotation with a new position
+	kPoseSolved			// full least squares fit
+};
+
+
+//
+// Pose of a rigid body in one frame
+//
+struct BodyPose
+{
+	int			frame;			// iFrame the pose was solved for
+	float		position[3];	// body origin in the capture volume
+	float		rotation[4];	// unit quaternion w,x,y,z, body to capture volume
+	float		error;			// rms distance between fitted and measured markers
+	int			markers;		// markers used for the fit
+	PoseStatus	status;
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: RigidBody
+%%%
+%%% Usage Notes:
+%%%
+%%% Resolve() must be called with the marker list from EVaRT before Solve(),
+%%% and again whenever the marker list changes. Solve() uses fixed-size arrays
+%%% only and doesn't allocate memory.
+%%%
+%%% When markers are occluded the body degrades step by step: three or more
+%%% visible markers give a full fit (unless they are nearly in a line), one
+%%% or two keep the previous rotation and only refit the position, and none
+%%% repeat the previous pose.
+%%%
+%%%		std::vector<RigidBody> bodies;
+%%%		BodyPose pose;
+%%%
+%%%		LoadRigidBodies( "bodies.txt", bodies );
+%%%		bodies[0].Resolve( markerList );
+%%%		bodies[0].Solve( frame, pose );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class RigidBody
+{
+public:
+
+	//
+	// Constructor
+	//
+	RigidBody( const std::string& name = std::string() );
+
+	//
+	// Set methods
+	//
+	bool	AddMarker		( const std::string& name );							// marker with a reference taken from the data
+	bool	AddMarker		( const std::string& name, const Point3 reference );	// marker with a known reference position
+	bool	Resolve			( const MarkerListWrapper& markers );					// find the markers in the EVaRT marker list
+	bool	Calibrate		( const TrcFrameWrapper& frame );						// take the reference from a frame
+	void	Reset			();														// forget the last pose
+
+	//
+	// Get methods
+	//
+	const std::string&	Name			()			const;		// name of the body
+	int					Markers			()			const;		// number of markers in the body
+	const std::string&	MarkerName		( int i )	const;		// name of marker i of the body
+	int					MarkerIndex		( int i )	const;		// index of marker i in the TRC frame, -1 if not resolved
+	void				GetReference	( int i, double ref[3] )	const;		// position of marker i in body coordinates
+	bool				IsResolved		()			const;		// every marker was found in the marker list
+	bool				IsCalibrated	()			const;		// the reference geometry is known
+
+	bool	Solve			( const TrcFrameWrapper& frame, BodyPose& pose );		// pose of the body in a frame
+
+private:
+
+	std::string					mName;
+	std::vector<std::string>	mMarkerNames;
+	int							mCount;
+	int							mIndex[MAX_BODY_MARKERS];			// index in the TRC frame, -1 if not found
+	double						mReference[MAX_BODY_MARKERS][3];	// position in body coordinates
+	bool						mHasReference;
+	bool						mResolved;
+	BodyPose					mLast;
+};
+
+
+bool LoadRigidBodies( const char* filename, std::vector<RigidBody>& bodies );		// read body definitions from a file
+
+#endif
@@ -0,0 +1,251 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: ringbuffer.h
+%%%
+%%% Description:
+%%%
+%%% This class provides a templated, thread-safe circular buffer with a fixed
+%%% capacity. All slots are allocated when the capacity is set; once the buffer
+%%% is full, each addition overwrites the oldest element. Objects stored in the
+%%% buffer must have a default constructor and the assignment operator defined.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+
+template<class T>
+class RingBuffer
+{
+
+public:
+
+	//
+	// Constructors
+	//
+	RingBuffer<T>		( unsigned long capacity = 0 );
+
+	//
+	// Destructor
+	//
+	~RingBuffer<T>		();
+
+	//
+	// Methods
+	//
+	void	Add			( const T& element );		// add a new element, overwriting the oldest one if full
+	bool	GetNext		( T& next );				// get the oldest element, the item is removed
+	void	Clear		();							// clear the buffer, the slots stay allocated
+
+	unsigned long	Size		();		// number of elements in the buffer
+	unsigned long	Capacity	();		// number of allocated slots
+	bool			IsLocked	();		// are additions currently not allowed
+
+	void	SetCapacity	( unsigned long capacity );		// reallocate the slots, the contents are discarded
+	void	SetLocked	( bool locked );				// allow/disallow new additions
+
+private:
+
+	std::vector<T>	mSlots;		// preallocated storage
+	unsigned long	mHead;		// index of the oldest element
+	unsigned long	mCount;		// number of elements stored
+	bool			mLocked;	// if true, addition of new elements is not allowed
+	HANDLE			mSemaphore;	// handle to semaphore to control access
+
+	bool SemWait();
+	bool SemRelease();
+};
+
+
+
+// Constructor
+template<class T>
+RingBuffer<T>::RingBuffer<T>( unsigned long capacity ) : mSlots( capacity )
+{
+	mHead = 0;
+	mCount = 0;
+	mLocked = false;
+
+	// Create semaphore to control access to our slots
+	mSemaphore = CreateSemaphore( NULL, 1, 1, NULL );
+}
+
+// Destructor
+template<class T>
+RingBuffer<T>::~RingBuffer<T>()
+{
+	CloseHandle( mSemaphore );
+}
+
+// Add a new element, once the buffer is full the oldest element is overwritten
+template<class T>
+void RingBuffer<T>::Add( const T& element )
+{
+	if (!mLocked && SemWait())
+	{
+		unsigned long capacity = (unsigned long) mSlots.size();
+
+		if (capacity > 0)
+		{
+			mSlots[ (mHead + mCount) % capacity ] = element;
+
+			if (mCount < capacity)
+			{
+				mCount++;
+			}
+			else
+			{
+				mHead = (mHead + 1) % capacity;
+			}
+		}
+		SemRelease();
+	}
+}
+
+// Get the oldest element, returns true if an element exists, false otherwise
+// The element is removed from the buffer
+template<class T>
+bool RingBuffer<T>::GetNext( T& next )
+{
+	bool rc = false;
+
+	if (SemWait())
+	{
+		if (mCount > 0)
+		{
+			next = mSlots[mHead];
+			mHead = (mHead + 1) % mSlots.size();
+			mCount--;
+			rc = true;
+		}
+		SemRelease();
+	}
+
+	return rc;
+}
+
+// Remove all elements, the slots keep their memory
+template<class T>
+void RingBuffer<T>::Clear()
+{
+	if (SemWait())
+	{
+		mHead = 0;
+		mCount = 0;
+		SemRelease();
+	}
+}
+
+// Get the number of elements currently in the buffer
+template<class T>
+unsigned long RingBuffer<T>::Size()
+{
+	unsigned long size = 0;
+
+	if (SemWait())
+	{
+		size = mCount;
+		SemRelease();
+	}
+
+	return size;
+}
+
+// Get the number of slots in the buffer
+template<class T>
+unsigned long RingBuffer<T>::Capacity()
+{
+	unsigned long capacity = 0;
+
+	if (SemWait())
+	{
+		capacity = (unsigned long) mSlots.size();
+		SemRelease();
+	}
+
+	return capacity;
+}
+
+// Get the current locked state of the buffer
+template<class T>
+bool RingBuffer<T>::IsLocked()
+{
+	bool locked = true;
+
+	if (SemWait())
+	{
+		locked = mLocked;
+		SemRelease();
+	}
+
+	return locked;
+}
+
+// Reallocate the slots, any stored elements are discarded
+template<class T>
+void RingBuffer<T>::SetCapacity( unsigned long capacity )
+{
+	if (SemWait())
+	{
+		std::vector<T> slots( capacity );
+		mSlots.swap( slots );
+		mHead = 0;
+		mCount = 0;
+		SemRelease();
+	}
+}
+
+// If locked is true, the buffer will not accept any additions
+template<class T>
+void RingBuffer<T>::SetLocked( bool locked )
+{
+	if (SemWait())
+	{
+		mLocked = locked;
+		SemRelease();
+	}
+}
+
+
+//
+//  Method:  SemWait
+//  Purpose: Wait for the state of the semaphore to be signaled
+//  Returns: true if successful, false otherwise
+//
+template<class T>
+bool RingBuffer<T>::SemWait()
+{
+	return (WaitForSingleObject( mSemaphore, INFINITE ) == WAIT_OBJECT_0);
+}
+
+//
+//  Method:  SemRelease
+//  Purpose: Release the semaphore so it's state is signaled
+//  Returns: true if successful, false otherwise
+//
+template<class T>
+bool RingBuffer<T>::SemRelease()
+{
+	return (ReleaseSemaphore( mSemaphore, 1, NULL ) != 0);
+}
+
+#endif
@@ -0,0 +1,525 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: rollingwriter.h
+%%%
+%%% Description:
+%%%
+%%% This class drains a recorder into a series of segment files instead of one
+%%% large output file. A new segment is started whenever the current one
+%%% reaches a frame count, duration or size limit.
+%%%
+%%% Segment files are named <base>_0001.txt, <base>_0002.txt, ... Each one starts
+%%% with a "#SEGMENT,<type>,<number>" line followed by the recorder's header,
+%%% so it can be read on its own. While a segment is being written it is
+%%% called <name>.part; it is renamed to its final name only after it has
+%%% been closed and flushed to the disk. If the process dies, only the
+%%% current .part file is lost. A segment that can not be renamed keeps its
+%%% .part name in the index, and the next segment gets a new number. A new
+%%% segment is also started when EVaRT restarts its frame numbers.
+%%%
+%%% A frame that could not be written, because the disk was full for
+%%% example, has already left the recorder. The writer keeps it, and the
+%%% frames after it, and writes them first on the next Write() or Finish().
+%%%
+%%% After every finished segment the index file <base>.idx is rewritten (also
+%%% through a .part file and a rename) with one line per segment:
+%%%
+%%%		file name,first frame,last frame,frame count,bytes
+%%%
+%%% where the frame numbers are the iFrame values reported by EVaRT. The
+%%% recorder's frame continuity, its counters and the ranges of frames that
+%%% never made it into the recording, is written to <base>.gaps at the same
+%%% time.
+%%%
+%%% At the end of a session Write() would format the rest of a recording on
+%%% one thread. NewFlushJob() returns a job for SessionFlush instead, so
+%%% several recordings are formatted side by side; the job still writes
+%%% the frames in order and starts new segments at the same limits.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __ROLLINGWRITER_H__
+#define __ROLLINGWRITER_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+#include <windows.h>
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "recorderbase.h"
+#include "sessionflush.h"
+
+template<class F> class RollingFlushJob;
+
+template<class F>
+class RollingWriter
+{
+public:
+
+	//
+	// Constructor
+	//
+	RollingWriter<F>( RecorderBase<F>& recorder, const std::string& baseName );
+
+	//
+	// Destructor
+	//
+	~RollingWriter<F>();		// finishes the current segment
+
+	void	SetMaxFrames	( unsigned long frames );	// frames per segment, zero for no limit
+	void	SetMaxSeconds	( double seconds );			// seconds per segment, zero for no limit
+	void	SetMaxBytes		( double bytes );			// approximate bytes per segment, zero for no limit
+
+	bool	Write			();			// write every frame currently in the recorder, call periodically
+	bool	Finish			();			// close and finalize the current segment
+
+	FlushJob*	NewFlushJob	();			// job writing the rest of the recorder through SessionFlush, deleted by it
+
+	int		Segments		() const;	// number of finalized segments
+
+private:
+
+	struct RollingSegment
+	{
+		std::string		name;			// file name without directory
+		int				firstFrame;
+		int				lastFrame;
+		unsigned long	frames;
+		double			bytes;
+	};
+
+	RecorderBase<F>&			mRecorder;
+	std::string					mBaseName;
+	std::ofstream				mOut;
+	RollingSegment				mCurrent;
+	std::vector<RollingSegment>	mSegments;
+	std::vector<F>				mPending;		// frames taken from the recorder that could not be written yet
+
+	unsigned long	mMaxFrames;
+	double			mMaxSeconds;
+	double			mMaxBytes;
+
+	friend class RollingFlushJob<F>;
+
+	bool	Place			( const F& next );	// open the segment the next frame goes in, false if that failed
+	bool	Placed			( const F& f );		// count a frame written to the segment, false if the stream failed
+	bool	Put				( const F& f );		// write one frame into its segment
+	bool	WritePending	();					// write the frames left over from a failed write, false if some are still left
+	bool	OpenSegment		();
+	bool	CloseSegment	();
+	bool	WriteIndex		();
+	bool	WriteGaps		();
+	bool	LimitReached	( const F& next );
+
+	std::string		SegmentPath	( const std::string& name ) const;
+
+	static bool		FlushToDisk	( const std::string& path );	// write the data of a closed file through to the disk
+
+	// not copyable
+	RollingWriter<F>( const RollingWriter<F>& );
+	RollingWriter<F>& operator = ( const RollingWriter<F>& );
+};
+
+
+// Constructor
+template<class F>
+RollingWriter<F>::RollingWriter<F>( RecorderBase<F>& recorder, const std::string& baseName ) : mRecorder( recorder ), mBaseName( baseName )
+{
+	mMaxFrames = 0;
+	mMaxSeconds = 0.0;
+	mMaxBytes = 0.0;
+}
+
+// Destructor
+template<class F>
+RollingWriter<F>::~RollingWriter<F>()
+{
+	Finish();
+}
+
+// Set the maximum number of frames in a segment
+template<class F>
+void RollingWriter<F>::SetMaxFrames( unsigned long frames )
+{
+	mMaxFrames = frames;
+}
+
+// Set the maximum duration of a segment, needs the recorder's frame rate
+template<class F>
+void RollingWriter<F>::SetMaxSeconds( double seconds )
+{
+	mMaxSeconds = seconds;
+}
+
+// Set the approximate maximum size of a segment
+template<class F>
+void RollingWriter<F>::SetMaxBytes( double bytes )
+{
+	mMaxBytes = bytes;
+}
+
+// Number of segments that have been finalized
+template<class F>
+int RollingWriter<F>::Segments() const
+{
+	return (int) mSegments.size();
+}
+
+// Drain the recorder into segment files, starting new segments as limits are reached
+template<class F>
+bool RollingWriter<F>::Write()
+{
+	bool rc = WritePending();
+	F f;
+
+	while (rc && mRecorder.GetNext(f))
+	{
+		if (!Put( f ))
+		{
+			// the frame has left the recorder, so it is kept for the next call
+			mPending.push_back( f );
+			rc = false;
+		}
+	}
+
+	return rc;
+}
+
+// Write one frame, starting a new segment first if needed
+template<class F>
+bool RollingWriter<F>::Put( const F& f )
+{
+	if (!Place( f ))	return false;
+
+	mRecorder.OutputFrame( mOut, f );
+	return Placed( f );
+}
+
+// Write the frames whose write failed earlier, in order
+template<class F>
+bool RollingWriter<F>::WritePending()
+{
+	unsigned int written = 0;
+
+	while (written < mPending.size() && Put( mPending[written] ))
+	{
+		written++;
+	}
+	mPending.erase( mPending.begin(), mPending.begin() + written );
+
+	return mPending.empty();
+}
+
+// Job for SessionFlush that writes the rest of the recorder into the segments
+template<class F>
+FlushJob* RollingWriter<F>::NewFlushJob()
+{
+	return new RollingFlushJob<F>( *this );
+}
+
+// Start a new segment if the next frame would take the current one past a limit
+template<class F>
+bool RollingWriter<F>::Place( const F& next )
+{
+	bool rc = true;
+
+	// a write that failed is tried again on the same segment
+	if (mOut.is_open() && mOut.fail())
+	{
+		mOut.clear();
+	}
+
+	if (mOut.is_open() && LimitReached(next))
+	{
+		rc = CloseSegment();
+	}
+
+	if (rc && !mOut.is_open())
+	{
+		rc = OpenSegment();
+		mCurrent.firstFrame = next.Frame();
+	}
+
+	return rc;
+}
+
+// Count a frame that has been written to the current segment
+template<class F>
+bool RollingWriter<F>::Placed( const F& f )
+{
+	if (!mOut.good())	return false;
+
+	mCurrent.lastFrame = f.Frame();
+	mCurrent.frames++;
+
+	return true;
+}
+
+// Finalize the segment being written, if any
+template<class F>
+bool RollingWriter<F>::Finish()
+{
+	bool rc = WritePending();
+
+	return (mOut.is_open() ? CloseSegment() : true) && rc;
+}
+
+
+// Start the next segment as a .part file and write its header
+template<class F>
+bool RollingWriter<F>::OpenSegment()
+{
+	char name[32];
+
+	sprintf( name, "_%04d.txt", (int) mSegments.size() + 1 );
+
+	// keep only the file name of the base, the index lives next to the segments
+	std::string::size_type slash = mBaseName.find_last_of( "\\/" );
+
+	mCurrent.name = (slash == std::string::npos ? mBaseName : mBaseName.substr( slash + 1 )) + name;
+	mCurrent.firstFrame = -1;
+	mCurrent.lastFrame = -1;
+	mCurrent.frames = 0;
+	mCurrent.bytes = 0.0;
+
+	mOut.clear();
+	mOut.open( (SegmentPath( mCurrent.name ) + ".part").c_str(), std::ios::out | std::ios::trunc );
+
+	if (!mOut.is_open())	return false;
+
+	mOut << "#SEGMENT," << mRecorder.TypeName() << "," << mSegments.size() + 1 << std::endl;
+	mRecorder.OutputHeader( mOut );
+
+	return mOut.good();
+}
+
+// Close the current segment, give it its final name and update the index
+template<class F>
+bool RollingWriter<F>::CloseSegment()
+{
+	mOut.flush();
+	mCurrent.bytes = (double) mOut.tellp();
+	mOut.close();
+
+	std::string path = SegmentPath( mCurrent.name );
+	bool rc = !mOut.fail() && FlushToDisk( path + ".part" ) &&
+		MoveFileEx( (path + ".part").c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+
+	// the next segment must not reuse the name of one that is still a .part file
+	if (!rc)
+	{
+		mCurrent.name += ".part";
+	}
+
+	mSegments.push_back( mCurrent );
+	return WriteIndex() && WriteGaps() && rc;
+}
+
+// Rewrite the index file, replacing the old one in a single rename
+template<class F>
+bool RollingWriter<F>::WriteIndex()
+{
+	std::string path = mBaseName + ".idx";
+	std::ofstream os( (path + ".part").c_str(), std::ios::out | std::ios::trunc );
+
+	os << "SEGMENT,FIRST,LAST,FRAMES,BYTES" << std::endl;
+	for (int i = 0; i < (int) mSegments.size(); i++)
+	{
+		os << mSegments[i].name << "," << mSegments[i].firstFrame << "," << mSegments[i].lastFrame << "," <<
+			mSegments[i].frames << "," << (unsigned long) mSegments[i].bytes << std::endl;
+	}
+	os.close();
+
+	return !os.fail() && FlushToDisk( path + ".part" ) &&
+		MoveFileEx( (path + ".part").c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+}
+
+// Rewrite the gaps file next to the index, replacing the old one in a single rename
+template<class F>
+bool RollingWriter<F>::WriteGaps()
+{
+	std::string path = mBaseName + ".gaps";
+	std::ofstream os( (path + ".part").c_str(), std::ios::out | std::ios::trunc );
+
+	mRecorder.Continuity().Output( os );
+	os.close();
+
+	return !os.fail() && FlushToDisk( path + ".part" ) &&
+		MoveFileEx( (path + ".part").c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+}
+
+// Write the data of a closed file through the cache, so a rename never exposes a file that is not on the disk yet
+template<class F>
+bool RollingWriter<F>::FlushToDisk( const std::string& path )
+{
+	HANDLE file = CreateFile( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+	if (file == INVALID_HANDLE_VALUE)	return false;
+
+	BOOL rc = FlushFileBuffers( file );
+	CloseHandle( file );
+
+	return rc != FALSE;
+}
+
+// Would adding the next frame take the current segment past one of its limits
+template<class F>
+bool RollingWriter<F>::LimitReached( const F& next )
+{
+	if (mMaxFrames > 0 && mCurrent.frames >= mMaxFrames)
+	{
+		return true;
+	}
+
+	// after EVaRT restarts its frame numbers the segment's duration can't be measured, and its range would be wrong
+	if (mCurrent.frames > 0 && next.Frame() < mCurrent.lastFrame - CONTINUITY_RESTART)
+	{
+		return true;
+	}
+
+	double rate = mRecorder.FrameRate();
+	if (mMaxSeconds > 0.0 && rate > 0.0 && (next.Frame() - mCurrent.firstFrame) / rate >= mMaxSeconds)
+	{
+		return true;
+	}
+
+	if (mMaxBytes > 0.0 && (double) mOut.tellp() >= mMaxBytes)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+// Full path of a segment file, in the same directory as the base name
+template<class F>
+std::string RollingWriter<F>::SegmentPath( const std::string& name ) const
+{
+	std::string::size_type slash = mBaseName.find_last_of( "\\/" );
+
+	return (slash == std::string::npos) ? name : mBaseName.substr( 0, slash + 1 ) + name;
+}
+
+
+//
+// FlushJob that formats the frames of a RollingWriter's recorder on the
+// SessionFlush's pool and writes them frame by frame into its segments
+//
+template<class F>
+class RollingFlushJob : public FlushJob
+{
+public:
+
+	RollingFlushJob<F>( RollingWriter<F>& writer ) : mWriter( writer ) {}
+
+	virtual const char* TypeName()
+	{
+		return mWriter.mRecorder.TypeName();
+	}
+
+	virtual unsigned long Begin()
+	{
+		return mWriter.mRecorder.Size();
+	}
+
+	virtual FlushChunk* Next( unsigned long maxFrames )
+	{
+		Chunk* chunk = new Chunk( mWriter.mRecorder );
+
+		chunk->mFrames = mWriter.mRecorder.GetBatch( chunk->mFrameData, maxFrames );
+		if (chunk->mFrames == 0)
+		{
+			delete chunk;
+			chunk = NULL;
+		}
+
+		return chunk;
+	}
+
+	virtual std::ostream& Stream()
+	{
+		return mWriter.mOut;
+	}
+
+	// a segment may end inside a chunk, so the text is written one frame at a time
+	virtual bool Write( FlushChunk& flushChunk )
+	{
+		Chunk& chunk = static_cast<Chunk&>( flushChunk );
+		std::string text = chunk.mText.str();
+		std::string::size_type start = 0;
+
+		// frames left over from a failed write go first, and once a write fails the rest queue up behind it
+		bool rc = mWriter.WritePending();
+
+		for (int i = 0; i < (int) chunk.mFrameData.size(); i++)
+		{
+			const F& f = chunk.mFrameData[i];
+
+			if (rc && mWriter.Place( f ))
+			{
+				mWriter.mOut.write( text.data() + start, chunk.mEnds[i] - start );
+				rc = mWriter.Placed( f );
+			}
+			else
+			{
+				rc = false;
+			}
+
+			if (!rc)
+			{
+				mWriter.mPending.push_back( f );
+			}
+			start = chunk.mEnds[i];
+		}
+
+		return rc;
+	}
+
+private:
+
+	class Chunk : public FlushChunk
+	{
+	public:
+
+		Chunk( RecorderBase<F>& recorder ) : mRecorder( recorder ) {}
+
+		std::vector<F>							mFrameData;
+		std::vector<std::string::size_type>		mEnds;			// end of each frame's text
+
+	protected:
+
+		virtual void Format()
+		{
+			for (int i = 0; i < (int) mFrameData.size(); i++)
+			{
+				mRecorder.OutputFrame( mText, mFrameData[i] );
+				mEnds.push_back( (std::string::size_type) mText.tellp() );
+			}
+		}
+
+	private:
+
+		RecorderBase<F>&	mRecorder;
+	};
+
+	RollingWriter<F>&	mWriter;
+};
+
+#endif
@@ -0,0 +1,241 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: sessionflush.h
+%%%
+%%% Description:
+%%%
+%%% Writes out several recorders at the end of a session at the same time,
+%%% instead of calling Output() on one recorder after the other.
+%%%
+%%% Each recorder is drained in chunks of frames, taking the recorder's lock
+%%% once per chunk. The chunks are turned into text on a WorkerPool, and
+%%% written to the recorder's stream in their original order as they are
+%%% finished. Only a few chunks per recorder are in flight at any time, so
+%%% memory use does not grow with the length of the session. The output is
+%%% the same as Output() would have written.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __SESSIONFLUSH_H__
+#define __SESSIONFLUSH_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <sstream>
+#include <vector>
+
+//
+// Project headers
+//
+#include "recorderbase.h"
+#include "threadpool.h"
+
+#define FLUSH_CHUNK_FRAMES		512		// frames formatted by one work item
+
+
+//
+// A chunk of frames being formatted, signals its event when the text is ready
+//
+class FlushChunk : public WorkItem
+{
+public:
+
+	FlushChunk() : mFrames(0)		{ mDone = CreateEvent( NULL, TRUE, FALSE, NULL ); }
+	virtual ~FlushChunk()			{ CloseHandle( mDone ); }
+
+	virtual void Run()				{ Format(); SetEvent( mDone ); }
+
+	std::stringstream	mText;		// formatted frames, read back through rdbuf()
+	unsigned long		mFrames;	// number of frames in the chunk
+	HANDLE				mDone;		// manual-reset event, set once mText is complete
+
+protected:
+
+	virtual void Format() = 0;		// fill mText, runs on a pool thread
+};
+
+
+//
+// One recorder and the stream it is written to
+//
+class FlushJob
+{
+public:
+
+	virtual ~FlushJob() {}
+
+	virtual const char*		TypeName	() = 0;							// type of the recorded data
+	virtual unsigned long	Begin		() = 0;							// write the header, returns the number of frames to write
+	virtual FlushChunk*		Next		( unsigned long maxFrames ) = 0;	// take the next frames out of the recorder, NULL when empty
+	virtual std::ostream&	Stream		() = 0;
+	virtual bool			Write		( FlushChunk& chunk );				// write a formatted chunk, in order, false if the stream failed
+};
+
+
+// Append the text of a chunk to the job's stream
+inline bool FlushJob::Write( FlushChunk& chunk )
+{
+	if (chunk.mFrames > 0)
+	{
+		Stream() << chunk.mText.rdbuf();
+	}
+
+	return Stream().good();
+}
+
+
+//
+// FlushJob for any recorder derived from RecorderBase
+//
+template<class F>
+class RecorderFlushJob : public FlushJob
+{
+public:
+
+	RecorderFlushJob<F>( RecorderBase<F>& recorder, std::ostream& os, bool header ) :
+		mRecorder( recorder ), mOut( os ), mHeader( header ) {}
+
+	virtual const char* TypeName()
+	{
+		return mRecorder.TypeName();
+	}
+
+	virtual unsigned long Begin()
+	{
+		if (mHeader)
+		{
+			mRecorder.OutputHeader( mOut );
+		}
+		return mRecorder.Size();
+	}
+
+	virtual FlushChunk* Next( unsigned long maxFrames )
+	{
+		Chunk* chunk = new Chunk( mRecorder );
+
+		chunk->mFrames = mRecorder.GetBatch( chunk->mFrameData, maxFrames );
+		if (chunk->mFrames == 0)
+		{
+			delete chunk;
+			chunk = NULL;
+		}
+
+		return chunk;
+	}
+
+	virtual std::ostream& Stream()
+	{
+		return mOut;
+	}
+
+private:
+
+	// OutputFrame() only reads the names set on the recorder, so chunks of
+	// the same recorder can be formatted on several threads at once
+	class Chunk : public FlushChunk
+	{
+	public:
+
+		Chunk( RecorderBase<F>& recorder ) : mRecorder( recorder ) {}
+
+		std::vector<F>		mFrameData;
+
+	protected:
+
+		virtual void Format()
+		{
+			for (int i = 0; i < (int) mFrameData.size(); i++)
+			{
+				mRecorder.OutputFrame( mText, mFrameData[i] );
+			}
+		}
+
+	private:
+
+		RecorderBase<F>&	mRecorder;
+	};
+
+	RecorderBase<F>&	mRecorder;
+	std::ostream&		mOut;
+	bool				mHeader;
+};
+
+
+//
+// Receives progress reports from SessionFlush::Flush()
+//
+class FlushProgress
+{
+public:
+
+	virtual ~FlushProgress() {}
+
+	virtual void Report( const char* typeName, unsigned long written, unsigned long total ) = 0;	// called after each chunk written
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: SessionFlush
+%%%
+%%% Usage Notes:
+%%%
+%%% Recorders should be stopped before Flush() is called, so the frame totals
+%%% passed to the progress reports are final.
+%%%
+%%%		SessionFlush flush;
+%%%
+%%%		flush.Add( new RecorderFlushJob<TrcFrameWrapper>( trcRecorder, trcFile, true ) );
+%%%		flush.Add( new RecorderFlushJob<DofFrameWrapper>( dofRecorder, dofFile, true ) );
+%%%		flush.Flush( &progress );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class SessionFlush
+{
+public:
+
+	//
+	// Constructor
+	//
+	SessionFlush( WorkerPool* pool = NULL, unsigned long chunkFrames = FLUSH_CHUNK_FRAMES );	// without a pool, one is created
+
+	//
+	// Destructor
+	//
+	~SessionFlush();
+
+	void	Add			( FlushJob* job );						// the job is deleted by the SessionFlush
+	bool	Flush		( FlushProgress* progress = NULL );		// write every job, returns false if a stream failed
+	void	Clear		();										// delete all jobs
+
+private:
+
+	WorkerPool*				mPool;
+	bool					mOwnPool;
+	unsigned long			mChunkFrames;
+	std::vector<FlushJob*>	mJobs;
+
+	// not copyable
+	SessionFlush( const SessionFlush& );
+	SessionFlush& operator = ( const SessionFlush& );
+};
+
+#endif
@@ -0,0 +1,186 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: sessionreader.h
+%%%
+%%% Description:
+%%%
+%%% Random access to recorded sessions by frame number. A session is either a
+%%% set of segment files listed in a <base>.idx index written by RollingWriter,
+%%% or a single file written by a recorder's Output() method with its header.
+%%% TRC, segment, HTR, DOF and analog recordings are supported; the type is
+%%% taken from the file header. An HTR recording in HtrRecorder's compact
+%%% layout has a Root channel first, X,Y,Z and a Length of 0, then one channel
+%%% per segment. An analog recording returns one row per sample, so a frame
+%%% number repeats for each sample of the frame. Force plate recordings are
+%%% not supported and fail to open.
+%%%
+%%% Every frame is checked against the header as it is read: one line per
+%%% channel, named in order, or one value per channel on the frame's line.
+%%% A frame that does not match fails the query; the rows before it are kept.
+%%%
+%%% The .idx file tells which segment holds a frame. Inside a segment, a sparse
+%%% index holds the file offset of every SESSION_INDEX_STRIDE'th frame, so a
+%%% query only parses the frames it returns plus at most one stride of frames
+%%% before them. Segment files are mapped into memory read-only and values are
+%%% parsed straight out of the mapping; only the requested channels are
+%%% converted, the other lines are skipped.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __SESSIONREADER_H__
+#define __SESSIONREADER_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+#include <string>
+
+#define SESSION_INDEX_STRIDE	64		// frames between entries of a segment's sparse index
+
+
+enum SessionType
+{
+	kUnknownSession = 0,
+	kTrcSession,			// marker positions, X,Y,Z per marker
+	kSegmentSession,		// segment poses, X,Y,Z,aX,aY,aZ,Length per segment
+	kHtrSession,			// root position, then aX,aY,aZ,Length per segment
+	kDofSession,			// one value per degree of freedom
+	kAnalogSession			// one row per sample, one value per channel
+};
+
+
+//
+// Result of a SessionReader query
+//
+struct SessionRange
+{
+	std::vector<int>	frames;			// frame number (iFrame) of each returned row
+	std::vector<double>	values;			// row major, then channel, then component
+	int					channels;		// channels per row, in the order they were requested
+	int					components;		// values per channel
+
+	SessionRange() : channels(0), components(0) {}
+
+	int				Rows	() const							{ return (int) frames.size(); }
+	const double*	Value	( int row, int channel ) const		{ return &values[ (row*channels + channel)*components ]; }
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: SessionReader
+%%%
+%%% Description:
+%%%
+%%% Read() may be called from any number of threads at once. Segment files are
+%%% mapped and indexed the first time a query touches them; that step is done
+%%% under a lock, everything else only reads shared state.
+%%%
+%%% Frame numbers are the iFrame values reported by EVaRT, which is what the
+%%% .idx file holds. The text files show them plus one.
+%%%
+%%% Usage Notes:
+%%%
+%%%		SessionReader reader;
+%%%		SessionRange range;
+%%%		std::vector<int> channels;
+%%%
+%%%		if (reader.Open( "session.idx" ))
+%%%		{
+%%%			channels.push_back( reader.Channel( "LFHD" ) );
+%%%			channels.push_back( reader.Channel( "RFHD" ) );
+%%%
+%%%			reader.Read( 12000, 15000, channels, range );
+%%%		}
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class SessionReader
+{
+public:
+
+	//
+	// Constructor
+	//
+	SessionReader();
+
+	//
+	// Destructor
+	//
+	~SessionReader();
+
+	bool	Open		( const char* filename );	// a .idx index or a single recorded file
+	void	Close		();
+	bool	IsOpen		() const;
+
+	//
+	// Get methods
+	//
+	SessionType			Type			()								const;	// type of data in the session
+	int					Components		()								const;	// values per channel
+	int					Channels		()								const;	// number of markers, segments, DOFs or analog channels
+	const std::string&	ChannelName		( int i )						const;	// name of channel i
+	int					Channel			( const std::string& name )		const;	// index of a named channel, -1 if not found
+	int					FirstFrame		()								const;	// first frame number in the session
+	int					LastFrame		()								const;	// last frame number in the session
+
+	bool	Read		( int firstFrame, int lastFrame, const std::vector<int>& channels, SessionRange& out ) const;	// frames in [first,last], all channels if none given
+
+private:
+
+	struct IndexEntry
+	{
+		int			frame;
+		__int64		offset;
+	};
+
+	struct SessionSegment
+	{
+		std::string				path;
+		int						firstFrame;
+		int						lastFrame;
+
+		HANDLE					file;
+		HANDLE					mapping;
+		const char*				data;
+		__int64					size;
+		std::vector<IndexEntry>	index;		// sparse frame -> offset index, built on first use
+	};
+
+	SessionType					mType;
+	int							mComponents;
+	std::vector<std::string>	mNames;
+	std::vector<SessionSegment*>	mSegments;		// in frame order
+
+	mutable CRITICAL_SECTION	mLock;			// guards mapping and indexing of segments
+
+	bool	ReadIndexFile	( const char* filename );
+	bool	ReadHeader		( const SessionSegment& seg );
+	bool	Prepare			( SessionSegment& seg ) const;
+	void	Unmap			( SessionSegment& seg ) const;
+	bool	ReadSegment		( const SessionSegment& seg, int firstFrame, int lastFrame,
+							  const std::vector<int>& channels, SessionRange& out ) const;
+
+	// not copyable
+	SessionReader( const SessionReader& );
+	SessionReader& operator = ( const SessionReader& );
+};
+
+#endif
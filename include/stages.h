@@ -0,0 +1,226 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: stages.h
+%%%
+%%% Description:
+%%%
+%%% Pipeline stages for the processing steps of the program. Each stage
+%%% wraps an object that already does the work, and decides which part of
+%%% the PipelineFrame it reads and writes:
+%%%
+%%%		ingest		copies the frame from EVaRT into raw and trc
+%%%		record		adds raw to a TRC recorder
+%%%		assemble	adds raw to a FrameAssembler as the TRC part of its frame,
+%%%					if the assembler was set up to collect one
+%%%		validate	rejects spikes and undoes swaps in trc
+%%%		solve		solves the bodies from trc into packets[0]
+%%%		fill		fills the empty markers of trc, using packets[0]
+%%%		filter		smooths trc and packets[0]
+%%%		predict		predicts packets[0] ahead into packets[1]
+%%%		transform	converts packets[0] and packets[1] to the simulator's coordinates
+%%%
+%%% The objects are owned by the program, and a stage must be the only user
+%%% of its object while the pipeline is running.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __STAGES_H__
+#define __STAGES_H__
+
+//
+// Project headers
+//
+#include "assembler.h"
+#include "bodytracker.h"
+#include "filter.h"
+#include "gapfill.h"
+#include "jitterbuffer.h"
+#include "outputscheduler.h"
+#include "pipeline.h"
+#include "predictor.h"
+#include "recorders.h"
+#include "transform.h"
+#include "validator.h"
+
+
+//
+// Copies the frame from EVaRT, must be the first stage
+//
+class IngestStage : public Stage
+{
+public:
+
+	IngestStage() : mMarkers(0) {}
+
+	void			SetMarkers	( int count )	{ mMarkers = count; }		// markers in the marker list
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	int		mMarkers;
+};
+
+
+//
+// Records the frames as they were received
+//
+class RecordStage : public Stage
+{
+public:
+
+	RecordStage( TrcRecorder* recorder ) : mRecorder(recorder) {}		// NULL to record nothing
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	TrcRecorder*	mRecorder;
+};
+
+
+//
+// Hands the frames as they were received to the assembler
+//
+class AssembleStage : public Stage
+{
+public:
+
+	AssembleStage( FrameAssembler& assembler );
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	FrameAssembler&		mAssembler;
+	sTrcFrame			mFrame;			// raw laid out as EVaRT sends it
+	int					mCount;			// markers set in mFrame by the last frame
+};
+
+
+//
+// Rejects spikes and undoes marker swaps
+//
+class ValidateStage : public Stage
+{
+public:
+
+	ValidateStage( MarkerValidator& validator, const BodyTracker& tracker ) :
+		mValidator(validator), mTracker(tracker) {}
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	MarkerValidator&		mValidator;
+	const BodyTracker&		mTracker;
+};
+
+
+//
+// Solves the poses of the rigid bodies
+//
+class SolveStage : public Stage
+{
+public:
+
+	SolveStage( BodyTracker& tracker ) : mTracker(tracker) {}
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	BodyTracker&	mTracker;
+};
+
+
+//
+// Fills occluded and rejected markers
+//
+class FillStage : public Stage
+{
+public:
+
+	FillStage( GapFiller& filler, const BodyTracker& tracker ) : mFiller(filler), mTracker(tracker) {}
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	GapFiller&				mFiller;
+	const BodyTracker&		mTracker;
+};
+
+
+//
+// Smooths the markers and the poses
+//
+class FilterStage : public Stage
+{
+public:
+
+	FilterStage( FrameFilter& filter, const BodyTracker& tracker ) : mFilter(filter), mTracker(tracker) {}
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	FrameFilter&			mFilter;
+	const BodyTracker&		mTracker;
+};
+
+
+//
+// Predicts the poses ahead by the latency of the filter, the stages before
+// it, and the scheduler or jitter buffer the poses are sent through
+//
+class PredictStage : public Stage
+{
+public:
+
+	PredictStage( PosePredictor& predictor, const FrameFilter& filter,
+				  const OutputScheduler& scheduler, const JitterBuffer& jitter ) :
+		mPredictor(predictor), mFilter(filter), mScheduler(scheduler), mJitter(jitter), mEnabled(false) {}
+
+	void			SetEnabled	( bool enable )		{ mEnabled = enable; }
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	PosePredictor&				mPredictor;
+	const FrameFilter&			mFilter;
+	const OutputScheduler&		mScheduler;
+	const JitterBuffer&			mJitter;
+	bool						mEnabled;
+};
+
+
+//
+// Converts the poses to the simulator's coordinates
+//
+class TransformStage : public Stage
+{
+public:
+
+	TransformStage( const CoordinateTransform& transform ) : mTransform(transform) {}
+
+	virtual void	Process		( PipelineFrame& frame );
+
+private:
+
+	const CoordinateTransform&	mTransform;
+};
+
+#endif
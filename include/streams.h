@@ -0,0 +1,210 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: streams.h
+%%%
+%%% Description:
+%%%
+%%% Routes the data types streamed from EVaRT to their own queues and worker
+%%% threads. The SDK calls the data handler once per data type per frame, all
+%%% from one thread, so any time spent handling one type delays every other
+%%% type of the same frame. Here the handler only copies each frame into a
+%%% free slot of its type's queue and wakes that type's worker; everything
+%%% else happens on the worker.
+%%%
+%%% Each queue is a ring of slots allocated up front, written only by the SDK
+%%% thread and read only by the worker, so it needs no lock: the writer
+%%% publishes a slot by moving the head, the reader frees it by moving the
+%%% tail. A copy takes the same time whatever the worker is doing, and a
+%%% frame that finds its queue full is dropped and counted, never waited for.
+%%%
+%%% Only the used part of a frame is copied: the frame's own counts for DOF,
+%%% analog and force data, the count set by SetItems() for the fixed arrays
+%%% of TRC and segment data, or the whole structure when no count is set.
+%%% Analog and force frames larger than their slots are dropped.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __STREAMS_H__
+#define __STREAMS_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <vector>
+
+//
+// Project headers
+//
+#include "EVaRT.h"
+#include "continuity.h"
+
+#define STREAM_SLOTS			64			// frames a queue holds before new ones are dropped
+#define STREAM_ANALOG_WORDS		16384		// analog samples times channels an analog slot holds
+#define STREAM_FORCE_VALUES		4096		// floats a force slot holds, 7 per plate per sample
+
+
+//
+// Receives the frames of one data type, on the type's worker thread
+//
+class StreamSink
+{
+public:
+
+	virtual ~StreamSink() {}
+
+	virtual void Consume( int type, const void* data ) = 0;		// a frame laid out as EVaRT sent it, valid until this returns
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: FrameStream
+%%%
+%%% Usage Notes:
+%%%
+%%% Post() may only be called from one thread, the EVaRT callback, and the
+%%% sink only runs on the stream's worker. The frame numbers passed to Post()
+%%% are checked by Continuity(), which also counts the frames Post() dropped.
+%%% A stream without a sink only checks continuity.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class FrameStream
+{
+public:
+
+	//
+	// Constructor
+	//
+	FrameStream( int type, StreamSink* sink, int slots = STREAM_SLOTS );
+
+	//
+	// Destructor
+	//
+	~FrameStream();
+
+	void	SetItems		( int items );					// markers or segments to copy, 0 for the whole frame
+	bool	Start			();								// start the worker
+	void	Stop			();								// consume the queued frames, then stop the worker
+	bool	Post			( const void* data );			// copy a frame into the queue, false if it was dropped
+	void	Drain			();								// wait until the worker has consumed every queued frame
+
+	//
+	// Get methods
+	//
+	int						Type		()	const;			// EVaRT data type
+	int						SlotBytes	()	const;			// largest frame a slot holds
+	unsigned long			Posted		()	const;			// frames copied into the queue
+	unsigned long			Consumed	()	const;			// frames handed to the sink
+	unsigned long			Deepest		()	const;			// most frames ever waiting
+	const FrameContinuity&	Continuity	()	const;			// frame numbers posted, and frames dropped
+
+private:
+
+	int					mType;
+	StreamSink*			mSink;
+	int					mSlots;
+	int					mSlotBytes;
+	volatile LONG		mItems;
+	char*				mBuffer;			// mSlots slots of mSlotBytes
+	volatile LONG		mHead;				// slots written, only the SDK thread moves it
+	volatile LONG		mTail;				// slots consumed, only the worker moves it
+	unsigned long		mDeepest;
+	FrameContinuity		mContinuity;
+
+	HANDLE				mAvailable;			// semaphore, counts the slots written
+	HANDLE				mStop;				// manual-reset event, stops the worker
+	HANDLE				mThread;
+
+	int		FrameBytes		( const void* data )	const;
+	void	Run				();
+
+	static unsigned __stdcall ThreadProc( void* arg );
+
+	// not copyable
+	FrameStream( const FrameStream& );
+	FrameStream& operator = ( const FrameStream& );
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: StreamRouter
+%%%
+%%% Usage Notes:
+%%%
+%%% Add a stream for each data type wanted, then pass Types() to
+%%% EVaRT_SetDataTypesWanted(). Post() picks the stream by data type and
+%%% returns false for a type with no stream, so the callback can hand every
+%%% frame to the router and deal with the rest itself.
+%%%
+%%%		StreamRouter router;
+%%%
+%%%		router.Add( GTR_DATA, &gtrSink );
+%%%		router.Add( DOF_DATA, &dofSink );
+%%%		router.Start();
+%%%
+%%%		// in the EVaRT callback
+%%%		router.Post( DataType, Data );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class StreamRouter
+{
+public:
+
+	//
+	// Constructor
+	//
+	StreamRouter();
+
+	//
+	// Destructor
+	//
+	~StreamRouter();
+
+	bool	Add				( int type, StreamSink* sink, int slots = STREAM_SLOTS );	// a queue and worker for a data type
+	bool	Start			();								// start every worker
+	void	Stop			();								// stop every worker
+	bool	Post			( int type, const void* data );	// copy a frame to its stream, false if there is none or it was dropped
+	void	Drain			( int types );					// wait for the streams of the types ORed together
+
+	//
+	// Get methods
+	//
+	int				Types			()				const;	// data types with a stream, ORed together
+	int				Streams			()				const;
+	FrameStream&	Stream			( int i );
+	FrameStream*	Find			( int type );			// stream of a data type, NULL if none
+
+private:
+
+	std::vector<FrameStream*>	mStreams;
+
+	// not copyable
+	StreamRouter( const StreamRouter& );
+	StreamRouter& operator = ( const StreamRouter& );
+};
+
+
+const char*	StreamTypeName		( int type );				// short name of a data type, for printing and command lines
+int			ParseStreamTypes	( const char* names );		// data types named in a comma separated list, ORed together, -1 if one is unknown
+int			StreamSlotBytes		( int type );				// room for the largest frame of a data type
+int			StreamFrameBytes	( int type, const void* data, int items = 0 );	// used bytes of a frame, -1 if too large
+
+#endif
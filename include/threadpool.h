@@ -0,0 +1,104 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: threadpool.h
+%%%
+%%% Description:
+%%%
+%%% A small fixed-size pool of worker threads. Work is handed to the pool as
+%%% WorkItem objects; the pool never takes ownership of the items, so the caller
+%%% must keep them alive until Wait() returns.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <queue>
+#include <vector>
+
+
+//
+// A unit of work to be run by a WorkerPool thread
+//
+class WorkItem
+{
+public:
+
+	virtual ~WorkItem() {}
+
+	virtual void Run() = 0;		// called once on one of the pool threads
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: WorkerPool
+%%%
+%%% Description:
+%%%
+%%% Runs queued WorkItems on a fixed set of threads created up front.
+%%%
+%%% Usage Notes:
+%%%
+%%%		WorkerPool pool;			// one thread per processor
+%%%
+%%%		pool.Submit( &itemA );
+%%%		pool.Submit( &itemB );
+%%%		pool.Wait();				// itemA and itemB have both run
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class WorkerPool
+{
+public:
+
+	//
+	// Constructor
+	//
+	WorkerPool( int numThreads = 0 );		// zero means one thread per processor
+
+	//
+	// Destructor
+	//
+	~WorkerPool();
+
+	int		Size		() const;				// number of worker threads
+	void	Submit		( WorkItem* item );		// queue an item to be run
+	void	Wait		();						// block until every submitted item has run
+
+	static int	NumProcessors	();				// number of processors in the machine
+
+private:
+
+	std::vector<HANDLE>		mThreads;
+	std::queue<WorkItem*>	mQueue;			// items waiting for a thread
+	CRITICAL_SECTION		mLock;			// protects mQueue and mPending
+	HANDLE					mAvailable;		// semaphore counting queued items
+	HANDLE					mIdle;			// manual-reset event, signaled when nothing is pending
+	long					mPending;		// items submitted but not yet finished
+
+	static unsigned __stdcall ThreadProc( void* arg );
+	void RunItems();
+
+	// not copyable
+	WorkerPool( const WorkerPool& );
+	WorkerPool& operator = ( const WorkerPool& );
+};
+
+#endif
@@ -0,0 +1,154 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: transform.h
+%%%
+%%% Description:
+%%%
+%%% Converts poses from the capture volume to the simulator's coordinate
+%%% system before they are sent, so PedSim no longer has to.
+%%%
+%%% The transform is a 4x4 affine matrix and a unit scale, read from a text
+%%% file:
+%%%
+%%%		# capture volume in mm, Z up  ->  simulator in m, Y up
+%%%		SCALE	0.001
+%%%		MATRIX	1	0	0	0
+%%%				0	0	1	0
+%%%				0	-1	0	0
+%%%				0	0	0	1
+%%%
+%%% A position is multiplied by the scale, then by the matrix; the matrix's
+%%% translation is therefore in the simulator's units. The 3x3 part of the
+%%% matrix must be a rotation or a reflection, optionally with a uniform
+%%% scale. An orientation is carried over as a change of basis, R' = A R A^-1,
+%%% so a body whose axes lined up with the capture volume's lines up with the
+%%% simulator's; this is a rotation even when A switches handedness. A
+%%% direction such as a force keeps its length: it is turned, or reflected,
+%%% by the 3x3 part without its scale. A moment is a cross product of a
+%%% position and a force, so it is scaled like a position and also changes
+%%% sign when A switches handedness. Both keywords are optional, the default
+%%% is the identity.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+// Disable linker warning about truncation to 255 characters in debug info with std::string
+#pragma warning (disable: 4786)
+
+//
+// Standard headers
+//
+#include <windows.h>
+#include <string>
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "wrappers.h"
+
+#define TRANSFORM_ORTHO_TOLERANCE	1e-3	// allowed error of the matrix's rotation part
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: CoordinateTransform
+%%%
+%%% Usage Notes:
+%%%
+%%% Apply() may be called from any thread while Load() or Reload() publish a
+%%% new transform on another. The coefficients are kept in two buffers: a
+%%% new transform is written to the one not in use and then made current
+%%% with one interlocked exchange. Apply() copies the current coefficients
+%%% and copies them again if a new transform was published meanwhile, so
+%%% every packet is converted by either the old or the new transform, never
+%%% a mix, and the stream is never held up. A file that can't be read leaves
+%%% the current transform in place.
+%%%
+%%% Apply() converts the poses of a packet with SSE, four floats at a time.
+%%%
+%%%		CoordinateTransform transform;
+%%%
+%%%		transform.Load( "pedsim.cal" );
+%%%		transform.Apply( packet );			// from the capture thread
+%%%		transform.Reload();					// from time to time, from the main thread
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class CoordinateTransform
+{
+public:
+
+	//
+	// Constructor
+	//
+	CoordinateTransform();
+
+	//
+	// Destructor
+	//
+	~CoordinateTransform();
+
+	//
+	// Set methods
+	//
+	bool	Set				( const double matrix[4][4], double scale );	// false if the 3x3 part is not a scaled rotation
+	void	SetIdentity		();
+	bool	Load			( const char* filename );						// read a calibration file, false if it is not valid
+	bool	Reload			();												// read the file again if it changed, true if it was
+
+	//
+	// Get methods
+	//
+	const std::string&	FileName	()	const;		// file last loaded
+	bool				IsIdentity	()	const;
+	long				Version		()	const;		// number of transforms published
+
+	void	Apply			( PosePacket& packet )	const;		// convert every pose of a packet in place
+	void	Apply			( Point3 position )		const;		// convert one position in place
+	void	ApplyDirection	( float direction[3] )	const;		// convert a force or other direction in place, not scaled
+	void	ApplyMoment		( float moment[3] )		const;		// convert a moment in place
+
+private:
+
+	// everything Apply() needs, as the columns of two matrices
+	struct Coefficients
+	{
+		float		position[4][4];		// scaled 3x3 part, then the translation, w unused
+		float		rotation[4][4];		// quaternion q -> a q a*, as a 4x4 matrix
+		float		direction[3][3];	// 3x3 part without its scale
+		float		moment[3][3];		// scaled 3x3 part times the sign of its determinant
+		bool		identity;
+	};
+
+	Coefficients		mBuffers[2];
+	volatile LONG		mCurrent;			// buffer Apply() reads
+	volatile LONG		mVersion;			// changed before and after each buffer is written
+	CRITICAL_SECTION	mLock;				// one writer at a time, and the file name and time
+	std::string			mFileName;
+	FILETIME			mWriteTime;			// of the file when it was loaded
+
+	bool	Compute			( const double matrix[4][4], double scale, Coefficients& c ) const;
+	void	Publish			( const Coefficients& c );
+	void	Current			( Coefficients& c ) const;
+
+	// not copyable
+	CoordinateTransform( const CoordinateTransform& );
+	CoordinateTransform& operator = ( const CoordinateTransform& );
+};
+
+#endif
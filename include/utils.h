@@ -24,6 +24,7 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <windows.h>
 #include <cstdio>
 #include <string>
 #include <ctime>
@@ -74,6 +75,53 @@ private:
 };
 
 
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: StopWatch
+%%%
+%%% Description:
+%%%
+%%% Measures short intervals with the performance counter, for timing the
+%%% work done per frame. clock() is far too coarse for that.
+%%%
+%%% Usage Notes:
+%%%
+%%%		StopWatch w;
+%%%
+%%%		w.Begin();
+%%%		// do stuff
+%%%		double us = w.Microseconds();
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class StopWatch
+{
+
+public:
+
+	StopWatch				()
+	{
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency( &f );
+		mFrequency = (double) f.QuadPart;
+		Begin();
+	}
+
+	void Begin				()			{ QueryPerformanceCounter( &mStart ); }
+
+	double Seconds			() const
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter( &now );
+		return (double) (now.QuadPart - mStart.QuadPart) / mFrequency;
+	}
+	double Microseconds		() const	{ return Seconds() * 1e6; }
+
+private:
+	LARGE_INTEGER	mStart;
+	double			mFrequency;		// counts per second
+};
+
+
 void	trimWhiteSpace	( char* s );
 bool	isInteger		( const char* s );
 void	promptInput		( const char* prompt, const char* def, char *s, int size );
@@ -0,0 +1,173 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: validator.h
+%%%
+%%% Description:
+%%%
+%%% Rejects ghost spikes and undoes marker swaps in live TRC frames, before
+%%% the frames reach the rigid body solver and the gap filler.
+%%%
+%%% Three checks are made on every frame:
+%%%
+%%%		kinematic		a marker may not move faster than the speed limit
+%%%						since it was last accepted, nor depart from its
+%%%						constant velocity track by more than the
+%%%						acceleration limit allows
+%%%		relabelling		when a marker of a rigid body fails the kinematic
+%%%						check, the body's measured markers are matched to
+%%%						the positions their tracks predict by a minimum cost
+%%%						assignment; if a different labelling fits much better
+%%%						than the one from EVaRT, the markers are swapped back
+%%%		geometry		the distances between the markers of a calibrated
+%%%						body must match those of its reference; a marker
+%%%						that disagrees with more than half of the others
+%%%						is rejected
+%%%
+%%% A rejected marker is set to XEMPTY, so the gap filler treats it like an
+%%% occlusion. A marker that has been rejected for several frames in a row
+%%% starts a new track instead, so a marker that really moved that fast is
+%%% not lost for good.
+%%%
+%%% The body checks stop once the time spent on the frame reaches the budget.
+%%% The remaining bodies are only checked kinematically, and the next frame
+%%% starts with the first body that was left out.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#ifndef __VALIDATOR_H__
+#define __VALIDATOR_H__
+
+//
+// Project headers
+//
+#include "bodytracker.h"
+#include "wrappers.h"
+
+#define VALIDATE_MAX_SPEED		15000.0f	// mm/s
+#define VALIDATE_MAX_ACCEL		300000.0f	// mm/s^2, about 30 g
+#define VALIDATE_TOLERANCE		10.0f		// mm a body's marker distances may differ from the reference
+#define VALIDATE_BUDGET			0.0005		// seconds per frame for the body checks
+#define VALIDATE_REACQUIRE		5			// frames a marker is rejected before its track restarts
+#define VALIDATE_MAX_GAP		10			// frames after which a track is too old to check against
+#define VALIDATE_SWAP_GAIN		0.25		// a new labelling must cost less than this share of the old one
+
+
+// What the validator did with a marker
+enum SampleStatus
+{
+	kSampleValid = 0,		// passed every check
+	kSampleEmpty,			// missing in the frame from EVaRT
+	kSampleRejected,		// failed a check, set to XEMPTY
+	kSampleSwapped			// position taken from another marker of the same body
+};
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: MarkerValidator
+%%%
+%%% Usage Notes:
+%%%
+%%% Validate() works on the frame in place and uses fixed arrays only. The
+%%% speed and acceleration limits are in the units of the TRC data per
+%%% second; without a capture rate only the geometry is checked. The bodies
+%%% come from the tracker, which must have resolved them against the marker
+%%% list; bodies that take their reference from the data are only checked
+%%% for geometry once they have it.
+%%%
+%%% Reset() must be called when the marker list changes.
+%%%
+%%%		MarkerValidator validator;
+%%%
+%%%		validator.SetRate( 120.0f );
+%%%		validator.Validate( frame, &tracker );
+%%%		tracker.Solve( frame, packet );
+%%%		filler.Fill( frame, &tracker, &packet );
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class MarkerValidator
+{
+public:
+
+	//
+	// Constructor
+	//
+	MarkerValidator();
+
+	//
+	// Set methods
+	//
+	void	SetRate			( float rate );									// capture rate, frames per second
+	void	SetLimits		( float maxSpeed, float maxAccel );				// kinematic limits, 0 for none
+	void	SetTolerance	( float tolerance );							// allowed error of a body's marker distances
+	void	SetBudget		( double seconds );								// time per frame for the body checks
+	void	Reset			();												// forget the history of every marker
+
+	//
+	// Get methods
+	//
+	SampleStatus	Status			( int i )	const;		// what happened to marker i of the last frame
+	int				Rejected		()			const;		// markers rejected in the last frame
+	int				Swapped			()			const;		// markers relabelled in the last frame
+	int				Skipped			()			const;		// bodies left out of the last frame for lack of time
+	unsigned long	TotalRejected	()			const;		// since the last Reset()
+	unsigned long	TotalSwapped	()			const;
+	unsigned long	TotalSkipped	()			const;
+
+	void	Validate		( TrcFrameWrapper& frame, const BodyTracker* tracker = NULL );	// check the markers of a frame
+
+private:
+
+	// accepted history of one marker
+	struct Track
+	{
+		float			pos[2][3];		// last accepted positions, most recent first
+		int				count;			// valid entries in pos, all from consecutive frames
+		int				frame;			// frame of pos[0]
+		int				rejected;		// frames rejected in a row
+		SampleStatus	status;			// status in the current frame
+	};
+
+	Track			mTracks[MAX_MARKERS];
+	float			mPos[MAX_MARKERS][3];	// positions of the current frame
+	int				mCount;					// markers in the current frame
+	int				mFrame;					// number of the current frame
+
+	float			mRate;
+	float			mMaxSpeed;
+	float			mMaxAccel;
+	float			mTolerance;
+	double			mBudget;
+	int				mNextBody;				// body checked first in the next frame
+
+	int				mRejected;
+	int				mSwapped;
+	int				mSkipped;
+	unsigned long	mTotalRejected;
+	unsigned long	mTotalSwapped;
+	unsigned long	mTotalSkipped;
+
+	bool	Kinematic		( const Track& t, const float pos[3] ) const;
+	bool	Predict			( const Track& t, double pos[3] ) const;
+	void	Relabel			( TrcFrameWrapper& frame, const int* index, int n );
+	void	CheckGeometry	( const RigidBody& body, const int* slot, const int* index, int n );
+	void	Push			( Track& t, const float pos[3] );
+};
+
+
+const char* SampleStatusName( SampleStatus status );		// short name of a sample status, for printing
+
+#endif
@@ -278,6 +278,75 @@ private:
 };
 
 
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: AnalogNamesWrapper
+%%%
+%%% Description:
+%%%
+%%% This class encapsulates the sAnalogNames structure defined in EVaRT.h as:
+%%%
+%%% typedef struct sAnalogNames
+%%% {
+%%%    int    nChannels;
+%%%    char **szChannelNames;
+%%%
+%%% } sAnalogNames;
+%%%
+%%% The "nChannels" field is the number of analog channels defined in EVaRT
+%%% The "szChannelNames" field is the name of the analog channels defined in EVaRT
+%%% 
+%%% Usage Notes:
+%%%
+%%% An AnalogNamesWrapper object can not modify the contents of a sAnalogNames, 
+%%% it is a read-only wrapper.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+class AnalogNamesWrapper
+{
+public:
+	
+	//
+	// Constructors
+	//
+	AnalogNamesWrapper		( const sAnalogNames* src = NULL );		// default constructor
+	AnalogNamesWrapper		( const AnalogNamesWrapper& src );		// copy constructor
+
+	//
+	// Destructor
+	//
+	~AnalogNamesWrapper		();
+
+	//
+	// Set methods
+	//
+	void Set				( const sAnalogNames* src = NULL );		// set/reset after creation
+	
+	//
+	// Get methods
+	//
+	int				Size				()			const;			// number of analog channels
+	std::string		Name				( int i )	const;			// channel name at index i
+
+	//
+	// Operators
+	//
+	AnalogNamesWrapper&	operator	=	( const sAnalogNames* lhs );			// assignment from sAnalogNames structure
+	AnalogNamesWrapper&	operator	=	( const AnalogNamesWrapper& lhs );		// assignment from AnalogNamesWrapper object
+
+	bool				operator	==	( const sAnalogNames* lhs ) const;			// equality to sAnalogNames structure
+	bool				operator	==	( const AnalogNamesWrapper& lhs ) const;	// equality to AnalogNamesWrapper object
+	bool				operator	!=	( const sAnalogNames* lhs ) const;			// inequality to sAnalogNames structure
+	bool				operator	!=	( const AnalogNamesWrapper& lhs ) const;	// inequality to AnalogNamesWrapper object
+
+private:
+
+	std::vector<std::string>	mChannelNames;
+
+	void Copy( const sAnalogNames* src );
+	void Copy( const AnalogNamesWrapper& src );
+};
+
 /*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %%%
 %%% Class: TrcFrameWrapper
@@ -328,6 +397,7 @@ public:
 	// Set methods
 	//
 	void Set				( const sTrcFrame* src = NULL, int count = 0 );		// set/reset after creation
+	void SetMarkerLocation	( int i, const Point3 loc );						// replace the position of the marker at the specified index
 	
 	//
 	// Get methods
@@ -335,6 +405,13 @@ public:
 	int				Size				()					const;	// number of markers in this frame
 	int				Frame				()					const;	// frame number of this frame
 	void			GetMarkerLocation	(int i, Point3 loc) const;	// 3-D position of the marker at the specified index 
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
 	
 
 	//
@@ -423,6 +500,13 @@ public:
 	int				Size				()							const;	// number of segments in this frame
 	int				Frame				()							const;	// frame number of this frame
 	void			GetSegmentInfo		(int i, SegmentInfo info)	const;	// segment info for segment at the specified index 
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
 	
 
 	//
@@ -446,6 +530,112 @@ private:
 
 
 
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: HtrFrameWrapper
+%%%
+%%% Description:
+%%%
+%%% This class encapsulates the sHtrFrame structure defined in EVaRT.h as:
+%%%
+%%% typedef struct sHtrFrame
+%%% {
+%%%    int    iFrame;
+%%%    float  RootPosition[3];              // X,Y,Z 
+%%%    float  Segments[MAX_SEGMENTS][4];    // aX,aY,aZ,Length 
+%%%
+%%% } sHtrFrame;
+%%%
+%%% The "iFrame" field is the frame number from EVaRT 
+%%% The "RootPosition" field is the translation of the root of the skeleton
+%%% The "Segments" array gives an X,Y,Z rotation and a length for each skeletal
+%%% segment in EVaRT. The rotations are Euler angles in degrees relative to the
+%%% segment's parent, as in sHtr2Frame. There are no per-segment translations:
+%%% a segment starts at the end of its parent, Length along the parent's bone
+%%% axis, so a frame is little more than half the size of a sHtr2Frame.
+%%% 
+%%% Usage Notes:
+%%%
+%%% A HtrFrameWrapper object can not modify the contents of a sHtrFrame, 
+%%% it is a read-only wrapper, however, it only stores the number of segments which are valid.
+%%%
+%%% GetSegmentFrame() expands a frame to the layout of sHtr2Frame for code
+%%% that expects every segment's translation. Segments without a parent in
+%%% the hierarchy are placed at RootPosition; every other segment is offset
+%%% from its parent by the parent's length along the bone axis, Y by default
+%%% as in HTR files. These translations are an approximation: sHtrFrame
+%%% does not carry the base position of a segment on its parent, so siblings
+%%% such as the two hips all start at the same point, the end of their
+%%% parent. Only a chain of single children comes out right; use an sHtr2Frame
+%%% stream where the translations matter.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+typedef float HtrSegmentInfo[4];
+
+class HtrFrameWrapper
+{
+public:
+	
+	//
+	// Constructors
+	//
+	HtrFrameWrapper		( const sHtrFrame* src = NULL, int count = 0 );		// default constructor
+	HtrFrameWrapper		( const HtrFrameWrapper& src );					// copy constructor
+
+	//
+	// Destructor
+	//
+	~HtrFrameWrapper		();
+
+	//
+	// Set methods
+	//
+	void Set				( const sHtrFrame* src = NULL, int count = 0 );		// set/reset after creation
+	
+	//
+	// Get methods
+	//
+	int				Size				()								const;	// number of segments in this frame
+	int				Frame				()								const;	// frame number of this frame
+	void			GetRootPosition		( Point3 loc )					const;	// translation of the root
+	void			GetSegmentInfo		( int i, HtrSegmentInfo info )	const;	// rotation and length of the segment at the specified index
+
+	//
+	// Conversion to the layout of sHtr2Frame
+	//
+	bool			GetTranslation		( const HierarchyWrapper& hierarchy, int i, Point3 loc, int axis = 1 )	const;	// approximate offset of segment i from its parent
+	bool			GetSegmentFrame		( const HierarchyWrapper& hierarchy, SegmentFrame& dst, int axis = 1 )	const;	// false if the hierarchy doesn't match
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
+
+	//
+	// Operators
+	//
+	HtrFrameWrapper&	operator	=	( const HtrFrameWrapper& lhs );		// assignment from HtrFrameWrapper object
+
+	bool				operator	==	( const HtrFrameWrapper& lhs ) const;	// equality to HtrFrameWrapper object
+	bool				operator	!=	( const HtrFrameWrapper& lhs ) const;	// inequality to HtrFrameWrapper object
+
+private:
+
+	HtrSegmentInfo*	mSegments;
+	Point3			mRoot;
+	int				mFrame;
+	int				mCount;
+
+	void Copy( const sHtrFrame* src, int count );
+	void Copy( const HtrFrameWrapper& src );
+	void FreeMemory();
+};
+
+
+
 /*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %%%
 %%% Class: DofFrameWrapper
@@ -499,6 +689,13 @@ public:
 	int				Size				()							const;	// number of DOFs in this frame
 	int				Frame				()							const;	// frame number of this frame
 	void			GetDofValue			(int i, double& value)		const;	// DOF value at index i
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
 	
 
 	//
@@ -521,4 +718,202 @@ private:
 };
 
 
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: AnalogFrameWrapper
+%%%
+%%% Description:
+%%%
+%%% This class encapsulates the sAnalogFrame structure defined in EVaRT.h as:
+%%%
+%%% typedef struct sAnalogFrame
+%%% {
+%%%    int    iFrame;
+%%%    int    nSamples;
+%%%    int    nChannels;
+%%%    short  wData[1];   // This will actually be nChannels*nSamples words 
+%%%
+%%% } sAnalogFrame;
+%%%
+%%% The "iFrame" field is the frame number from EVaRT
+%%% The "nSamples" field is the number of samples of each channel in this frame
+%%% The "nChannels" field is the number of analog channels
+%%% The "wData" array holds the samples, sample major: all channels of the
+%%% first sample, then all channels of the second sample, and so on
+%%% 
+%%% Usage Notes:
+%%%
+%%% An AnalogFrameWrapper object can not modify the contents of a sAnalogFrame, 
+%%% it is a read-only wrapper. The size of an analog frame depends on the
+%%% analog rate, so the samples are kept in a block from BufferPool::Shared().
+%%% The block is kept when the next frame fits in it, and goes back to the
+%%% pool when it doesn't, so wrappers that are reused or copied at the frame
+%%% rate stop allocating memory once the pool has warmed up.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+class AnalogFrameWrapper
+{
+public:
+	
+	//
+	// Constructors
+	//
+	AnalogFrameWrapper		( const sAnalogFrame* src = NULL );		// default constructor
+	AnalogFrameWrapper		( const AnalogFrameWrapper& src );		// copy constructor
+
+	//
+	// Destructor
+	//
+	~AnalogFrameWrapper		();
+
+	//
+	// Set methods
+	//
+	void Set				( const sAnalogFrame* src = NULL );		// set/reset after creation
+	void Set				( int frame, int samples, int channels, const short* data );	// set from samples laid out as in wData
+	
+	//
+	// Get methods
+	//
+	int				Frame				()							const;	// frame number of this frame
+	int				Samples				()							const;	// samples of each channel in this frame
+	int				Channels			()							const;	// number of analog channels
+	short			Value				( int sample, int channel )	const;	// one sample of one channel, 0 if out of range
+	const short*	Data				()							const;	// all samples, sample major, NULL if empty
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
+
+	//
+	// Operators
+	//
+	AnalogFrameWrapper&	operator	=	( const AnalogFrameWrapper& lhs );		// assignment from AnalogFrameWrapper object
+
+	bool				operator	==	( const AnalogFrameWrapper& lhs ) const;	// equality to AnalogFrameWrapper object
+	bool				operator	!=	( const AnalogFrameWrapper& lhs ) const;	// inequality to AnalogFrameWrapper object
+
+private:
+
+	short*			mData;
+	int				mCapacity;		// bytes in the pooled block
+	int				mFrame;
+	int				mSamples;
+	int				mChannels;
+
+	void Copy( int frame, int samples, int channels, const short* data );
+	bool Reserve( int bytes );
+	void FreeMemory();
+};
+
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% Class: ForceFrameWrapper
+%%%
+%%% Description:
+%%%
+%%% This class encapsulates the sForceFrame structure defined in EVaRT.h as:
+%%%
+%%% typedef struct sForceFrame
+%%% {
+%%%    int    iFrame;
+%%%    int    nSamples;
+%%%    int    nPlates;
+%%%    float  fData[7];   // This will actually be nPlates*nSamples*7 floats 
+%%%
+%%% } sForceFrame;
+%%%
+%%% The "iFrame" field is the frame number from EVaRT
+%%% The "nSamples" field is the number of samples of each plate in this frame
+%%% The "nPlates" field is the number of force plates
+%%% The "fData" array holds 7 values for each plate of each sample, sample
+%%% major: the center of pressure X,Y,Z, the force fX,fY,fZ and the free
+%%% moment MZ
+%%% 
+%%% Usage Notes:
+%%%
+%%% A ForceFrameWrapper object can not modify the contents of a sForceFrame, 
+%%% it is a read-only wrapper. Like AnalogFrameWrapper, the values are kept
+%%% in a block from BufferPool::Shared().
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#define FORCE_VALUES	7		// values of one plate in one sample
+
+// Index of each value of a plate
+enum ForceValue
+{
+	kForceX = 0,		// center of pressure
+	kForceY,
+	kForceZ,
+	kForceFX,			// force
+	kForceFY,
+	kForceFZ,
+	kForceMZ			// free moment
+};
+
+class ForceFrameWrapper
+{
+public:
+	
+	//
+	// Constructors
+	//
+	ForceFrameWrapper		( const sForceFrame* src = NULL );		// default constructor
+	ForceFrameWrapper		( const ForceFrameWrapper& src );		// copy constructor
+
+	//
+	// Destructor
+	//
+	~ForceFrameWrapper		();
+
+	//
+	// Set methods
+	//
+	void Set				( const sForceFrame* src = NULL );		// set/reset after creation
+	
+	//
+	// Get methods
+	//
+	int				Frame				()										const;	// frame number of this frame
+	int				Samples				()										const;	// samples of each plate in this frame
+	int				Plates				()										const;	// number of force plates
+	float			Value				( int sample, int plate, int value )	const;	// one ForceValue, XEMPTY if out of range
+	const float*	Data				()										const;	// all values, sample major, NULL if empty
+
+	//
+	// Flat buffer methods, used to store frames without per-frame allocations
+	//
+	int				PackedSize			()							const;	// number of bytes Pack() writes
+	void			Pack				( void* dst )				const;	// copy this frame into a flat buffer
+	void			Unpack				( const void* src );				// set from a buffer filled by Pack()
+
+	//
+	// Operators
+	//
+	ForceFrameWrapper&	operator	=	( const ForceFrameWrapper& lhs );		// assignment from ForceFrameWrapper object
+
+	bool				operator	==	( const ForceFrameWrapper& lhs ) const;	// equality to ForceFrameWrapper object
+	bool				operator	!=	( const ForceFrameWrapper& lhs ) const;	// inequality to ForceFrameWrapper object
+
+private:
+
+	float*			mData;
+	int				mCapacity;		// bytes in the pooled block
+	int				mFrame;
+	int				mSamples;
+	int				mPlates;
+
+	void Copy( int frame, int samples, int plates, const float* data );
+	bool Reserve( int bytes );
+	void FreeMemory();
+};
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,789 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: archive.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the compressed TRC archive writer and reader.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "archive.h"
+#include <math.h>
+#include <string.h>
+
+static const char		kArchiveMagic[4]	= { 'M', 'C', 'A', '1' };
+static const char		kTrailerMagic[4]	= { 'M', 'C', 'A', 'X' };
+static const int		kArchiveVersion		= 1;
+static const int		kChunkHeaderSize	= 12;		// first frame, frame count, payload size
+static const int		kDirEntrySize		= 16;		// offset, first frame, frame count
+static const int		kTrailerSize		= 16;		// chunk count, directory offset, magic
+static const double		kMaxQuantized		= 1073741823.0;
+
+
+//
+// Varint helpers
+//
+
+// Map signed values to unsigned so small magnitudes give small codes
+static inline unsigned __int64 ZigZag( __int64 v )
+{
+	return ((unsigned __int64) v << 1) ^ (unsigned __int64) (v >> 63);
+}
+
+static inline __int64 UnZigZag( unsigned __int64 v )
+{
+	return (__int64) (v >> 1) ^ -(__int64) (v & 1);
+}
+
+// Append an unsigned value, seven bits per byte
+static inline void PutVarint( std::vector<unsigned char>& out, unsigned __int64 v )
+{
+	while (v >= 0x80)
+	{
+		out.push_back( (unsigned char) (v | 0x80) );
+		v >>= 7;
+	}
+	out.push_back( (unsigned char) v );
+}
+
+// Read an unsigned value, returns false if the data runs out
+static inline bool GetVarint( const unsigned char*& p, const unsigned char* end, unsigned __int64& v )
+{
+	int shift = 0;
+
+	v = 0;
+	while (p < end && shift < 64)
+	{
+		unsigned char b = *p++;
+		v |= (unsigned __int64) (b & 0x7f) << shift;
+
+		if ((b & 0x80) == 0)	return true;
+		shift += 7;
+	}
+
+	return false;
+}
+
+
+//
+// Delta-of-delta coding: the first value is stored as is, the second as a delta,
+// and every other value as the change of the delta.
+//
+struct DodEncoder
+{
+	__int64		prev;
+	__int64		prevDelta;
+	int			count;
+
+	DodEncoder() : prev(0), prevDelta(0), count(0) {}
+
+	void Put( std::vector<unsigned char>& out, __int64 v )
+	{
+		__int64 delta = v - prev;
+
+		if (count == 0)			PutVarint( out, ZigZag(v) );
+		else if (count == 1)	PutVarint( out, ZigZag(delta) );
+		else					PutVarint( out, ZigZag(delta - prevDelta) );
+
+		prevDelta = (count == 0) ? 0 : delta;
+		prev = v;
+		count++;
+	}
+};
+
+struct DodDecoder
+{
+	__int64		prev;
+	__int64		prevDelta;
+	int			count;
+
+	DodDecoder() : prev(0), prevDelta(0), count(0) {}
+
+	bool Get( const unsigned char*& p, const unsigned char* end, __int64& v )
+	{
+		unsigned __int64 code;
+
+		if (!GetVarint( p, end, code ))	return false;
+
+		__int64 d = UnZigZag( code );
+
+		if (count == 0)			{ v = d; prevDelta = 0; }
+		else if (count == 1)	{ v = prev + d; prevDelta = d; }
+		else					{ prevDelta += d; v = prev + prevDelta; }
+
+		prev = v;
+		count++;
+		return true;
+	}
+};
+
+// Read a little-endian value from an unaligned address
+template<class T>
+static inline T Peek( const unsigned char* p )
+{
+	T v;
+	memcpy( &v, p, sizeof(T) );
+	return v;
+}
+
+// A marker is occluded when EVaRT reports XEMPTY for it
+static inline bool IsEmpty( const Point3 pt )
+{
+	return pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY;
+}
+
+
+
+//
+// Decoded archive chunk
+//
+
+// Constructor
+ArchiveChunk::ArchiveChunk()
+{
+	mMarkers = 0;
+}
+
+// Number of frames in the chunk
+int ArchiveChunk::Size() const
+{
+	return (int) mFrames.size();
+}
+
+// Number of markers per frame
+int ArchiveChunk::Markers() const
+{
+	return mMarkers;
+}
+
+// Frame number of the frame at the given row
+int ArchiveChunk::Frame( int row ) const
+{
+	return (row >= 0 && row < Size()) ? mFrames[row] : -1;
+}
+
+// Pointer to the Size() samples of one marker axis
+const float* ArchiveChunk::Column( int marker, int axis ) const
+{
+	if (marker < 0 || marker >= mMarkers || axis < 0 || axis > 2 || mFrames.empty())
+	{
+		return NULL;
+	}
+
+	return &mColumns[ (marker*3 + axis) * mFrames.size() ];
+}
+
+// Get the 3-D coordinates of a marker in the frame at the given row
+void ArchiveChunk::GetMarkerLocation( int row, int marker, Point3 loc ) const
+{
+	loc[0] = loc[1] = loc[2] = XEMPTY;
+
+	if (row >= 0 && row < Size() && marker >= 0 && marker < mMarkers)
+	{
+		int rows = Size();
+
+		loc[0] = mColumns[ (marker*3 + 0) * rows + row ];
+		loc[1] = mColumns[ (marker*3 + 1) * rows + row ];
+		loc[2] = mColumns[ (marker*3 + 2) * rows + row ];
+	}
+}
+
+// Copy the frame at the given row into a TrcFrameWrapper
+void ArchiveChunk::GetFrame( int row, TrcFrameWrapper& frame ) const
+{
+	sTrcFrame src;
+	int count = mMarkers < MAX_MARKERS ? mMarkers : MAX_MARKERS;
+
+	src.iFrame = Frame( row );
+	for (int i = 0; i < count; i++)
+	{
+		GetMarkerLocation( row, i, src.Markers[i] );
+	}
+
+	frame.Set( &src, count );
+}
+
+// Size the chunk for the given number of frames and markers
+void ArchiveChunk::Resize( int frames, int markers )
+{
+	mMarkers = markers;
+	mFrames.resize( frames );
+	mColumns.resize( frames * markers * 3 );
+}
+
+
+
+//
+// Archive writer
+//
+
+// Constructor
+TrcArchiveWriter::TrcArchiveWriter()
+{
+	mFile = NULL;
+	mMarkers = 0;
+	mFramesPerChunk = ARCHIVE_FRAMES_PER_CHUNK;
+	mResolution = ARCHIVE_RESOLUTION;
+	mRows = 0;
+	mFrameCount = 0;
+	mOffset = 0;
+}
+
+// Destructor
+TrcArchiveWriter::~TrcArchiveWriter()
+{
+	Close();
+}
+
+// Create the archive and write the file header
+bool TrcArchiveWriter::Open( const char* filename, const MarkerListWrapper& markers, int framesPerChunk, float resolution )
+{
+	Close();
+
+	if (!filename || framesPerChunk <= 0 || resolution <= 0.0f)
+	{
+		return false;
+	}
+
+	mFile = fopen( filename, "wb" );
+	if (!mFile)	return false;
+
+	mMarkers = markers.Size();
+	mFramesPerChunk = framesPerChunk;
+	mResolution = resolution;
+	mRows = 0;
+	mFrameCount = 0;
+	mOffset = 0;
+	mDirectory.clear();
+
+	mFrames.resize( mFramesPerChunk );
+	mValues.resize( mMarkers * 3 * mFramesPerChunk );
+	mVisible.resize( mMarkers * mFramesPerChunk );
+
+	// marker names, NUL separated
+	std::string names;
+	for (int i = 0; i < mMarkers; i++)
+	{
+		names += markers.Name(i);
+		names += '\0';
+	}
+
+	int nameBytes = (int) names.size();
+
+	bool rc = Write( kArchiveMagic, 4 ) &&
+			  Write( &kArchiveVersion, 4 ) &&
+			  Write( &mMarkers, 4 ) &&
+			  Write( &mFramesPerChunk, 4 ) &&
+			  Write( &mResolution, 4 ) &&
+			  Write( &nameBytes, 4 ) &&
+			  (nameBytes == 0 || Write( names.data(), nameBytes ));
+
+	if (!rc)
+	{
+		fclose( mFile );
+		mFile = NULL;
+	}
+
+	return rc;
+}
+
+// Add a frame, a full chunk is encoded and written out
+bool TrcArchiveWriter::Add( const TrcFrameWrapper& frame )
+{
+	if (!mFile)	return false;
+
+	Point3 pt;
+	double scale = 1.0 / mResolution;
+
+	mFrames[mRows] = frame.Frame();
+
+	for (int i = 0; i < mMarkers; i++)
+	{
+		frame.GetMarkerLocation( i, pt );
+
+		bool visible = !IsEmpty(pt);
+
+		for (int axis = 0; axis < 3 && visible; axis++)
+		{
+			double q = floor( pt[axis] * scale + 0.5 );
+
+			// values outside the fixed-point range can't be represented, treat them as occluded
+			if (q > kMaxQuantized || q < -kMaxQuantized)
+			{
+				visible = false;
+			}
+			else
+			{
+				mValues[ (i*3 + axis) * mFramesPerChunk + mRows ] = (int) q;
+			}
+		}
+
+		mVisible[ i * mFramesPerChunk + mRows ] = visible ? 1 : 0;
+	}
+
+	mRows++;
+	mFrameCount++;
+
+	return (mRows < mFramesPerChunk) ? true : FlushChunk();
+}
+
+// Write out any buffered frames, the chunk directory and the trailer
+bool TrcArchiveWriter::Close()
+{
+	if (!mFile)	return false;
+
+	bool rc = FlushChunk();
+
+	__int64 dirOffset = mOffset;
+	int count = (int) mDirectory.size();
+
+	for (int i = 0; i < count && rc; i++)
+	{
+		rc = Write( &mDirectory[i].offset, 8 ) &&
+			 Write( &mDirectory[i].firstFrame, 4 ) &&
+			 Write( &mDirectory[i].frames, 4 );
+	}
+
+	rc = rc && Write( &count, 4 ) && Write( &dirOffset, 8 ) && Write( kTrailerMagic, 4 );
+	rc = (fclose( mFile ) == 0) && rc;
+
+	mFile = NULL;
+	mRows = 0;
+
+	return rc;
+}
+
+// Is the archive open for writing
+bool TrcArchiveWriter::IsOpen() const
+{
+	return mFile != NULL;
+}
+
+// Number of frames added since Open()
+unsigned long TrcArchiveWriter::Frames() const
+{
+	return mFrameCount;
+}
+
+// Number of bytes written to the file so far
+__int64 TrcArchiveWriter::BytesWritten() const
+{
+	return mOffset;
+}
+
+
+// Encode the buffered frames as one chunk and append it to the file
+bool TrcArchiveWriter::FlushChunk()
+{
+	if (mRows == 0)	return true;
+
+	int i, row, axis;
+
+	mBuffer.clear();
+
+	// frame numbers are normally consecutive, so this column is nearly all zeros
+	DodEncoder frames;
+	for (row = 0; row < mRows; row++)
+	{
+		frames.Put( mBuffer, mFrames[row] );
+	}
+
+	for (i = 0; i < mMarkers; i++)
+	{
+		const unsigned char* visible = &mVisible[ i * mFramesPerChunk ];
+
+		// visibility mask as alternating run lengths, starting with a visible run
+		std::vector<int> runs;
+		unsigned char state = 1;
+		int length = 0;
+
+		for (row = 0; row < mRows; row++)
+		{
+			if (visible[row] != state)
+			{
+				runs.push_back( length );
+				state = visible[row];
+				length = 0;
+			}
+			length++;
+		}
+		runs.push_back( length );
+
+		PutVarint( mBuffer, runs.size() );
+		for (row = 0; row < (int) runs.size(); row++)
+		{
+			PutVarint( mBuffer, runs[row] );
+		}
+
+		// one column per axis, holding only the visible samples
+		for (axis = 0; axis < 3; axis++)
+		{
+			const int* values = &mValues[ (i*3 + axis) * mFramesPerChunk ];
+			DodEncoder column;
+
+			for (row = 0; row < mRows; row++)
+			{
+				if (visible[row])
+				{
+					column.Put( mBuffer, values[row] );
+				}
+			}
+		}
+	}
+
+	ChunkInfo info;
+	info.offset = mOffset;
+	info.firstFrame = mFrames[0];
+	info.frames = mRows;
+
+	unsigned int payload = (unsigned int) mBuffer.size();
+
+	bool rc = Write( &info.firstFrame, 4 ) &&
+			  Write( &info.frames, 4 ) &&
+			  Write( &payload, 4 ) &&
+			  Write( &mBuffer[0], payload );
+
+	if (rc)
+	{
+		mDirectory.push_back( info );
+	}
+
+	mRows = 0;
+	return rc;
+}
+
+// Write raw bytes and keep track of the file offset
+bool TrcArchiveWriter::Write( const void* data, size_t size )
+{
+	if (fwrite( data, 1, size, mFile ) != size)
+	{
+		return false;
+	}
+
+	mOffset += size;
+	return true;
+}
+
+
+
+//
+// Archive reader
+//
+
+// Work item which decodes one chunk on a pool thread
+class DecodeChunkItem : public WorkItem
+{
+public:
+
+	const TrcArchiveReader*		reader;
+	int							chunk;
+	ArchiveChunk*				out;
+	bool						ok;
+
+	virtual void Run()
+	{
+		ok = reader->DecodeChunk( chunk, *out );
+	}
+};
+
+
+// Constructor
+TrcArchiveReader::TrcArchiveReader()
+{
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = NULL;
+	mData = NULL;
+	mSize = 0;
+	mMarkers = 0;
+	mFrames = 0;
+	mResolution = ARCHIVE_RESOLUTION;
+}
+
+// Destructor
+TrcArchiveReader::~TrcArchiveReader()
+{
+	Close();
+}
+
+// Map the archive into memory and read its directory
+bool TrcArchiveReader::Open( const char* filename )
+{
+	Close();
+
+	if (!filename)	return false;
+
+	mFile = CreateFile( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (mFile == INVALID_HANDLE_VALUE)	return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx( mFile, &size ) && size.QuadPart > 0)
+	{
+		mSize = size.QuadPart;
+		mMapping = CreateFileMapping( mFile, NULL, PAGE_READONLY, 0, 0, NULL );
+
+		if (mMapping)
+		{
+			mData = (const unsigned char*) MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 );
+		}
+	}
+
+	if (!mData || !ReadIndex())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+// Unmap and close the archive
+void TrcArchiveReader::Close()
+{
+	if (mData)							UnmapViewOfFile( mData );
+	if (mMapping)						CloseHandle( mMapping );
+	if (mFile != INVALID_HANDLE_VALUE)	CloseHandle( mFile );
+
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = NULL;
+	mData = NULL;
+	mSize = 0;
+	mMarkers = 0;
+	mFrames = 0;
+	mMarkerList.Set( NULL );
+	mDirectory.clear();
+}
+
+// Is an archive open
+bool TrcArchiveReader::IsOpen() const
+{
+	return mData != NULL;
+}
+
+// Number of chunks in the archive
+int TrcArchiveReader::Chunks() const
+{
+	return (int) mDirectory.size();
+}
+
+// Total number of frames in the archive
+int TrcArchiveReader::Frames() const
+{
+	return mFrames;
+}
+
+// Number of markers per frame
+int TrcArchiveReader::Markers() const
+{
+	return mMarkers;
+}
+
+// Quantization step the archive was written with
+float TrcArchiveReader::Resolution() const
+{
+	return mResolution;
+}
+
+// Marker names stored in the archive header
+const MarkerListWrapper& TrcArchiveReader::MarkerList() const
+{
+	return mMarkerList;
+}
+
+// Frame number of the first frame in a chunk
+int TrcArchiveReader::ChunkFirstFrame( int chunk ) const
+{
+	return (chunk >= 0 && chunk < Chunks()) ? mDirectory[chunk].firstFrame : -1;
+}
+
+// Number of frames in a chunk
+int TrcArchiveReader::ChunkFrames( int chunk ) const
+{
+	return (chunk >= 0 && chunk < Chunks()) ? mDirectory[chunk].frames : 0;
+}
+
+// Decode one chunk, safe to call from several threads at once
+bool TrcArchiveReader::DecodeChunk( int chunk, ArchiveChunk& out ) const
+{
+	if (!mData || chunk < 0 || chunk >= Chunks())	return false;
+
+	const ChunkInfo& info = mDirectory[chunk];
+
+	if (info.offset < 0 || info.offset + kChunkHeaderSize > mSize)	return false;
+
+	const unsigned char* p = mData + info.offset;
+	int rows = Peek<int>( p + 4 );
+	unsigned int payload = Peek<unsigned int>( p + 8 );
+
+	p += kChunkHeaderSize;
+	if (rows != info.frames || rows <= 0 || (__int64) payload > mSize - info.offset - kChunkHeaderSize)
+	{
+		return false;
+	}
+
+	const unsigned char* end = p + payload;
+	__int64 v;
+	int i, row, axis;
+
+	out.Resize( rows, mMarkers );
+
+	DodDecoder frames;
+	for (row = 0; row < rows; row++)
+	{
+		if (!frames.Get( p, end, v ))	return false;
+		out.mFrames[row] = (int) v;
+	}
+
+	std::vector<unsigned char> visible( rows );
+
+	for (i = 0; i < mMarkers; i++)
+	{
+		unsigned __int64 nRuns, length;
+		unsigned char state = 1;
+
+		if (!GetVarint( p, end, nRuns ))	return false;
+
+		row = 0;
+		for (unsigned __int64 r = 0; r < nRuns; r++)
+		{
+			if (!GetVarint( p, end, length ) || length > (unsigned __int64) (rows - row))	return false;
+
+			memset( &visible[row], state, (size_t) length );
+			row += (int) length;
+			state = !state;
+		}
+		if (row != rows)	return false;
+
+		for (axis = 0; axis < 3; axis++)
+		{
+			float* column = &out.mColumns[ (i*3 + axis) * rows ];
+			DodDecoder decoder;
+
+			for (row = 0; row < rows; row++)
+			{
+				if (visible[row])
+				{
+					if (!decoder.Get( p, end, v ))	return false;
+					column[row] = (float) (v * (double) mResolution);
+				}
+				else
+				{
+					column[row] = XEMPTY;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// Decode every chunk, one chunk per work item
+bool TrcArchiveReader::DecodeAll( std::vector<ArchiveChunk>& out, WorkerPool* pool ) const
+{
+	int i, count = Chunks();
+
+	out.clear();
+	out.resize( count );
+
+	WorkerPool* localPool = NULL;
+	if (!pool)
+	{
+		pool = localPool = new WorkerPool();
+	}
+
+	std::vector<DecodeChunkItem> items( count );
+	for (i = 0; i < count; i++)
+	{
+		items[i].reader = this;
+		items[i].chunk = i;
+		items[i].out = &out[i];
+		items[i].ok = false;
+		pool->Submit( &items[i] );
+	}
+	pool->Wait();
+
+	delete localPool;
+
+	bool rc = true;
+	for (i = 0; i < count; i++)
+	{
+		rc = rc && items[i].ok;
+	}
+
+	return rc;
+}
+
+
+// Parse the header, trailer and chunk directory
+bool TrcArchiveReader::ReadIndex()
+{
+	if (mSize < 24 + kTrailerSize || memcmp( mData, kArchiveMagic, 4 ) != 0 || Peek<int>( mData + 4 ) != kArchiveVersion)
+	{
+		return false;
+	}
+
+	mMarkers = Peek<int>( mData + 8 );
+	mResolution = Peek<float>( mData + 16 );
+
+	int nameBytes = Peek<int>( mData + 20 );
+	if (mMarkers < 0 || nameBytes < 0 || 24 + (__int64) nameBytes > mSize)
+	{
+		return false;
+	}
+
+	// marker names
+	std::vector<char*> names;
+	std::vector<char> block( mData + 24, mData + 24 + nameBytes );
+	block.push_back( '\0' );
+
+	for (int pos = 0; pos < nameBytes && (int) names.size() < mMarkers; pos += (int) strlen( &block[pos] ) + 1)
+	{
+		names.push_back( &block[pos] );
+	}
+	if ((int) names.size() == mMarkers)
+	{
+		sMarkerList list;
+		list.nMarkers = mMarkers;
+		list.szMarkerNames = names.empty() ? NULL : &names[0];
+		mMarkerList.Set( &list );
+	}
+
+	// trailer and directory
+	const unsigned char* trailer = mData + mSize - kTrailerSize;
+	if (memcmp( trailer + 12, kTrailerMagic, 4 ) != 0)	return false;
+
+	int count = Peek<int>( trailer );
+	__int64 dirOffset = Peek<__int64>( trailer + 4 );
+
+	if (count < 0 || dirOffset < 0 || dirOffset + (__int64) count * kDirEntrySize + kTrailerSize != mSize)
+	{
+		return false;
+	}
+
+	mFrames = 0;
+	mDirectory.resize( count );
+	for (int i = 0; i < count; i++)
+	{
+		const unsigned char* e = mData + dirOffset + i * kDirEntrySize;
+
+		mDirectory[i].offset = Peek<__int64>( e );
+		mDirectory[i].firstFrame = Peek<int>( e + 8 );
+		mDirectory[i].frames = Peek<int>( e + 12 );
+		mFrames += mDirectory[i].frames;
+	}
+
+	return true;
+}
@@ -0,0 +1,172 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: arena.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the chunked record arena.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// every record starts with its size, records are kept 8 byte aligned
+static const unsigned long kHeaderSize = 8;
+
+static inline unsigned long AlignRecord( unsigned long size )
+{
+	return (size + 7) & ~7UL;
+}
+
+
+// Constructor
+ChunkArena::ChunkArena( unsigned long chunkSize )
+{
+	mChunkSize = chunkSize > 4*kHeaderSize ? chunkSize : 4*kHeaderSize;
+	mFirst = 0;
+	mRecords = 0;
+	mBytes = 0.0;
+}
+
+// Destructor
+ChunkArena::~ChunkArena()
+{
+	Release();
+}
+
+// Reserve space for a record of the given size at the end of the arena
+void* ChunkArena::Append( unsigned long size )
+{
+	unsigned long needed = kHeaderSize + AlignRecord( size );
+
+	// start a new chunk when the record doesn't fit in the current one,
+	// records larger than a chunk get a chunk of their own
+	if (mChunks.empty() || mChunks.back().size - mChunks.back().used < needed)
+	{
+		Chunk c;
+		c.size = needed > mChunkSize ? needed : mChunkSize;
+		c.used = 0;
+		c.data = (char*) malloc( c.size );
+
+		if (!c.data)	return NULL;
+
+		mChunks.push_back( c );
+		mBytes += c.size;
+	}
+
+	Chunk& c = mChunks.back();
+	char* record = c.data + c.used;
+
+	memcpy( record, &size, sizeof(size) );
+	c.used += needed;
+	mRecords++;
+
+	return record + kHeaderSize;
+}
+
+// Read the record at the cursor, returns false when there are no more records
+bool ChunkArena::Next( ArenaCursor& cursor, const void*& data, unsigned long& size ) const
+{
+	// the records of trimmed chunks are gone, carry on from the oldest one left
+	if (cursor.chunk < mFirst)
+	{
+		cursor.chunk = mFirst;
+		cursor.offset = 0;
+	}
+
+	while (cursor.chunk - mFirst < mChunks.size())
+	{
+		const Chunk& c = mChunks[cursor.chunk - mFirst];
+
+		if (cursor.offset < c.used)
+		{
+			const char* record = c.data + cursor.offset;
+
+			memcpy( &size, record, sizeof(size) );
+			data = record + kHeaderSize;
+			cursor.offset += kHeaderSize + AlignRecord( size );
+
+			return true;
+		}
+
+		// end of this chunk, move on only if a later chunk exists so the
+		// cursor stays valid for records appended after this call
+		if (cursor.chunk - mFirst + 1 >= mChunks.size())	break;
+
+		cursor.chunk++;
+		cursor.offset = 0;
+	}
+
+	return false;
+}
+
+// Free the chunks a reader has finished with, so a session that is drained
+// while it is still being recorded doesn't keep growing. The freed chunks are
+// removed from the list, which only ever holds the few chunks not yet read.
+void ChunkArena::Trim( const ArenaCursor& cursor )
+{
+	if (cursor.chunk <= mFirst)		return;
+
+	unsigned long count = cursor.chunk - mFirst;
+
+	if (count > mChunks.size())
+	{
+		count = (unsigned long) mChunks.size();
+	}
+
+	for (unsigned long i = 0; i < count; i++)
+	{
+		free( mChunks[i].data );
+		mBytes -= mChunks[i].size;
+	}
+
+	mChunks.erase( mChunks.begin(), mChunks.begin() + count );
+	mFirst += count;
+}
+
+// Free all of the chunks at once
+void ChunkArena::Release()
+{
+	for (unsigned long i = 0; i < mChunks.size(); i++)
+	{
+		free( mChunks[i].data );
+	}
+
+	mChunks.clear();
+	mFirst = 0;
+	mRecords = 0;
+	mBytes = 0.0;
+}
+
+// Number of records appended since the last Release()
+unsigned long ChunkArena::Records() const
+{
+	return mRecords;
+}
+
+// Number of chunks currently allocated
+unsigned long ChunkArena::Chunks() const
+{
+	return (unsigned long) mChunks.size();
+}
+
+// Number of bytes of chunk memory currently allocated
+double ChunkArena::Bytes() const
+{
+	return mBytes;
+}
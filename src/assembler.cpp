@@ -0,0 +1,360 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: assembler.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the frame assembler.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "assembler.h"
+#include <math.h>
+#include <string.h>
+#include <process.h>
+
+
+// Bit position of a single EVaRT data type, -1 if it is not one
+static int TypeIndex( int type )
+{
+	for (int i = 0; i < ASSEMBLER_TYPES; i++)
+	{
+		if (type == (1 << i))	return i;
+	}
+
+	return -1;
+}
+
+
+// A type's frame, NULL when it is missing
+const void* CompositeFrame::Part( int type ) const
+{
+	int index = TypeIndex( type );
+
+	return index >= 0 ? parts[index] : NULL;
+}
+
+
+// Constructor
+FrameAssembler::FrameAssembler()
+{
+	mTypes = 0;
+	mTimeout = ASSEMBLER_TIMEOUT;
+	mSink = NULL;
+	mEmitted = 0;
+	mAnyEmitted = false;
+	mEpoch = 0;
+
+	mComplete = 0;
+	mPartial = 0;
+	mLate = 0;
+	mOverflow = 0;
+	mRestarts = 0;
+	mWaitMax = 0.0;
+
+	for (int i = 0; i < ASSEMBLER_TYPES; i++)
+	{
+		mMissing[i] = 0;
+	}
+
+	for (int s = 0; s < ASSEMBLER_WINDOW; s++)
+	{
+		mWindow[s].frame = -1;
+		mWindow[s].epoch = 0;
+		mWindow[s].types = 0;
+		mWindow[s].first = 0.0;
+
+		for (int i = 0; i < ASSEMBLER_TYPES; i++)
+		{
+			mWindow[s].parts[i] = NULL;
+		}
+	}
+
+	InitializeCriticalSection( &mLock );
+	mReady = CreateEvent( NULL, FALSE, FALSE, NULL );
+	mStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+	mThread = NULL;
+}
+
+// Destructor
+FrameAssembler::~FrameAssembler()
+{
+	Stop();
+
+	CloseHandle( mStop );
+	CloseHandle( mReady );
+	DeleteCriticalSection( &mLock );
+}
+
+// Set aside room in every slot for the types of a complete frame, not while running
+void FrameAssembler::SetTypes( int types )
+{
+	if (mThread)	return;
+
+	int bytes = 0;
+	int i;
+
+	for (i = 0; i < ASSEMBLER_TYPES; i++)
+	{
+		if (types & (1 << i))	bytes += StreamSlotBytes( 1 << i );
+	}
+
+	mTypes = types & ((1 << ASSEMBLER_TYPES) - 1);
+	mMemory.assign( (size_t) bytes * ASSEMBLER_WINDOW, 0 );
+
+	char* next = mMemory.empty() ? NULL : &mMemory[0];
+
+	for (int s = 0; s < ASSEMBLER_WINDOW; s++)
+	{
+		mWindow[s].frame = -1;
+		mWindow[s].types = 0;
+
+		for (i = 0; i < ASSEMBLER_TYPES; i++)
+		{
+			mWindow[s].parts[i] = NULL;
+
+			if (mTypes & (1 << i))
+			{
+				mWindow[s].parts[i] = next;
+				next += StreamSlotBytes( 1 << i );
+			}
+		}
+	}
+}
+
+// How long a frame waits for its missing types after its first part arrived
+void FrameAssembler::SetTimeout( double seconds )
+{
+	mTimeout = seconds;
+}
+
+// Where the composite frames go
+void FrameAssembler::SetSink( CompositeSink* sink )
+{
+	mSink = sink;
+}
+
+// Start the thread that emits the frames
+bool FrameAssembler::Start()
+{
+	if (mThread)	return true;
+
+	mAnyEmitted = false;
+	mClock.Begin();
+	ResetEvent( mStop );
+	mThread = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, this, 0, NULL );
+
+	return mThread != NULL;
+}
+
+// Emit every frame still in the window, then stop the thread
+void FrameAssembler::Stop()
+{
+	if (!mThread)	return;
+
+	SetEvent( mStop );
+	WaitForSingleObject( mThread, INFINITE );
+	CloseHandle( mThread );
+	mThread = NULL;
+}
+
+// Copy a part into the slot of its frame
+bool FrameAssembler::Add( int type, const void* data )
+{
+	int index = TypeIndex( type );
+
+	if (index < 0 || !(mTypes & type))		return false;
+
+	int bytes = StreamFrameBytes( type, data );
+	int frame = *(const int*) data;
+	bool complete = false;
+
+	EnterCriticalSection( &mLock );
+
+	Slot& slot = mWindow[(frame % ASSEMBLER_WINDOW + ASSEMBLER_WINDOW) % ASSEMBLER_WINDOW];
+
+	// far behind the frames emitted, the frame numbers started over rather than the part being late
+	if (mAnyEmitted && frame < mEmitted - ASSEMBLER_WINDOW)
+	{
+		mEpoch++;
+		mRestarts++;
+		mAnyEmitted = false;
+	}
+
+	if (bytes < 0 || (mAnyEmitted && frame <= mEmitted))
+	{
+		mLate++;
+		LeaveCriticalSection( &mLock );
+		return false;
+	}
+
+	if (slot.frame != frame || slot.epoch != mEpoch)
+	{
+		// an older frame still holds the slot, the window is full
+		if (slot.frame != -1)
+		{
+			mOverflow++;
+			LeaveCriticalSection( &mLock );
+			return false;
+		}
+
+		slot.frame = frame;
+		slot.epoch = mEpoch;
+		slot.types = 0;
+		slot.first = mClock.Seconds();
+	}
+
+	memcpy( slot.parts[index], data, bytes );
+	slot.types |= type;
+	complete = (slot.types == mTypes);
+
+	LeaveCriticalSection( &mLock );
+
+	if (complete)	SetEvent( mReady );
+
+	return true;
+}
+
+// Data types of a complete frame
+int FrameAssembler::Types() const
+{
+	return mTypes;
+}
+
+// Frames emitted with every type
+unsigned long FrameAssembler::Complete() const
+{
+	return mComplete;
+}
+
+// Frames emitted with types missing
+unsigned long FrameAssembler::Partial() const
+{
+	return mPartial;
+}
+
+// Frames emitted without a type
+unsigned long FrameAssembler::Missing( int type ) const
+{
+	int index = TypeIndex( type );
+
+	return index >= 0 ? mMissing[index] : 0;
+}
+
+// Parts that arrived after their frame was emitted, or were too large
+unsigned long FrameAssembler::Late() const
+{
+	return mLate;
+}
+
+// Parts dropped because an older frame held their place in the window
+unsigned long FrameAssembler::Overflow() const
+{
+	return mOverflow;
+}
+
+// Times a part far behind the frames emitted showed that the frame numbers started over
+unsigned long FrameAssembler::Restarts() const
+{
+	return mRestarts;
+}
+
+// Longest a frame waited between its first part and being emitted, in seconds
+double FrameAssembler::WaitMax() const
+{
+	return mWaitMax;
+}
+
+// Thread entry point
+unsigned __stdcall FrameAssembler::ThreadProc( void* arg )
+{
+	((FrameAssembler*) arg)->Run();
+	return 0;
+}
+
+// Emit the oldest frame once it is complete or has waited long enough
+void FrameAssembler::Run()
+{
+	HANDLE events[2] = { mStop, mReady };
+	bool stopping = false;
+
+	while (true)
+	{
+		EnterCriticalSection( &mLock );
+
+		Slot* oldest = NULL;
+
+		for (int s = 0; s < ASSEMBLER_WINDOW; s++)
+		{
+			// frames from before a restart go first
+			if (mWindow[s].frame != -1 && (!oldest || mWindow[s].epoch < oldest->epoch ||
+				(mWindow[s].epoch == oldest->epoch && mWindow[s].frame < oldest->frame)))
+			{
+				oldest = &mWindow[s];
+			}
+		}
+
+		double now = mClock.Seconds();
+		double wait = oldest ? oldest->first + mTimeout - now : 0.0;
+
+		if (oldest && (oldest->types == mTypes || wait <= 0.0 || stopping))
+		{
+			CompositeFrame composite;
+
+			composite.frame = oldest->frame;
+			composite.types = oldest->types;
+			composite.missing = mTypes & ~oldest->types;
+			composite.wait = now - oldest->first;
+
+			for (int i = 0; i < ASSEMBLER_TYPES; i++)
+			{
+				composite.parts[i] = (oldest->types & (1 << i)) ? oldest->parts[i] : NULL;
+				if (composite.missing & (1 << i))	mMissing[i]++;
+			}
+
+			if (composite.missing)	mPartial++;
+			else					mComplete++;
+			if (composite.wait > mWaitMax)	mWaitMax = composite.wait;
+
+			// later parts of this frame, or of older ones, are too late from here on
+			if (oldest->epoch == mEpoch)
+			{
+				mEmitted = oldest->frame;
+				mAnyEmitted = true;
+			}
+
+			LeaveCriticalSection( &mLock );
+
+			if (mSink)	mSink->Consume( composite );
+
+			EnterCriticalSection( &mLock );
+			oldest->frame = -1;
+			LeaveCriticalSection( &mLock );
+			continue;
+		}
+
+		LeaveCriticalSection( &mLock );
+
+		if (stopping)	break;
+
+		DWORD ms = oldest ? (DWORD) ceil( wait * 1000.0 ) : INFINITE;
+
+		if (WaitForMultipleObjects( 2, events, FALSE, ms ) == WAIT_OBJECT_0)
+		{
+			stopping = true;
+		}
+	}
+}
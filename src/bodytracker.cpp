@@ -0,0 +1,194 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: bodytracker.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the multi-body tracker.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "bodytracker.h"
+
+
+// A contiguous range of bodies solved by one pool thread
+class BodyRange : public WorkItem
+{
+public:
+
+	BodyRange( BodyTracker& tracker ) : mTracker( tracker ), mFirst( 0 ), mLast( 0 ), mFrame( NULL ), mPacket( NULL ) {}
+
+	virtual void Run()		{ mTracker.SolveRange( mFirst, mLast, *mFrame, *mPacket ); }
+
+	BodyTracker&			mTracker;
+	int						mFirst;		// first body of the range
+	int						mLast;		// one past the last body
+	const TrcFrameWrapper*	mFrame;
+	PosePacket*				mPacket;
+
+private:
+
+	// not copyable
+	BodyRange( const BodyRange& );
+	BodyRange& operator = ( const BodyRange& );
+};
+
+
+// Constructor
+BodyTracker::BodyTracker( int parallelBodies, int numThreads )
+{
+	mPool = NULL;
+	mParallelBodies = parallelBodies > 1 ? parallelBodies : 2;
+	mThreads = numThreads > 0 ? numThreads : 1;
+}
+
+// Destructor
+BodyTracker::~BodyTracker()
+{
+	Clear();
+}
+
+// Set the number of bodies from which they are solved on the worker pool
+void BodyTracker::SetParallelBodies( int bodies )
+{
+	mParallelBodies = bodies > 1 ? bodies : 2;
+}
+
+// Set the bodies to track, starting the worker threads if there are enough bodies
+void BodyTracker::SetBodies( const std::vector<RigidBody>& bodies )
+{
+	Clear();
+
+	mBodies = bodies;
+
+	if ((int) mBodies.size() >= mParallelBodies)
+	{
+		// no point in more threads than processors, the caller takes one range itself
+		int threads = mThreads;
+
+		if (threads > WorkerPool::NumProcessors() - 1)	threads = WorkerPool::NumProcessors() - 1;
+
+		if (threads > 0)
+		{
+			mPool = new WorkerPool( threads );
+
+			for (int i = 0; i <= mPool->Size(); i++)
+			{
+				mRanges.push_back( new BodyRange( *this ) );
+			}
+		}
+	}
+}
+
+// Remove the bodies and stop the worker threads
+void BodyTracker::Clear()
+{
+	delete mPool;
+	mPool = NULL;
+
+	for (int i = 0; i < (int) mRanges.size(); i++)
+	{
+		delete mRanges[i];
+	}
+
+	mRanges.clear();
+	mBodies.clear();
+}
+
+// Resolve every body against the marker list, returns false if any body is missing markers
+bool BodyTracker::Resolve( const MarkerListWrapper& markers )
+{
+	bool rc = true;
+
+	for (int i = 0; i < (int) mBodies.size(); i++)
+	{
+		rc = mBodies[i].Resolve( markers ) && rc;
+	}
+
+	return rc;
+}
+
+// Number of bodies
+int BodyTracker::Bodies() const
+{
+	return (int) mBodies.size();
+}
+
+// Body i, in output order
+const RigidBody& BodyTracker::Body( int i ) const
+{
+	return mBodies[i];
+}
+
+// Are the bodies solved on the worker pool
+bool BodyTracker::IsParallel() const
+{
+	return mPool != NULL;
+}
+
+// Solve every body in a frame, the poses are in the order of the bodies
+void BodyTracker::Solve( const TrcFrameWrapper& frame, PosePacket& packet )
+{
+	int count = (int) mBodies.size();
+
+	packet.frame = frame.Frame();
+	packet.poses.resize( count );
+
+	if (!mPool)
+	{
+		SolveRange( 0, count, frame, packet );
+	}
+	else
+	{
+		// each range writes only its own slots of the packet and its own bodies
+		int ranges = (int) mRanges.size();
+		int first = 0;
+
+		for (int i = 0; i < ranges; i++)
+		{
+			BodyRange* range = mRanges[i];
+
+			range->mFirst = first;
+			range->mLast = first + (count - first) / (ranges - i);
+			range->mFrame = &frame;
+			range->mPacket = &packet;
+			first = range->mLast;
+
+			if (i < ranges - 1)
+			{
+				mPool->Submit( range );
+			}
+		}
+
+		mRanges[ranges - 1]->Run();
+		mPool->Wait();
+	}
+
+	packet.solved = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (packet.poses[i].status != kPoseNone)	packet.solved++;
+	}
+}
+
+// Solve bodies first to last-1 into their slots of the packet
+void BodyTracker::SolveRange( int first, int last, const TrcFrameWrapper& frame, PosePacket& packet )
+{
+	for (int i = first; i < last; i++)
+	{
+		mBodies[i].Solve( frame, packet.poses[i] );
+	}
+}
@@ -0,0 +1,214 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: bufferpool.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the block pool.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "bufferpool.h"
+#include <stdlib.h>
+
+// The pool for the whole program, a static object so it is constructed before
+// main() starts any thread. sSharedAlive is plain data, still valid after the
+// pool has been destroyed at exit.
+static volatile LONG sSharedAlive = 0;
+
+static struct SharedPool
+{
+	SharedPool()		{ InterlockedExchange( &sSharedAlive, 1 ); }
+	~SharedPool()		{ InterlockedExchange( &sSharedAlive, 0 ); }
+
+	BufferPool		pool;		// constructed before the flag is set, destroyed after it is cleared
+} sShared;
+
+
+// Constructor
+BufferPool::BufferPool()
+{
+	for (int i = 0; i < POOL_SIZES; i++)
+	{
+		mFree[i] = NULL;
+	}
+
+	mBytes = 0.0;
+	mPeakBytes = 0.0;
+	mInUse = 0;
+	mHeapCalls = 0;
+
+	InitializeCriticalSection( &mLock );
+}
+
+// Destructor
+BufferPool::~BufferPool()
+{
+	Trim();
+	DeleteCriticalSection( &mLock );
+}
+
+// A block of at least the given size, from the free list of its size if there is one
+void* BufferPool::Acquire( int bytes, int& capacity )
+{
+	int size = 0;
+	int sizeBytes = POOL_MIN_BLOCK;
+
+	while (size < POOL_SIZES && sizeBytes < bytes)
+	{
+		size++;
+		sizeBytes *= 2;
+	}
+
+	Header* block = NULL;
+
+	EnterCriticalSection( &mLock );
+
+	if (size < POOL_SIZES && mFree[size])
+	{
+		block = mFree[size];
+		mFree[size] = block->info.next;
+	}
+
+	mInUse++;
+
+	LeaveCriticalSection( &mLock );
+
+	if (!block)
+	{
+		if (size == POOL_SIZES)
+		{
+			sizeBytes = bytes;
+			size = -1;
+		}
+
+		block = (Header*) malloc( sizeof(Header) + sizeBytes );
+		if (!block)
+		{
+			EnterCriticalSection( &mLock );
+			mInUse--;
+			LeaveCriticalSection( &mLock );
+
+			capacity = 0;
+			return NULL;
+		}
+
+		block->info.size = size;
+		block->info.capacity = sizeBytes;
+
+		EnterCriticalSection( &mLock );
+		mHeapCalls++;
+		mBytes += sizeof(Header) + sizeBytes;
+		if (mBytes > mPeakBytes)	mPeakBytes = mBytes;
+		LeaveCriticalSection( &mLock );
+	}
+
+	block->info.next = NULL;
+	capacity = block->info.capacity;
+
+	return block + 1;
+}
+
+// Put a block back on the free list of its size
+void BufferPool::Release( void* data )
+{
+	if (!data)	return;
+
+	Header* block = (Header*) data - 1;
+
+	EnterCriticalSection( &mLock );
+
+	mInUse--;
+
+	if (block->info.size < 0)
+	{
+		mBytes -= sizeof(Header) + block->info.capacity;
+		LeaveCriticalSection( &mLock );
+
+		free( block );
+		return;
+	}
+
+	block->info.next = mFree[block->info.size];
+	mFree[block->info.size] = block;
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Free every block on the free lists, the blocks in use are not affected
+void BufferPool::Trim()
+{
+	EnterCriticalSection( &mLock );
+
+	for (int i = 0; i < POOL_SIZES; i++)
+	{
+		while (mFree[i])
+		{
+			Header* block = mFree[i];
+
+			mFree[i] = block->info.next;
+			mBytes -= sizeof(Header) + block->info.capacity;
+			free( block );
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Bytes taken from the heap and not yet freed, headers included
+double BufferPool::Bytes() const
+{
+	return mBytes;
+}
+
+// Most bytes ever taken from the heap at once
+double BufferPool::PeakBytes() const
+{
+	return mPeakBytes;
+}
+
+// Blocks handed out and not yet released
+long BufferPool::InUse() const
+{
+	return mInUse;
+}
+
+// Number of blocks allocated from the heap
+unsigned long BufferPool::HeapCalls() const
+{
+	return mHeapCalls;
+}
+
+// The pool for the whole program
+BufferPool& BufferPool::Shared()
+{
+	return sShared.pool;
+}
+
+// Give a block of the shared pool back, freeing it directly if the pool was destroyed before its owner
+void BufferPool::ReleaseShared( void* data )
+{
+	if (!data)	return;
+
+	if (sSharedAlive)
+	{
+		sShared.pool.Release( data );
+	}
+	else
+	{
+		free( (Header*) data - 1 );
+	}
+}
@@ -0,0 +1,525 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: c3d.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the C3D writer.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "c3d.h"
+#include <string.h>
+#include <math.h>
+
+static const int	kBlockSize		= 512;
+static const int	kParameterBlock	= 2;			// the parameter section follows the header block
+static const int	kIntelProcessor	= 84;
+static const float	kPointScale		= -1.0f;		// negative scale means floating point data
+static const size_t	kBufferFloats	= 256*1024;		// frames are written out in pieces of about 1 MB
+
+// C3D parameter data types
+static const int	kC3dChar	= -1;
+static const int	kC3dInt		= 2;
+static const int	kC3dFloat	= 4;
+
+// group numbers
+static const int	kPointGroup		= 1;
+static const int	kAnalogGroup	= 2;
+static const int	kTrialGroup		= 3;
+
+
+//
+// Builds the parameter section in memory
+//
+class C3dParameters
+{
+public:
+
+	C3dParameters() : mNext(0), mLast(0)
+	{
+		// reserved, key, block count (set by Finish), processor type
+		mBytes.push_back( 1 );
+		mBytes.push_back( 0x50 );
+		mBytes.push_back( 0 );
+		mBytes.push_back( kIntelProcessor );
+	}
+
+	void Group( int id, const char* name, const char* description )
+	{
+		Begin( -id, name );
+		End( description );
+	}
+
+	// add a parameter, returns the offset of its data inside the section
+	long Parameter( int group, const char* name, int type, const std::vector<int>& dims, const void* data, const char* description )
+	{
+		int count = 1;
+
+		Begin( group, name );
+		mBytes.push_back( (unsigned char)(signed char) type );
+		mBytes.push_back( (unsigned char) dims.size() );
+
+		for (int i = 0; i < (int) dims.size(); i++)
+		{
+			mBytes.push_back( (unsigned char) dims[i] );
+			count *= dims[i];
+		}
+
+		long offset = (long) mBytes.size();
+		const unsigned char* p = (const unsigned char*) data;
+
+		mBytes.insert( mBytes.end(), p, p + count * (type < 0 ? -type : type) );
+		End( description );
+
+		return offset;
+	}
+
+	long Integers( int group, const char* name, const std::vector<short>& values, const char* description )
+	{
+		std::vector<int> dims( 1, (int) values.size() );
+		return Parameter( group, name, kC3dInt, dims, values.empty() ? NULL : &values[0], description );
+	}
+
+	long Integer( int group, const char* name, short value, const char* description )
+	{
+		return Parameter( group, name, kC3dInt, std::vector<int>(), &value, description );
+	}
+
+	long Float( int group, const char* name, float value, const char* description )
+	{
+		return Parameter( group, name, kC3dFloat, std::vector<int>(), &value, description );
+	}
+
+	long Floats( int group, const char* name, const std::vector<float>& values, const char* description )
+	{
+		std::vector<int> dims( 1, (int) values.size() );
+		return Parameter( group, name, kC3dFloat, dims, values.empty() ? NULL : &values[0], description );
+	}
+
+	long String( int group, const char* name, const std::string& value, const char* description )
+	{
+		std::vector<int> dims( 1, (int) value.size() );
+		return Parameter( group, name, kC3dChar, dims, value.data(), description );
+	}
+
+	// a column of names padded to the same length
+	long Strings( int group, const char* name, const std::vector<std::string>& values, const char* description )
+	{
+		int width = 4;
+		std::string data;
+
+		for (int i = 0; i < (int) values.size(); i++)
+		{
+			if ((int) values[i].size() > width)	width = (int) values[i].size();
+		}
+		if (width > 255)	width = 255;
+
+		for (int i = 0; i < (int) values.size(); i++)
+		{
+			std::string s = values[i].substr( 0, width );
+			data += s + std::string( width - s.size(), ' ' );
+		}
+
+		std::vector<int> dims;
+		dims.push_back( width );
+		dims.push_back( (int) values.size() );
+
+		return Parameter( group, name, kC3dChar, dims, data.data(), description );
+	}
+
+	// end the list and pad the section to whole blocks, returns the block count
+	int Finish()
+	{
+		// a zero offset marks the last item
+		mBytes[mLast] = 0;
+		mBytes[mLast + 1] = 0;
+
+		int blocks = ((int) mBytes.size() + kBlockSize - 1) / kBlockSize;
+
+		mBytes.resize( blocks * kBlockSize, 0 );
+		mBytes[2] = (unsigned char) blocks;
+
+		return blocks;
+	}
+
+	const std::vector<unsigned char>& Bytes() const		{ return mBytes; }
+
+private:
+
+	std::vector<unsigned char>	mBytes;
+	size_t						mNext;		// position of the offset of the item being written
+	size_t						mLast;		// position of the offset of the last item written
+
+	void Begin( int id, const char* name )
+	{
+		size_t len = strlen( name );
+
+		mBytes.push_back( (unsigned char) len );
+		mBytes.push_back( (unsigned char)(signed char) id );
+		mBytes.insert( mBytes.end(), name, name + len );
+
+		mNext = mBytes.size();
+		mBytes.push_back( 0 );
+		mBytes.push_back( 0 );
+	}
+
+	void End( const char* description )
+	{
+		size_t len = strlen( description );
+
+		mBytes.push_back( (unsigned char) len );
+		mBytes.insert( mBytes.end(), description, description + len );
+
+		// offset from the offset field to the next item
+		unsigned short next = (unsigned short)(mBytes.size() - mNext);
+
+		memcpy( &mBytes[mNext], &next, 2 );
+		mLast = mNext;
+	}
+};
+
+
+// Constructor
+C3dWriter::C3dWriter()
+{
+	mFrameRate = 0.0f;
+	mUnits = "mm";
+	mFiles = 0;
+	mFile = NULL;
+	mMarkers = 0;
+	mChannels = 0;
+	mSamples = 0;
+	mFirstFrame = 0;
+	mLastFrame = 0;
+	mFrames = 0;
+	mPointFramesOffset = 0;
+	mLongFramesOffset = 0;
+	mStartFieldOffset = 0;
+	mEndFieldOffset = 0;
+}
+
+// Destructor
+C3dWriter::~C3dWriter()
+{
+	Close();
+}
+
+// Set the units of the marker positions written to POINT:UNITS
+void C3dWriter::SetPointUnits( const std::string& units )
+{
+	mUnits = units;
+}
+
+// Create the file and write the header and parameter sections
+bool C3dWriter::Open( const char* filename, const MarkerListWrapper& markers, float frameRate,
+					  const std::vector<std::string>& analogNames, int analogSamples )
+{
+	Close();
+
+	if (!filename || frameRate <= 0.0f || markers.Size() > 255 || analogNames.size() > 255)
+	{
+		return false;
+	}
+
+	mFileName = filename;
+	mFrameRate = frameRate;
+	mAnalogNames = analogNames;
+	mLabels.clear();
+	mFiles = 0;
+
+	for (int i = 0; i < markers.Size(); i++)
+	{
+		mLabels.push_back( markers.Name(i) );
+	}
+
+	mMarkers = markers.Size();
+	mChannels = analogSamples > 0 ? (int) analogNames.size() : 0;
+	mSamples = mChannels > 0 ? analogSamples : 0;
+
+	return Create( mFileName );
+}
+
+// Write the header and parameter sections of a new file with the settings of Open()
+bool C3dWriter::Create( const std::string& filename )
+{
+	const std::vector<std::string>& labels = mLabels;
+	const std::vector<std::string>& analogNames = mAnalogNames;
+	float frameRate = mFrameRate;
+
+	mFirstFrame = 0;
+	mLastFrame = 0;
+	mFrames = 0;
+	mBuffer.clear();
+	mBuffer.reserve( kBufferFloats + mMarkers * 4 + mChannels * mSamples );
+
+	// parameters, the frame counts are placeholders until Close()
+	C3dParameters params;
+	std::vector<short> field( 2, 0 );
+
+	params.Group( kPointGroup, "POINT", "3-D point parameters" );
+	params.Integer( kPointGroup, "USED", (short) mMarkers, "Number of points" );
+	mPointFramesOffset = params.Integer( kPointGroup, "FRAMES", 0, "Number of frames" );
+	mLongFramesOffset = params.Float( kPointGroup, "LONG_FRAMES", 0.0f, "Number of frames, not limited to 16 bits" );
+	long dataStartOffset = params.Integer( kPointGroup, "DATA_START", 0, "Number of the first block of 3-D and analog data" );
+	params.Float( kPointGroup, "SCALE", kPointScale, "3-D scale factor, negative for floating point" );
+	params.Float( kPointGroup, "RATE", frameRate, "3-D frame rate in Hz" );
+	params.Strings( kPointGroup, "LABELS", labels, "Point labels" );
+	params.Strings( kPointGroup, "DESCRIPTIONS", labels, "Point descriptions" );
+	params.String( kPointGroup, "UNITS", mUnits, "3-D units" );
+
+	std::vector<float> scale( mChannels, 1.0f );
+	std::vector<short> offset( mChannels, 0 );
+	std::vector<std::string> units( mChannels, "V" );
+
+	params.Group( kAnalogGroup, "ANALOG", "Analog data parameters" );
+	params.Integer( kAnalogGroup, "USED", (short) mChannels, "Number of analog channels" );
+	params.Float( kAnalogGroup, "RATE", frameRate * mSamples, "Analog sample rate in Hz" );
+	params.Float( kAnalogGroup, "GEN_SCALE", 1.0f, "Analog general scale factor" );
+	params.Floats( kAnalogGroup, "SCALE", scale, "Analog channel scale factors" );
+	params.Integers( kAnalogGroup, "OFFSET", offset, "Analog channel offsets" );
+	if (mChannels > 0)
+	{
+		params.Strings( kAnalogGroup, "LABELS", analogNames, "Analog labels" );
+		params.Strings( kAnalogGroup, "DESCRIPTIONS", analogNames, "Analog descriptions" );
+		params.Strings( kAnalogGroup, "UNITS", units, "Analog units" );
+	}
+
+	params.Group( kTrialGroup, "TRIAL", "Trial parameters" );
+	mStartFieldOffset = params.Integers( kTrialGroup, "ACTUAL_START_FIELD", field, "First frame number, low and high word" );
+	mEndFieldOffset = params.Integers( kTrialGroup, "ACTUAL_END_FIELD", field, "Last frame number, low and high word" );
+
+	int blocks = params.Finish();
+	short dataStart = (short)(kParameterBlock + blocks);
+
+	std::vector<unsigned char> section( params.Bytes() );
+	memcpy( &section[dataStartOffset], &dataStart, 2 );
+
+	mPointFramesOffset += kBlockSize;
+	mLongFramesOffset += kBlockSize;
+	mStartFieldOffset += kBlockSize;
+	mEndFieldOffset += kBlockSize;
+
+	// header block, 16 bit words; the frame range is filled in by Close()
+	unsigned char header[kBlockSize];
+	short points = (short) mMarkers;
+	short analog = (short)(mChannels * mSamples);
+	short samples = (short) mSamples;
+
+	memset( header, 0, sizeof(header) );
+	header[0] = kParameterBlock;
+	header[1] = 0x50;
+	memcpy( header + 2, &points, 2 );
+	memcpy( header + 4, &analog, 2 );
+	memcpy( header + 12, &kPointScale, 4 );
+	memcpy( header + 16, &dataStart, 2 );
+	memcpy( header + 18, &samples, 2 );
+	memcpy( header + 20, &frameRate, 4 );
+
+	mFile = fopen( filename.c_str(), "wb" );
+	if (!mFile)	return false;
+
+	mFiles++;
+
+	if (fwrite( header, 1, kBlockSize, mFile ) != kBlockSize ||
+		fwrite( &section[0], 1, section.size(), mFile ) != section.size())
+	{
+		fclose( mFile );
+		mFile = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// Append a frame, filling any frames skipped since the last one with invalid points
+bool C3dWriter::Add( const TrcFrameWrapper& frame, const short* analog )
+{
+	if (!mFile)	return false;
+
+	if (mFrames == 0)
+	{
+		mFirstFrame = frame.Frame();
+	}
+	else if (frame.Frame() < mLastFrame - CONTINUITY_RESTART)
+	{
+		// EVaRT started its frame numbers over, the file can't go back
+		if (!Restart())		return false;
+
+		mFirstFrame = frame.Frame();
+	}
+	else if (frame.Frame() <= mLastFrame)
+	{
+		return true;
+	}
+	else
+	{
+		for (int i = mLastFrame + 1; i < frame.Frame(); i++)
+		{
+			if (!WriteFrame( NULL, NULL ))	return false;
+		}
+	}
+
+	mLastFrame = frame.Frame();
+	return WriteFrame( &frame, analog );
+}
+
+// Append a frame with the samples of an analog frame, if it has as many as the file
+bool C3dWriter::Add( const TrcFrameWrapper& frame, const AnalogFrameWrapper& analog )
+{
+	bool fits = (analog.Samples() == mSamples && analog.Channels() == mChannels);
+
+	return Add( frame, fits ? analog.Data() : NULL );
+}
+
+// Write out the buffered frames and fill in the frame counts
+bool C3dWriter::Close()
+{
+	if (!mFile)	return false;
+
+	bool rc = Flush();
+
+	// pad the data section to a whole block
+	double bytes = (double) mFrames * (mMarkers*4 + mChannels*mSamples) * sizeof(float);
+	int pad = (kBlockSize - (int) fmod( bytes, kBlockSize )) % kBlockSize;
+
+	if (pad > 0)
+	{
+		std::vector<char> zeros( pad, 0 );
+		rc = rc && fwrite( &zeros[0], 1, pad, mFile ) == (size_t) pad;
+	}
+
+	// header words 4 and 5 and POINT:FRAMES only have 16 bits
+	int first = mFirstFrame + 1;
+	int last = mFirstFrame + (int) mFrames;
+	unsigned short first16 = (unsigned short)(first > 65535 ? 65535 : first);
+	unsigned short last16 = (unsigned short)(last > 65535 ? 65535 : last);
+	unsigned short frames16 = (unsigned short)(mFrames > 65535 ? 65535 : mFrames);
+	float longFrames = (float) mFrames;
+	unsigned short startField[2] = { (unsigned short)(first & 0xffff), (unsigned short)(first >> 16) };
+	unsigned short endField[2] = { (unsigned short)(last & 0xffff), (unsigned short)(last >> 16) };
+
+	rc = rc && Patch( 6, &first16, 2 ) &&
+			   Patch( 8, &last16, 2 ) &&
+			   Patch( mPointFramesOffset, &frames16, 2 ) &&
+			   Patch( mLongFramesOffset, &longFrames, 4 ) &&
+			   Patch( mStartFieldOffset, startField, 4 ) &&
+			   Patch( mEndFieldOffset, endField, 4 );
+
+	rc = (fclose( mFile ) == 0) && rc;
+
+	mFile = NULL;
+	mBuffer.clear();
+
+	return rc;
+}
+
+// Close the current file and go on in the next one, session_2.c3d after session.c3d
+bool C3dWriter::Restart()
+{
+	char suffix[16];
+	std::string::size_type dot = mFileName.find_last_of( '.' );
+	std::string::size_type slash = mFileName.find_last_of( "\\/" );
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		dot = mFileName.size();
+	}
+
+	sprintf( suffix, "_%d", mFiles + 1 );
+
+	bool rc = Close();
+
+	return Create( mFileName.substr( 0, dot ) + suffix + mFileName.substr( dot ) ) && rc;
+}
+
+// Is a file open
+bool C3dWriter::IsOpen() const
+{
+	return mFile != NULL;
+}
+
+// Number of frames written to the current file so far
+unsigned long C3dWriter::Frames() const
+{
+	return mFrames;
+}
+
+// Number of files written since Open()
+int C3dWriter::Files() const
+{
+	return mFiles;
+}
+
+
+// Add one frame record to the output buffer, a NULL frame is written as all invalid
+bool C3dWriter::WriteFrame( const TrcFrameWrapper* frame, const short* analog )
+{
+	Point3 pt;
+
+	for (int i = 0; i < mMarkers; i++)
+	{
+		if (frame && i < frame->Size())
+		{
+			frame->GetMarkerLocation( i, pt );
+		}
+		else
+		{
+			pt[0] = pt[1] = pt[2] = (float) XEMPTY;
+		}
+
+		// occluded markers are invalid points, residual -1
+		if (pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY)
+		{
+			mBuffer.push_back( 0.0f );
+			mBuffer.push_back( 0.0f );
+			mBuffer.push_back( 0.0f );
+			mBuffer.push_back( -1.0f );
+		}
+		else
+		{
+			mBuffer.push_back( pt[0] );
+			mBuffer.push_back( pt[1] );
+			mBuffer.push_back( pt[2] );
+			mBuffer.push_back( 0.0f );
+		}
+	}
+
+	for (int i = 0; i < mSamples * mChannels; i++)
+	{
+		mBuffer.push_back( analog ? (float) analog[i] : 0.0f );
+	}
+
+	mFrames++;
+
+	return mBuffer.size() < kBufferFloats || Flush();
+}
+
+// Write the buffered frames to the file
+bool C3dWriter::Flush()
+{
+	bool rc = mBuffer.empty() || fwrite( &mBuffer[0], sizeof(float), mBuffer.size(), mFile ) == mBuffer.size();
+
+	mBuffer.clear();
+
+	return rc;
+}
+
+// Overwrite a value written earlier
+bool C3dWriter::Patch( long offset, const void* data, size_t size )
+{
+	return fseek( mFile, offset, SEEK_SET ) == 0 && fwrite( data, 1, size, mFile ) == size;
+}
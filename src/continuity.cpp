@@ -0,0 +1,300 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: continuity.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of frame continuity tracking.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "continuity.h"
+
+
+// Constructor
+FrameContinuity::FrameContinuity()
+{
+	InitializeCriticalSection( &mLock );
+	Reset();
+}
+
+// Destructor
+FrameContinuity::~FrameContinuity()
+{
+	DeleteCriticalSection( &mLock );
+}
+
+// Forget every frame seen so far
+void FrameContinuity::Reset()
+{
+	EnterCriticalSection( &mLock );
+
+	mGaps.clear();
+	mEpochStart = 0;
+	mEpoch = 0;
+	mFirst = -1;
+	mLast = -1;
+	mStarted = false;
+
+	InterlockedExchange( &mReceived, 0 );
+	InterlockedExchange( &mMissing, 0 );
+	InterlockedExchange( &mDuplicates, 0 );
+	InterlockedExchange( &mOutOfOrder, 0 );
+	InterlockedExchange( &mDropped, 0 );
+	InterlockedExchange( &mRestarts, 0 );
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Check a frame number against the ones seen before
+void FrameContinuity::Add( int frame )
+{
+	EnterCriticalSection( &mLock );
+
+	InterlockedIncrement( &mReceived );
+
+	if (!mStarted)
+	{
+		mFirst = frame;
+		mLast = frame;
+		mStarted = true;
+	}
+	else if (frame > mLast)
+	{
+		// skipped ahead, everything in between is missing
+		if (frame > mLast + 1)
+		{
+			GapRange gap;
+
+			gap.epoch = mEpoch;
+			gap.first = mLast + 1;
+			gap.last = frame - 1;
+			mGaps.push_back( gap );
+
+			InterlockedExchangeAdd( &mMissing, frame - mLast - 1 );
+		}
+		mLast = frame;
+	}
+	else if (frame >= mFirst && FillGap( frame ))
+	{
+		// late, but inside a gap of this epoch
+		InterlockedIncrement( &mOutOfOrder );
+	}
+	else if (frame < mLast - CONTINUITY_RESTART)
+	{
+		// far behind the last frame and in no gap, EVaRT has started its frame numbers over
+		mEpoch++;
+		mEpochStart = (int) mGaps.size();
+		mFirst = frame;
+		mLast = frame;
+
+		InterlockedIncrement( &mRestarts );
+	}
+	else if (frame < mFirst)
+	{
+		// older than anything seen so far, the frames in between are missing
+		if (frame < mFirst - 1)
+		{
+			GapRange gap;
+
+			gap.epoch = mEpoch;
+			gap.first = frame + 1;
+			gap.last = mFirst - 1;
+			mGaps.insert( mGaps.begin() + mEpochStart, gap );
+
+			InterlockedExchangeAdd( &mMissing, mFirst - frame - 1 );
+		}
+		mFirst = frame;
+
+		InterlockedIncrement( &mOutOfOrder );
+	}
+	else
+	{
+		InterlockedIncrement( &mDuplicates );
+	}
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Count frames that arrived but could not be kept
+void FrameContinuity::AddDropped( long count )
+{
+	InterlockedExchangeAdd( &mDropped, count );
+}
+
+// Number of frames passed to Add()
+long FrameContinuity::Received() const
+{
+	return mReceived;
+}
+
+// Number of frame numbers skipped that have not arrived since
+long FrameContinuity::Missing() const
+{
+	return mMissing;
+}
+
+// Number of frames seen more than once
+long FrameContinuity::Duplicates() const
+{
+	return mDuplicates;
+}
+
+// Number of frames that arrived after a later frame
+long FrameContinuity::OutOfOrder() const
+{
+	return mOutOfOrder;
+}
+
+// Number of frames that arrived but were not kept
+long FrameContinuity::Dropped() const
+{
+	return mDropped;
+}
+
+// Number of times EVaRT started its frame numbers over
+long FrameContinuity::Restarts() const
+{
+	return mRestarts;
+}
+
+// Did every frame between the first and the last arrive and get kept
+bool FrameContinuity::IsComplete() const
+{
+	return mMissing == 0 && mDropped == 0;
+}
+
+// Lowest frame number seen
+int FrameContinuity::FirstFrame() const
+{
+	EnterCriticalSection( &mLock );
+	int frame = mFirst;
+	LeaveCriticalSection( &mLock );
+
+	return frame;
+}
+
+// Highest frame number seen
+int FrameContinuity::LastFrame() const
+{
+	EnterCriticalSection( &mLock );
+	int frame = mLast;
+	LeaveCriticalSection( &mLock );
+
+	return frame;
+}
+
+// Number of gap ranges
+int FrameContinuity::Gaps() const
+{
+	EnterCriticalSection( &mLock );
+	int gaps = (int) mGaps.size();
+	LeaveCriticalSection( &mLock );
+
+	return gaps;
+}
+
+// Get the range of frame numbers in gap i, returns false if there is no such gap
+bool FrameContinuity::GetGap( int i, int& first, int& last, int* epoch ) const
+{
+	bool rc = false;
+
+	EnterCriticalSection( &mLock );
+
+	if (i >= 0 && i < (int) mGaps.size())
+	{
+		first = mGaps[i].first;
+		last = mGaps[i].last;
+		if (epoch)	*epoch = mGaps[i].epoch;
+		rc = true;
+	}
+
+	LeaveCriticalSection( &mLock );
+
+	return rc;
+}
+
+// Write the counters followed by the gap ranges
+void FrameContinuity::Output( std::ostream& os ) const
+{
+	EnterCriticalSection( &mLock );
+
+	os << "RECEIVED,MISSING,DUPLICATE,OUT_OF_ORDER,DROPPED,FIRST,LAST,RESTARTS" << std::endl;
+	os << mReceived << "," << mMissing << "," << mDuplicates << "," << mOutOfOrder << "," <<
+		mDropped << "," << mFirst << "," << mLast << "," << mRestarts << std::endl;
+
+	os << "EPOCH,GAP_FIRST,GAP_LAST" << std::endl;
+	for (int i = 0; i < (int) mGaps.size(); i++)
+	{
+		os << mGaps[i].epoch << "," << mGaps[i].first << "," << mGaps[i].last << std::endl;
+	}
+
+	LeaveCriticalSection( &mLock );
+}
+
+
+// Take a frame at or before the last one out of the gap it falls in, false if it is in none
+// The lock must be held
+bool FrameContinuity::FillGap( int frame )
+{
+	// first gap of this epoch that doesn't end before the frame
+	int lo = mEpochStart;
+	int hi = (int) mGaps.size();
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if (mGaps[mid].last < frame)	lo = mid + 1;
+		else							hi = mid;
+	}
+
+	if (lo == (int) mGaps.size() || mGaps[lo].first > frame)
+	{
+		return false;
+	}
+
+	GapRange& gap = mGaps[lo];
+
+	if (gap.first == frame && gap.last == frame)
+	{
+		mGaps.erase( mGaps.begin() + lo );
+	}
+	else if (gap.first == frame)
+	{
+		gap.first++;
+	}
+	else if (gap.last == frame)
+	{
+		gap.last--;
+	}
+	else
+	{
+		// the frame splits the gap in two
+		GapRange after;
+
+		after.epoch = mEpoch;
+		after.first = frame + 1;
+		after.last = gap.last;
+		gap.last = frame - 1;
+
+		mGaps.insert( mGaps.begin() + lo + 1, after );
+	}
+
+	InterlockedDecrement( &mMissing );
+
+	return true;
+}
@@ -0,0 +1,412 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: decimator.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the analog decimator.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "decimator.h"
+#include "utils.h"
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+#define DECIMATOR_MIN_CAPACITY	64			// input samples a row has room for at first
+
+static const double kPi = 3.14159265358979;
+
+
+// Sum of the four lanes
+static inline float Sum( __m128 v )
+{
+	float f[4];
+
+	_mm_storeu_ps( f, v );
+	return f[0] + f[1] + f[2] + f[3];
+}
+
+// Four shorts as four floats. Converted one at a time, SSE has no integer
+// conversions of its own and the MMX ones would need _mm_empty() before the
+// floating point code around them.
+static inline __m128 LoadShorts( const short* p )
+{
+	return _mm_set_ps( (float) p[3], (float) p[2], (float) p[1], (float) p[0] );
+}
+
+
+// Constructor
+AnalogDecimator::AnalogDecimator()
+{
+	mFactor = 1;
+	mTaps = 1;
+	mPadded = 4;
+	mChannels = 0;
+	mCapacity = DECIMATOR_MIN_CAPACITY;
+	mBlock = NULL;
+	mDesign[0] = 1.0f;
+
+	Allocate( mCapacity );
+	Reset();
+}
+
+// Destructor
+AnalogDecimator::~AnalogDecimator()
+{
+	Free();
+}
+
+// Keep one sample in factor, behind a windowed-sinc low pass that ends the
+// passband at DECIMATOR_CUTOFF of the new Nyquist frequency
+bool AnalogDecimator::SetFactor( int factor )
+{
+	if (factor < 1 || factor * DECIMATOR_TAPS_PER_PHASE + 1 > DECIMATOR_MAX_TAPS)	return false;
+
+	if (factor == 1)
+	{
+		float one = 1.0f;
+		return SetCoefficients( &one, 1, 1 );
+	}
+
+	float taps[DECIMATOR_MAX_TAPS];
+	int count = factor * DECIMATOR_TAPS_PER_PHASE + 1;		// odd, so the delay is a whole sample
+	int m = count - 1;
+	double fc = DECIMATOR_CUTOFF * 0.5 / factor;			// cycles per input sample
+	double sum = 0.0;
+
+	for (int n = 0; n < count; n++)
+	{
+		double x = n - m / 2.0;
+		double sinc = (x == 0.0) ? 2.0 * fc : sin( 2.0 * kPi * fc * x ) / (kPi * x);
+		double blackman = 0.42 - 0.5 * cos( 2.0 * kPi * n / m ) + 0.08 * cos( 4.0 * kPi * n / m );
+
+		taps[n] = (float) (sinc * blackman);
+		sum += taps[n];
+	}
+
+	// unity gain for a constant input
+	for (int n = 0; n < count; n++)
+	{
+		taps[n] = (float) (taps[n] / sum);
+	}
+
+	return SetCoefficients( taps, count, factor );
+}
+
+// Use a filter of your own, taps[0] applies to the newest sample
+bool AnalogDecimator::SetCoefficients( const float* taps, int count, int factor )
+{
+	if (!taps || count < 1 || count > DECIMATOR_MAX_TAPS || factor < 1)	return false;
+
+	memcpy( mDesign, taps, count * sizeof(float) );
+	mTaps = count;
+	mPadded = (count + 3) & ~3;
+	mFactor = factor;
+
+	Allocate( mCapacity );
+	Reset();
+
+	return true;
+}
+
+// Set the number of channels, the stream starts over
+void AnalogDecimator::SetChannels( int count )
+{
+	mChannels = count > 0 ? count : 0;
+
+	Allocate( mCapacity );
+	Reset();
+}
+
+// Start the stream over, as if every earlier sample had been zero
+void AnalogDecimator::Reset()
+{
+	memset( mHistory, 0, mChannels * mRowStride * sizeof(float) );
+
+	mSkip = mFactor - 1;
+	mSamples = 0;
+	mCostTotal = 0.0;
+	mCostMax = 0.0;
+	mCalls = 0;
+	mChannelSamples = 0.0;
+	mSeconds = 0.0;
+}
+
+// Keep one sample in
+int AnalogDecimator::Factor() const
+{
+	return mFactor;
+}
+
+// Length of the filter
+int AnalogDecimator::Taps() const
+{
+	return mTaps;
+}
+
+// Number of channels
+int AnalogDecimator::Channels() const
+{
+	return mChannels;
+}
+
+// Delay of the outputs behind the inputs, in input samples
+double AnalogDecimator::Delay() const
+{
+	double weighted = 0.0;
+	double sum = 0.0;
+
+	// centre of the filter, half its length for the symmetric ones SetFactor() designs
+	for (int i = 0; i < mTaps; i++)
+	{
+		weighted += i * mDesign[i];
+		sum += mDesign[i];
+	}
+
+	return sum != 0.0 ? weighted / sum : 0.0;
+}
+
+// Number of outputs of the last Process()
+int AnalogDecimator::Samples() const
+{
+	return mSamples;
+}
+
+// Outputs of one channel from the last Process()
+const float* AnalogDecimator::Output( int channel ) const
+{
+	return (channel >= 0 && channel < mChannels) ? mOutput + channel * mOutStride : NULL;
+}
+
+// One output of one channel, 0 if out of range
+float AnalogDecimator::Value( int sample, int channel ) const
+{
+	float value = 0.0f;
+
+	if (sample >= 0 && sample < mSamples && channel >= 0 && channel < mChannels)
+	{
+		value = mOutput[channel * mOutStride + sample];
+	}
+
+	return value;
+}
+
+// Outputs of the last Process() with the channels of a sample side by side,
+// rounded and limited to the range of a short
+void AnalogDecimator::GetInterleaved( short* dst ) const
+{
+	for (int c = 0; c < mChannels; c++)
+	{
+		const float* out = mOutput + c * mOutStride;
+
+		for (int s = 0; s < mSamples; s++)
+		{
+			float v = out[s];
+
+			if (v > 32767.0f)	v = 32767.0f;
+			if (v < -32768.0f)	v = -32768.0f;
+
+			dst[s * mChannels + c] = (short) floor( v + 0.5f );
+		}
+	}
+}
+
+// Average processor time of Process(), microseconds
+double AnalogDecimator::CostAverage() const
+{
+	return mCalls > 0 ? mCostTotal / mCalls : 0.0;
+}
+
+// Processor time of the slowest Process(), microseconds
+double AnalogDecimator::CostMax() const
+{
+	return mCostMax;
+}
+
+// Channels times input samples filtered per second spent in Process()
+double AnalogDecimator::Throughput() const
+{
+	return mSeconds > 0.0 ? mChannelSamples / mSeconds : 0.0;
+}
+
+// Filter a block of samples, returns the number of outputs
+int AnalogDecimator::Process( const short* data, int samples )
+{
+	StopWatch watch;
+
+	if (samples <= 0 || !data)
+	{
+		mSamples = 0;
+		return 0;
+	}
+
+	if (samples > mCapacity)
+	{
+		Allocate( samples );
+	}
+
+	Convert( data, samples );
+
+	// positions of the kept samples among the new ones
+	int first = mSkip;
+	int count = (first < samples) ? (samples - 1 - first) / mFactor + 1 : 0;
+
+	mSkip = (count > 0) ? first + count * mFactor - samples : first - samples;
+	mSamples = count;
+
+	for (int c = 0; c < mChannels; c++)
+	{
+		float* row = mHistory + c * mRowStride;
+		float* out = mOutput + c * mOutStride;
+
+		for (int k = 0; k < count; k++)
+		{
+			// the window ends at the kept sample, at mPadded + its position in the row
+			const float* x = row + first + k * mFactor + 1;
+			__m128 acc = _mm_setzero_ps();
+
+			for (int j = 0; j < mPadded; j += 4)
+			{
+				acc = _mm_add_ps( acc, _mm_mul_ps( _mm_loadu_ps( x + j ), _mm_load_ps( mCoefficients + j ) ) );
+			}
+
+			out[k] = Sum( acc );
+		}
+
+		// the newest samples become the old ones of the next block
+		memmove( row, row + samples, mPadded * sizeof(float) );
+	}
+
+	double seconds = watch.Seconds();
+
+	mCostTotal += seconds * 1e6;
+	if (seconds * 1e6 > mCostMax)	mCostMax = seconds * 1e6;
+	mCalls++;
+	mChannelSamples += (double) mChannels * samples;
+	mSeconds += seconds;
+
+	return count;
+}
+
+// Make room for blocks of capacity samples, keeping the old samples of every row
+void AnalogDecimator::Allocate( int capacity )
+{
+	int rowStride = (mPadded + capacity + 3) & ~3;
+	int outStride = ((capacity + mFactor - 1) / mFactor + 1 + 3) & ~3;
+	int channels = mChannels > 0 ? mChannels : 1;
+	float* block = (float*) _aligned_malloc( (mPadded + channels * (rowStride + outStride)) * sizeof(float), 16 );
+
+	if (!block)		return;
+
+	float* coefficients = block;
+	float* history = coefficients + mPadded;
+	float* output = history + channels * rowStride;
+
+	// reversed and zero padded in front, so coefficient j meets sample j of a window
+	memset( coefficients, 0, mPadded * sizeof(float) );
+	for (int i = 0; i < mTaps; i++)
+	{
+		coefficients[mPadded - 1 - i] = mDesign[i];
+	}
+
+	// only Process() grows the rows, the filter and the channels are the same then
+	memset( history, 0, channels * rowStride * sizeof(float) );
+	if (mBlock && capacity > mCapacity)
+	{
+		for (int c = 0; c < mChannels; c++)
+		{
+			memcpy( history + c * rowStride, mHistory + c * mRowStride, mPadded * sizeof(float) );
+		}
+	}
+
+	Free();
+
+	mBlock = block;
+	mCoefficients = coefficients;
+	mHistory = history;
+	mOutput = output;
+	mCapacity = capacity;
+	mRowStride = rowStride;
+	mOutStride = outStride;
+}
+
+// Convert the new samples to floats behind the old ones of their channel's row
+void AnalogDecimator::Convert( const short* data, int samples )
+{
+	int channels4 = mChannels & ~3;
+	int samples4 = samples & ~3;
+	int c, s;
+
+	// blocks of four samples of four channels, turned so each channel's samples are in one register
+	for (c = 0; c < channels4; c += 4)
+	{
+		float* dst0 = mHistory + c * mRowStride + mPadded;
+		float* dst1 = dst0 + mRowStride;
+		float* dst2 = dst1 + mRowStride;
+		float* dst3 = dst2 + mRowStride;
+
+		for (s = 0; s < samples4; s += 4)
+		{
+			const short* src = data + s * mChannels + c;
+			__m128 r0 = LoadShorts( src );
+			__m128 r1 = LoadShorts( src + mChannels );
+			__m128 r2 = LoadShorts( src + 2 * mChannels );
+			__m128 r3 = LoadShorts( src + 3 * mChannels );
+
+			_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+
+			_mm_store_ps( dst0 + s, r0 );
+			_mm_store_ps( dst1 + s, r1 );
+			_mm_store_ps( dst2 + s, r2 );
+			_mm_store_ps( dst3 + s, r3 );
+		}
+
+		for (; s < samples; s++)
+		{
+			const short* src = data + s * mChannels + c;
+
+			dst0[s] = src[0];
+			dst1[s] = src[1];
+			dst2[s] = src[2];
+			dst3[s] = src[3];
+		}
+	}
+
+	// channels left over
+	for (; c < mChannels; c++)
+	{
+		float* dst = mHistory + c * mRowStride + mPadded;
+
+		for (s = 0; s < samples; s++)
+		{
+			dst[s] = data[s * mChannels + c];
+		}
+	}
+}
+
+// Free the block
+void AnalogDecimator::Free()
+{
+	if (mBlock)
+	{
+		_aligned_free( mBlock );
+	}
+
+	mBlock = NULL;
+}
@@ -0,0 +1,583 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: filter.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the SSE filter banks.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "filter.h"
+#include "mathutil.h"
+#include "utils.h"
+#include <malloc.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <xmmintrin.h>
+
+#define FILTER_ARRAYS		13			// float arrays carved from the block
+#define LATENCY_SMOOTHING	0.05		// weight of the newest frame in the lag estimate
+
+static const float kTwoPi = 6.2831853f;
+
+
+// a where mask is set, b elsewhere
+static inline __m128 Select( __m128 mask, __m128 a, __m128 b )
+{
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+// Sum of the four lanes
+static inline float Sum( __m128 v )
+{
+	float f[4];
+
+	_mm_storeu_ps( f, v );
+	return f[0] + f[1] + f[2] + f[3];
+}
+
+
+// Default parameters of a position or a rotation channel
+FilterParams::FilterParams( FilterQuantity quantity )
+{
+	bool rotation = (quantity == kFilterRotation);
+
+	minCutoff = rotation ? FILTER_ROT_MIN_CUTOFF : FILTER_MIN_CUTOFF;
+	beta = rotation ? FILTER_ROT_BETA : FILTER_BETA;
+	dCutoff = rotation ? FILTER_ROT_D_CUTOFF : FILTER_D_CUTOFF;
+	processNoise = rotation ? FILTER_ROT_PROCESS_NOISE : FILTER_PROCESS_NOISE;
+	measureNoise = rotation ? FILTER_ROT_MEASURE_NOISE : FILTER_MEASURE_NOISE;
+}
+
+
+// Constructor
+FilterBank::FilterBank()
+{
+	mType = kFilterOneEuro;
+	mRate = 120.0f;
+	mChannels = 0;
+	mPadded = 0;
+	mBlock = NULL;
+
+	SetChannels( 0 );
+}
+
+// Destructor
+FilterBank::~FilterBank()
+{
+	Free();
+}
+
+// Set the kind of filter, the state of every channel is lost
+void FilterBank::SetType( FilterType type )
+{
+	mType = type;
+	Reset();
+}
+
+// Set the frame rate the filters are tuned for
+void FilterBank::SetRate( float rate )
+{
+	if (rate > 0.0f)
+	{
+		mRate = rate;
+	}
+}
+
+// Set the number of channels, all with the default parameters
+void FilterBank::SetChannels( int count )
+{
+	Free();
+
+	mChannels = count > 0 ? count : 0;
+	mPadded = (mChannels + 3) & ~3;
+
+	// at least one group of four, so the arrays are never NULL
+	int stride = mPadded > 0 ? mPadded : 4;
+
+	mBlock = (float*) _aligned_malloc( FILTER_ARRAYS * stride * sizeof(float), 16 );
+
+	float** arrays[FILTER_ARRAYS] = { &mIn, &mX, &mD, &mPrev, &mValid, &mP00, &mP01, &mP11,
+		&mMinCutoff, &mBeta, &mDCutoff, &mQ, &mR };
+
+	for (int a = 0; a < FILTER_ARRAYS; a++)
+	{
+		*arrays[a] = mBlock + a * stride;
+	}
+
+	// the padding channels get valid parameters and stay empty
+	SetParams( 0, stride, FilterParams() );
+	Reset();
+}
+
+// Set the parameters of a range of channels
+void FilterBank::SetParams( int first, int count, const FilterParams& params )
+{
+	int stride = mPadded > 0 ? mPadded : 4;
+
+	for (int i = first; i < first + count && i < stride; i++)
+	{
+		if (i < 0)	continue;
+
+		mMinCutoff[i] = params.minCutoff;
+		mBeta[i] = params.beta;
+		mDCutoff[i] = params.dCutoff;
+		mQ[i] = params.processNoise;
+		mR[i] = params.measureNoise;
+	}
+}
+
+// Forget the state of every channel, each starts over from its next value
+void FilterBank::Reset()
+{
+	int stride = mPadded > 0 ? mPadded : 4;
+
+	for (int i = 0; i < stride; i++)
+	{
+		mIn[i] = (float) XEMPTY;
+		mX[i] = mD[i] = mPrev[i] = 0.0f;
+		mValid[i] = 0.0f;
+		mP00[i] = mP01[i] = mP11[i] = 0.0f;
+	}
+
+	mCostTotal = 0.0;
+	mCostMax = 0.0;
+	mFrames = 0;
+	mLatency = 0.0;
+}
+
+// Kind of filter
+FilterType FilterBank::Type() const
+{
+	return mType;
+}
+
+// Number of channels
+int FilterBank::Channels() const
+{
+	return mChannels;
+}
+
+// Average processor time per frame, microseconds
+double FilterBank::CostAverage() const
+{
+	return mFrames > 0 ? mCostTotal / mFrames : 0.0;
+}
+
+// Processor time of the slowest frame, microseconds
+double FilterBank::CostMax() const
+{
+	return mCostMax;
+}
+
+// Estimated lag of the output behind the input, milliseconds
+double FilterBank::Latency() const
+{
+	return mLatency * 1000.0;
+}
+
+// Filter one frame of every channel
+void FilterBank::Filter( const float* in, float* out )
+{
+	StopWatch watch;
+	float lagNum = 0.0f;		// sum of (input - output) * input speed
+	float lagDen = 0.0f;		// sum of input speed squared
+	int i;
+
+	if (mType == kFilterNone)
+	{
+		if (out != in)
+		{
+			memcpy( out, in, mChannels * sizeof(float) );
+		}
+		return;
+	}
+
+	memcpy( mIn, in, mChannels * sizeof(float) );
+
+	if (mType == kFilterKalman)
+	{
+		Kalman( lagNum, lagDen );
+	}
+	else
+	{
+		OneEuro( lagNum, lagDen );
+	}
+
+	// empty channels come out empty
+	for (i = 0; i < mChannels; i++)
+	{
+		out[i] = (mValid[i] != 0.0f) ? mX[i] : (float) XEMPTY;
+	}
+
+	// least squares fit of lag * speed = input - output
+	if (lagDen > 0.0f)
+	{
+		double lag = lagNum / lagDen;
+
+		mLatency = (mFrames == 0) ? lag : mLatency + LATENCY_SMOOTHING * (lag - mLatency);
+	}
+
+	double cost = watch.Microseconds();
+
+	mCostTotal += cost;
+	if (cost > mCostMax)	mCostMax = cost;
+	mFrames++;
+}
+
+// One-Euro filter, four channels at a time
+void FilterBank::OneEuro( float& lagNum, float& lagDen )
+{
+	const __m128 empty = _mm_set1_ps( (float) XEMPTY );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 rate = _mm_set1_ps( mRate );
+	const __m128 rateOver2Pi = _mm_set1_ps( mRate / kTwoPi );
+	__m128 num = zero;
+	__m128 den = zero;
+
+	for (int i = 0; i < mPadded; i += 4)
+	{
+		__m128 z = _mm_load_ps( mIn + i );
+		__m128 x = _mm_load_ps( mX + i );
+		__m128 d = _mm_load_ps( mD + i );
+		__m128 present = _mm_cmpneq_ps( z, empty );
+		__m128 running = _mm_and_ps( present, _mm_load_ps( mValid + i ) );
+
+		// smoothed speed, alpha = fc / (fc + rate / 2pi)
+		__m128 dc = _mm_load_ps( mDCutoff + i );
+		__m128 alphaD = _mm_div_ps( dc, _mm_add_ps( dc, rateOver2Pi ) );
+		__m128 speed = _mm_mul_ps( _mm_sub_ps( z, x ), rate );
+		__m128 d1 = _mm_add_ps( d, _mm_mul_ps( alphaD, _mm_sub_ps( speed, d ) ) );
+
+		// the cutoff rises with speed
+		__m128 fc = _mm_add_ps( _mm_load_ps( mMinCutoff + i ), _mm_mul_ps( _mm_load_ps( mBeta + i ), _mm_max_ps( d1, _mm_sub_ps( zero, d1 ) ) ) );
+		__m128 alpha = _mm_div_ps( fc, _mm_add_ps( fc, rateOver2Pi ) );
+		__m128 x1 = _mm_add_ps( x, _mm_mul_ps( alpha, _mm_sub_ps( z, x ) ) );
+
+		// a channel that just got a value starts there at rest
+		x1 = Select( running, x1, z );
+		d1 = Select( running, d1, zero );
+
+		__m128 s = _mm_and_ps( running, _mm_mul_ps( _mm_sub_ps( z, _mm_load_ps( mPrev + i ) ), rate ) );
+
+		num = _mm_add_ps( num, _mm_mul_ps( _mm_sub_ps( z, x1 ), s ) );
+		den = _mm_add_ps( den, _mm_mul_ps( s, s ) );
+
+		_mm_store_ps( mPrev + i, z );
+		_mm_store_ps( mX + i, Select( present, x1, x ) );
+		_mm_store_ps( mD + i, Select( present, d1, d ) );
+		_mm_store_ps( mValid + i, present );
+	}
+
+	lagNum = Sum( num );
+	lagDen = Sum( den );
+}
+
+// Constant-velocity Kalman filter, four channels at a time
+void FilterBank::Kalman( float& lagNum, float& lagDen )
+{
+	float dt = 1.0f / mRate;
+	const __m128 empty = _mm_set1_ps( (float) XEMPTY );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 vdt = _mm_set1_ps( dt );
+	const __m128 vdt2 = _mm_set1_ps( dt * dt / 2.0f );
+	const __m128 vdt3 = _mm_set1_ps( dt * dt * dt / 3.0f );
+	const __m128 rate = _mm_set1_ps( mRate );
+	const __m128 rate2 = _mm_set1_ps( mRate * mRate );
+	__m128 num = zero;
+	__m128 den = zero;
+
+	for (int i = 0; i < mPadded; i += 4)
+	{
+		__m128 z = _mm_load_ps( mIn + i );
+		__m128 p = _mm_load_ps( mX + i );
+		__m128 v = _mm_load_ps( mD + i );
+		__m128 p00 = _mm_load_ps( mP00 + i );
+		__m128 p01 = _mm_load_ps( mP01 + i );
+		__m128 p11 = _mm_load_ps( mP11 + i );
+		__m128 q = _mm_load_ps( mQ + i );
+		__m128 r = _mm_load_ps( mR + i );
+		__m128 present = _mm_cmpneq_ps( z, empty );
+		__m128 running = _mm_and_ps( present, _mm_load_ps( mValid + i ) );
+
+		// predict
+		__m128 pp = _mm_add_ps( p, _mm_mul_ps( v, vdt ) );
+		__m128 c00 = _mm_add_ps( _mm_add_ps( p00, _mm_mul_ps( vdt, _mm_add_ps( _mm_add_ps( p01, p01 ), _mm_mul_ps( vdt, p11 ) ) ) ), _mm_mul_ps( q, vdt3 ) );
+		__m128 c01 = _mm_add_ps( _mm_add_ps( p01, _mm_mul_ps( vdt, p11 ) ), _mm_mul_ps( q, vdt2 ) );
+		__m128 c11 = _mm_add_ps( p11, _mm_mul_ps( q, vdt ) );
+
+		// update
+		__m128 s = _mm_add_ps( c00, r );
+		__m128 k0 = _mm_div_ps( c00, s );
+		__m128 k1 = _mm_div_ps( c01, s );
+		__m128 y = _mm_sub_ps( z, pp );
+		__m128 p1 = _mm_add_ps( pp, _mm_mul_ps( k0, y ) );
+		__m128 v1 = _mm_add_ps( v, _mm_mul_ps( k1, y ) );
+		__m128 n11 = _mm_sub_ps( c11, _mm_mul_ps( k1, c01 ) );
+		__m128 n01 = _mm_mul_ps( c01, _mm_sub_ps( one, k0 ) );
+		__m128 n00 = _mm_mul_ps( c00, _mm_sub_ps( one, k0 ) );
+
+		// a channel that just got a value starts there at rest, with a wide velocity spread
+		p1 = Select( running, p1, z );
+		v1 = Select( running, v1, zero );
+		n00 = Select( running, n00, r );
+		n01 = Select( running, n01, zero );
+		n11 = Select( running, n11, _mm_mul_ps( r, rate2 ) );
+
+		__m128 ds = _mm_and_ps( running, _mm_mul_ps( _mm_sub_ps( z, _mm_load_ps( mPrev + i ) ), rate ) );
+
+		num = _mm_add_ps( num, _mm_mul_ps( _mm_sub_ps( z, p1 ), ds ) );
+		den = _mm_add_ps( den, _mm_mul_ps( ds, ds ) );
+
+		_mm_store_ps( mPrev + i, z );
+		_mm_store_ps( mX + i, Select( present, p1, p ) );
+		_mm_store_ps( mD + i, Select( present, v1, v ) );
+		_mm_store_ps( mP00 + i, Select( present, n00, p00 ) );
+		_mm_store_ps( mP01 + i, Select( present, n01, p01 ) );
+		_mm_store_ps( mP11 + i, Select( present, n11, p11 ) );
+		_mm_store_ps( mValid + i, present );
+	}
+
+	lagNum = Sum( num );
+	lagDen = Sum( den );
+}
+
+// Release the channel arrays
+void FilterBank::Free()
+{
+	if (mBlock)
+	{
+		_aligned_free( mBlock );
+		mBlock = NULL;
+	}
+}
+
+
+// Constructor
+FrameFilter::FrameFilter()
+{
+	mMarkers.SetChannels( 0 );
+	mBodies.SetChannels( 0 );
+}
+
+// Set the kind of filter for markers and bodies
+void FrameFilter::SetType( FilterType type )
+{
+	mMarkers.SetType( type );
+	mBodies.SetType( type );
+}
+
+// Set the frame rate
+void FrameFilter::SetRate( float rate )
+{
+	mMarkers.SetRate( rate );
+	mBodies.SetRate( rate );
+}
+
+// Set the parameters of every marker
+void FrameFilter::SetMarkerParams( const FilterParams& params )
+{
+	mMarkerParams = params;
+	mMarkers.SetParams( 0, mMarkers.Channels(), params );
+}
+
+// Set the number of bodies, each with the default parameters
+void FrameFilter::SetBodies( int count )
+{
+	mBodies.SetChannels( 7 * count );
+	mBodyData.resize( 7 * count );
+
+	for (int i = 0; i < count; i++)
+	{
+		SetBodyParams( i, FilterParams( kFilterPosition ), FilterParams( kFilterRotation ) );
+	}
+}
+
+// Set the parameters of one body's position and of its rotation
+void FrameFilter::SetBodyParams( int body, const FilterParams& position, const FilterParams& rotation )
+{
+	mBodies.SetParams( 7 * body, 3, position );
+	mBodies.SetParams( 7 * body + 3, 4, rotation );
+}
+
+// Read one line of parameters
+static bool ReadParams( std::istream& tokens, FilterParams& params )
+{
+	return !(tokens >> params.minCutoff >> params.beta >> params.dCutoff >> params.processNoise >> params.measureNoise).fail();
+}
+
+// Read the type and parameters, see filter.h for the file format. SetBodies() must have been called.
+bool FrameFilter::Load( const char* filename, const BodyTracker& tracker )
+{
+	std::ifstream is( filename );
+	std::string line;
+	std::string text;
+
+	if (!is.is_open())	return false;
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		text += line;
+		text += ' ';
+	}
+
+	std::istringstream tokens( text );
+	std::string key;
+	FilterType type = mMarkers.Type();
+	FilterParams markers = mMarkerParams;
+	std::vector<FilterParams> positions( tracker.Bodies(), FilterParams( kFilterPosition ) );
+	std::vector<FilterParams> rotations( tracker.Bodies(), FilterParams( kFilterRotation ) );
+	int body = -1;
+
+	while (tokens >> key)
+	{
+		if (key == "TYPE")
+		{
+			std::string name;
+
+			if (!(tokens >> name))		return false;
+
+			if (name == "oneeuro")		type = kFilterOneEuro;
+			else if (name == "kalman")	type = kFilterKalman;
+			else if (name == "off")		type = kFilterNone;
+			else						return false;
+		}
+		else if (key == "MARKERS")
+		{
+			if (!ReadParams( tokens, markers ))		return false;
+		}
+		else if (key == "BODY")
+		{
+			std::string name;
+
+			if (!(tokens >> name))		return false;
+
+			for (body = tracker.Bodies() - 1; body >= 0; body--)
+			{
+				if (tracker.Body( body ).Name() == name)	break;
+			}
+			if (body < 0)	return false;		// no such body
+		}
+		else if (key == "POSITION" || key == "ROTATION")
+		{
+			if (body < 0)	return false;		// parameters outside of a body
+
+			if (!ReadParams( tokens, key == "POSITION" ? positions[body] : rotations[body] ))	return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	SetType( type );
+	SetMarkerParams( markers );
+
+	for (int i = 0; i < tracker.Bodies() && 7 * i < mBodies.Channels(); i++)
+	{
+		SetBodyParams( i, positions[i], rotations[i] );
+	}
+
+	return true;
+}
+
+// Forget the state of all markers and bodies
+void FrameFilter::Reset()
+{
+	mMarkers.Reset();
+	mBodies.Reset();
+}
+
+// The marker bank
+const FilterBank& FrameFilter::Markers() const
+{
+	return mMarkers;
+}
+
+// The body bank
+const FilterBank& FrameFilter::Bodies() const
+{
+	return mBodies;
+}
+
+// Filter the markers of a frame in place
+void FrameFilter::Filter( TrcFrameWrapper& frame )
+{
+	int count = frame.Size() < MAX_MARKERS ? frame.Size() : MAX_MARKERS;
+	int i;
+
+	if (mMarkers.Type() == kFilterNone)		return;
+
+	// only allocates when the marker count changes
+	if (mMarkers.Channels() != 3 * count)
+	{
+		mMarkers.SetChannels( 3 * count );
+		mMarkers.SetParams( 0, 3 * count, mMarkerParams );
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		frame.GetMarkerLocation( i, mMarkerData + 3 * i );
+	}
+
+	mMarkers.Filter( mMarkerData, mMarkerData );
+
+	for (i = 0; i < count; i++)
+	{
+		frame.SetMarkerLocation( i, mMarkerData + 3 * i );
+	}
+}
+
+// Filter the poses of a packet in place, unsolved poses are left alone
+void FrameFilter::Filter( PosePacket& packet )
+{
+	int count = (int) packet.poses.size();
+	int i, k;
+
+	if (count == 0 || 7 * count != mBodies.Channels() || mBodies.Type() == kFilterNone)	return;
+
+	float* data = &mBodyData[0];
+
+	for (i = 0; i < count; i++)
+	{
+		const BodyPose& pose = packet.poses[i];
+
+		for (k = 0; k < 3; k++)		data[7*i + k] = (pose.status != kPoseNone) ? pose.position[k] : (float) XEMPTY;
+		for (k = 0; k < 4; k++)		data[7*i + 3 + k] = (pose.status != kPoseNone) ? pose.rotation[k] : (float) XEMPTY;
+	}
+
+	mBodies.Filter( data, data );
+
+	for (i = 0; i < count; i++)
+	{
+		BodyPose& pose = packet.poses[i];
+
+		if (pose.status == kPoseNone)	continue;
+
+		double q[4] = { data[7*i + 3], data[7*i + 4], data[7*i + 5], data[7*i + 6] };
+
+		QuatNormalize( q );
+
+		for (k = 0; k < 3; k++)		pose.position[k] = data[7*i + k];
+		for (k = 0; k < 4; k++)		pose.rotation[k] = (float) q[k];
+	}
+}
@@ -0,0 +1,432 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: forceplate.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the force plate computations.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "forceplate.h"
+#include "utils.h"
+#include <malloc.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <xmmintrin.h>
+
+#define FORCE_MIN_CAPACITY		32			// samples a row has room for at first
+
+static const char* kChannelNames[FORCE_CHANNELS] = { "COPx", "COPy", "COPz", "Fx", "Fy", "Fz", "Tz" };
+
+
+// a where mask is set, b elsewhere
+static inline __m128 Select( __m128 mask, __m128 a, __m128 b )
+{
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+// Row r of a 3x3 matrix times a vector of four samples
+static inline __m128 Row( const float r[3], __m128 x, __m128 y, __m128 z )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( r[0] ), x ), _mm_mul_ps( _mm_set1_ps( r[1] ), y ) ),
+		_mm_mul_ps( _mm_set1_ps( r[2] ), z ) );
+}
+
+
+// Identity calibration
+PlateCalibration::PlateCalibration()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		origin[i] = 0.0f;
+		for (int j = 0; j < 3; j++)
+		{
+			rotation[i][j] = (i == j) ? 1.0f : 0.0f;
+		}
+	}
+
+	forceScale = 1.0f;
+	momentScale = 1.0f;
+	zero[0] = zero[1] = zero[2] = zero[3] = 0.0f;
+	threshold = FORCE_THRESHOLD;
+}
+
+
+// Constructor
+ForcePlates::ForcePlates()
+{
+	mPlates = 0;
+	mSamples = 0;
+	mOutput = NULL;
+	mCostTotal = 0.0;
+	mCostMax = 0.0;
+	mFrames = 0;
+	mPlateSamples = 0.0;
+	mSeconds = 0.0;
+
+	Allocate( FORCE_MIN_CAPACITY );
+}
+
+// Destructor
+ForcePlates::~ForcePlates()
+{
+	if (mOutput)
+	{
+		_aligned_free( mOutput );
+	}
+}
+
+// Set the calibration of one plate, counted from 0
+void ForcePlates::SetCalibration( int plate, const PlateCalibration& calibration )
+{
+	if (plate >= 0 && plate < MAX_FORCE_PLATES)
+	{
+		mCalibration[plate] = calibration;
+	}
+}
+
+// Read plate calibrations, see forceplate.h for the file format
+bool ForcePlates::Load( const char* filename )
+{
+	std::ifstream is( filename );
+	std::string line;
+	std::string text;
+
+	if (!is.is_open())	return false;
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		text += line;
+		text += ' ';
+	}
+
+	std::istringstream tokens( text );
+	std::string key;
+	PlateCalibration plates[MAX_FORCE_PLATES];
+	PlateCalibration* plate = NULL;
+
+	while (tokens >> key)
+	{
+		if (key == "PLATE")
+		{
+			int number;
+
+			if (!(tokens >> number) || number < 1 || number > MAX_FORCE_PLATES)	return false;
+
+			plate = &plates[number - 1];
+			continue;
+		}
+
+		if (!plate)		return false;		// calibration outside of a plate
+
+		if (key == "ORIGIN")
+		{
+			if (!(tokens >> plate->origin[0] >> plate->origin[1] >> plate->origin[2]))		return false;
+		}
+		else if (key == "ROTATION")
+		{
+			for (int i = 0; i < 9; i++)
+			{
+				if (!(tokens >> plate->rotation[i / 3][i % 3]))		return false;
+			}
+		}
+		else if (key == "SCALE")
+		{
+			if (!(tokens >> plate->forceScale >> plate->momentScale))	return false;
+		}
+		else if (key == "ZERO")
+		{
+			if (!(tokens >> plate->zero[0] >> plate->zero[1] >> plate->zero[2] >> plate->zero[3]))	return false;
+		}
+		else if (key == "THRESHOLD")
+		{
+			if (!(tokens >> plate->threshold) || plate->threshold < 0.0f)	return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < MAX_FORCE_PLATES; i++)
+	{
+		mCalibration[i] = plates[i];
+	}
+
+	return true;
+}
+
+// Calibration of one plate, counted from 0
+const PlateCalibration& ForcePlates::Calibration( int plate ) const
+{
+	return mCalibration[(plate >= 0 && plate < MAX_FORCE_PLATES) ? plate : 0];
+}
+
+// Number of plates in the last frame
+int ForcePlates::Plates() const
+{
+	return mPlates;
+}
+
+// Number of samples in the last frame
+int ForcePlates::Samples() const
+{
+	return mSamples;
+}
+
+// Number of derived channels, those of every plate and then those of the resultant
+int ForcePlates::Channels() const
+{
+	return mPlates > 0 ? (mPlates + 1) * FORCE_CHANNELS : 0;
+}
+
+// Name of a derived channel, such as "Plate1 COPx" or "Total Fz"
+std::string ForcePlates::ChannelName( int channel ) const
+{
+	std::ostringstream name;
+
+	if (channel >= 0 && channel < Channels())
+	{
+		int plate = channel / FORCE_CHANNELS;
+
+		if (plate < mPlates)
+		{
+			name << "Plate" << plate + 1;
+		}
+		else
+		{
+			name << "Total";
+		}
+		name << " " << kChannelNames[channel % FORCE_CHANNELS];
+	}
+
+	return name.str();
+}
+
+// Values of a derived channel in the last frame
+const float* ForcePlates::Output( int channel ) const
+{
+	return (channel >= 0 && channel < Channels()) ? mOutput + channel * mStride : NULL;
+}
+
+// One value of a derived channel in the last frame
+float ForcePlates::Value( int sample, int channel ) const
+{
+	float value = (float) XEMPTY;
+
+	if (sample >= 0 && sample < mSamples && channel >= 0 && channel < Channels())
+	{
+		value = mOutput[channel * mStride + sample];
+	}
+
+	return value;
+}
+
+// Average processor time per frame, microseconds
+double ForcePlates::CostAverage() const
+{
+	return mFrames > 0 ? mCostTotal / mFrames : 0.0;
+}
+
+// Processor time of the slowest frame, microseconds
+double ForcePlates::CostMax() const
+{
+	return mCostMax;
+}
+
+// Plates times samples processed per second spent processing them
+double ForcePlates::Throughput() const
+{
+	return mSeconds > 0.0 ? mPlateSamples / mSeconds : 0.0;
+}
+
+// Compute the derived channels of every sample of a frame
+int ForcePlates::Process( const ForceFrameWrapper& frame )
+{
+	StopWatch watch;
+	const float* data = frame.Data();
+	int stride = frame.Plates() * FORCE_VALUES;
+	int s;
+
+	mPlates = frame.Plates() < MAX_FORCE_PLATES ? frame.Plates() : MAX_FORCE_PLATES;
+	mSamples = data ? frame.Samples() : 0;
+
+	if (mSamples == 0 || mPlates == 0)
+	{
+		mSamples = 0;
+		return 0;
+	}
+
+	if (mSamples > mCapacity)
+	{
+		Allocate( mSamples );
+	}
+
+	for (s = 0; s + 4 <= mSamples; s += 4)
+	{
+		Compute( data + s * stride, s, stride );
+	}
+
+	// the last few samples are copied out, followed by empty ones, so they go through the same code
+	if (s < mSamples)
+	{
+		float tail[4 * MAX_FORCE_PLATES * FORCE_VALUES];
+		int plateValues = mPlates * FORCE_VALUES;
+
+		memset( tail, 0, sizeof(tail) );
+		for (int k = 0; s + k < mSamples; k++)
+		{
+			memcpy( tail + k * plateValues, data + (s + k) * stride, plateValues * sizeof(float) );
+		}
+
+		Compute( tail, s, plateValues );
+	}
+
+	double seconds = watch.Seconds();
+
+	mCostTotal += seconds * 1e6;
+	if (seconds * 1e6 > mCostMax)	mCostMax = seconds * 1e6;
+	mFrames++;
+	mPlateSamples += (double) mPlates * mSamples;
+	mSeconds += seconds;
+
+	return mSamples;
+}
+
+// Make room for frames of capacity samples
+void ForcePlates::Allocate( int capacity )
+{
+	int stride = (capacity + 3) & ~3;
+	float* output = (float*) _aligned_malloc( (MAX_FORCE_PLATES + 1) * FORCE_CHANNELS * stride * sizeof(float), 16 );
+
+	if (!output)	return;
+
+	if (mOutput)
+	{
+		_aligned_free( mOutput );
+	}
+
+	mOutput = output;
+	mCapacity = capacity;
+	mStride = stride;
+}
+
+// Derived channels of four samples, starting at data, stride floats apart
+void ForcePlates::Compute( const float* data, int sample, int stride )
+{
+	const __m128 empty = _mm_set1_ps( (float) XEMPTY );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps( -0.0f );
+
+	// sums over the plates for the resultant
+	__m128 totalX = zero, totalY = zero, totalZ = zero;		// force of every plate
+	__m128 loadX = zero, loadY = zero;						// force of the loaded plates
+	__m128 weight = zero;									// their vertical force
+	__m128 momentX = zero, momentY = zero, momentZ = zero;	// their centers of pressure, times the weight
+	__m128 torque = zero;									// their free moments and moments about the origin
+	__m128 anyLoaded = zero;
+
+	for (int p = 0; p < mPlates; p++)
+	{
+		const PlateCalibration& cal = mCalibration[p];
+		const float* base = data + p * FORCE_VALUES;
+		float* out = mOutput + p * FORCE_CHANNELS * mStride + sample;
+
+		// X,Y,Z,fX and fX,fY,fZ,MZ of four samples, turned so each value has a register
+		__m128 x = _mm_loadu_ps( base );
+		__m128 y = _mm_loadu_ps( base + stride );
+		__m128 z = _mm_loadu_ps( base + 2 * stride );
+		__m128 unused = _mm_loadu_ps( base + 3 * stride );
+		__m128 fx = _mm_loadu_ps( base + 3 );
+		__m128 fy = _mm_loadu_ps( base + stride + 3 );
+		__m128 fz = _mm_loadu_ps( base + 2 * stride + 3 );
+		__m128 mz = _mm_loadu_ps( base + 3 * stride + 3 );
+
+		_MM_TRANSPOSE4_PS( x, y, z, unused );
+		_MM_TRANSPOSE4_PS( fx, fy, fz, mz );
+
+		// calibrated, still in plate axes
+		__m128 forceScale = _mm_set1_ps( cal.forceScale );
+
+		fx = _mm_mul_ps( _mm_sub_ps( fx, _mm_set1_ps( cal.zero[0] ) ), forceScale );
+		fy = _mm_mul_ps( _mm_sub_ps( fy, _mm_set1_ps( cal.zero[1] ) ), forceScale );
+		fz = _mm_mul_ps( _mm_sub_ps( fz, _mm_set1_ps( cal.zero[2] ) ), forceScale );
+		mz = _mm_mul_ps( _mm_sub_ps( mz, _mm_set1_ps( cal.zero[3] ) ), _mm_set1_ps( cal.momentScale ) );
+
+		__m128 loaded = _mm_cmpge_ps( _mm_andnot_ps( sign, fz ), _mm_set1_ps( cal.threshold ) );
+
+		// into the capture volume
+		__m128 forceX = Row( cal.rotation[0], fx, fy, fz );
+		__m128 forceY = Row( cal.rotation[1], fx, fy, fz );
+		__m128 forceZ = Row( cal.rotation[2], fx, fy, fz );
+		__m128 copX = _mm_add_ps( Row( cal.rotation[0], x, y, z ), _mm_set1_ps( cal.origin[0] ) );
+		__m128 copY = _mm_add_ps( Row( cal.rotation[1], x, y, z ), _mm_set1_ps( cal.origin[1] ) );
+		__m128 copZ = _mm_add_ps( Row( cal.rotation[2], x, y, z ), _mm_set1_ps( cal.origin[2] ) );
+		// the plate's own center of pressure from EVaRT, and its free moment if it is level
+		__m128 twist = _mm_and_ps( loaded, _mm_mul_ps( _mm_set1_ps( cal.rotation[2][2] ), mz ) );
+
+		_mm_store_ps( out + kCopX * mStride, Select( loaded, copX, empty ) );
+		_mm_store_ps( out + kCopY * mStride, Select( loaded, copY, empty ) );
+		_mm_store_ps( out + kCopZ * mStride, Select( loaded, copZ, empty ) );
+		_mm_store_ps( out + kResultX * mStride, forceX );
+		_mm_store_ps( out + kResultY * mStride, forceY );
+		_mm_store_ps( out + kResultZ * mStride, forceZ );
+		_mm_store_ps( out + kFreeMoment * mStride, twist );
+
+		totalX = _mm_add_ps( totalX, forceX );
+		totalY = _mm_add_ps( totalY, forceY );
+		totalZ = _mm_add_ps( totalZ, forceZ );
+
+		// an unloaded plate adds nothing to the center of pressure
+		__m128 w = _mm_and_ps( loaded, forceZ );
+		__m128 lx = _mm_and_ps( loaded, forceX );
+		__m128 ly = _mm_and_ps( loaded, forceY );
+		__m128 px = _mm_and_ps( loaded, copX );
+		__m128 py = _mm_and_ps( loaded, copY );
+		__m128 pz = _mm_and_ps( loaded, copZ );
+
+		loadX = _mm_add_ps( loadX, lx );
+		loadY = _mm_add_ps( loadY, ly );
+		weight = _mm_add_ps( weight, w );
+		momentX = _mm_add_ps( momentX, _mm_mul_ps( w, px ) );
+		momentY = _mm_add_ps( momentY, _mm_mul_ps( w, py ) );
+		momentZ = _mm_add_ps( momentZ, _mm_mul_ps( w, pz ) );
+		torque = _mm_add_ps( torque, _mm_add_ps( twist, _mm_sub_ps( _mm_mul_ps( px, ly ), _mm_mul_ps( py, lx ) ) ) );
+		anyLoaded = _mm_or_ps( anyLoaded, loaded );
+	}
+
+	// combined center of pressure, and the vertical moment about it
+	__m128 valid = _mm_and_ps( anyLoaded, _mm_cmpneq_ps( weight, zero ) );
+	__m128 inverse = _mm_div_ps( _mm_set1_ps( 1.0f ), Select( valid, weight, _mm_set1_ps( 1.0f ) ) );
+	__m128 copX = _mm_mul_ps( momentX, inverse );
+	__m128 copY = _mm_mul_ps( momentY, inverse );
+	__m128 copZ = _mm_mul_ps( momentZ, inverse );
+	__m128 twist = _mm_sub_ps( torque, _mm_sub_ps( _mm_mul_ps( copX, loadY ), _mm_mul_ps( copY, loadX ) ) );
+	float* out = mOutput + mPlates * FORCE_CHANNELS * mStride + sample;
+
+	_mm_store_ps( out + kCopX * mStride, Select( valid, copX, empty ) );
+	_mm_store_ps( out + kCopY * mStride, Select( valid, copY, empty ) );
+	_mm_store_ps( out + kCopZ * mStride, Select( valid, copZ, empty ) );
+	_mm_store_ps( out + kResultX * mStride, totalX );
+	_mm_store_ps( out + kResultY * mStride, totalY );
+	_mm_store_ps( out + kResultZ * mStride, totalZ );
+	_mm_store_ps( out + kFreeMoment * mStride, _mm_and_ps( valid, twist ) );
+}
@@ -0,0 +1,361 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: gapfill.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the live gap filler.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "gapfill.h"
+#include "mathutil.h"
+#include <fstream>
+#include <sstream>
+
+
+// Is any coordinate of a marker missing
+static bool IsEmpty( const Point3 pt )
+{
+	return pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY;
+}
+
+
+// Constructor
+GapFiller::GapFiller()
+{
+	mMethod = kFillAcceleration;
+	mMaxGap = FILL_MAX_GAP;
+	mDecay = FILL_DECAY;
+	mBodyFill = true;
+	mBodyMaxGap = FILL_BODY_MAX_GAP;
+	mBodyDecay = FILL_BODY_DECAY;
+	mMinConfidence = FILL_MIN_CONFIDENCE;
+
+	Reset();
+}
+
+// Set how markers are continued from their own track
+void GapFiller::SetExtrapolation( FillMethod method, int maxGap, float decay )
+{
+	mMethod = method;
+	mMaxGap = maxGap > 0 ? maxGap : 0;
+	mDecay = decay;
+}
+
+// Set whether markers are filled from the rigid bodies they belong to
+void GapFiller::SetBodyFill( bool enable, int maxGap, float decay )
+{
+	mBodyFill = enable;
+	mBodyMaxGap = maxGap > 0 ? maxGap : 0;
+	mBodyDecay = decay;
+}
+
+// Set the lowest confidence a filled marker may have
+void GapFiller::SetMinConfidence( float confidence )
+{
+	mMinConfidence = confidence;
+}
+
+// Read the limits, see gapfill.h for the file format
+bool GapFiller::Load( const char* filename )
+{
+	std::ifstream is( filename );
+	std::string line;
+	std::string text;
+
+	if (!is.is_open())	return false;
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		text += line;
+		text += ' ';
+	}
+
+	std::istringstream tokens( text );
+	std::string key;
+	FillMethod method = mMethod;
+	int maxGap = mMaxGap;
+	float decay = mDecay;
+	bool bodyFill = mBodyFill;
+	int bodyMaxGap = mBodyMaxGap;
+	float bodyDecay = mBodyDecay;
+	float minConfidence = mMinConfidence;
+
+	while (tokens >> key)
+	{
+		if (key == "EXTRAPOLATE")
+		{
+			std::string name;
+
+			if (!(tokens >> name >> maxGap >> decay))	return false;
+
+			if (name == "none")					method = kFillNone;
+			else if (name == "velocity")		method = kFillVelocity;
+			else if (name == "acceleration")	method = kFillAcceleration;
+			else								return false;
+		}
+		else if (key == "BODY")
+		{
+			std::string name;
+
+			if (!(tokens >> name >> bodyMaxGap >> bodyDecay))	return false;
+
+			if (name == "on")			bodyFill = true;
+			else if (name == "off")		bodyFill = false;
+			else						return false;
+		}
+		else if (key == "CONFIDENCE")
+		{
+			if (!(tokens >> minConfidence))		return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	SetExtrapolation( method, maxGap, decay );
+	SetBodyFill( bodyFill, bodyMaxGap, bodyDecay );
+	SetMinConfidence( minConfidence );
+
+	return true;
+}
+
+// Forget the history of every marker
+void GapFiller::Reset()
+{
+	for (int i = 0; i < MAX_MARKERS; i++)
+	{
+		Track& t = mTracks[i];
+
+		t.count = 0;
+		t.frame = 0;
+		t.confidence = 0.0f;
+		t.measured = 0;
+		t.status = kMarkerEmpty;
+		t.lastConfidence = 0.0f;
+	}
+
+	mCount = 0;
+	mFilled = 0;
+	mEmpty = 0;
+}
+
+// Where marker i of the last frame came from
+FillStatus GapFiller::Status( int i ) const
+{
+	return (i >= 0 && i < mCount) ? mTracks[i].status : kMarkerEmpty;
+}
+
+// Confidence of marker i of the last frame
+float GapFiller::Confidence( int i ) const
+{
+	return (i >= 0 && i < mCount) ? mTracks[i].lastConfidence : 0.0f;
+}
+
+// Number of markers filled in the last frame
+int GapFiller::Filled() const
+{
+	return mFilled;
+}
+
+// Number of markers left empty in the last frame
+int GapFiller::Empty() const
+{
+	return mEmpty;
+}
+
+// Fill the missing markers of a frame in place
+void GapFiller::Fill( TrcFrameWrapper& frame, const BodyTracker* tracker, const PosePacket* packet )
+{
+	int frameNo = frame.Frame();
+	Point3 pt;
+	int i;
+
+	mCount = frame.Size() < MAX_MARKERS ? frame.Size() : MAX_MARKERS;
+	mFilled = 0;
+	mEmpty = 0;
+
+	// measured markers extend their tracks
+	for (i = 0; i < mCount; i++)
+	{
+		Track& t = mTracks[i];
+
+		frame.GetMarkerLocation( i, pt );
+
+		if (IsEmpty( pt ))
+		{
+			t.status = kMarkerEmpty;
+			t.lastConfidence = 0.0f;
+			continue;
+		}
+
+		Push( t, frameNo, pt, 1.0f );
+		t.measured = frameNo;
+		t.status = kMarkerMeasured;
+		t.lastConfidence = 1.0f;
+	}
+
+	if (mBodyFill && tracker && packet)
+	{
+		FillFromBodies( frame, *tracker, *packet );
+	}
+
+	// what is still missing is continued from its own track
+	for (i = 0; i < mCount; i++)
+	{
+		Track& t = mTracks[i];
+
+		if (t.status != kMarkerEmpty)	continue;
+
+		if (mMethod != kFillNone && frameNo - t.measured <= mMaxGap && Extrapolate( t, frameNo, pt ))
+		{
+			float confidence = t.confidence * (float) pow( mDecay, frameNo - t.frame );
+
+			if (confidence >= mMinConfidence)
+			{
+				frame.SetMarkerLocation( i, pt );
+				t.status = kMarkerExtrapolated;
+				t.lastConfidence = confidence;
+				mFilled++;
+				continue;
+			}
+		}
+
+		mEmpty++;
+	}
+}
+
+// Add a position to a marker's track, restarting the track if a frame was skipped
+void GapFiller::Push( Track& t, int frame, const Point3 pos, float confidence )
+{
+	if (t.count > 0 && frame == t.frame + 1)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			t.pos[2][k] = t.pos[1][k];
+			t.pos[1][k] = t.pos[0][k];
+		}
+		if (t.count < 3)	t.count++;
+	}
+	else
+	{
+		t.count = 1;
+	}
+
+	t.pos[0][0] = pos[0];
+	t.pos[0][1] = pos[1];
+	t.pos[0][2] = pos[2];
+	t.frame = frame;
+	t.confidence = confidence;
+}
+
+// Carry the reference position of missing markers through the pose of fully solved bodies
+void GapFiller::FillFromBodies( TrcFrameWrapper& frame, const BodyTracker& tracker, const PosePacket& packet )
+{
+	int frameNo = frame.Frame();
+	int bodies = tracker.Bodies() < (int) packet.poses.size() ? tracker.Bodies() : (int) packet.poses.size();
+
+	for (int b = 0; b < bodies; b++)
+	{
+		const BodyPose& pose = packet.poses[b];
+		const RigidBody& body = tracker.Body( b );
+
+		// a partial pose reuses an old rotation, not good enough to place markers
+		if (pose.status != kPoseSolved || pose.frame != frameNo)	continue;
+
+		double q[4] = { pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3] };
+		double m[3][3];
+
+		QuatToMatrix( q, m );
+
+		for (int j = 0; j < body.Markers(); j++)
+		{
+			int i = body.MarkerIndex( j );
+
+			if (i < 0 || i >= mCount)	continue;
+
+			Track& t = mTracks[i];
+
+			// already measured, or filled from another body
+			if (t.status != kMarkerEmpty || frameNo - t.measured > mBodyMaxGap)	continue;
+
+			float confidence = (t.count > 0 && frameNo > t.frame) ?
+				t.confidence * (float) pow( mBodyDecay, frameNo - t.frame ) : mBodyDecay;
+
+			if (confidence < mMinConfidence)	continue;
+
+			double ref[3];
+			Point3 pt;
+
+			body.GetReference( j, ref );
+			for (int k = 0; k < 3; k++)
+			{
+				pt[k] = (float) (m[k][0]*ref[0] + m[k][1]*ref[1] + m[k][2]*ref[2] + pose.position[k]);
+			}
+
+			frame.SetMarkerLocation( i, pt );
+			Push( t, frameNo, pt, confidence );
+			t.status = kMarkerFromBody;
+			t.lastConfidence = confidence;
+			mFilled++;
+		}
+	}
+}
+
+// Continue a marker's track to a frame, false if the track is too short
+bool GapFiller::Extrapolate( const Track& t, int frame, Point3 pos ) const
+{
+	int gap = frame - t.frame;
+
+	if (gap <= 0 || t.count < 2)	return false;
+
+	for (int k = 0; k < 3; k++)
+	{
+		double v = t.pos[0][k] - t.pos[1][k];
+		double p = t.pos[0][k] + v * gap;
+
+		if (mMethod == kFillAcceleration && t.count >= 3)
+		{
+			double a = t.pos[0][k] - 2.0 * t.pos[1][k] + t.pos[2][k];
+
+			p += 0.5 * a * gap * (gap + 1);
+		}
+
+		pos[k] = (float) p;
+	}
+
+	return true;
+}
+
+
+// Short name of a fill status, for printing
+const char* FillStatusName( FillStatus status )
+{
+	switch (status)
+	{
+	case kMarkerMeasured:		return "measured";
+	case kMarkerEmpty:			return "empty";
+	case kMarkerFromBody:		return "body";
+	case kMarkerExtrapolated:	return "extrapolated";
+	}
+
+	return "unknown";
+}
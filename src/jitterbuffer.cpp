@@ -0,0 +1,423 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: jitterbuffer.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the adaptive jitter buffer.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "jitterbuffer.h"
+#include "precisetimer.h"
+#include <math.h>
+#include <process.h>
+
+#define JITTER_MAX_DELAY	0.1			// default upper limit of the playout delay, seconds
+#define CLOCK_DRIFT			0.001		// how fast the frame clock follows later arrivals
+
+
+// Constructor
+JitterBuffer::JitterBuffer()
+{
+	mSink = NULL;
+	mStreams = 0;
+	mCaptureRate = 0.0;
+	mPercentile = JITTER_PERCENTILE;
+	mMaxDelay = JITTER_MAX_DELAY;
+	mFirst = 0;
+	mCount = 0;
+	mLastReleased = 0;
+	mReleasedAny = false;
+	mOffset = 0.0;
+	mHaveOffset = false;
+	mDelay = 0.0;
+	mWindowNext = 0;
+	mWindowCount = 0;
+	mLastArrival = 0.0;
+	mArrivalMean = 0.0;
+	mArrivalVar = 0.0;
+	mArrivals = 0;
+	mThread = NULL;
+	mReleased = 0;
+	mLate = 0;
+	mDropped = 0;
+
+	for (int i = 0; i < JITTER_BINS; i++)
+	{
+		mHistogram[i] = 0;
+	}
+
+	InitializeCriticalSection( &mLock );
+	mStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+	mArrived = CreateEvent( NULL, FALSE, FALSE, NULL );
+}
+
+// Destructor
+JitterBuffer::~JitterBuffer()
+{
+	Stop();
+
+	CloseHandle( mArrived );
+	CloseHandle( mStop );
+	DeleteCriticalSection( &mLock );
+}
+
+// Set the receiver of the released frames
+void JitterBuffer::SetSink( OutputSink* sink )
+{
+	mSink = sink;
+}
+
+// Size the buffer for a number of streams of packets with a number of poses
+void JitterBuffer::SetLayout( int streams, int bodies )
+{
+	EnterCriticalSection( &mLock );
+
+	mStreams = streams > 0 ? streams : 0;
+
+	for (int i = 0; i < JITTER_CAPACITY; i++)
+	{
+		mQueue[i].packets.resize( mStreams );
+
+		for (int s = 0; s < mStreams; s++)
+		{
+			mQueue[i].packets[s].poses.resize( bodies > 0 ? bodies : 0 );
+		}
+	}
+
+	mOut = mQueue[0].packets;
+	mCount = 0;
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Set the capture rate, which gives each frame its capture time
+void JitterBuffer::SetCaptureRate( double rate )
+{
+	EnterCriticalSection( &mLock );
+
+	mCaptureRate = rate > 0.0 ? rate : 0.0;
+	mHaveOffset = false;
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Set the share of frames that should arrive before their playout time
+void JitterBuffer::SetPercentile( double percentile )
+{
+	mPercentile = percentile < 0.0 ? 0.0 : (percentile > 1.0 ? 1.0 : percentile);
+}
+
+// Set the upper limit of the playout delay
+void JitterBuffer::SetMaxDelay( double seconds )
+{
+	mMaxDelay = seconds > 0.0 ? seconds : 0.0;
+}
+
+// Start the release thread
+bool JitterBuffer::Start()
+{
+	if (mThread)	return true;
+
+	ResetEvent( mStop );
+	mReleased = 0;
+	mLate = 0;
+	mDropped = 0;
+
+	mThread = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, this, 0, NULL );
+
+	return mThread != NULL;
+}
+
+// Stop the release thread, frames still waiting are not sent
+void JitterBuffer::Stop()
+{
+	if (!mThread)	return;
+
+	SetEvent( mStop );
+	WaitForSingleObject( mThread, INFINITE );
+	CloseHandle( mThread );
+	mThread = NULL;
+}
+
+// Is the release thread running
+bool JitterBuffer::IsRunning() const
+{
+	return mThread != NULL;
+}
+
+// Current playout delay
+double JitterBuffer::Delay() const
+{
+	return mDelay;
+}
+
+// Mean time between arrivals
+double JitterBuffer::ArrivalMean() const
+{
+	return mArrivalMean;
+}
+
+// Standard deviation of the time between arrivals
+double JitterBuffer::ArrivalSpread() const
+{
+	return sqrt( mArrivalVar );
+}
+
+// Number of frames sent
+unsigned long JitterBuffer::Released() const
+{
+	return mReleased;
+}
+
+// Number of frames sent after their playout time
+unsigned long JitterBuffer::Late() const
+{
+	return mLate;
+}
+
+// Number of frames that were not sent
+unsigned long JitterBuffer::Dropped() const
+{
+	return mDropped;
+}
+
+// Queue the packets of a new frame until its playout time
+void JitterBuffer::Add( const PosePacket* packets )
+{
+	double now = mClock.Seconds();
+	int frame = packets[0].frame;
+	int s;
+
+	EnterCriticalSection( &mLock );
+
+	if (mStreams == 0)
+	{
+		LeaveCriticalSection( &mLock );
+		return;
+	}
+
+	// spacing of the arrivals, averaged over about a window of frames
+	if (mArrivals > 0)
+	{
+		double gap = now - mLastArrival;
+		double w = mArrivals < JITTER_WINDOW ? 1.0 / mArrivals : 1.0 / JITTER_WINDOW;
+		double d = gap - mArrivalMean;
+
+		mArrivalMean += w * d;
+		mArrivalVar = (1.0 - w) * (mArrivalVar + w * d * d);
+	}
+	mLastArrival = now;
+	mArrivals++;
+
+	double time = now;
+
+	if (mCaptureRate > 0.0)
+	{
+		double frameTime = frame / mCaptureRate;
+		double offset = now - frameTime;
+
+		// the earliest arrival is closest to the capture; a big jump means the frame numbers restarted
+		if (!mHaveOffset || offset < mOffset - 1.0 || offset > mOffset + 1.0)
+		{
+			mOffset = offset;
+			mHaveOffset = true;
+			mReleasedAny = false;
+		}
+		else if (offset < mOffset)
+		{
+			mOffset = offset;
+		}
+		else
+		{
+			mOffset += CLOCK_DRIFT * (offset - mOffset);
+		}
+
+		time = frameTime + mOffset;
+
+		// the shortest delay that keeps the requested share of frames in time, shrinking slowly
+		AddLateness( now - time );
+
+		double target = PercentileDelay();
+
+		if (target > mMaxDelay)		target = mMaxDelay;
+
+		if (target >= mDelay)
+		{
+			mDelay = target;
+		}
+		else
+		{
+			mDelay = (mDelay - JITTER_SHRINK > target) ? mDelay - JITTER_SHRINK : target;
+		}
+	}
+
+	// a later frame has already gone out
+	if (mReleasedAny && frame <= mLastReleased)
+	{
+		mDropped++;
+		LeaveCriticalSection( &mLock );
+		return;
+	}
+
+	if (now > time + mDelay)
+	{
+		mLate++;
+	}
+
+	// make room by dropping the oldest frame
+	if (mCount == JITTER_CAPACITY)
+	{
+		mFirst = (mFirst + 1) % JITTER_CAPACITY;
+		mCount--;
+		mDropped++;
+	}
+
+	// insert in frame order, nearly always at the end
+	int pos = mCount;
+
+	while (pos > 0 && mQueue[(mFirst + pos - 1) % JITTER_CAPACITY].frame > frame)
+	{
+		pos--;
+	}
+
+	for (int i = mCount; i > pos; i--)
+	{
+		Entry& to = mQueue[(mFirst + i) % JITTER_CAPACITY];
+		Entry& from = mQueue[(mFirst + i - 1) % JITTER_CAPACITY];
+
+		to.frame = from.frame;
+		to.time = from.time;
+		to.packets.swap( from.packets );
+	}
+
+	Entry& e = mQueue[(mFirst + pos) % JITTER_CAPACITY];
+
+	e.frame = frame;
+	e.time = time;
+	for (s = 0; s < mStreams; s++)
+	{
+		e.packets[s] = packets[s];
+	}
+	mCount++;
+
+	LeaveCriticalSection( &mLock );
+
+	SetEvent( mArrived );
+}
+
+// Add how late a frame arrived to the histogram, removing the oldest frame of the window
+void JitterBuffer::AddLateness( double lateness )
+{
+	int bin = (lateness > 0.0) ? (int) (lateness / JITTER_BIN) : 0;
+
+	if (bin >= JITTER_BINS)		bin = JITTER_BINS - 1;
+
+	if (mWindowCount == JITTER_WINDOW)
+	{
+		mHistogram[mWindow[mWindowNext]]--;
+	}
+	else
+	{
+		mWindowCount++;
+	}
+
+	mWindow[mWindowNext] = bin;
+	mWindowNext = (mWindowNext + 1) % JITTER_WINDOW;
+	mHistogram[bin]++;
+}
+
+// Lateness at the requested percentile of the window
+double JitterBuffer::PercentileDelay() const
+{
+	int needed = (int) ceil( mPercentile * mWindowCount );
+	int sum = 0;
+
+	for (int i = 0; i < JITTER_BINS; i++)
+	{
+		sum += mHistogram[i];
+
+		if (sum >= needed)
+		{
+			return (i + 1) * JITTER_BIN;
+		}
+	}
+
+	return JITTER_BINS * JITTER_BIN;
+}
+
+// Thread entry point
+unsigned __stdcall JitterBuffer::ThreadProc( void* arg )
+{
+	((JitterBuffer*) arg)->Run();
+	return 0;
+}
+
+// Release each frame at its playout time
+void JitterBuffer::Run()
+{
+	PreciseTimer timer;
+	HANDLE events[2] = { mStop, mArrived };
+
+	SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_HIGHEST );
+
+	while (true)
+	{
+		bool waiting;
+		double due = 0.0;
+
+		EnterCriticalSection( &mLock );
+		waiting = (mCount > 0);
+		if (waiting)
+		{
+			due = mQueue[mFirst].time + mDelay;
+		}
+		LeaveCriticalSection( &mLock );
+
+		// sleep until the oldest frame is due, or a new frame arrives that may be due sooner
+		int rc = waiting ? timer.WaitUntil( mClock, due, 2, events ) :
+			(int) (WaitForMultipleObjects( 2, events, FALSE, INFINITE ) - WAIT_OBJECT_0);
+
+		if (rc == 0)	break;
+		if (rc > 0)		continue;
+
+		EnterCriticalSection( &mLock );
+
+		if (mCount == 0)
+		{
+			LeaveCriticalSection( &mLock );
+			continue;
+		}
+
+		Entry& e = mQueue[mFirst];
+
+		// take the packets without copying, the entry gets the old ones to reuse
+		mOut.swap( e.packets );
+		mLastReleased = e.frame;
+		mReleasedAny = true;
+		mFirst = (mFirst + 1) % JITTER_CAPACITY;
+		mCount--;
+
+		LeaveCriticalSection( &mLock );
+
+		if (mSink)
+		{
+			mSink->Send( mOut );
+		}
+		mReleased++;
+	}
+}
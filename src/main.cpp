@@ -9,52 +9,701 @@
 #include <ws2tcpip.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <conio.h>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <map>
 
 //  EVaRT SDK headers
 #include "EVaRT.h"
 
 // Our project headers
 #include "wrappers.h"
+#include "assembler.h"
+#include "bufferpool.h"
+#include "decimator.h"
 #include "fifo.h"
 #include "recorders.h"
+#include "bodytracker.h"
+#include "filter.h"
+#include "forceplate.h"
+#include "gapfill.h"
+#include "jitterbuffer.h"
+#include "outputscheduler.h"
+#include "pipeline.h"
+#include "predictor.h"
+#include "rollingwriter.h"
+#include "sessionflush.h"
+#include "stages.h"
+#include "streams.h"
+#include "transform.h"
 #include "utils.h"
+#include "validator.h"
 
 // Prototypes for local functions
 static int EVaRT_Data_Handler(int DataType, void *Data); // EVaRT SDK thread calls this function
 static int Handle_Error(const char * msg, int code);
+static BOOL WINAPI Console_Handler(DWORD CtrlType); // asks the streaming loop to stop
+static void Print_Continuity(const char * msg, const FrameContinuity& continuity);
+template<class F> static void Flush_Recording(SessionFlush& flush, RecorderBase<F>* recorder, RollingWriter<F>* writer);
+template<class F> static void Finish_Recording(const char * msg, RecorderBase<F>* recorder, RollingWriter<F>* writer);
+static void Start_Recording();
+static void Set_PreTrigger(double seconds);
+static void Send_Poses(const PosePacket& packet, const PosePacket* predicted);
+static void Publish_Frame(const PipelineFrame& frame);
 
 //  Constants
 #define DEFAULT_HOST			"localhost"				// EVaRT host machine
 #define DEFAULT_ITERATIONS		"10000"					// number of iterations to perform
+#define DEFAULT_RECORD_BASE		"none"					// base name of rolling TRC recording files
+#define SEGMENT_SECONDS			60.0					// length of each rolling TRC recording file
+#define DEFAULT_BODY_FILE		"none"					// rigid body definitions for head pose
+#define DEFAULT_PREDICTION		"0"						// pose prediction horizon in ms, 0 for none or auto
+#define EXTERNAL_LATENCY		0.015					// seconds from capture to callback and from send to display
+#define DEFAULT_OUTPUT_RATE		"0"						// poses sent per second, 0 to send every frame as it arrives
+#define DEFAULT_JITTER			"0"						// share of frames the jitter buffer keeps in time, 0 for no buffer
+#define DEFAULT_CALIBRATION		"none"					// capture volume to simulator transform
+#define CALIBRATION_POLL		100						// main loop passes between checks for a new calibration
+#define CLOSE_WAIT				4500					// ms the console window is kept open to finish the recordings
+#define DEFAULT_PIPELINE		"none"					// stage graph file, none for every stage inline
+#define DEFAULT_DATA_TYPES		"trc"					// data types to stream, any of trc,gtr,htr,htr2,dof,analog,force
+#define DEFAULT_DECIMATION		"1"						// analog samples per recorded sample, 1 to record every sample
+#define DEFAULT_PLATES			"none"					// force plate calibration file, none for the identity
+#define DEFAULT_HTR_LAYOUT		"compact"				// HTR recording columns, compact for the root and rotations or full, approximate translations
+#define DEFAULT_PRE_TRIGGER		"0"						// seconds of history kept until R starts recording, 0 to record from the start
+#define DEFAULT_FILTER			"oneeuro"				// smoothing of markers and poses, oneeuro, kalman, off or a settings file
+#define DEFAULT_FILL			"none"					// gap filler limits file, none for the defaults
+#define DEFAULT_PARALLEL		"0"						// bodies from which they are solved in parallel, 0 for the tracker's default
+#define DEFAULT_VERBOSE			"off"					// print markers 0 and 2 of every frame on stderr, on or off
+
+// Stage graph when no file is given, every stage on the EVaRT callback thread
+static const char* kInlinePipeline =
+	"ingest		inline\n"
+	"record		inline		ingest\n"
+	"validate	inline		ingest\n"
+	"solve		inline		validate\n"
+	"fill		inline		solve\n"
+	"filter		inline		fill\n"
+	"predict		inline		filter\n"
+	"transform	inline		predict\n"
+	"publish		inline		transform record\n";
 
 //  Globals
 static CRITICAL_SECTION		gCriticalSection;			// Windows critical section object
+static volatile LONG		gStopRequested = 0;			// set by Ctrl+C, closing the console or Q to end streaming
+static volatile LONG		gFinished = 0;				// set once the recordings have been written out
 static TrcRecorder*			gTrcRecorder = NULL;
 static bool gGotMarkerList = false;
+static bool gGotHierarchy = false;
+static bool gGotDofNames = false;
+static bool gGotAnalogNames = false;
+static SegmentRecorder*		gGtrRecorder = NULL;
+static SegmentRecorder*		gHtr2Recorder = NULL;
+static HtrRecorder*			gHtrRecorder = NULL;
+static DofRecorder*			gDofRecorder = NULL;
+static AnalogRecorder*		gAnalogRecorder = NULL;
+static ForceRecorder*		gForceRecorder = NULL;
+static double gFrameRate = 0.0;							// capture rate reported by EVaRT
+static FrameContinuity		gTrcContinuity;				// TRC frame numbers as delivered by EVaRT
+static BodyTracker			gTracker;				// bodies whose pose is sent to PedSim
+static MarkerValidator		gValidator;				// rejects spikes and undoes marker swaps
+static GapFiller			gFiller;				// fills occluded markers before they are used
+static FrameFilter			gFilter;				// smooths markers and poses before they are sent
+static PosePredictor		gPredictor;				// predicts poses ahead to hide the latency
+static bool					gPredicting = false;
+static bool					gVerbose = false;		// print markers 0 and 2 of every frame without bodies
+static OutputScheduler		gScheduler;				// sends poses at the simulator's rate
+static CoordinateTransform	gTransform;				// converts poses to the simulator's coordinates
+static JitterBuffer			gJitter;				// evens out the spacing of frames sent as they arrive
 
 //socket used for communicating with PedSim server
 SOCKET ConnectSocket = INVALID_SOCKET;
 
+// Sends the samples of the output scheduler to PedSim
+class PedSimSink : public OutputSink
+{
+public:
+	virtual void Send(const std::vector<PosePacket>& packets)
+	{
+		Send_Poses(packets[0], packets.size() > 1 ? &packets[1] : NULL);
+	}
+};
+static PedSimSink			gPedSimSink;
+
+// Prints how much of each recording has been written at the end of a session, every tenth of it
+class ConsoleProgress : public FlushProgress
+{
+public:
+	virtual void Report(const char* typeName, unsigned long written, unsigned long total)
+	{
+		int lTenths = total > 0 ? (int)((double)written * 10.0 / total) : 10;
+		int& lPrinted = mPrinted[typeName];
+
+		if (lTenths > lPrinted)
+		{
+			lPrinted = lTenths;
+			printf("%s recording: %lu of %lu frames written\n", typeName, written, total);
+		}
+	}
+
+private:
+	std::map<std::string, int>	mPrinted;		// tenths reported so far, by type
+};
+
+// Records the frames of GTR or HTR2 data, on the stream's worker
+class SegmentSink : public StreamSink
+{
+public:
+	SegmentSink() : mRecorder(NULL), mSegments(0) {}
+
+	void SetRecorder(SegmentRecorder* recorder)		{ mRecorder = recorder; }
+	void SetSegments(int segments)					{ mSegments = segments; }
+
+	virtual void Consume(int type, const void* data)
+	{
+		if (!mRecorder)	return;
+
+		mFrame.Set((const SegmentFrame *)data, mSegments);
+		mRecorder->Add(mFrame);
+	}
+
+private:
+	SegmentRecorder*		mRecorder;
+	int						mSegments;		// from the hierarchy
+	SegmentFrameWrapper		mFrame;
+};
+
+// Records the frames of HTR data, on the stream's worker
+class HtrSink : public StreamSink
+{
+public:
+	HtrSink() : mRecorder(NULL), mSegments(0) {}
+
+	void SetRecorder(HtrRecorder* recorder)			{ mRecorder = recorder; }
+	void SetSegments(int segments)					{ mSegments = segments; }
+
+	virtual void Consume(int type, const void* data)
+	{
+		if (!mRecorder)	return;
+
+		mFrame.Set((const sHtrFrame *)data, mSegments);
+		mRecorder->Add(mFrame);
+	}
+
+private:
+	HtrRecorder*			mRecorder;
+	int						mSegments;		// from the hierarchy
+	HtrFrameWrapper			mFrame;
+};
+
+// Records the frames of DOF data, on the stream's worker
+class DofSink : public StreamSink
+{
+public:
+	DofSink() : mRecorder(NULL) {}
+
+	void SetRecorder(DofRecorder* recorder)			{ mRecorder = recorder; }
+
+	virtual void Consume(int type, const void* data)
+	{
+		if (!mRecorder)	return;
+
+		mFrame.Set((const sDofFrame *)data);
+		mRecorder->Add(mFrame);
+	}
+
+private:
+	DofRecorder*			mRecorder;
+	DofFrameWrapper			mFrame;
+};
+
+// Records the frames of analog data, on the stream's worker, optionally at a lower rate
+// The wrappers keep their pooled buffers from frame to frame, so nothing is allocated here
+class AnalogSink : public StreamSink
+{
+public:
+	AnalogSink() : mRecorder(NULL) {}
+
+	void SetRecorder(AnalogRecorder* recorder)		{ mRecorder = recorder; }
+	bool SetDecimation(int factor)					{ return mDecimator.SetFactor(factor); }
+	const AnalogDecimator& Decimator() const		{ return mDecimator; }
+
+	virtual void Consume(int type, const void* data)
+	{
+		if (!mRecorder)	return;
+
+		mFrame.Set((const sAnalogFrame *)data);
+
+		if (mDecimator.Factor() <= 1)
+		{
+			mRecorder->Add(mFrame);
+			return;
+		}
+
+		// the filter starts over when the channels change
+		if (mFrame.Channels() != mDecimator.Channels())
+		{
+			mDecimator.SetChannels(mFrame.Channels());
+		}
+
+		int lSamples = mDecimator.Process(mFrame.Data(), mFrame.Samples());
+		if (lSamples > 0)
+		{
+			if ((int) mBuffer.size() < lSamples * mFrame.Channels())
+			{
+				mBuffer.resize(lSamples * mFrame.Channels());
+			}
+
+			mDecimator.GetInterleaved(&mBuffer[0]);
+			mDecimated.Set(mFrame.Frame(), lSamples, mFrame.Channels(), &mBuffer[0]);
+			mRecorder->Add(mDecimated);
+		}
+	}
+
+private:
+	AnalogRecorder*			mRecorder;
+	AnalogFrameWrapper		mFrame;
+	AnalogDecimator			mDecimator;
+	std::vector<short>		mBuffer;		// decimated samples, interleaved again
+	AnalogFrameWrapper		mDecimated;
+};
+
+// Records the frames of force plate data and computes the plates' centers of pressure and resultants,
+// on the stream's worker. The last sample of each frame is kept for Send_Poses.
+class ForceSink : public StreamSink
+{
+public:
+	ForceSink() : mRecorder(NULL), mLatestFrame(-1), mLatestPlates(0)	{ InitializeCriticalSection(&mLock); }
+	~ForceSink()									{ DeleteCriticalSection(&mLock); }
+
+	void SetRecorder(ForceRecorder* recorder)		{ mRecorder = recorder; }
+	ForcePlates& Plates()							{ return mPlates; }
+
+	virtual void Consume(int type, const void* data)
+	{
+		mFrame.Set((const sForceFrame *)data);
+		if (mRecorder)	mRecorder->Add(mFrame);
+
+		int lSamples = mPlates.Process(mFrame);
+		if (lSamples == 0)	return;
+
+		EnterCriticalSection(&mLock);
+
+		mLatestFrame = mFrame.Frame();
+		mLatestPlates = mPlates.Plates();
+		for (int i = 0; i < mPlates.Channels(); i++)
+		{
+			mLatest[i] = mPlates.Value(lSamples - 1, i);
+		}
+
+		LeaveCriticalSection(&mLock);
+	}
+
+	// Derived channels of the last sample so far, returns the number of plates, 0 before the first frame
+	int GetLatest(float* values, int& frame)
+	{
+		EnterCriticalSection(&mLock);
+
+		int lPlates = mLatestPlates;
+
+		frame = mLatestFrame;
+		memcpy(values, mLatest, (lPlates + 1) * FORCE_CHANNELS * sizeof(float));
+
+		LeaveCriticalSection(&mLock);
+
+		return lPlates;
+	}
+
+private:
+	ForceRecorder*			mRecorder;
+	ForceFrameWrapper		mFrame;
+	ForcePlates				mPlates;
+	float					mLatest[(MAX_FORCE_PLATES + 1) * FORCE_CHANNELS];
+	int						mLatestFrame;
+	int						mLatestPlates;
+	CRITICAL_SECTION		mLock;
+
+	// not copyable
+	ForceSink(const ForceSink&);
+	ForceSink& operator = (const ForceSink&);
+};
+
+static SegmentSink			gGtrSink;
+static SegmentSink			gHtr2Sink;
+static HtrSink				gHtrSink;
+static DofSink				gDofSink;
+static AnalogSink			gAnalogSink;
+static ForceSink			gForceSink;
+static StreamRouter			gStreams;				// queues and workers for the data types other than TRC
+
+// Hands the parts of each assembled frame to the sinks of their types
+class SnapshotSink : public CompositeSink
+{
+public:
+	virtual void Consume(const CompositeFrame& frame)
+	{
+		if (frame.Part(GTR_DATA))	gGtrSink.Consume(GTR_DATA, frame.Part(GTR_DATA));
+		if (frame.Part(HTR2_DATA))	gHtr2Sink.Consume(HTR2_DATA, frame.Part(HTR2_DATA));
+		if (frame.Part(HTR_DATA))	gHtrSink.Consume(HTR_DATA, frame.Part(HTR_DATA));
+		if (frame.Part(DOF_DATA))	gDofSink.Consume(DOF_DATA, frame.Part(DOF_DATA));
+		if (frame.Part(ANALOG_DATA))	gAnalogSink.Consume(ANALOG_DATA, frame.Part(ANALOG_DATA));
+		if (frame.Part(FORCE_DATA))	gForceSink.Consume(FORCE_DATA, frame.Part(FORCE_DATA));
+	}
+};
+static SnapshotSink			gSnapshotSink;
+static FrameAssembler		gAssembler;				// joins the data types of each frame when there are several
+
+// Sends the poses of a frame, as the last stage of the pipeline
+class PublishStage : public Stage
+{
+public:
+	virtual void Process(PipelineFrame& frame)
+	{
+		Publish_Frame(frame);
+	}
+};
+
+// The stages that don't depend on command line settings
+static IngestStage			gIngestStage;
+static ValidateStage		gValidateStage(gValidator, gTracker);
+static SolveStage			gSolveStage(gTracker);
+static FillStage			gFillStage(gFiller, gTracker);
+static FilterStage			gFilterStage(gFilter, gTracker);
+static PredictStage			gPredictStage(gPredictor, gFilter, gScheduler, gJitter);
+static TransformStage		gTransformStage(gTransform);
+static PublishStage			gPublishStage;
+static Pipeline				gPipeline;				// runs every TRC frame through the stages
+
 // Entry point
+//
+// Arguments, after the program name, any left out take their defaults:
+//   1  EVaRT host machine
+//   2  local machine
+//   3  base name of the recording files
+//   4  rigid body file
+//   5  pose prediction in ms, or auto
+//   6  simulator rate in Hz
+//   7  share of frames the jitter buffer keeps in time
+//   8  simulator calibration file
+//   9  pipeline file
+//   10 data types to stream, any of trc,gtr,htr,htr2,dof,analog,force
+//   11 analog samples per recorded sample
+//   12 force plate calibration file
+//   13 HTR recording layout, compact or full
+//   14 seconds kept before R starts recording
+//   15 filter, oneeuro, kalman, off or a filter settings file
+//   16 print markers 0 and 2 of every frame, on or off
+//   17 gap filler limits file
+//   18 bodies from which they are solved in parallel, 0 for the default
+// With fewer than two arguments every value is prompted for.
 int main(int argc, char* argv[])
 {
 	char	lHost[80];
 	char	lIpAddr[80];
+	char	lRecordBase[80];
+	char	lBodyFile[80];
+	char	lPrediction[80];
+	char	lOutputRate[80];
+	char	lJitter[80];
+	char	lCalibration[80];
+	char	lPipeline[80];
+	char	lStreams[80];
+	char	lDecimation[80];
+	char	lPlates[80];
+	char	lHtrLayout[80];
+	char	lPreTrigger[80];
+	char	lFilter[80];
+	char	lVerbose[80];
+	char	lFill[80];
+	char	lParallel[80];
 	int		lDataTypes;
-	int		lNumTypes = 0;
 
 	//if we are passed a host as an argument, use it. otherwise prompt
-	if (argc == 3) {
+	if (argc >= 3) {
 		strcpy(lHost, argv[1]);
 		strcpy(lIpAddr, argv[2]);
+		strcpy(lRecordBase, argc >= 4 ? argv[3] : DEFAULT_RECORD_BASE);
+		strcpy(lBodyFile, argc >= 5 ? argv[4] : DEFAULT_BODY_FILE);
+		strcpy(lPrediction, argc >= 6 ? argv[5] : DEFAULT_PREDICTION);
+		strcpy(lOutputRate, argc >= 7 ? argv[6] : DEFAULT_OUTPUT_RATE);
+		strcpy(lJitter, argc >= 8 ? argv[7] : DEFAULT_JITTER);
+		strcpy(lCalibration, argc >= 9 ? argv[8] : DEFAULT_CALIBRATION);
+		strcpy(lPipeline, argc >= 10 ? argv[9] : DEFAULT_PIPELINE);
+		strcpy(lStreams, argc >= 11 ? argv[10] : DEFAULT_DATA_TYPES);
+		strcpy(lDecimation, argc >= 12 ? argv[11] : DEFAULT_DECIMATION);
+		strcpy(lPlates, argc >= 13 ? argv[12] : DEFAULT_PLATES);
+		strcpy(lHtrLayout, argc >= 14 ? argv[13] : DEFAULT_HTR_LAYOUT);
+		strcpy(lPreTrigger, argc >= 15 ? argv[14] : DEFAULT_PRE_TRIGGER);
+		strcpy(lFilter, argc >= 16 ? argv[15] : DEFAULT_FILTER);
+		strcpy(lVerbose, argc >= 17 ? argv[16] : DEFAULT_VERBOSE);
+		strcpy(lFill, argc >= 18 ? argv[17] : DEFAULT_FILL);
+		strcpy(lParallel, argc >= 19 ? argv[18] : DEFAULT_PARALLEL);
 	}
 	else {
 		printf("\n\nPress <Enter> to accept default values\n\n");
 		promptInput("Enter host machine", DEFAULT_HOST, lHost, 80);
 		promptInput("Enter local machine", DEFAULT_HOST, lIpAddr, 80);
+		promptInput("Enter base name for TRC recording files", DEFAULT_RECORD_BASE, lRecordBase, 80);
+		promptInput("Enter rigid body file", DEFAULT_BODY_FILE, lBodyFile, 80);
+		promptInput("Enter pose prediction in ms, or auto", DEFAULT_PREDICTION, lPrediction, 80);
+		promptInput("Enter simulator rate in Hz, 0 to send every frame", DEFAULT_OUTPUT_RATE, lOutputRate, 80);
+		promptInput("Enter share of frames to buffer for in time, 0 for none", DEFAULT_JITTER, lJitter, 80);
+		promptInput("Enter simulator calibration file", DEFAULT_CALIBRATION, lCalibration, 80);
+		promptInput("Enter pipeline file", DEFAULT_PIPELINE, lPipeline, 80);
+		promptInput("Enter data types to stream (trc,gtr,htr,htr2,dof,analog,force)", DEFAULT_DATA_TYPES, lStreams, 80);
+		promptInput("Enter analog samples per recorded sample, 1 for all", DEFAULT_DECIMATION, lDecimation, 80);
+		promptInput("Enter force plate calibration file", DEFAULT_PLATES, lPlates, 80);
+		promptInput("Enter HTR recording layout (compact,full)", DEFAULT_HTR_LAYOUT, lHtrLayout, 80);
+		promptInput("Enter seconds to keep before R starts recording, 0 to record from the start", DEFAULT_PRE_TRIGGER, lPreTrigger, 80);
+		promptInput("Enter filter (oneeuro,kalman,off) or filter settings file", DEFAULT_FILTER, lFilter, 80);
+		promptInput("Print markers 0 and 2 of every frame (on,off)", DEFAULT_VERBOSE, lVerbose, 80);
+		promptInput("Enter gap filler limits file", DEFAULT_FILL, lFill, 80);
+		promptInput("Enter bodies from which they are solved in parallel, 0 for the default", DEFAULT_PARALLEL, lParallel, 80);
+	}
+
+	gVerbose = _stricmp(lVerbose, "on") == 0;
+
+	// Determine which data types will be streamed
+	lDataTypes = ParseStreamTypes(lStreams);
+	if (lDataTypes <= 0)
+	{
+		printf("Unknown data types %s, streaming %s\n", lStreams, DEFAULT_DATA_TYPES);
+		lDataTypes = ParseStreamTypes(DEFAULT_DATA_TYPES);
+	}
+
+	// Analog channels can be low pass filtered down to a lower rate before they are recorded
+	if ((lDataTypes & ANALOG_DATA) && !gAnalogSink.SetDecimation(atoi(lDecimation)))
+	{
+		printf("Can not record 1 in %s analog samples, recording every sample\n", lDecimation);
+	}
+
+	// Where the force plates are in the capture volume
+	if ((lDataTypes & FORCE_DATA) && strcmp(lPlates, DEFAULT_PLATES) != 0 && !gForceSink.Plates().Load(lPlates))
+	{
+		printf("Could not read the force plates from %s, using the plates' own coordinates\n", lPlates);
+	}
+
+	// TRC goes straight into the pipeline, every other type is only copied to its own queue in the callback.
+	// With several types the queues feed the assembler, and the sinks get the parts of whole frames from it.
+	bool lAssembled = (lDataTypes & (lDataTypes - 1)) != 0;
+
+	if (lDataTypes & GTR_DATA)		gStreams.Add(GTR_DATA, lAssembled ? (StreamSink *)&gAssembler : &gGtrSink);
+	if (lDataTypes & HTR2_DATA)		gStreams.Add(HTR2_DATA, lAssembled ? (StreamSink *)&gAssembler : &gHtr2Sink);
+	if (lDataTypes & DOF_DATA)		gStreams.Add(DOF_DATA, lAssembled ? (StreamSink *)&gAssembler : &gDofSink);
+	if (lDataTypes & HTR_DATA)		gStreams.Add(HTR_DATA, lAssembled ? (StreamSink *)&gAssembler : &gHtrSink);
+	if (lDataTypes & ANALOG_DATA)	gStreams.Add(ANALOG_DATA, lAssembled ? (StreamSink *)&gAssembler : &gAnalogSink);
+	if (lDataTypes & FORCE_DATA)	gStreams.Add(FORCE_DATA, lAssembled ? (StreamSink *)&gAssembler : &gForceSink);
+
+	// Send rigid body poses instead of the midpoint of markers 0 and 2
+	if (strcmp(lBodyFile, DEFAULT_BODY_FILE) != 0)
+	{
+		std::vector<RigidBody> lBodies;
+
+		if (LoadRigidBodies(lBodyFile, lBodies))
+		{
+			if (atoi(lParallel) > 0)	gTracker.SetParallelBodies(atoi(lParallel));
+			gTracker.SetBodies(lBodies);
+			gFilter.SetBodies(gTracker.Bodies());
+			gPredictor.SetBodies(gTracker.Bodies());
+			printf("Tracking %d bodies%s\n", gTracker.Bodies(), gTracker.IsParallel() ? " in parallel" : "");
+		}
+		else
+		{
+			printf("Could not read rigid bodies from %s, sending marker midpoint\n", lBodyFile);
+		}
+	}
+
+	// Smooth the markers and poses, with the bodies' own settings when they come from a file
+	if (_stricmp(lFilter, "off") == 0)
+	{
+		gFilter.SetType(kFilterNone);
+	}
+	else if (_stricmp(lFilter, "kalman") == 0)
+	{
+		gFilter.SetType(kFilterKalman);
+	}
+	else if (_stricmp(lFilter, DEFAULT_FILTER) != 0 && !gFilter.Load(lFilter, gTracker))
+	{
+		printf("Could not read the filter settings from %s, using %s\n", lFilter, DEFAULT_FILTER);
+	}
+
+	// How long occluded markers are filled, and from where
+	if (strcmp(lFill, DEFAULT_FILL) != 0 && !gFiller.Load(lFill))
+	{
+		printf("Could not read the gap filler limits from %s, using the defaults\n", lFill);
+	}
+
+	// Predict the poses ahead, by a fixed time or by the measured latency
+	if (gTracker.Bodies() > 0)
+	{
+		if (_stricmp(lPrediction, "auto") == 0)
+		{
+			gPredictor.SetAutoHorizon(EXTERNAL_LATENCY);
+			gPredicting = true;
+		}
+		else if (atof(lPrediction) > 0.0)
+		{
+			gPredictor.SetHorizon(atof(lPrediction) / 1000.0);
+			gPredicting = true;
+		}
+	}
+
+	// Send the poses on the simulator's clock rather than as frames arrive
+	bool lScheduled = gTracker.Bodies() > 0 && atof(lOutputRate) > 0.0;
+
+	if (lScheduled)
+	{
+		gScheduler.SetLayout(gPredicting ? 2 : 1, gTracker.Bodies());
+		gScheduler.SetTickRate(atof(lOutputRate));
+		gScheduler.SetSink(&gPedSimSink);
+	}
+
+	// Otherwise hold each frame back just long enough to send them evenly spaced
+	bool lBuffered = gTracker.Bodies() > 0 && !lScheduled && atof(lJitter) > 0.0;
+
+	if (lBuffered)
+	{
+		gJitter.SetLayout(gPredicting ? 2 : 1, gTracker.Bodies());
+		gJitter.SetPercentile(atof(lJitter));
+		gJitter.SetSink(&gPedSimSink);
+	}
+
+	// Send poses in the simulator's coordinates, the file is read again whenever it changes
+	if (strcmp(lCalibration, DEFAULT_CALIBRATION) != 0 && !gTransform.Load(lCalibration))
+	{
+		printf("Could not read the calibration from %s, sending capture volume coordinates\n", lCalibration);
+	}
+
+	// Record TRC data into rolling segment files, unless told not to
+	RollingWriter<TrcFrameWrapper>* lTrcWriter = NULL;
+
+	if (strcmp(lRecordBase, DEFAULT_RECORD_BASE) != 0)
+	{
+		gTrcRecorder = new TrcRecorder();
+		gTrcRecorder->SetStorage(kArenaStorage);
+
+		lTrcWriter = new RollingWriter<TrcFrameWrapper>(*gTrcRecorder, lRecordBase);
+		lTrcWriter->SetMaxSeconds(SEGMENT_SECONDS);
+	}
+
+	// The segment and DOF data go into files of their own next to it
+	RollingWriter<SegmentFrameWrapper>* lGtrWriter = NULL;
+	RollingWriter<SegmentFrameWrapper>* lHtr2Writer = NULL;
+	RollingWriter<HtrFrameWrapper>* lHtrWriter = NULL;
+	RollingWriter<DofFrameWrapper>* lDofWriter = NULL;
+	RollingWriter<AnalogFrameWrapper>* lAnalogWriter = NULL;
+	RollingWriter<ForceFrameWrapper>* lForceWriter = NULL;
+
+	if (strcmp(lRecordBase, DEFAULT_RECORD_BASE) != 0)
+	{
+		if (lDataTypes & GTR_DATA)
+		{
+			gGtrRecorder = new SegmentRecorder();
+			gGtrRecorder->SetStorage(kArenaStorage);
+			gGtrSink.SetRecorder(gGtrRecorder);
+
+			lGtrWriter = new RollingWriter<SegmentFrameWrapper>(*gGtrRecorder, std::string(lRecordBase) + "_gtr");
+			lGtrWriter->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+		if (lDataTypes & HTR2_DATA)
+		{
+			gHtr2Recorder = new SegmentRecorder();
+			gHtr2Recorder->SetStorage(kArenaStorage);
+			gHtr2Sink.SetRecorder(gHtr2Recorder);
+
+			lHtr2Writer = new RollingWriter<SegmentFrameWrapper>(*gHtr2Recorder, std::string(lRecordBase) + "_htr2");
+			lHtr2Writer->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+		if (lDataTypes & HTR_DATA)
+		{
+			gHtrRecorder = new HtrRecorder();
+			gHtrRecorder->SetStorage(kArenaStorage);
+			gHtrSink.SetRecorder(gHtrRecorder);
+
+			// approximate translations can be filled in from the hierarchy for tools that expect the HTR2 columns
+			if (strcmp(lHtrLayout, "full") == 0)
+			{
+				gHtrRecorder->SetFullLayout(true);
+			}
+			else if (strcmp(lHtrLayout, DEFAULT_HTR_LAYOUT) != 0)
+			{
+				printf("Unknown HTR layout %s, recording %s\n", lHtrLayout, DEFAULT_HTR_LAYOUT);
+			}
+
+			lHtrWriter = new RollingWriter<HtrFrameWrapper>(*gHtrRecorder, std::string(lRecordBase) + "_htr");
+			lHtrWriter->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+		if (lDataTypes & DOF_DATA)
+		{
+			gDofRecorder = new DofRecorder();
+			gDofRecorder->SetStorage(kArenaStorage);
+			gDofSink.SetRecorder(gDofRecorder);
+
+			lDofWriter = new RollingWriter<DofFrameWrapper>(*gDofRecorder, std::string(lRecordBase) + "_dof");
+			lDofWriter->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+		if (lDataTypes & ANALOG_DATA)
+		{
+			gAnalogRecorder = new AnalogRecorder();
+			gAnalogRecorder->SetStorage(kArenaStorage);
+			gAnalogSink.SetRecorder(gAnalogRecorder);
+
+			lAnalogWriter = new RollingWriter<AnalogFrameWrapper>(*gAnalogRecorder, std::string(lRecordBase) + "_analog");
+			lAnalogWriter->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+		if (lDataTypes & FORCE_DATA)
+		{
+			gForceRecorder = new ForceRecorder();
+			gForceRecorder->SetStorage(kArenaStorage);
+			gForceSink.SetRecorder(gForceRecorder);
+
+			lForceWriter = new RollingWriter<ForceFrameWrapper>(*gForceRecorder, std::string(lRecordBase) + "_force");
+			lForceWriter->SetMaxSeconds(SEGMENT_SECONDS);
+		}
+	}
+
+	// With a pre-trigger the recorders only keep the last few seconds until R is pressed,
+	// the recording then starts with that history
+	double lPreTriggerSeconds = atof(lPreTrigger);
+	bool lTriggered = lPreTriggerSeconds > 0.0 && strcmp(lRecordBase, DEFAULT_RECORD_BASE) != 0;
+
+	if (lTriggered)
+	{
+		Set_PreTrigger(lPreTriggerSeconds);
+	}
+
+	// Connect the processing stages as the pipeline file says, or all inline in the usual order
+	RecordStage lRecordStage(gTrcRecorder);
+	AssembleStage lAssembleStage(gAssembler);
+
+	gPredictStage.SetEnabled(gPredicting);
+	gPipeline.AddType("ingest", &gIngestStage);
+	gPipeline.AddType("record", &lRecordStage);
+	gPipeline.AddType("assemble", &lAssembleStage);
+	gPipeline.AddType("validate", &gValidateStage, true);
+	gPipeline.AddType("solve", &gSolveStage);
+	gPipeline.AddType("fill", &gFillStage);
+	gPipeline.AddType("filter", &gFilterStage, true);
+	gPipeline.AddType("predict", &gPredictStage);
+	gPipeline.AddType("transform", &gTransformStage);
+	gPipeline.AddType("publish", &gPublishStage);
+
+	if (strcmp(lPipeline, DEFAULT_PIPELINE) != 0 && !gPipeline.Load(lPipeline))
+	{
+		printf("Could not read the pipeline from %s (%s), running every stage inline\n", lPipeline, gPipeline.Error().c_str());
+	}
+	if (gPipeline.Stages() == 0)
+	{
+		gPipeline.Parse(kInlinePipeline);
+	}
+
+	// The snapshot sink has no use for a TRC part, markers are recorded and sent by the pipeline,
+	// so the assembler does not wait for one and an assemble stage in a pipeline file does nothing
+	if (lAssembled)
+	{
+		gAssembler.SetTypes(lDataTypes & ~TRC_DATA);
+		gAssembler.SetSink(&gSnapshotSink);
 	}
 
 	//connect socket
@@ -97,14 +746,12 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-	// Determine which data types will be streamed
-	lDataTypes = 0;
-	lDataTypes |= TRC_DATA;
-	lNumTypes++;
-
 	// Initialize the Windows critical section object
 	InitializeCriticalSection(&gCriticalSection);
 
+	// Ctrl+C and closing the console end streaming through the normal shutdown, so the recordings are finished
+	SetConsoleCtrlHandler(Console_Handler, TRUE);
+
 	// Initialize EVaRT SDK, only call this function once
 	EVaRT_Initialize();
 
@@ -136,6 +783,62 @@ int main(int argc, char* argv[])
 				if (!gGotMarkerList)	printf("Did not get a marker list\n");
 			}
 
+			// Get the segment hierarchy if streaming segment data
+			if (lDataTypes & (GTR_DATA | HTR_DATA | HTR2_DATA))
+			{
+				EVaRT_RequestHierarchy();
+
+				t.Begin();
+				while (!t.IsExpired() && !gGotHierarchy)
+				{
+					Sleep(10);
+				}
+
+				if (!gGotHierarchy)	printf("Did not get a hierarchy\n");
+			}
+
+			// Get the DOF names if streaming DOF data
+			if (lDataTypes & DOF_DATA)
+			{
+				EVaRT_RequestDofNames();
+
+				t.Begin();
+				while (!t.IsExpired() && !gGotDofNames)
+				{
+					Sleep(10);
+				}
+
+				if (!gGotDofNames)	printf("Did not get the DOF names\n");
+			}
+
+			// Get the analog channel names if streaming analog data
+			if (lDataTypes & ANALOG_DATA)
+			{
+				EVaRT_RequestAnalogNames();
+
+				t.Begin();
+				while (!t.IsExpired() && !gGotAnalogNames)
+				{
+					Sleep(10);
+				}
+
+				if (!gGotAnalogNames)	printf("Did not get the analog channel names\n");
+			}
+
+			// The frame rate arrives through our callback as CONTEXT_FRAME_RATE, it sizes the recorders' pre-trigger buffers
+			EVaRT_Request("GetContextFrameRate");
+
+			if (lTriggered)
+			{
+				t.Begin();
+				while (!t.IsExpired() && gFrameRate <= 0.0)
+				{
+					Sleep(10);
+				}
+
+				if (gFrameRate <= 0.0)	printf("Did not get the frame rate, keeping history for %.0f Hz until it arrives\n", PRE_TRIGGER_RATE);
+			}
+
 			printf("\n\n");
 
 			// Tell EVaRT which data types to send us
@@ -144,11 +847,76 @@ int main(int argc, char* argv[])
 
 				// Tell EVaRT to start sending us frames of data
 				// Our callback function will get called once for each type of data we are streaming for each frame
+				if (!lTriggered)	Start_Recording();
+				gTrcContinuity.Reset();
+				if (lScheduled)		gScheduler.Start();
+				if (lBuffered)		gJitter.Start();
+				if (lAssembled)		gAssembler.Start();
+				gPipeline.Start();
+				gStreams.Start();
+
 				Handle_Error("EVaRT_StartStreaming", EVaRT_StartStreaming());
 
-				while (true)
+				long lLost = 0;
+				int lPolls = 0;
+				int lLevel = 0;
+
+				if (lTriggered)
+				{
+					printf("Keeping the last %.1f s, press R to start recording\n", lPreTriggerSeconds);
+				}
+				printf("Streaming, press Q or Ctrl+C to stop\n");
+
+				while (!gStopRequested)
 				{
 					Sleep(10); // Not required, but otherwise CPU will be at 100%
+
+					// Q or Esc ends streaming
+					if (_kbhit())
+					{
+						int lKey = _getch();
+
+						if (lKey == 'q' || lKey == 'Q' || lKey == 27)
+						{
+							InterlockedExchange(&gStopRequested, 1);
+						}
+						else if ((lKey == 'r' || lKey == 'R') && lTriggered)
+						{
+							Start_Recording();
+							lTriggered = false;
+							printf("Recording started, with up to %.1f s before it\n", lPreTriggerSeconds);
+						}
+					}
+
+					// Move recorded frames to disk as they arrive
+					if (lTrcWriter)	lTrcWriter->Write();
+					if (lGtrWriter)	lGtrWriter->Write();
+					if (lHtr2Writer)	lHtr2Writer->Write();
+					if (lHtrWriter)	lHtrWriter->Write();
+					if (lDofWriter)	lDofWriter->Write();
+					if (lAnalogWriter)	lAnalogWriter->Write();
+					if (lForceWriter)	lForceWriter->Write();
+
+					// Report lost frames as soon as they are noticed
+					if (gTrcContinuity.Missing() + gTrcContinuity.Dropped() != lLost)
+					{
+						lLost = gTrcContinuity.Missing() + gTrcContinuity.Dropped();
+						Print_Continuity("TRC stream", gTrcContinuity);
+					}
+
+					// Report when optional stages start or stop being shed
+					if (gPipeline.Level() != lLevel)
+					{
+						lLevel = gPipeline.Level();
+						printf("Pipeline %s, optional stages run on 1 frame in %d\n",
+							lLevel > 0 ? "behind" : "caught up", 1 << lLevel);
+					}
+
+					// Pick up an edited calibration, the stream carries on with the old one until it is read
+					if (++lPolls % CALIBRATION_POLL == 0 && gTransform.Reload())
+					{
+						printf("Calibration reloaded from %s\n", gTransform.FileName().c_str());
+					}
 				}
 
 				// Ignore any more data from EVaRT
@@ -161,6 +929,132 @@ int main(int argc, char* argv[])
 
 				LeaveCriticalSection(&gCriticalSection);
 
+				// Finish the frames still in the pipeline and the queues
+				gPipeline.Stop();
+				gStreams.Stop();
+				gAssembler.Stop();
+
+				// No more sends from the scheduler thread
+				if (lScheduled)
+				{
+					gScheduler.Stop();
+					printf("Sent %lu poses at %.1f Hz, %lu before the next frame arrived, %lu ticks skipped, %.0f us late on average\n",
+						gScheduler.Ticks(), atof(lOutputRate), gScheduler.Held(), gScheduler.Skipped(), gScheduler.TickError() * 1e6);
+				}
+				if (lBuffered)
+				{
+					gJitter.Stop();
+					printf("Sent %lu poses %.1f ms behind the earliest frames, %lu late, %lu dropped, frames %.2f +- %.2f ms apart\n",
+						gJitter.Released(), gJitter.Delay() * 1000.0, gJitter.Late(), gJitter.Dropped(),
+						gJitter.ArrivalMean() * 1000.0, gJitter.ArrivalSpread() * 1000.0);
+				}
+
+				// Write out the rest of the recordings side by side, then finalize their last segments
+				SessionFlush lFlush;
+				ConsoleProgress lProgress;
+
+				Flush_Recording(lFlush, gTrcRecorder, lTrcWriter);
+				Flush_Recording(lFlush, gGtrRecorder, lGtrWriter);
+				Flush_Recording(lFlush, gHtr2Recorder, lHtr2Writer);
+				Flush_Recording(lFlush, gHtrRecorder, lHtrWriter);
+				Flush_Recording(lFlush, gDofRecorder, lDofWriter);
+				Flush_Recording(lFlush, gAnalogRecorder, lAnalogWriter);
+				Flush_Recording(lFlush, gForceRecorder, lForceWriter);
+
+				if (!lFlush.Flush(&lProgress))
+				{
+					printf("Could not write all of the recordings\n");
+				}
+
+				Finish_Recording("TRC recording", gTrcRecorder, lTrcWriter);
+				Finish_Recording("GTR recording", gGtrRecorder, lGtrWriter);
+				Finish_Recording("HTR2 recording", gHtr2Recorder, lHtr2Writer);
+				Finish_Recording("HTR recording", gHtrRecorder, lHtrWriter);
+				Finish_Recording("DOF recording", gDofRecorder, lDofWriter);
+				Finish_Recording("Analog recording", gAnalogRecorder, lAnalogWriter);
+				Finish_Recording("Force recording", gForceRecorder, lForceWriter);
+				InterlockedExchange(&gFinished, 1);
+				Print_Continuity("TRC stream", gTrcContinuity);
+
+				for (int i = 0; i < gStreams.Streams(); i++)
+				{
+					FrameStream& lStream = gStreams.Stream(i);
+					std::string lName = std::string(StreamTypeName(lStream.Type())) + " stream";
+
+					Print_Continuity(lName.c_str(), lStream.Continuity());
+					printf("  at most %lu of %d byte frames waiting\n", lStream.Deepest(), lStream.SlotBytes());
+				}
+				if (gAnalogSink.Decimator().Factor() > 1)
+				{
+					const AnalogDecimator& lDecimator = gAnalogSink.Decimator();
+
+					printf("Analog decimation: 1 in %d with %d taps, %.1f samples delay, %.1f M channel samples/s, %.1f us per frame (max %.1f)\n",
+						lDecimator.Factor(), lDecimator.Taps(), lDecimator.Delay(), lDecimator.Throughput() / 1e6,
+						lDecimator.CostAverage(), lDecimator.CostMax());
+				}
+				if (gForceSink.Plates().Plates() > 0)
+				{
+					const ForcePlates& lForcePlates = gForceSink.Plates();
+
+					printf("Force plates: %d plates, %.1f M plate samples/s, %.1f us per frame (max %.1f)\n",
+						lForcePlates.Plates(), lForcePlates.Throughput() / 1e6, lForcePlates.CostAverage(), lForcePlates.CostMax());
+				}
+				if (lDataTypes & (ANALOG_DATA | FORCE_DATA))
+				{
+					printf("Analog and force buffers: %lu taken from the heap, %.0f KB at most\n",
+						BufferPool::Shared().HeapCalls(), BufferPool::Shared().PeakBytes() / 1024.0);
+				}
+				if (lAssembled)
+				{
+					printf("Assembled %lu complete and %lu partial frames, waited up to %.1f ms, %lu parts late, %lu with no room, %lu restarts\n",
+						gAssembler.Complete(), gAssembler.Partial(), gAssembler.WaitMax() * 1000.0, gAssembler.Late(), gAssembler.Overflow(),
+						gAssembler.Restarts());
+					for (int i = 0; i < ASSEMBLER_TYPES; i++)
+					{
+						if (gAssembler.Missing(1 << i) > 0)
+						{
+							printf("  %lu frames without %s\n", gAssembler.Missing(1 << i), StreamTypeName(1 << i));
+						}
+					}
+				}
+
+				printf("Pipeline: %lu frames dropped with every frame in flight, %lu late\n", gPipeline.Dropped(), gPipeline.Late());
+				for (int i = 0; i < gPipeline.Stages(); i++)
+				{
+					printf("  %-10s %-10s %lu frames, %.1f us per frame (max %.1f)", gPipeline.StageType(i).c_str(),
+						gPipeline.StageThread(i).c_str(), gPipeline.StageCalls(i), gPipeline.StageCostAverage(i), gPipeline.StageCostMax(i));
+					if (gPipeline.StageOptional(i))		printf(", shed on %lu", gPipeline.StageShed(i));
+					printf("\n");
+				}
+
+				std::vector<ShedEvent> lShed;
+
+				gPipeline.Events(lShed);
+				for (int i = 0; i < (int) lShed.size(); i++)
+				{
+					printf("  %8.3f s  frame %-8d %-10s %-10s level %d\n", lShed[i].time, lShed[i].frame,
+						lShed[i].stage >= 0 ? gPipeline.StageType(lShed[i].stage).c_str() : "-",
+						ShedReasonName(lShed[i].reason), lShed[i].level);
+				}
+				printf("Validation: %lu markers rejected, %lu relabelled, %lu body checks over budget\n",
+					gValidator.TotalRejected(), gValidator.TotalSwapped(), gValidator.TotalSkipped());
+				printf("Marker filter: %.1f us per frame (max %.1f), %.1f ms lag\n",
+					gFilter.Markers().CostAverage(), gFilter.Markers().CostMax(), gFilter.Markers().Latency());
+				if (gTracker.Bodies() > 0)
+				{
+					printf("Body filter: %.1f us per frame (max %.1f), %.1f ms lag\n",
+						gFilter.Bodies().CostAverage(), gFilter.Bodies().CostMax(), gFilter.Bodies().Latency());
+				}
+				if (gPredicting)
+				{
+					printf("Prediction %.1f ms ahead%s\n", gPredictor.Horizon() * 1000.0, gPredictor.IsAuto() ? " (measured)" : "");
+					for (int i = 0; i < gTracker.Bodies(); i++)
+					{
+						printf("  %s: %.2f mm, %.2f deg rms error over %d frames\n", gTracker.Body(i).Name().c_str(),
+							gPredictor.PositionError(i), gPredictor.AngleError(i), gPredictor.Checked(i));
+					}
+				}
+
 				// shutdown the connection since no more data will be sent
 				iResult = shutdown(ConnectSocket, SD_SEND);
 				if (iResult == SOCKET_ERROR) {
@@ -211,6 +1105,33 @@ int main(int argc, char* argv[])
 	EVaRT_Exit();
 	DeleteCriticalSection(&gCriticalSection);
 
+	// Nothing left to write, a console being closed can go now
+	InterlockedExchange(&gFinished, 1);
+
+	gTracker.Clear();
+
+	delete lTrcWriter;
+	delete gTrcRecorder;
+	gTrcRecorder = NULL;
+
+	delete lGtrWriter;
+	delete lHtr2Writer;
+	delete lHtrWriter;
+	delete lDofWriter;
+	delete lAnalogWriter;
+	delete lForceWriter;
+	delete gGtrRecorder;
+	delete gHtr2Recorder;
+	delete gHtrRecorder;
+	delete gDofRecorder;
+	delete gAnalogRecorder;
+	delete gForceRecorder;
+	gGtrRecorder = gHtr2Recorder = NULL;
+	gHtrRecorder = NULL;
+	gDofRecorder = NULL;
+	gAnalogRecorder = NULL;
+	gForceRecorder = NULL;
+
 	printf("\n\n");
 	system("pause");
 	return 0;
@@ -224,13 +1145,27 @@ int main(int argc, char* argv[])
 static int EVaRT_Data_Handler(int DataType, void *Data)
 {
 	static int numMarkers = 0;
-	static int iResult = 0;
-	std::ostringstream stringStream;
-	std::string copyOfStr;
+
+	// Data types other than TRC are only copied to their queues, so they never hold up the TRC frames
+	if (gStreams.Find(DataType))
+	{
+		gStreams.Post(DataType, Data);
+		return 0;
+	}
+
+	// Check the frame number of every TRC frame delivered, including the ones skipped below
+	if (DataType == TRC_DATA)
+	{
+		gTrcContinuity.Add(((sTrcFrame *)Data)->iFrame);
+	}
 
 	// Example of how you could protect global data in your main thread
 	if (TryEnterCriticalSection(&gCriticalSection) == 0)
 	{
+		if (DataType == TRC_DATA)
+		{
+			gTrcContinuity.AddDropped();
+		}
 		return 0;
 	}
 
@@ -242,34 +1177,107 @@ static int EVaRT_Data_Handler(int DataType, void *Data)
 
 			if (p->nMarkers > 0)
 			{
+				// The stages' state is about to change, let the frames in flight finish first
+				gPipeline.Drain();
+
 				gGotMarkerList = true;
 				numMarkers = p->nMarkers;
+				gIngestStage.SetMarkers(numMarkers);
+
+				if (gTrcRecorder)
+				{
+					gTrcRecorder->SetMarkerList(MarkerListWrapper(p));
+				}
+
+				gValidator.Reset();
+				gFiller.Reset();
+				gFilter.Reset();
+				gPredictor.Reset();
+
+				if (!gTracker.Resolve(MarkerListWrapper(p)))
+				{
+					for (int i = 0; i < gTracker.Bodies(); i++)
+					{
+						if (!gTracker.Body(i).IsResolved())
+						{
+							printf("Not all markers of body %s are in the marker list\n", gTracker.Body(i).Name().c_str());
+						}
+					}
+				}
+			}
+		}
+		break;
+		case HIERARCHY:
+		{
+			sHierarchy *p = (sHierarchy *)Data;
+			HierarchyWrapper lHierarchy(p);
+
+			// Frames queued before the change are still recorded with the old hierarchy
+			gStreams.Drain(GTR_DATA | HTR_DATA | HTR2_DATA);
+
+			gGotHierarchy = true;
+			gGtrSink.SetSegments(lHierarchy.Size());
+			gHtr2Sink.SetSegments(lHierarchy.Size());
+			gHtrSink.SetSegments(lHierarchy.Size());
+
+			for (int i = 0; i < gStreams.Streams(); i++)
+			{
+				if (gStreams.Stream(i).Type() & (GTR_DATA | HTR_DATA | HTR2_DATA))
+				{
+					gStreams.Stream(i).SetItems(lHierarchy.Size());
+				}
 			}
+
+			if (gGtrRecorder)	gGtrRecorder->SetHierarchy(lHierarchy);
+			if (gHtr2Recorder)	gHtr2Recorder->SetHierarchy(lHierarchy);
+			if (gHtrRecorder)	gHtrRecorder->SetHierarchy(lHierarchy);
+		}
+		break;
+		case DOF_NAMES:
+		{
+			gStreams.Drain(DOF_DATA);
+
+			gGotDofNames = true;
+			if (gDofRecorder)	gDofRecorder->SetDofNames(DofNamesWrapper((sDofNames *)Data));
+		}
+		break;
+		case ANALOG_NAMES:
+		{
+			gStreams.Drain(ANALOG_DATA);
+
+			gGotAnalogNames = true;
+			if (gAnalogRecorder)	gAnalogRecorder->SetAnalogNames(AnalogNamesWrapper((sAnalogNames *)Data));
+		}
+		break;
+		case CONTEXT_FRAME_RATE:
+		{
+			gPipeline.Drain();
+			gStreams.Drain(gStreams.Types());
+
+			gFrameRate = *(float *)Data;
+
+			if (gTrcRecorder)	gTrcRecorder->SetFrameRate(gFrameRate);
+			if (gGtrRecorder)	gGtrRecorder->SetFrameRate(gFrameRate);
+			if (gHtr2Recorder)	gHtr2Recorder->SetFrameRate(gFrameRate);
+			if (gHtrRecorder)	gHtrRecorder->SetFrameRate(gFrameRate);
+			if (gDofRecorder)	gDofRecorder->SetFrameRate(gFrameRate);
+			if (gAnalogRecorder)	gAnalogRecorder->SetFrameRate(gFrameRate);
+			if (gForceRecorder)	gForceRecorder->SetFrameRate(gFrameRate);
+
+			gValidator.SetRate((float) gFrameRate);
+			gFilter.SetRate((float) gFrameRate);
+			gPredictor.SetRate((float) gFrameRate);
+			gScheduler.SetCaptureRate(gFrameRate);
+			gJitter.SetCaptureRate(gFrameRate);
+			gPipeline.SetFrameRate(gFrameRate);
 		}
 		break;
 		case TRC_DATA:
 		{
-			TrcFrameWrapper f((sTrcFrame *)Data, numMarkers);
-			Point3 pt1;
-			Point3 pt2;
-
-			f.GetMarkerLocation(0, pt1);
-			f.GetMarkerLocation(2, pt2);
-			fprintf(stderr, "0, %f, %f, %f\n", pt1[0], pt1[1], pt1[2]);
-			fprintf(stderr, "2, %f, %f, %f\n", pt2[0], pt2[1], pt2[2]);
-
-			Point3 mid;
-			mid[0] = (pt1[0] + pt2[0]) / 2;
-			mid[1] = (pt1[1] + pt2[1]) / 2;
-			mid[2] = (pt1[2] + pt2[2]) / 2;
-
-			stringStream.clear();
-			stringStream.str(std::string());
-			stringStream << "head," << mid[0] << "," << mid[1] << "," << mid[2] << "\n";
-			copyOfStr = stringStream.str();
-			iResult = send(ConnectSocket, copyOfStr.c_str(), copyOfStr.length(), 0);
-			if (iResult == SOCKET_ERROR) {
-				printf("send failed with error: %d\n", WSAGetLastError());
+			// Everything else happens in the stages of the pipeline
+			if (!gPipeline.Push((sTrcFrame *)Data))
+			{
+				gTrcContinuity.AddDropped();
 			}
 		}
 		break;
@@ -278,6 +1286,34 @@ static int EVaRT_Data_Handler(int DataType, void *Data)
 	return 0;
 }
 
+// Called on a thread of its own when Ctrl+C is pressed or the console is closed.
+// Windows ends the process once the handler returns from a close, so the handler
+// waits a little while for main to write out the recordings.
+static BOOL WINAPI Console_Handler(DWORD CtrlType)
+{
+	switch (CtrlType)
+	{
+		case CTRL_C_EVENT:
+		case CTRL_BREAK_EVENT:
+		{
+			InterlockedExchange(&gStopRequested, 1);
+			return TRUE;
+		}
+		case CTRL_CLOSE_EVENT:
+		{
+			InterlockedExchange(&gStopRequested, 1);
+
+			for (int i = 0; i < CLOSE_WAIT / 50 && !gFinished; i++)
+			{
+				Sleep(50);
+			}
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 // Print error messages from calling EVaRT SDK functions
 static int Handle_Error(const char * msg, int code)
 {
@@ -303,4 +1339,199 @@ static int Handle_Error(const char * msg, int code)
 		}
 	}
 	return code;
-}
\ No newline at end of file
+}
+
+// Print the frame counters of a continuity tracker
+static void Print_Continuity(const char * msg, const FrameContinuity& continuity)
+{
+	printf("%s: received %ld, missing %ld in %d gaps, duplicate %ld, out of order %ld, dropped %ld, restarted %ld times\n",
+		msg, continuity.Received(), continuity.Missing(), continuity.Gaps(),
+		continuity.Duplicates(), continuity.OutOfOrder(), continuity.Dropped(), continuity.Restarts());
+}
+
+// Start every recorder, a recorder with a pre-trigger begins with its history
+static void Start_Recording()
+{
+	if (gTrcRecorder)	gTrcRecorder->Start();
+	if (gGtrRecorder)	gGtrRecorder->Start();
+	if (gHtr2Recorder)	gHtr2Recorder->Start();
+	if (gHtrRecorder)	gHtrRecorder->Start();
+	if (gDofRecorder)	gDofRecorder->Start();
+	if (gAnalogRecorder)	gAnalogRecorder->Start();
+	if (gForceRecorder)	gForceRecorder->Start();
+}
+
+// Keep the given seconds of history in every recorder until it is started
+static void Set_PreTrigger(double seconds)
+{
+	if (gTrcRecorder)	gTrcRecorder->SetPreTrigger(seconds);
+	if (gGtrRecorder)	gGtrRecorder->SetPreTrigger(seconds);
+	if (gHtr2Recorder)	gHtr2Recorder->SetPreTrigger(seconds);
+	if (gHtrRecorder)	gHtrRecorder->SetPreTrigger(seconds);
+	if (gDofRecorder)	gDofRecorder->SetPreTrigger(seconds);
+	if (gAnalogRecorder)	gAnalogRecorder->SetPreTrigger(seconds);
+	if (gForceRecorder)	gForceRecorder->SetPreTrigger(seconds);
+}
+
+// Stop a recording and add the rest of it to the end of session flush
+template<class F>
+static void Flush_Recording(SessionFlush& flush, RecorderBase<F>* recorder, RollingWriter<F>* writer)
+{
+	if (!recorder || !writer)	return;
+
+	recorder->Stop();
+	flush.Add(writer->NewFlushJob());
+}
+
+// Finalize the last segment of a flushed recording
+template<class F>
+static void Finish_Recording(const char * msg, RecorderBase<F>* recorder, RollingWriter<F>* writer)
+{
+	if (!recorder || !writer)	return;
+
+	writer->Finish();
+
+	Print_Continuity(msg, recorder->Continuity());
+}
+
+// Send the pose of every body that could be solved to PedSim
+// Add the latest center of pressure, force and free moment of each plate and of all plates together,
+// converted to the simulator's coordinates like the poses they are sent with
+static void Append_Forces(std::ostringstream& stringStream)
+{
+	float lForce[(MAX_FORCE_PLATES + 1) * FORCE_CHANNELS];
+	int lForceFrame;
+	int lPlates = gForceSink.GetLatest(lForce, lForceFrame);
+
+	for (int i = 0; i <= lPlates && lPlates > 0; i++)
+	{
+		float* values = lForce + i * FORCE_CHANNELS;
+
+		// an unloaded plate has no center of pressure, it stays XEMPTY
+		if (values[kCopX] != (float) XEMPTY)
+		{
+			gTransform.Apply(values + kCopX);
+		}
+		gTransform.ApplyDirection(values + kResultX);
+
+		// the free moment is about the vertical, Z, and is sent about where the vertical ends up
+		float lMoment[3] = { 0.0f, 0.0f, values[kFreeMoment] };
+		float lVertical[3] = { 0.0f, 0.0f, 1.0f };
+
+		gTransform.ApplyMoment(lMoment);
+		gTransform.ApplyDirection(lVertical);
+		values[kFreeMoment] = lMoment[0] * lVertical[0] + lMoment[1] * lVertical[1] + lMoment[2] * lVertical[2];
+
+		if (i < lPlates)	stringStream << "FORCE" << i + 1;
+		else				stringStream << "FORCE";
+
+		for (int k = 0; k < FORCE_CHANNELS; k++)
+		{
+			stringStream << "," << values[k];
+		}
+		stringStream << "\n";
+	}
+}
+
+static void Send_Poses(const PosePacket& packet, const PosePacket* predicted)
+{
+	std::ostringstream stringStream;
+	std::string copyOfStr;
+
+	for (int i = 0; i < (int) packet.poses.size() && i < gTracker.Bodies(); i++)
+	{
+		const BodyPose& pose = packet.poses[i];
+
+		if (pose.status != kPoseNone)
+		{
+			stringStream << gTracker.Body(i).Name() << "," <<
+				pose.position[0] << "," << pose.position[1] << "," << pose.position[2] << "," <<
+				pose.rotation[0] << "," << pose.rotation[1] << "," << pose.rotation[2] << "," << pose.rotation[3];
+
+			// followed by the predicted pose and how far ahead it is, the raw pose with 0 until there is one
+			if (predicted)
+			{
+				bool ahead = predicted->poses[i].status != kPoseNone;
+				const BodyPose& next = ahead ? predicted->poses[i] : pose;
+
+				stringStream << "," <<
+					next.position[0] << "," << next.position[1] << "," << next.position[2] << "," <<
+					next.rotation[0] << "," << next.rotation[1] << "," << next.rotation[2] << "," << next.rotation[3] << "," <<
+					(ahead ? gPredictor.Horizon() * 1000.0 : 0.0);
+			}
+			stringStream << "\n";
+		}
+	}
+
+	Append_Forces(stringStream);
+
+	copyOfStr = stringStream.str();
+	if (!copyOfStr.empty())
+	{
+		int iResult = send(ConnectSocket, copyOfStr.c_str(), copyOfStr.length(), 0);
+		if (iResult == SOCKET_ERROR) {
+			printf("send failed with error: %d\n", WSAGetLastError());
+		}
+	}
+}
+
+// Send the poses of a frame, or the midpoint of markers 0 and 2 when there are no bodies
+static void Publish_Frame(const PipelineFrame& frame)
+{
+	// Send the full pose of every body that could be solved
+	if (gTracker.Bodies() > 0)
+	{
+		if (gScheduler.IsRunning())
+		{
+			gScheduler.Add(frame.packets);
+		}
+		else if (gJitter.IsRunning())
+		{
+			gJitter.Add(frame.packets);
+		}
+		else
+		{
+			Send_Poses(frame.packets[0], frame.predicted ? &frame.packets[1] : NULL);
+		}
+		return;
+	}
+
+	Point3 pt1;
+	Point3 pt2;
+
+	frame.trc.GetMarkerLocation(0, pt1);
+	frame.trc.GetMarkerLocation(2, pt2);
+	// The validator and filler may already be on a later frame, so their status comes from the frame
+	if (gVerbose)
+	{
+		fprintf(stderr, "0, %f, %f, %f, %s, %s\n", pt1[0], pt1[1], pt1[2], FillStatusName(frame.filled[0]), SampleStatusName(frame.validated[0]));
+		fprintf(stderr, "2, %f, %f, %f, %s, %s\n", pt2[0], pt2[1], pt2[2], FillStatusName(frame.filled[2]), SampleStatusName(frame.validated[2]));
+	}
+
+	std::ostringstream stringStream;
+	std::string copyOfStr;
+
+	// An empty marker would put the head kilometres away, send no head until it can be filled again
+	if (pt1[0] != (float) XEMPTY && pt2[0] != (float) XEMPTY)
+	{
+		// The midpoint is made after the transform stage, so it is converted here
+		Point3 mid;
+		mid[0] = (pt1[0] + pt2[0]) / 2;
+		mid[1] = (pt1[1] + pt2[1]) / 2;
+		mid[2] = (pt1[2] + pt2[2]) / 2;
+		gTransform.Apply(mid);
+
+		stringStream << "head," << mid[0] << "," << mid[1] << "," << mid[2] << "\n";
+	}
+
+	Append_Forces(stringStream);
+
+	copyOfStr = stringStream.str();
+	if (!copyOfStr.empty())
+	{
+		int iResult = send(ConnectSocket, copyOfStr.c_str(), copyOfStr.length(), 0);
+		if (iResult == SOCKET_ERROR) {
+			printf("send failed with error: %d\n", WSAGetLastError());
+		}
+	}
+}
@@ -0,0 +1,370 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: outputscheduler.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the output scheduler.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "outputscheduler.h"
+#include "mathutil.h"
+#include "precisetimer.h"
+#include <process.h>
+
+
+// Interpolate one pose between two frames
+static void InterpolatePose( const BodyPose& a, const BodyPose& b, double t, BodyPose& out )
+{
+	// a pose that is missing on one side is taken from the other
+	if (a.status == kPoseNone || b.status == kPoseNone)
+	{
+		out = (a.status == kPoseNone) ? b : a;
+		return;
+	}
+
+	double qa[4] = { a.rotation[0], a.rotation[1], a.rotation[2], a.rotation[3] };
+	double qb[4] = { b.rotation[0], b.rotation[1], b.rotation[2], b.rotation[3] };
+	double q[4];
+	int k;
+
+	QuatSlerp( qa, qb, t, q );
+
+	out = (t < 0.5) ? a : b;
+	for (k = 0; k < 3; k++)		out.position[k] = (float) (a.position[k] + t * (b.position[k] - a.position[k]));
+	for (k = 0; k < 4; k++)		out.rotation[k] = (float) q[k];
+	out.error = (float) (a.error + t * (b.error - a.error));
+}
+
+
+// Constructor
+OutputScheduler::OutputScheduler()
+{
+	mSink = NULL;
+	mStreams = 0;
+	mBodies = 0;
+	mTickRate = 60.0;
+	mCaptureRate = 0.0;
+	mDelay = 0.0;
+	mNewest = 0;
+	mCount = 0;
+	mOffset = 0.0;
+	mHaveOffset = false;
+	mThread = NULL;
+	mTicks = 0;
+	mSkipped = 0;
+	mHeld = 0;
+	mLateSum = 0.0;
+
+	InitializeCriticalSection( &mLock );
+	mStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+}
+
+// Destructor
+OutputScheduler::~OutputScheduler()
+{
+	Stop();
+
+	CloseHandle( mStop );
+	DeleteCriticalSection( &mLock );
+}
+
+// Set the receiver of the samples
+void OutputScheduler::SetSink( OutputSink* sink )
+{
+	mSink = sink;
+}
+
+// Size the history for a number of streams of packets with a number of poses
+void OutputScheduler::SetLayout( int streams, int bodies )
+{
+	EnterCriticalSection( &mLock );
+
+	mStreams = streams > 0 ? streams : 0;
+	mBodies = bodies > 0 ? bodies : 0;
+
+	for (int i = 0; i < OUTPUT_HISTORY; i++)
+	{
+		mHistory[i].packets.resize( mStreams );
+
+		for (int s = 0; s < mStreams; s++)
+		{
+			mHistory[i].packets[s].poses.resize( mBodies );
+		}
+	}
+
+	mSample = mHistory[0].packets;
+	mCount = 0;
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Set the consumer's rate
+void OutputScheduler::SetTickRate( double rate )
+{
+	if (rate > 0.0)
+	{
+		mTickRate = rate;
+	}
+}
+
+// Set the capture rate, which places frames in time
+void OutputScheduler::SetCaptureRate( double rate )
+{
+	EnterCriticalSection( &mLock );
+
+	mCaptureRate = rate > 0.0 ? rate : 0.0;
+	mHaveOffset = false;
+	mCount = 0;
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Set how far behind each tick the history is sampled
+void OutputScheduler::SetDelay( double seconds )
+{
+	mDelay = seconds > 0.0 ? seconds : 0.0;
+}
+
+// Sampling delay in use
+double OutputScheduler::Delay() const
+{
+	if (mDelay > 0.0)
+	{
+		return mDelay;
+	}
+
+	// one capture interval to have a frame on either side, and a half to spare
+	return (mCaptureRate > 0.0 ? 1.5 / mCaptureRate : 0.0) + OUTPUT_JITTER;
+}
+
+// Start the tick thread
+bool OutputScheduler::Start()
+{
+	if (mThread)	return true;
+
+	ResetEvent( mStop );
+	mTicks = 0;
+	mSkipped = 0;
+	mHeld = 0;
+	mLateSum = 0.0;
+
+	mThread = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, this, 0, NULL );
+
+	return mThread != NULL;
+}
+
+// Stop the tick thread
+void OutputScheduler::Stop()
+{
+	if (!mThread)	return;
+
+	SetEvent( mStop );
+	WaitForSingleObject( mThread, INFINITE );
+	CloseHandle( mThread );
+	mThread = NULL;
+}
+
+// Is the tick thread running
+bool OutputScheduler::IsRunning() const
+{
+	return mThread != NULL;
+}
+
+// Number of samples sent
+unsigned long OutputScheduler::Ticks() const
+{
+	return mTicks;
+}
+
+// Number of ticks missed because the thread woke too late for them
+unsigned long OutputScheduler::Skipped() const
+{
+	return mSkipped;
+}
+
+// Number of samples for which no newer frame had arrived yet
+unsigned long OutputScheduler::Held() const
+{
+	return mHeld;
+}
+
+// Average time between a tick's deadline and the moment it was taken, seconds
+double OutputScheduler::TickError() const
+{
+	return mTicks > 0 ? mLateSum / mTicks : 0.0;
+}
+
+// Add the packets of a new frame to the history
+void OutputScheduler::Add( const PosePacket* packets )
+{
+	double now = mClock.Seconds();
+
+	EnterCriticalSection( &mLock );
+
+	if (mStreams > 0)
+	{
+		double time = now;
+
+		if (mCaptureRate > 0.0)
+		{
+			double frameTime = packets[0].frame / mCaptureRate;
+			double offset = now - frameTime;
+
+			// the earliest arrival is closest to the capture; a big jump means the frame numbers restarted
+			if (!mHaveOffset || offset < mOffset - 1.0 || offset > mOffset + 1.0)
+			{
+				mOffset = offset;
+				mHaveOffset = true;
+				mCount = 0;
+			}
+			else if (offset < mOffset)
+			{
+				mOffset = offset;
+			}
+			else
+			{
+				mOffset += OUTPUT_DRIFT * (offset - mOffset);
+			}
+
+			time = frameTime + mOffset;
+		}
+
+		mNewest = (mNewest + 1) % OUTPUT_HISTORY;
+		if (mCount < OUTPUT_HISTORY)	mCount++;
+
+		Entry& e = mHistory[mNewest];
+
+		e.time = time;
+		for (int s = 0; s < mStreams; s++)
+		{
+			e.packets[s] = packets[s];
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Interpolate the history at a time into mSample, false if there is nothing to send
+bool OutputScheduler::Sample( double time )
+{
+	bool rc = true;
+
+	EnterCriticalSection( &mLock );
+
+	if (mCount == 0 || time - mHistory[mNewest].time > OUTPUT_STALE)
+	{
+		rc = false;
+	}
+	else if (time >= mHistory[mNewest].time)
+	{
+		// nothing newer has arrived yet, send the newest frame
+		mSample = mHistory[mNewest].packets;
+		mHeld++;
+	}
+	else
+	{
+		// newest entry at or before the time, and the one after it
+		int after = mNewest;
+		int before = -1;
+
+		for (int n = 1; n < mCount; n++)
+		{
+			int i = (mNewest - n + OUTPUT_HISTORY) % OUTPUT_HISTORY;
+
+			if (mHistory[i].time <= time)
+			{
+				before = i;
+				break;
+			}
+			after = i;
+		}
+
+		if (before < 0)
+		{
+			// older than the history, send the oldest frame
+			mSample = mHistory[after].packets;
+		}
+		else
+		{
+			const Entry& a = mHistory[before];
+			const Entry& b = mHistory[after];
+			double span = b.time - a.time;
+			double t = (span > 0.0) ? (time - a.time) / span : 1.0;
+
+			for (int s = 0; s < mStreams; s++)
+			{
+				const PosePacket& pa = a.packets[s];
+				const PosePacket& pb = b.packets[s];
+				PosePacket& out = mSample[s];
+				int bodies = (int) out.poses.size();
+
+				out.frame = (t < 0.5) ? pa.frame : pb.frame;
+				out.solved = 0;
+
+				for (int i = 0; i < bodies && i < (int) pa.poses.size() && i < (int) pb.poses.size(); i++)
+				{
+					InterpolatePose( pa.poses[i], pb.poses[i], t, out.poses[i] );
+					if (out.poses[i].status != kPoseNone)	out.solved++;
+				}
+			}
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+
+	return rc;
+}
+
+// Thread entry point
+unsigned __stdcall OutputScheduler::ThreadProc( void* arg )
+{
+	((OutputScheduler*) arg)->Run();
+	return 0;
+}
+
+// Wait for each tick, sample the history and send it
+void OutputScheduler::Run()
+{
+	PreciseTimer timer;
+	double period = 1.0 / mTickRate;
+	double next = mClock.Seconds() + period;
+	double now;
+
+	SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_HIGHEST );
+
+	while (timer.WaitUntil( mClock, next, 1, &mStop ) < 0)
+	{
+		now = mClock.Seconds();
+
+		if (Sample( next - Delay() ) && mSink)
+		{
+			mSink->Send( mSample );
+			mTicks++;
+			mLateSum += now - next;
+		}
+
+		// ticks the thread was too late for are dropped, not sent in a burst
+		next += period;
+		now = mClock.Seconds();
+		while (next <= now)
+		{
+			next += period;
+			mSkipped++;
+		}
+	}
+}
@@ -0,0 +1,652 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: pipeline.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the stage graph.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "pipeline.h"
+#include <fstream>
+#include <sstream>
+#include <process.h>
+#include <string.h>
+
+#define INLINE_THREAD	"inline"
+
+
+// Constructor
+Pipeline::Pipeline()
+{
+	mFreeCount = PIPELINE_FRAMES;
+	for (int i = 0; i < PIPELINE_FRAMES; i++)
+	{
+		mFree[i] = i;
+	}
+	mDropped = 0;
+	mSequence = 0;
+
+	mPeriod = 0.0;
+	mDeadline = PIPELINE_DEADLINE;
+	mLevel = 0;
+	mLevelFrom = 0;
+	mInTime = 0;
+	mLate = 0;
+	mLogNext = 0;
+	mLogCount = 0;
+
+	InitializeCriticalSection( &mFreeLock );
+	InitializeCriticalSection( &mLogLock );
+	mIdle = CreateEvent( NULL, TRUE, TRUE, NULL );
+	mStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+}
+
+// Destructor
+Pipeline::~Pipeline()
+{
+	Stop();
+	Clear();
+
+	CloseHandle( mStop );
+	CloseHandle( mIdle );
+	DeleteCriticalSection( &mLogLock );
+	DeleteCriticalSection( &mFreeLock );
+}
+
+// Make a stage available to the graph under a type name, optional stages may be shed
+void Pipeline::AddType( const char* type, Stage* stage, bool optional )
+{
+	Type entry;
+
+	entry.name = type;
+	entry.stage = stage;
+	entry.optional = optional;
+	mTypes.push_back( entry );
+}
+
+// Read the graph from a file, see pipeline.h for the format
+bool Pipeline::Load( const char* filename )
+{
+	std::ifstream is( filename );
+	std::stringstream text;
+
+	if (!is.is_open())
+	{
+		mError = std::string( "can't open " ) + filename;
+		return false;
+	}
+
+	text << is.rdbuf();
+
+	return Parse( text.str().c_str() );
+}
+
+// Read the graph from text
+bool Pipeline::Parse( const char* text )
+{
+	std::istringstream is( text );
+	std::string line;
+	int lineNo = 0;
+
+	for (int running = 1; running < (int) mLanes.size(); running++)
+	{
+		if (mLanes[running].thread)
+		{
+			mError = "the pipeline is running";
+			return false;
+		}
+	}
+
+	Clear();
+
+	Lane inlineLane;
+
+	inlineLane.name = INLINE_THREAD;
+	inlineLane.owner = this;
+	inlineLane.index = 0;
+	inlineLane.thread = NULL;
+	inlineLane.available = NULL;
+	inlineLane.queue = NULL;
+	mLanes.push_back( inlineLane );
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		std::istringstream tokens( line );
+		std::string type;
+		std::string thread;
+		std::string after;
+		std::ostringstream where;
+
+		lineNo++;
+		where << "line " << lineNo << ": ";
+
+		if (!(tokens >> type))	continue;
+
+		if (!(tokens >> thread))
+		{
+			mError = where.str() + "no thread for " + type;
+			Clear();
+			return false;
+		}
+
+		Node node;
+		int i;
+
+		node.type = type;
+		node.stage = NULL;
+		node.optional = false;
+		node.waitFor = 0;
+		node.calls = 0;
+		node.total = 0.0;
+		node.max = 0.0;
+		node.estimate = 0.0;
+		node.shed = 0;
+		node.skipping = false;
+
+		for (i = 0; i < (int) mTypes.size(); i++)
+		{
+			if (mTypes[i].name == type)
+			{
+				node.stage = mTypes[i].stage;
+				node.optional = mTypes[i].optional;
+			}
+		}
+		for (i = 0; i < (int) mNodes.size(); i++)
+		{
+			if (mNodes[i].type == type)		node.stage = NULL;
+		}
+
+		if (!node.stage || (int) mNodes.size() >= PIPELINE_MAX_STAGES)
+		{
+			mError = where.str() + "unknown, repeated or too many stages at " + type;
+			Clear();
+			return false;
+		}
+
+		// the thread, new names start a worker
+		node.lane = -1;
+		for (i = 0; i < (int) mLanes.size(); i++)
+		{
+			if (mLanes[i].name == thread)	node.lane = i;
+		}
+		if (node.lane < 0)
+		{
+			Lane lane;
+
+			lane.name = thread;
+			lane.owner = this;
+			lane.index = (int) mLanes.size();
+			lane.thread = NULL;
+			lane.available = CreateSemaphore( NULL, 0, PIPELINE_FRAMES * PIPELINE_MAX_STAGES, NULL );
+			lane.queue = new FIFO<Task>( PIPELINE_FRAMES * PIPELINE_MAX_STAGES );
+			mLanes.push_back( lane );
+
+			node.lane = lane.index;
+		}
+
+		// predecessors must be listed above
+		int self = (int) mNodes.size();
+
+		while (tokens >> after)
+		{
+			int pred = -1;
+
+			if (after == "optional" || after == "critical")
+			{
+				node.optional = (after == "optional");
+				continue;
+			}
+
+			for (i = 0; i < self; i++)
+			{
+				if (mNodes[i].type == after)	pred = i;
+			}
+
+			if (pred < 0)
+			{
+				mError = where.str() + type + " runs after " + after + ", which is not listed above it";
+				Clear();
+				return false;
+			}
+
+			mNodes[pred].next.push_back( self );
+			node.waitFor++;
+		}
+
+		if ((self == 0) != (node.waitFor == 0))
+		{
+			mError = where.str() + "only the first stage runs after nothing";
+			Clear();
+			return false;
+		}
+		if (self == 0 && node.lane != 0)
+		{
+			mError = where.str() + "the first stage must be " INLINE_THREAD;
+			Clear();
+			return false;
+		}
+
+		mNodes.push_back( node );
+	}
+
+	if (mNodes.empty())
+	{
+		mError = "no stages";
+		Clear();
+		return false;
+	}
+
+	mError.erase();
+	return true;
+}
+
+// Capture rate the frames arrive at, stages are only shed once it is known
+void Pipeline::SetFrameRate( double rate )
+{
+	mPeriod = rate > 0.0 ? 1.0 / rate : 0.0;
+}
+
+// How many frame periods a frame may spend in the pipeline before it is late
+void Pipeline::SetDeadline( double periods )
+{
+	mDeadline = periods;
+}
+
+// Start a thread for every worker
+bool Pipeline::Start()
+{
+	ResetEvent( mStop );
+	mClock.Begin();
+
+	for (int i = 1; i < (int) mLanes.size(); i++)
+	{
+		if (mLanes[i].thread)	continue;
+
+		mLanes[i].thread = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, &mLanes[i], 0, NULL );
+		if (!mLanes[i].thread)
+		{
+			Stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Let the frames in flight finish, then stop the worker threads
+void Pipeline::Stop()
+{
+	Drain();
+	SetEvent( mStop );
+
+	for (int i = 1; i < (int) mLanes.size(); i++)
+	{
+		if (!mLanes[i].thread)	continue;
+
+		WaitForSingleObject( mLanes[i].thread, INFINITE );
+		CloseHandle( mLanes[i].thread );
+		mLanes[i].thread = NULL;
+	}
+}
+
+// Run a new frame through the graph
+bool Pipeline::Push( const sTrcFrame* data )
+{
+	if (mNodes.empty())		return false;
+
+	Slot* slot = NULL;
+
+	EnterCriticalSection( &mFreeLock );
+	if (mFreeCount > 0)
+	{
+		slot = &mSlots[mFree[--mFreeCount]];
+		slot->sequence = mSequence++;
+		ResetEvent( mIdle );
+	}
+	else
+	{
+		mDropped++;
+	}
+	LeaveCriticalSection( &mFreeLock );
+
+	if (!slot)	return false;
+
+	for (int i = 0; i < (int) mNodes.size(); i++)
+	{
+		slot->waiting[i] = mNodes[i].waitFor;
+	}
+	slot->remaining = (LONG) mNodes.size();
+	slot->frame.source = data;
+	slot->frame.predicted = false;
+	memset( slot->frame.validated, 0, sizeof(slot->frame.validated) );		// kSampleValid
+	memset( slot->frame.filled, 0, sizeof(slot->frame.filled) );			// kMarkerMeasured
+	slot->iFrame = data->iFrame;
+	slot->frame.arrival.Begin();
+
+	Run( slot, 0 );
+
+	return true;
+}
+
+// Wait until no frame is in flight
+void Pipeline::Drain()
+{
+	WaitForSingleObject( mIdle, INFINITE );
+}
+
+// Why the graph could not be read
+const std::string& Pipeline::Error() const
+{
+	return mError;
+}
+
+// Number of stages in the graph
+int Pipeline::Stages() const
+{
+	return (int) mNodes.size();
+}
+
+// Type of stage i
+const std::string& Pipeline::StageType( int i ) const
+{
+	return mNodes[i].type;
+}
+
+// Thread stage i runs on
+const std::string& Pipeline::StageThread( int i ) const
+{
+	return mLanes[mNodes[i].lane].name;
+}
+
+// Frames processed by stage i
+unsigned long Pipeline::StageCalls( int i ) const
+{
+	return mNodes[i].calls;
+}
+
+// Average time stage i took per frame, in microseconds
+double Pipeline::StageCostAverage( int i ) const
+{
+	return mNodes[i].calls > 0 ? mNodes[i].total / mNodes[i].calls : 0.0;
+}
+
+// Longest time stage i took for a frame, in microseconds
+double Pipeline::StageCostMax( int i ) const
+{
+	return mNodes[i].max;
+}
+
+// Can stage i be shed
+bool Pipeline::StageOptional( int i ) const
+{
+	return mNodes[i].optional;
+}
+
+// Frames stage i was shed on
+unsigned long Pipeline::StageShed( int i ) const
+{
+	return mNodes[i].shed;
+}
+
+// Current shedding level, optional stages run on one frame in 2^level
+int Pipeline::Level() const
+{
+	return (int) mLevel;
+}
+
+// Frames that missed their deadline
+unsigned long Pipeline::Late() const
+{
+	return mLate;
+}
+
+// The latest shedding events, oldest first
+void Pipeline::Events( std::vector<ShedEvent>& events ) const
+{
+	EnterCriticalSection( &mLogLock );
+
+	events.clear();
+	for (int i = 0; i < mLogCount; i++)
+	{
+		events.push_back( mLog[(mLogNext - mLogCount + i + PIPELINE_SHED_LOG) % PIPELINE_SHED_LOG] );
+	}
+
+	LeaveCriticalSection( &mLogLock );
+}
+
+// Number of worker threads
+int Pipeline::Threads() const
+{
+	return mLanes.empty() ? 0 : (int) mLanes.size() - 1;
+}
+
+// Frames dropped because no frame was free
+unsigned long Pipeline::Dropped() const
+{
+	return mDropped;
+}
+
+// Thread entry point
+unsigned __stdcall Pipeline::ThreadProc( void* arg )
+{
+	Lane* lane = (Lane*) arg;
+
+	lane->owner->RunLane( *lane );
+	return 0;
+}
+
+// Run the tasks queued for a worker until told to stop
+void Pipeline::RunLane( Lane& lane )
+{
+	HANDLE events[2] = { mStop, lane.available };
+	Task task;
+
+	while (WaitForMultipleObjects( 2, events, FALSE, INFINITE ) == WAIT_OBJECT_0 + 1)
+	{
+		if (lane.queue->GetNext( task ))
+		{
+			Run( task.slot, task.node );
+		}
+	}
+}
+
+// Run a stage on a frame, then every stage on the same thread that it makes ready
+void Pipeline::Run( Slot* slot, int node )
+{
+	bool ready[PIPELINE_MAX_STAGES];
+	int count = (int) mNodes.size();
+	int lane = mNodes[node].lane;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		ready[i] = false;
+	}
+	ready[node] = true;
+
+	// in the order of the file, which is an order the graph allows
+	for (i = node; i < count; i++)
+	{
+		if (!ready[i])	continue;
+
+		Node& n = mNodes[i];
+
+		if (!n.optional || Admit( slot, n, i ))
+		{
+			StopWatch watch;
+
+			n.stage->Process( slot->frame );
+
+			double us = watch.Microseconds();
+
+			n.calls++;
+			n.total += us;
+			if (us > n.max)		n.max = us;
+			n.estimate += (n.calls == 1 ? 1.0 : PIPELINE_COST_SMOOTHING) * (us * 1e-6 - n.estimate);
+		}
+		else
+		{
+			n.shed++;
+		}
+
+		for (int j = 0; j < (int) n.next.size(); j++)
+		{
+			int s = n.next[j];
+
+			if (InterlockedDecrement( &slot->waiting[s] ) != 0)	continue;
+
+			if (mNodes[s].lane == lane)
+			{
+				ready[s] = true;
+			}
+			else
+			{
+				Lane& other = mLanes[mNodes[s].lane];
+				Task task;
+
+				task.slot = slot;
+				task.node = s;
+				other.queue->Add( task );
+				ReleaseSemaphore( other.available, 1, NULL );
+			}
+		}
+
+		// the slot may be reused as soon as the last stage is done with it
+		if (InterlockedDecrement( &slot->remaining ) == 0)
+		{
+			Release( slot );
+		}
+	}
+}
+
+// Should an optional stage run on a frame, or be shed
+bool Pipeline::Admit( Slot* slot, Node& node, int index )
+{
+	if (mPeriod <= 0.0)		return true;
+
+	// decimated by the level, every optional stage skips the same frames
+	if (slot->sequence & ((1UL << mLevel) - 1))		return false;
+
+	// would make the frame late; the estimate decays while the stage is skipped,
+	// so it is tried again and its cost measured once the pipeline catches up
+	if (slot->frame.arrival.Seconds() + node.estimate > mDeadline * mPeriod)
+	{
+		if (!node.skipping)		Log( slot->iFrame, index, kShedDeadline );
+
+		node.skipping = true;
+		node.estimate *= 1.0 - PIPELINE_COST_SMOOTHING;
+		return false;
+	}
+
+	node.skipping = false;
+	return true;
+}
+
+// Return a frame to the free list, and raise or lower the level by how late it was
+void Pipeline::Release( Slot* slot )
+{
+	EnterCriticalSection( &mFreeLock );
+
+	if (mPeriod > 0.0)
+	{
+		bool late = slot->frame.arrival.Seconds() > mDeadline * mPeriod;
+		bool backlog = PIPELINE_FRAMES - mFreeCount > PIPELINE_BACKLOG;
+		int frame = slot->iFrame;
+
+		if (late)	mLate++;
+
+		if (late || backlog)
+		{
+			mInTime = 0;
+
+			// frames admitted before the last change don't show its effect yet
+			if (mLevel < PIPELINE_MAX_LEVEL && slot->sequence >= mLevelFrom)
+			{
+				InterlockedIncrement( &mLevel );
+				mLevelFrom = mSequence;
+				Log( frame, -1, late ? kShedLate : kShedBacklog );
+			}
+		}
+		else if (mLevel > 0 && ++mInTime >= PIPELINE_RECOVER)
+		{
+			mInTime = 0;
+			InterlockedDecrement( &mLevel );
+			mLevelFrom = mSequence;
+			Log( frame, -1, kShedRecovered );
+		}
+	}
+
+	slot->frame.source = NULL;
+	mFree[mFreeCount++] = (int) (slot - mSlots);
+	if (mFreeCount == PIPELINE_FRAMES)
+	{
+		SetEvent( mIdle );
+	}
+
+	LeaveCriticalSection( &mFreeLock );
+}
+
+// Add an entry to the shedding log, the oldest is overwritten when it is full
+void Pipeline::Log( int frame, int stage, ShedReason reason )
+{
+	EnterCriticalSection( &mLogLock );
+
+	ShedEvent& event = mLog[mLogNext];
+
+	event.time = mClock.Seconds();
+	event.frame = frame;
+	event.stage = stage;
+	event.level = (int) mLevel;
+	event.reason = reason;
+
+	mLogNext = (mLogNext + 1) % PIPELINE_SHED_LOG;
+	if (mLogCount < PIPELINE_SHED_LOG)	mLogCount++;
+
+	LeaveCriticalSection( &mLogLock );
+}
+
+// Forget the graph
+void Pipeline::Clear()
+{
+	for (int i = 1; i < (int) mLanes.size(); i++)
+	{
+		CloseHandle( mLanes[i].available );
+		delete mLanes[i].queue;
+	}
+
+	mLanes.clear();
+	mNodes.clear();
+}
+
+
+// Short name of a shedding reason, for printing
+const char* ShedReasonName( ShedReason reason )
+{
+	switch (reason)
+	{
+	case kShedDeadline:		return "deadline";
+	case kShedLate:			return "late";
+	case kShedBacklog:		return "backlog";
+	case kShedRecovered:	return "recovered";
+	}
+
+	return "unknown";
+}
@@ -0,0 +1,93 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: precisetimer.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the precise timer.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "precisetimer.h"
+#include <mmsystem.h>
+
+#define MAX_TIMER_EVENTS	(MAXIMUM_WAIT_OBJECTS - 1)
+
+
+// Constructor
+PreciseTimer::PreciseTimer()
+{
+	timeBeginPeriod( 1 );
+	mTimer = CreateWaitableTimer( NULL, FALSE, NULL );
+}
+
+// Destructor
+PreciseTimer::~PreciseTimer()
+{
+	CancelWaitableTimer( mTimer );
+	CloseHandle( mTimer );
+	timeEndPeriod( 1 );
+}
+
+// Wait until a time on the clock, or until an event is signaled
+int PreciseTimer::WaitUntil( const StopWatch& clock, double time, int count, const HANDLE* events )
+{
+	HANDLE handles[MAX_TIMER_EVENTS + 1];
+	DWORD rc;
+	int i;
+
+	if (count > MAX_TIMER_EVENTS)	count = MAX_TIMER_EVENTS;
+
+	for (i = 0; i < count; i++)
+	{
+		handles[i] = events[i];
+	}
+	handles[count] = mTimer;
+
+	double wait = time - TIMER_SPIN - clock.Seconds();
+
+	// sleep most of the way, in 100 ns units, negative for a relative time
+	if (wait > 0.0)
+	{
+		LARGE_INTEGER due;
+
+		due.QuadPart = -(LONGLONG) (wait * 1e7);
+		SetWaitableTimer( mTimer, &due, 0, NULL, NULL, FALSE );
+
+		rc = WaitForMultipleObjects( count + 1, handles, FALSE, INFINITE );
+		if ((DWORD) (rc - WAIT_OBJECT_0) < (DWORD) count)
+		{
+			CancelWaitableTimer( mTimer );
+			return (int) (rc - WAIT_OBJECT_0);
+		}
+	}
+	else if (count > 0)
+	{
+		rc = WaitForMultipleObjects( count, handles, FALSE, 0 );
+		if ((DWORD) (rc - WAIT_OBJECT_0) < (DWORD) count)
+		{
+			return (int) (rc - WAIT_OBJECT_0);
+		}
+	}
+
+	// and the rest of the way on the counter
+	while (clock.Seconds() < time)
+	{
+		SwitchToThread();
+	}
+
+	return -1;
+}
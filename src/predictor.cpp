@@ -0,0 +1,288 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: predictor.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the pose predictor.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "predictor.h"
+#include "mathutil.h"
+
+static const double kDegrees = 57.29577951308232;
+
+
+// Constructor
+PosePredictor::PosePredictor()
+{
+	mRate = 120.0;
+	mHorizon = 0.0;
+	mAuto = false;
+	mExtra = 0.0;
+
+	Reset();
+}
+
+// Set the number of bodies, their history is lost
+void PosePredictor::SetBodies( int count )
+{
+	mBodies.resize( count > 0 ? count : 0 );
+	Reset();
+}
+
+// Set the frame rate, which turns frame numbers into time
+void PosePredictor::SetRate( float rate )
+{
+	if (rate > 0.0f)
+	{
+		mRate = rate;
+	}
+}
+
+// Predict a fixed time ahead
+void PosePredictor::SetHorizon( double seconds )
+{
+	mAuto = false;
+	mHorizon = seconds < 0.0 ? 0.0 : (seconds > PREDICT_MAX_HORIZON ? PREDICT_MAX_HORIZON : seconds);
+}
+
+// Predict ahead by the reported latency plus a fixed allowance
+void PosePredictor::SetAutoHorizon( double extra )
+{
+	mAuto = true;
+	mExtra = extra < 0.0 ? 0.0 : extra;
+	mHorizon = mExtra;
+}
+
+// Add the lag of the stages before the predictor for this frame
+void PosePredictor::ReportLatency( double seconds )
+{
+	mLatency = mHaveLatency ? mLatency + PREDICT_SMOOTHING * (seconds - mLatency) : seconds;
+	mHaveLatency = true;
+
+	if (mAuto)
+	{
+		double h = mLatency + mExtra;
+
+		mHorizon = h < 0.0 ? 0.0 : (h > PREDICT_MAX_HORIZON ? PREDICT_MAX_HORIZON : h);
+	}
+}
+
+// Forget the history and errors of every body
+void PosePredictor::Reset()
+{
+	for (int i = 0; i < (int) mBodies.size(); i++)
+	{
+		BodyState& s = mBodies[i];
+
+		s.frame = -1;
+		s.moving = false;
+		s.first = 0;
+		s.count = 0;
+		s.positionSum = 0.0;
+		s.angleSum = 0.0;
+		s.checked = 0;
+	}
+
+	mLatency = 0.0;
+	mHaveLatency = false;
+}
+
+// Current horizon, seconds
+double PosePredictor::Horizon() const
+{
+	return mHorizon;
+}
+
+// Is the horizon measured
+bool PosePredictor::IsAuto() const
+{
+	return mAuto;
+}
+
+// Rms distance between the predicted and the actual position of a body
+double PosePredictor::PositionError( int body ) const
+{
+	const BodyState& s = mBodies[body];
+
+	return s.checked > 0 ? sqrt( s.positionSum / s.checked ) : 0.0;
+}
+
+// Rms angle between the predicted and the actual rotation of a body, degrees
+double PosePredictor::AngleError( int body ) const
+{
+	const BodyState& s = mBodies[body];
+
+	return s.checked > 0 ? sqrt( s.angleSum / s.checked ) * kDegrees : 0.0;
+}
+
+// Number of predictions of a body compared with the frames that arrived
+int PosePredictor::Checked( int body ) const
+{
+	return mBodies[body].checked;
+}
+
+// Predict every body one horizon ahead of the packet
+void PosePredictor::Predict( const PosePacket& packet, PosePacket& predicted )
+{
+	int count = (int) mBodies.size() < (int) packet.poses.size() ? (int) mBodies.size() : (int) packet.poses.size();
+
+	predicted.frame = packet.frame;
+	predicted.solved = 0;
+	predicted.poses.resize( packet.poses.size() );
+
+	for (int i = 0; i < count; i++)
+	{
+		const BodyPose& pose = packet.poses[i];
+		BodyPose& out = predicted.poses[i];
+		BodyState& s = mBodies[i];
+
+		out = pose;
+
+		if (pose.status == kPoseNone)
+		{
+			continue;
+		}
+
+		double p[3] = { pose.position[0], pose.position[1], pose.position[2] };
+		double q[4] = { pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3] };
+		int k;
+
+		// score the predictions made for the time up to this frame
+		if (s.frame >= 0 && pose.frame > s.frame)
+		{
+			Check( s, pose.frame, p, q );
+		}
+
+		// velocities from the last two poses, if they are close enough in time
+		double dt = (s.frame >= 0) ? (pose.frame - s.frame) / mRate : 0.0;
+
+		if (dt > 0.0 && dt <= PREDICT_MAX_STEP)
+		{
+			double inverse[4];
+			double delta[4];
+			double r[3];
+
+			QuatConjugate( s.rotation, inverse );
+			QuatMultiply( q, inverse, delta );
+			QuatToRotationVector( delta, r );
+
+			for (k = 0; k < 3; k++)
+			{
+				s.velocity[k] = (p[k] - s.position[k]) / dt;
+				s.angular[k] = r[k] / dt;
+			}
+			s.moving = true;
+		}
+		else if (dt != 0.0)
+		{
+			// too long since the last pose, or frames went backwards
+			s.moving = false;
+			s.count = 0;
+		}
+
+		if (dt != 0.0 || s.frame < 0)
+		{
+			s.frame = pose.frame;
+			for (k = 0; k < 3; k++)		s.position[k] = p[k];
+			for (k = 0; k < 4; k++)		s.rotation[k] = q[k];
+		}
+
+		if (!s.moving)
+		{
+			out.status = kPoseNone;
+			continue;
+		}
+
+		// carry the pose forward at constant velocities
+		double r[3];
+		double step[4];
+		double qp[4];
+		double pp[3];
+
+		for (k = 0; k < 3; k++)
+		{
+			pp[k] = p[k] + s.velocity[k] * mHorizon;
+			r[k] = s.angular[k] * mHorizon;
+		}
+		QuatFromRotationVector( r, step );
+		QuatMultiply( step, q, qp );
+		QuatNormalize( qp );
+
+		for (k = 0; k < 3; k++)		out.position[k] = (float) pp[k];
+		for (k = 0; k < 4; k++)		out.rotation[k] = (float) qp[k];
+		predicted.solved++;
+
+		// keep it to compare with the frame it was made for, dropping the oldest when full
+		if (mHorizon > 0.0)
+		{
+			if (s.count == PREDICT_PENDING)
+			{
+				s.first = (s.first + 1) % PREDICT_PENDING;
+				s.count--;
+			}
+
+			Pending& pending = s.pending[(s.first + s.count) % PREDICT_PENDING];
+
+			pending.frame = pose.frame + mHorizon * mRate;
+			for (k = 0; k < 3; k++)		pending.position[k] = pp[k];
+			for (k = 0; k < 4; k++)		pending.rotation[k] = qp[k];
+			s.count++;
+		}
+	}
+}
+
+// Compare the predictions for times up to a new frame with the pose interpolated from the last and new frames
+void PosePredictor::Check( BodyState& s, int frame, const double position[3], const double rotation[4] )
+{
+	while (s.count > 0)
+	{
+		Pending& pending = s.pending[s.first];
+
+		if (pending.frame > frame)	break;
+
+		// made for a time before the last pose, there is nothing to compare with
+		if (pending.frame >= s.frame)
+		{
+			double t = (pending.frame - s.frame) / (double) (frame - s.frame);
+			double actual[4];
+			double inverse[4];
+			double delta[4];
+			double r[3];
+			double d2 = 0.0;
+
+			for (int k = 0; k < 3; k++)
+			{
+				double d = s.position[k] + t * (position[k] - s.position[k]) - pending.position[k];
+				d2 += d*d;
+			}
+
+			QuatSlerp( s.rotation, rotation, t, actual );
+			QuatConjugate( pending.rotation, inverse );
+			QuatMultiply( actual, inverse, delta );
+			QuatToRotationVector( delta, r );
+
+			s.positionSum += d2;
+			s.angleSum += r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+			s.checked++;
+		}
+
+		s.first = (s.first + 1) % PREDICT_PENDING;
+		s.count--;
+	}
+}
@@ -23,6 +23,13 @@
 
 #include "recorders.h"
 
+
+// Is frame a from before frame b, allowing for EVaRT starting its frame numbers over in between
+static bool IsBefore( int a, int b )
+{
+	return (a < b && b - a <= CONTINUITY_RESTART) || a > b + CONTINUITY_RESTART;
+}
+
 //
 // Class to record TRC data from EVaRT
 //
@@ -41,37 +48,85 @@ void TrcRecorder::SetMarkerList( const MarkerListWrapper& list )
 	mMarkerList = list;
 }
 
-// Write current data to the specified stream
-void TrcRecorder::Output( std::ostream& os, bool header )
+// Write the marker names to the specified stream
+void TrcRecorder::OutputHeader( std::ostream& os )
 {
-	int i;
+	os << "Marker Names" << std::endl;
 
-	if (header)
+	for (int i = 0; i < mMarkerList.Size(); i++)
 	{
-		os << "Marker Names" << std::endl;
+		os << mMarkerList.Name(i) << std::endl;
+	}
 
-		for (i = 0; i < mMarkerList.Size(); i++)
-		{
-			os << mMarkerList.Name(i) << std::endl;
-		}
+	os << std::endl << std::endl;
+}
 
-		os << std::endl << std::endl;
+// Write one frame to the specified stream
+void TrcRecorder::OutputFrame( std::ostream& os, const TrcFrameWrapper& f )
+{
+	Point3 pt;
+
+	os << "Frame #" << f.Frame()+1 << ",X,Y,Z" << std::endl;	
+	for (int i = 0; i < f.Size(); i++)
+	{
+		f.GetMarkerLocation(i,pt);
+
+		os << mMarkerList.Name(i) << "," << pt[0] << "," << pt[1] << "," << pt[2] << std::endl;
 	}
+}
 
+// Name of the recorded data type
+const char* TrcRecorder::TypeName() const
+{
+	return "TRC";
+}
+
+// Write current data to a compressed archive, the archive must already be open
+void TrcRecorder::OutputArchive( TrcArchiveWriter& archive )
+{
 	TrcFrameWrapper f;
-	Point3 pt;
 
-	while (mFifo.Size() > 0)
+	while (GetNext(f))
 	{
-		if (mFifo.GetNext(f))
+		archive.Add(f);
+	}
+}
+
+// Write current data to a C3D file, the file must already be open
+void TrcRecorder::OutputC3d( C3dWriter& c3d )
+{
+	TrcFrameWrapper f;
+
+	while (GetNext(f))
+	{
+		c3d.Add(f);
+	}
+}
+
+// Write current data to a C3D file along with the analog data, the file must already be open.
+// Analog frames are paired with the TRC frame of the same iFrame; those without one are dropped,
+// and a TRC frame without one gets zero samples.
+void TrcRecorder::OutputC3d( C3dWriter& c3d, AnalogRecorder& analog )
+{
+	TrcFrameWrapper f;
+	AnalogFrameWrapper a;
+	bool pending = analog.GetNext(a);
+
+	while (GetNext(f))
+	{
+		while (pending && IsBefore(a.Frame(), f.Frame()))
 		{
-			os << "Frame #" << f.Frame()+1 << ",X,Y,Z" << std::endl;	
-			for (i = 0; i < f.Size(); i++)
-			{
-				f.GetMarkerLocation(i,pt);
+			pending = analog.GetNext(a);
+		}
 
-				os << mMarkerList.Name(i) << "," << pt[0] << "," << pt[1] << "," << pt[2] << std::endl;
-			}
+		if (pending && a.Frame() == f.Frame())
+		{
+			c3d.Add(f, a);
+			pending = analog.GetNext(a);
+		}
+		else
+		{
+			c3d.Add(f);
 		}
 	}
 }
@@ -96,42 +151,123 @@ void SegmentRecorder::SetHierarchy( const HierarchyWrapper& hierarchy )
 	mHierarchy = hierarchy;
 }
 
-// Write current data to the specified stream
-void SegmentRecorder::Output( std::ostream& os, bool header )
+// Write the skeletal hierarchy to the specified stream
+void SegmentRecorder::OutputHeader( std::ostream& os )
 {
-	int i;
+	os << "CHILD,PARENT" << std::endl;
 
-	if (header)
+	for (int i = 0; i < mHierarchy.Size(); i++)
 	{
-		os << "CHILD,PARENT" << std::endl;
+		os << mHierarchy.Name(i) << "," << mHierarchy.NameOfParent(i) << std::endl;
+	}
 
-		for (i = 0; i < mHierarchy.Size(); i++)
-		{
-			os << mHierarchy.Name(i) << "," << mHierarchy.NameOfParent(i) << std::endl;
-		}
+	os << std::endl << std::endl;
+}
+
+// Write one frame to the specified stream
+void SegmentRecorder::OutputFrame( std::ostream& os, const SegmentFrameWrapper& f )
+{
+	SegmentInfo seg;
+
+	os << "Frame #" << f.Frame()+1 << ",X,Y,Z,aX,aY,aZ,Length" << std::endl;	
+	for (int i = 0; i < f.Size(); i++)
+	{
+		f.GetSegmentInfo(i,seg);
 
-		os << std::endl << std::endl;
+		os << mHierarchy.Name(i) << "," << 
+			seg[0] << "," << seg[1] << "," << seg[2] << "," << 
+			seg[3] << "," << seg[4] << "," << seg[5] << "," <<
+			seg[6] << std::endl;
 	}
+}
 
-	SegmentFrameWrapper f;
-	SegmentInfo seg;
+// Name of the recorded data type
+const char* SegmentRecorder::TypeName() const
+{
+	return "SEGMENT";
+}
+
+
+//
+// Class to record HTR data from EVaRT
+//
+
+// Constructor
+HtrRecorder::HtrRecorder( unsigned long maxSize ) : RecorderBase<HtrFrameWrapper>(maxSize)
+{
+	mFullLayout = false;
+}
+
+// Destructor
+HtrRecorder::~HtrRecorder()
+{}
+
+// Set the skeletal hierarchy
+void HtrRecorder::SetHierarchy( const HierarchyWrapper& hierarchy )
+{
+	mHierarchy = hierarchy;
+}
+
+// Write every segment's translation, as SegmentRecorder does, instead of the root only
+void HtrRecorder::SetFullLayout( bool full )
+{
+	mFullLayout = full;
+}
+
+// Write the skeletal hierarchy to the specified stream, marked as HTR unless the frames have the segment layout
+void HtrRecorder::OutputHeader( std::ostream& os )
+{
+	os << (mFullLayout ? "CHILD,PARENT" : "HTR,CHILD,PARENT") << std::endl;
+
+	for (int i = 0; i < mHierarchy.Size(); i++)
+	{
+		os << mHierarchy.Name(i) << "," << mHierarchy.NameOfParent(i) << std::endl;
+	}
+
+	os << std::endl << std::endl;
+}
+
+// Write one frame to the specified stream
+void HtrRecorder::OutputFrame( std::ostream& os, const HtrFrameWrapper& f )
+{
+	HtrSegmentInfo seg;
+	Point3 loc;
 
-	while (mFifo.Size() > 0)
+	if (mFullLayout)
 	{
-		if (mFifo.GetNext(f))
+		// the translations are only approximate, see HtrFrameWrapper::GetTranslation()
+		os << "Frame #" << f.Frame()+1 << ",~X,~Y,~Z,aX,aY,aZ,Length" << std::endl;	
+		for (int i = 0; i < f.Size(); i++)
 		{
-			os << "Frame #" << f.Frame()+1 << ",X,Y,Z,aX,aY,aZ,Length" << std::endl;	
-			for (i = 0; i < f.Size(); i++)
-			{
-				f.GetSegmentInfo(i,seg);
+			f.GetTranslation(mHierarchy,i,loc);
+			f.GetSegmentInfo(i,seg);
 
-				os << mHierarchy.Name(i) << "," << 
-					seg[0] << "," << seg[1] << "," << seg[2] << "," << 
-					seg[3] << "," << seg[4] << "," << seg[5] << "," <<
-					seg[6] << std::endl;
-			}
+			os << mHierarchy.Name(i) << "," << 
+				loc[0] << "," << loc[1] << "," << loc[2] << "," << 
+				seg[0] << "," << seg[1] << "," << seg[2] << "," <<
+				seg[3] << std::endl;
 		}
+		return;
 	}
+
+	f.GetRootPosition(loc);
+
+	os << "Frame #" << f.Frame()+1 << ",aX,aY,aZ,Length" << std::endl;	
+	os << "Root," << loc[0] << "," << loc[1] << "," << loc[2] << std::endl;
+	for (int i = 0; i < f.Size(); i++)
+	{
+		f.GetSegmentInfo(i,seg);
+
+		os << mHierarchy.Name(i) << "," << 
+			seg[0] << "," << seg[1] << "," << seg[2] << "," << 
+			seg[3] << std::endl;
+	}
+}
+
+// Name of the recorded data type
+const char* HtrRecorder::TypeName() const
+{
+	return "HTR";
 }
 
 
@@ -155,38 +291,133 @@ void DofRecorder::SetDofNames( const DofNamesWrapper& names )
 	mDofNames = names;
 }
 
-// Write current data to the specified stream
-void DofRecorder::Output( std::ostream& os, bool header )
+// Write the DOF names to the specified stream
+void DofRecorder::OutputHeader( std::ostream& os )
+{
+	os << "Frame #,";
+
+	for (int i = 0; i < mDofNames.Size(); i++)
+	{
+		os << mDofNames.Name(i) << ",";
+	}
+
+	os << std::endl;
+}
+
+// Write one frame to the specified stream
+void DofRecorder::OutputFrame( std::ostream& os, const DofFrameWrapper& f )
 {
-	int i;
+	double value;
 
-	if (header)
+	os << f.Frame()+1 << ",";	
+	for (int i = 0; i < f.Size(); i++)
 	{
-		os << "Frame #,";
+		f.GetDofValue(i,value);
+
+		os << value << ",";
+	}
+	os << std::endl;
+}
+
+// Name of the recorded data type
+const char* DofRecorder::TypeName() const
+{
+	return "DOF";
+}
+
+//
+// Class to record analog data from EVaRT
+//
+
+// Constructor
+AnalogRecorder::AnalogRecorder( unsigned long maxSize ) : RecorderBase<AnalogFrameWrapper>(maxSize)
+{}
+
+// Destructor
+AnalogRecorder::~AnalogRecorder()
+{}
 
-		for (i = 0; i < mDofNames.Size(); i++)
+// Set the analog channel names
+void AnalogRecorder::SetAnalogNames( const AnalogNamesWrapper& names )
+{
+	mAnalogNames = names;
+}
+
+// Write the channel names to the specified stream
+void AnalogRecorder::OutputHeader( std::ostream& os )
+{
+	os << "Frame #,Sample,";
+
+	for (int i = 0; i < mAnalogNames.Size(); i++)
+	{
+		os << mAnalogNames.Name(i) << ",";
+	}
+
+	os << std::endl;
+}
+
+// Write one frame to the specified stream, a line for each sample
+void AnalogRecorder::OutputFrame( std::ostream& os, const AnalogFrameWrapper& f )
+{
+	const short* data = f.Data();
+
+	for (int s = 0; s < f.Samples(); s++)
+	{
+		os << f.Frame()+1 << "," << s+1 << ",";
+		for (int i = 0; i < f.Channels(); i++)
 		{
-			os << mDofNames.Name(i) << ",";
+			os << *data++ << ",";
 		}
-
 		os << std::endl;
 	}
+}
+
+// Name of the recorded data type
+const char* AnalogRecorder::TypeName() const
+{
+	return "Analog";
+}
 
-	DofFrameWrapper f;
-	double value;
 
-	while (mFifo.Size() > 0)
+//
+// Class to record force plate data from EVaRT
+//
+
+// Constructor
+ForceRecorder::ForceRecorder( unsigned long maxSize ) : RecorderBase<ForceFrameWrapper>(maxSize)
+{}
+
+// Destructor
+ForceRecorder::~ForceRecorder()
+{}
+
+// Write the column names to the specified stream
+void ForceRecorder::OutputHeader( std::ostream& os )
+{
+	os << "Frame #,Sample,Plate,X,Y,Z,fX,fY,fZ,MZ," << std::endl;
+}
+
+// Write one frame to the specified stream, a line for each plate of each sample
+void ForceRecorder::OutputFrame( std::ostream& os, const ForceFrameWrapper& f )
+{
+	const float* data = f.Data();
+
+	for (int s = 0; s < f.Samples(); s++)
 	{
-		if (mFifo.GetNext(f))
+		for (int p = 0; p < f.Plates(); p++)
 		{
-			os << f.Frame()+1 << ",";	
-			for (i = 0; i < f.Size(); i++)
+			os << f.Frame()+1 << "," << s+1 << "," << p+1 << ",";
+			for (int i = 0; i < FORCE_VALUES; i++)
 			{
-				f.GetDofValue(i,value);
-
-				os << value << ",";
+				os << *data++ << ",";
 			}
 			os << std::endl;
 		}
 	}
 }
+
+// Name of the recorded data type
+const char* ForceRecorder::TypeName() const
+{
+	return "Force";
+}
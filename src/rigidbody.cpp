@@ -0,0 +1,409 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: rigidbody.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the rigid body solver.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "rigidbody.h"
+#include "mathutil.h"
+#include <fstream>
+#include <sstream>
+
+// the eigenvalue gap, relative to the spread of the markers, below which
+// the visible markers are too close to a line to give a rotation
+static const double kDegenerateGap = 1e-6;
+
+
+// Constructor
+RigidBody::RigidBody( const std::string& name ) : mName( name )
+{
+	mCount = 0;
+	mHasReference = true;
+	mResolved = false;
+
+	for (int i = 0; i < MAX_BODY_MARKERS; i++)
+	{
+		mIndex[i] = -1;
+		mReference[i][0] = mReference[i][1] = mReference[i][2] = 0.0;
+	}
+
+	Reset();
+}
+
+// Add a marker whose reference position will be taken from the data by Calibrate()
+bool RigidBody::AddMarker( const std::string& name )
+{
+	if (mCount >= MAX_BODY_MARKERS)	return false;
+
+	mMarkerNames.push_back( name );
+	mIndex[mCount++] = -1;
+	mHasReference = false;
+	mResolved = false;
+
+	return true;
+}
+
+// Add a marker with a known position in body coordinates
+bool RigidBody::AddMarker( const std::string& name, const Point3 reference )
+{
+	if (mCount >= MAX_BODY_MARKERS)	return false;
+
+	mMarkerNames.push_back( name );
+	mIndex[mCount] = -1;
+	mReference[mCount][0] = reference[0];
+	mReference[mCount][1] = reference[1];
+	mReference[mCount][2] = reference[2];
+	mCount++;
+	mResolved = false;
+
+	return true;
+}
+
+// Look up the body's markers in the marker list, returns false if any are missing
+bool RigidBody::Resolve( const MarkerListWrapper& markers )
+{
+	mResolved = (mCount > 0);
+
+	for (int i = 0; i < mCount; i++)
+	{
+		mIndex[i] = -1;
+
+		for (int j = 0; j < markers.Size(); j++)
+		{
+			if (markers.Name(j) == mMarkerNames[i])
+			{
+				mIndex[i] = j;
+				break;
+			}
+		}
+
+		if (mIndex[i] < 0)	mResolved = false;
+	}
+
+	return mResolved;
+}
+
+// Take the reference geometry from a frame, every marker must be visible
+bool RigidBody::Calibrate( const TrcFrameWrapper& frame )
+{
+	double pos[MAX_BODY_MARKERS][3];
+	double centroid[3] = { 0.0, 0.0, 0.0 };
+	Point3 pt;
+
+	if (!mResolved)	return false;
+
+	for (int i = 0; i < mCount; i++)
+	{
+		if (mIndex[i] >= frame.Size())	return false;
+
+		frame.GetMarkerLocation( mIndex[i], pt );
+		if (pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY)
+		{
+			return false;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			pos[i][k] = pt[k];
+			centroid[k] += pt[k] / mCount;
+		}
+	}
+
+	for (int i = 0; i < mCount; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			mReference[i][k] = pos[i][k] - centroid[k];
+		}
+	}
+
+	mHasReference = true;
+	Reset();
+
+	return true;
+}
+
+// Forget the last pose, the next partial solve has no rotation to fall back on
+void RigidBody::Reset()
+{
+	mLast.frame = -1;
+	mLast.position[0] = mLast.position[1] = mLast.position[2] = 0.0f;
+	mLast.rotation[0] = 1.0f;
+	mLast.rotation[1] = mLast.rotation[2] = mLast.rotation[3] = 0.0f;
+	mLast.error = 0.0f;
+	mLast.markers = 0;
+	mLast.status = kPoseNone;
+}
+
+// Name of the body
+const std::string& RigidBody::Name() const
+{
+	return mName;
+}
+
+// Number of markers in the body
+int RigidBody::Markers() const
+{
+	return mCount;
+}
+
+// Name of marker i of the body
+const std::string& RigidBody::MarkerName( int i ) const
+{
+	return mMarkerNames[i];
+}
+
+// Index of marker i of the body in the TRC frame, -1 if it is not in the marker list
+int RigidBody::MarkerIndex( int i ) const
+{
+	return mIndex[i];
+}
+
+// Position of marker i of the body in body coordinates
+void RigidBody::GetReference( int i, double ref[3] ) const
+{
+	ref[0] = mReference[i][0];
+	ref[1] = mReference[i][1];
+	ref[2] = mReference[i][2];
+}
+
+// Were all markers found in the marker list
+bool RigidBody::IsResolved() const
+{
+	return mResolved;
+}
+
+// Is the reference geometry known
+bool RigidBody::IsCalibrated() const
+{
+	return mHasReference;
+}
+
+// Fit the reference geometry to the visible markers of a frame
+// Returns false if there is no usable pose, pose.status is then kPoseNone
+bool RigidBody::Solve( const TrcFrameWrapper& frame, BodyPose& pose )
+{
+	double meas[MAX_BODY_MARKERS][3];
+	double ref[MAX_BODY_MARKERS][3];
+	double mc[3] = { 0.0, 0.0, 0.0 };		// centroid of measured markers
+	double rc[3] = { 0.0, 0.0, 0.0 };		// centroid of their reference positions
+	double q[4];
+	int n = 0;
+	Point3 pt;
+
+	if (!mResolved || (!mHasReference && !Calibrate( frame )))
+	{
+		pose = mLast;
+		pose.frame = frame.Frame();
+		pose.status = kPoseNone;
+		return false;
+	}
+
+	// visible markers only
+	for (int i = 0; i < mCount; i++)
+	{
+		if (mIndex[i] >= frame.Size())	continue;
+
+		frame.GetMarkerLocation( mIndex[i], pt );
+		if (pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY)
+		{
+			continue;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			meas[n][k] = pt[k];
+			ref[n][k] = mReference[i][k];
+			mc[k] += pt[k];
+			rc[k] += mReference[i][k];
+		}
+		n++;
+	}
+
+	if (n == 0)
+	{
+		// nothing to go on, repeat the last pose
+		pose = mLast;
+		pose.frame = frame.Frame();
+		pose.markers = 0;
+		pose.status = (mLast.status == kPoseNone) ? kPoseNone : kPoseHeld;
+		return pose.status != kPoseNone;
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		mc[k] /= n;
+		rc[k] /= n;
+	}
+
+	PoseStatus status = kPoseNone;
+
+	if (n >= 3)
+	{
+		// cross covariance of the centered reference and measured positions
+		double s[3][3] = { {0,0,0}, {0,0,0}, {0,0,0} };
+		double spread = 0.0;
+
+		for (int i = 0; i < n; i++)
+		{
+			double a[3] = { ref[i][0] - rc[0], ref[i][1] - rc[1], ref[i][2] - rc[2] };
+			double b[3] = { meas[i][0] - mc[0], meas[i][1] - mc[1], meas[i][2] - mc[2] };
+
+			for (int r = 0; r < 3; r++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					s[r][c] += a[r] * b[c];
+				}
+			}
+			spread += sqrt( (a[0]*a[0] + a[1]*a[1] + a[2]*a[2]) * (b[0]*b[0] + b[1]*b[1] + b[2]*b[2]) );
+		}
+
+		// Horn's symmetric matrix, its largest eigenvector is the rotation
+		double N[4][4] =
+		{
+			{ s[0][0] + s[1][1] + s[2][2],	s[1][2] - s[2][1],				s[2][0] - s[0][2],				s[0][1] - s[1][0] },
+			{ s[1][2] - s[2][1],			s[0][0] - s[1][1] - s[2][2],	s[0][1] + s[1][0],				s[2][0] + s[0][2] },
+			{ s[2][0] - s[0][2],			s[0][1] + s[1][0],				-s[0][0] + s[1][1] - s[2][2],	s[1][2] + s[2][1] },
+			{ s[0][1] - s[1][0],			s[2][0] + s[0][2],				s[1][2] + s[2][1],				-s[0][0] - s[1][1] + s[2][2] }
+		};
+
+		if (LargestEigenvector4( N, q ) > kDegenerateGap * spread)
+		{
+			QuatNormalize( q );
+
+			// keep the same hemisphere as the last pose, so the quaternions are continuous
+			if (mLast.status != kPoseNone &&
+				q[0]*mLast.rotation[0] + q[1]*mLast.rotation[1] + q[2]*mLast.rotation[2] + q[3]*mLast.rotation[3] < 0.0)
+			{
+				q[0] = -q[0];	q[1] = -q[1];	q[2] = -q[2];	q[3] = -q[3];
+			}
+
+			status = kPoseSolved;
+		}
+	}
+
+	if (status == kPoseNone)
+	{
+		// too few markers for a rotation, keep the last one and refit the position
+		if (mLast.status == kPoseNone)
+		{
+			pose = mLast;
+			pose.frame = frame.Frame();
+			pose.markers = n;
+			return false;
+		}
+
+		for (int k = 0; k < 4; k++)		q[k] = mLast.rotation[k];
+		status = kPosePartial;
+	}
+
+	// translation maps the reference centroid onto the measured one
+	double rotated[3];
+	double t[3];
+
+	QuatRotate( q, rc, rotated );
+	for (int k = 0; k < 3; k++)
+	{
+		t[k] = mc[k] - rotated[k];
+	}
+
+	// rms fit error
+	double sum = 0.0;
+
+	for (int i = 0; i < n; i++)
+	{
+		QuatRotate( q, ref[i], rotated );
+
+		for (int k = 0; k < 3; k++)
+		{
+			double d = rotated[k] + t[k] - meas[i][k];
+			sum += d*d;
+		}
+	}
+
+	pose.frame = frame.Frame();
+	for (int k = 0; k < 3; k++)		pose.position[k] = (float) t[k];
+	for (int k = 0; k < 4; k++)		pose.rotation[k] = (float) q[k];
+	pose.error = (float) sqrt( sum / n );
+	pose.markers = n;
+	pose.status = status;
+
+	mLast = pose;
+
+	return true;
+}
+
+
+// Read rigid body definitions, see rigidbody.h for the file format
+bool LoadRigidBodies( const char* filename, std::vector<RigidBody>& bodies )
+{
+	std::ifstream is( filename );
+	std::string line;
+
+	bodies.clear();
+
+	if (!is.is_open())	return false;
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		std::istringstream tokens( line );
+		std::string name;
+
+		if (!(tokens >> name))	continue;
+
+		if (name == "BODY")
+		{
+			std::string bodyName;
+
+			if (!(tokens >> bodyName))	return false;
+
+			bodies.push_back( RigidBody( bodyName ) );
+			continue;
+		}
+
+		if (bodies.empty())		return false;		// marker outside of a body
+
+		Point3 ref;
+		bool added;
+
+		if (tokens >> ref[0] >> ref[1] >> ref[2])
+		{
+			added = bodies.back().AddMarker( name, ref );
+		}
+		else
+		{
+			added = bodies.back().AddMarker( name );
+		}
+
+		if (!added)		return false;
+	}
+
+	// a body needs three markers to have a rotation
+	for (int i = 0; i < (int) bodies.size(); i++)
+	{
+		if (bodies[i].Markers() < 3)	return false;
+	}
+
+	return !bodies.empty();
+}
@@ -0,0 +1,154 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: sessionflush.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the parallel session flush.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "sessionflush.h"
+#include <deque>
+
+
+// Progress of one job during Flush()
+struct FlushState
+{
+	std::deque<FlushChunk*>		pending;		// submitted chunks, oldest first
+	bool						drained;		// no more frames in the recorder
+	unsigned long				written;
+	unsigned long				total;
+};
+
+
+// Constructor
+SessionFlush::SessionFlush( WorkerPool* pool, unsigned long chunkFrames )
+{
+	mOwnPool = (pool == NULL);
+	mPool = mOwnPool ? new WorkerPool() : pool;
+	mChunkFrames = chunkFrames > 0 ? chunkFrames : FLUSH_CHUNK_FRAMES;
+}
+
+// Destructor
+SessionFlush::~SessionFlush()
+{
+	Clear();
+
+	if (mOwnPool)
+	{
+		delete mPool;
+	}
+}
+
+// Add a recorder to be written
+void SessionFlush::Add( FlushJob* job )
+{
+	if (job)
+	{
+		mJobs.push_back( job );
+	}
+}
+
+// Delete every job
+void SessionFlush::Clear()
+{
+	for (int i = 0; i < (int) mJobs.size(); i++)
+	{
+		delete mJobs[i];
+	}
+
+	mJobs.clear();
+}
+
+// Write all jobs, formatting their chunks in parallel
+bool SessionFlush::Flush( FlushProgress* progress )
+{
+	int jobs = (int) mJobs.size();
+	unsigned long inFlight = 2 * mPool->Size();		// chunks per job submitted at a time
+	std::vector<FlushState> state( jobs );
+	std::vector<HANDLE> waitFor;
+	bool rc = true;
+
+	for (int j = 0; j < jobs; j++)
+	{
+		state[j].drained = false;
+		state[j].written = 0;
+		state[j].total = mJobs[j]->Begin();
+	}
+
+	while (true)
+	{
+		waitFor.clear();
+
+		for (int j = 0; j < jobs; j++)
+		{
+			FlushState& s = state[j];
+
+			// write finished chunks, in order
+			while (!s.pending.empty() && WaitForSingleObject( s.pending.front()->mDone, 0 ) == WAIT_OBJECT_0)
+			{
+				FlushChunk* chunk = s.pending.front();
+
+				rc = mJobs[j]->Write( *chunk ) && rc;
+
+				s.written += chunk->mFrames;
+				s.pending.pop_front();
+				delete chunk;
+
+				if (progress)
+				{
+					progress->Report( mJobs[j]->TypeName(), s.written, s.total );
+				}
+			}
+
+			// keep the pool busy
+			while (!s.drained && s.pending.size() < inFlight)
+			{
+				FlushChunk* chunk = mJobs[j]->Next( mChunkFrames );
+
+				if (!chunk)
+				{
+					s.drained = true;
+					break;
+				}
+
+				s.pending.push_back( chunk );
+				mPool->Submit( chunk );
+			}
+
+			if (!s.pending.empty())
+			{
+				waitFor.push_back( s.pending.front()->mDone );
+			}
+		}
+
+		if (waitFor.empty())	break;
+
+		// sleep until the oldest chunk of some job is ready
+		if (waitFor.size() > MAXIMUM_WAIT_OBJECTS)	waitFor.resize( MAXIMUM_WAIT_OBJECTS );
+
+		WaitForMultipleObjects( (DWORD) waitFor.size(), &waitFor[0], FALSE, INFINITE );
+	}
+
+	for (int j = 0; j < jobs; j++)
+	{
+		mJobs[j]->Stream().flush();
+		rc = rc && mJobs[j]->Stream().good();
+	}
+
+	return rc;
+}
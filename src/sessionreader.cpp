@@ -0,0 +1,580 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: sessionreader.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of frame-indexed access to recorded sessions.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "sessionreader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+
+//
+// Text scanning helpers, all of them stop at the end of the mapping
+//
+
+// Start of the line after the one at p
+static const char* NextLine( const char* p, const char* end )
+{
+	const char* eol = (const char*) memchr( p, '\n', end - p );
+
+	return eol ? eol + 1 : end;
+}
+
+// Does the text at p start with s
+static bool StartsWith( const char* p, const char* end, const char* s )
+{
+	size_t len = strlen( s );
+
+	return (size_t)(end - p) >= len && memcmp( p, s, len ) == 0;
+}
+
+// Parse one comma separated value and step past its comma
+static const char* ParseValue( const char* p, const char* end, double& value )
+{
+	char buf[64];
+	int n = 0;
+
+	while (p < end && *p != ',' && *p != '\r' && *p != '\n' && n < (int) sizeof(buf) - 1)
+	{
+		buf[n++] = *p++;
+	}
+	buf[n] = '\0';
+	value = strtod( buf, NULL );
+
+	if (p < end && *p == ',')	p++;
+
+	return p;
+}
+
+// Number of commas on the line at p
+static int CountValues( const char* p, const char* end )
+{
+	int commas = 0;
+
+	while (p < end && *p != '\n')
+	{
+		if (*p++ == ',')	commas++;
+	}
+
+	return commas;
+}
+
+// Step past one comma separated value without converting it
+static const char* SkipValue( const char* p, const char* end )
+{
+	while (p < end && *p != ',' && *p != '\n')	p++;
+
+	return (p < end && *p == ',') ? p + 1 : p;
+}
+
+// Is the line at p the start of a frame, and which iFrame is it
+static bool IsFrameLine( SessionType type, const char* p, const char* end, int& frame )
+{
+	if (type == kDofSession || type == kAnalogSession)
+	{
+		// "<frame>,<value>,<value>,...", or "<frame>,<sample>,<value>,..." for analog
+		// samples; the header line starts with "Frame #"
+		if (p < end && ((*p >= '0' && *p <= '9') || *p == '-'))
+		{
+			frame = atoi( p ) - 1;
+			return true;
+		}
+	}
+	else if (StartsWith( p, end, "Frame #" ) && p + 7 < end && *(p + 7) >= '0' && *(p + 7) <= '9')
+	{
+		// "Frame #<frame>,X,Y,Z..."
+		frame = atoi( p + 7 ) - 1;
+		return true;
+	}
+
+	return false;
+}
+
+
+// Constructor
+SessionReader::SessionReader()
+{
+	mType = kUnknownSession;
+	mComponents = 0;
+
+	InitializeCriticalSection( &mLock );
+}
+
+// Destructor
+SessionReader::~SessionReader()
+{
+	Close();
+
+	DeleteCriticalSection( &mLock );
+}
+
+// Open a session, either a .idx file listing segment files or a single recorded file
+bool SessionReader::Open( const char* filename )
+{
+	Close();
+
+	if (!filename)	return false;
+
+	size_t len = strlen( filename );
+	bool indexed = len > 4 && (_stricmp( filename + len - 4, ".idx" ) == 0);
+
+	if (indexed)
+	{
+		ReadIndexFile( filename );
+	}
+	else
+	{
+		SessionSegment* seg = new SessionSegment;
+
+		seg->path = filename;
+		seg->firstFrame = -1;		// taken from the file when it is indexed
+		seg->lastFrame = -1;
+		seg->file = INVALID_HANDLE_VALUE;
+		seg->mapping = NULL;
+		seg->data = NULL;
+		seg->size = 0;
+
+		mSegments.push_back( seg );
+	}
+
+	// the first segment tells what kind of data this is
+	if (mSegments.empty() || !Prepare( *mSegments[0] ) || !ReadHeader( *mSegments[0] ))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+// Unmap every segment and forget the session
+void SessionReader::Close()
+{
+	for (int i = 0; i < (int) mSegments.size(); i++)
+	{
+		Unmap( *mSegments[i] );
+		delete mSegments[i];
+	}
+
+	mSegments.clear();
+	mNames.clear();
+	mType = kUnknownSession;
+	mComponents = 0;
+}
+
+// Is a session open
+bool SessionReader::IsOpen() const
+{
+	return mType != kUnknownSession;
+}
+
+// Type of data in the session
+SessionType SessionReader::Type() const
+{
+	return mType;
+}
+
+// Number of values per channel
+int SessionReader::Components() const
+{
+	return mComponents;
+}
+
+// Number of markers, segments, degrees of freedom or analog channels
+int SessionReader::Channels() const
+{
+	return (int) mNames.size();
+}
+
+// Name of the channel at index i
+const std::string& SessionReader::ChannelName( int i ) const
+{
+	return mNames[i];
+}
+
+// Index of the channel with the given name, -1 if there is none
+int SessionReader::Channel( const std::string& name ) const
+{
+	for (int i = 0; i < (int) mNames.size(); i++)
+	{
+		if (mNames[i] == name)	return i;
+	}
+
+	return -1;
+}
+
+// First frame number in the session
+int SessionReader::FirstFrame() const
+{
+	return mSegments.empty() ? -1 : mSegments.front()->firstFrame;
+}
+
+// Last frame number in the session
+int SessionReader::LastFrame() const
+{
+	return mSegments.empty() ? -1 : mSegments.back()->lastFrame;
+}
+
+// Read the requested channels of every frame in [firstFrame,lastFrame]
+bool SessionReader::Read( int firstFrame, int lastFrame, const std::vector<int>& channels, SessionRange& out ) const
+{
+	out.frames.clear();
+	out.values.clear();
+	out.channels = 0;
+	out.components = mComponents;
+
+	if (!IsOpen())	return false;
+
+	// no channels means all of them
+	std::vector<int> all;
+	const std::vector<int>* list = &channels;
+
+	if (channels.empty())
+	{
+		for (int i = 0; i < Channels(); i++)	all.push_back( i );
+		list = &all;
+	}
+
+	for (int i = 0; i < (int) list->size(); i++)
+	{
+		if ((*list)[i] < 0 || (*list)[i] >= Channels())	return false;
+	}
+
+	out.channels = (int) list->size();
+
+	for (int s = 0; s < (int) mSegments.size(); s++)
+	{
+		SessionSegment& seg = *mSegments[s];
+
+		if (seg.lastFrame < firstFrame || seg.firstFrame > lastFrame)	continue;
+
+		if (!Prepare( seg ) || !ReadSegment( seg, firstFrame, lastFrame, *list, out ))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Read the list of segment files written by RollingWriter
+bool SessionReader::ReadIndexFile( const char* filename )
+{
+	std::ifstream is( filename );
+	std::string line;
+
+	if (!is.is_open())	return false;
+
+	// segment files live next to the index
+	std::string dir( filename );
+	std::string::size_type slash = dir.find_last_of( "\\/" );
+
+	dir = (slash == std::string::npos) ? std::string() : dir.substr( 0, slash + 1 );
+
+	while (std::getline( is, line ))
+	{
+		// name,first,last,frames,bytes; the name is everything before the last four fields
+		std::string::size_type comma = line.size();
+		int fields = 0;
+
+		while (fields < 4 && comma != std::string::npos && comma > 0)
+		{
+			comma = line.find_last_of( ',', comma - 1 );
+			fields++;
+		}
+
+		if (fields < 4 || comma == std::string::npos || line.compare( 0, 8, "SEGMENT," ) == 0)
+		{
+			continue;
+		}
+
+		SessionSegment* seg = new SessionSegment;
+
+		seg->path = dir + line.substr( 0, comma );
+		seg->firstFrame = atoi( line.c_str() + comma + 1 );
+		seg->lastFrame = atoi( line.c_str() + line.find( ',', comma + 1 ) + 1 );
+		seg->file = INVALID_HANDLE_VALUE;
+		seg->mapping = NULL;
+		seg->data = NULL;
+		seg->size = 0;
+
+		mSegments.push_back( seg );
+	}
+
+	return !mSegments.empty();
+}
+
+// Work out the data type and channel names from the header of a segment
+bool SessionReader::ReadHeader( const SessionSegment& seg )
+{
+	const char* p = seg.data;
+	const char* end = seg.data + seg.size;
+
+	// files written by RollingWriter start with a #SEGMENT line
+	if (StartsWith( p, end, "#SEGMENT," ))	p = NextLine( p, end );
+
+	if (StartsWith( p, end, "HTR,CHILD,PARENT" ))
+	{
+		// compact HTR, a Root line of X,Y,Z starts every frame, then aX,aY,aZ,Length per segment
+		mType = kHtrSession;
+		mComponents = 4;
+		mNames.push_back( "Root" );
+
+		for (p = NextLine( p, end ); p < end && *p != '\r' && *p != '\n'; p = NextLine( p, end ))
+		{
+			const char* eol = p;
+			while (eol < end && *eol != '\r' && *eol != '\n' && *eol != ',')	eol++;
+
+			mNames.push_back( std::string( p, eol ) );
+		}
+	}
+	else if (StartsWith( p, end, "Marker Names" ) || StartsWith( p, end, "CHILD,PARENT" ))
+	{
+		// one name per line up to an empty line, segment lines also name the parent
+		bool markers = (*p == 'M');
+
+		mType = markers ? kTrcSession : kSegmentSession;
+		mComponents = markers ? 3 : 7;
+
+		for (p = NextLine( p, end ); p < end && *p != '\r' && *p != '\n'; p = NextLine( p, end ))
+		{
+			const char* eol = p;
+			while (eol < end && *eol != '\r' && *eol != '\n' && (markers || *eol != ','))	eol++;
+
+			mNames.push_back( std::string( p, eol ) );
+		}
+	}
+	else if (StartsWith( p, end, "Frame #,Sample,Plate," ))
+	{
+		// force plate recordings have a line per plate and sample, which has no channels to select
+		return false;
+	}
+	else if (StartsWith( p, end, "Frame #," ))
+	{
+		// "Frame #,<name>,<name>,...," or "Frame #,Sample,<name>,<name>,...,"
+		bool analog = StartsWith( p, end, "Frame #,Sample," );
+
+		mType = analog ? kAnalogSession : kDofSession;
+		mComponents = 1;
+
+		for (p += analog ? 15 : 8; p < end && *p != '\r' && *p != '\n'; )
+		{
+			const char* q = p;
+			while (q < end && *q != ',' && *q != '\r' && *q != '\n')	q++;
+
+			if (q > p)	mNames.push_back( std::string( p, q ) );
+
+			p = (q < end && *q == ',') ? q + 1 : q;
+		}
+	}
+
+	return mType != kUnknownSession;
+}
+
+// Map a segment and build its sparse frame index, if not done yet
+bool SessionReader::Prepare( SessionSegment& seg ) const
+{
+	bool rc = true;
+
+	EnterCriticalSection( &mLock );
+
+	if (!seg.data)
+	{
+		seg.file = CreateFile( seg.path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+		LARGE_INTEGER size;
+		if (seg.file != INVALID_HANDLE_VALUE && GetFileSizeEx( seg.file, &size ) && size.QuadPart > 0)
+		{
+			seg.size = size.QuadPart;
+			seg.mapping = CreateFileMapping( seg.file, NULL, PAGE_READONLY, 0, 0, NULL );
+
+			if (seg.mapping)
+			{
+				seg.data = (const char*) MapViewOfFile( seg.mapping, FILE_MAP_READ, 0, 0, 0 );
+			}
+		}
+
+		if (seg.data)
+		{
+			// the header has not been read yet when the first segment is opened;
+			// TRC, segment and HTR files all start frames with "Frame #<n>", DOF
+			// and analog files have a "Frame #," header and one line per frame or sample
+			const char* end = seg.data + seg.size;
+			const char* p = seg.data;
+			SessionType type = kTrcSession;
+			int frames = 0;
+			int frame;
+
+			if (StartsWith( p, end, "#SEGMENT," ))	p = NextLine( p, end );
+			if (StartsWith( p, end, "Frame #," ))	type = kDofSession;
+
+			for ( ; p < end; p = NextLine( p, end ))
+			{
+				if (!IsFrameLine( type, p, end, frame ))	continue;
+
+				if (frames % SESSION_INDEX_STRIDE == 0)
+				{
+					IndexEntry entry;
+
+					entry.frame = frame;
+					entry.offset = p - seg.data;
+					seg.index.push_back( entry );
+				}
+				frames++;
+
+				// a single file carries its frame range only in its contents
+				if (seg.firstFrame < 0)		seg.firstFrame = frame;
+				if (seg.lastFrame < frame)	seg.lastFrame = frame;
+			}
+		}
+		else
+		{
+			Unmap( seg );
+			rc = false;
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+
+	return rc;
+}
+
+// Release the mapping of a segment
+void SessionReader::Unmap( SessionSegment& seg ) const
+{
+	if (seg.data)								UnmapViewOfFile( seg.data );
+	if (seg.mapping)							CloseHandle( seg.mapping );
+	if (seg.file != INVALID_HANDLE_VALUE)		CloseHandle( seg.file );
+
+	seg.file = INVALID_HANDLE_VALUE;
+	seg.mapping = NULL;
+	seg.data = NULL;
+	seg.size = 0;
+	seg.index.clear();
+}
+
+// Append the requested frames of one segment to the result
+bool SessionReader::ReadSegment( const SessionSegment& seg, int firstFrame, int lastFrame,
+								 const std::vector<int>& channels, SessionRange& out ) const
+{
+	if (seg.index.empty())	return true;
+
+	// last index entry at or before the first frame wanted; an analog entry may
+	// point into the middle of a frame's samples, so it must come before the frame
+	int lo = 0;
+	int hi = (int) seg.index.size() - 1;
+	int before = (mType == kAnalogSession) ? firstFrame - 1 : firstFrame;
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi + 1) / 2;
+
+		if (seg.index[mid].frame <= before)	lo = mid;
+		else								hi = mid - 1;
+	}
+
+	// only the channels asked for are converted
+	int n = Channels();
+	int last = -1;
+	std::vector<char> wanted( n, 0 );
+	std::vector<double> row( n * mComponents, 0.0 );
+
+	for (int i = 0; i < (int) channels.size(); i++)
+	{
+		wanted[ channels[i] ] = 1;
+		if (channels[i] > last)	last = channels[i];
+	}
+
+	const char* end = seg.data + seg.size;
+	const char* p = seg.data + seg.index[lo].offset;
+	int frame;
+
+	while (p < end)
+	{
+		if (!IsFrameLine( mType, p, end, frame ))
+		{
+			p = NextLine( p, end );
+			continue;
+		}
+
+		if (frame > lastFrame)	break;
+
+		bool keep = (frame >= firstFrame);
+
+		if (mType == kDofSession || mType == kAnalogSession)
+		{
+			// every value of the frame or sample is on this line, each followed by a comma
+			bool analog = (mType == kAnalogSession);
+
+			if (CountValues( p, end ) != n + (analog ? 2 : 1))	return false;
+
+			const char* q = SkipValue( p, end );
+			if (analog)		q = SkipValue( q, end );
+
+			for (int i = 0; keep && i <= last; i++)
+			{
+				q = wanted[i] ? ParseValue( q, end, row[i] ) : SkipValue( q, end );
+			}
+			p = NextLine( p, end );
+		}
+		else
+		{
+			// one line per channel after the frame line, "<name>,<values>"
+			p = NextLine( p, end );
+
+			for (int i = 0; i < n; i++)
+			{
+				// a missing, extra or renamed channel means the frame doesn't match the header
+				if (!StartsWith( p, end, mNames[i].c_str() ) || p + mNames[i].size() >= end || p[ mNames[i].size() ] != ',')
+				{
+					return false;
+				}
+
+				if (keep && wanted[i])
+				{
+					const char* q = p + mNames[i].size() + 1;
+
+					for (int c = 0; c < mComponents && q < end; c++)
+					{
+						q = ParseValue( q, end, row[ i*mComponents + c ] );
+					}
+				}
+				p = NextLine( p, end );
+			}
+		}
+
+		if (keep)
+		{
+			out.frames.push_back( frame );
+
+			for (int i = 0; i < (int) channels.size(); i++)
+			{
+				const double* v = &row[ channels[i] * mComponents ];
+
+				out.values.insert( out.values.end(), v, v + mComponents );
+			}
+		}
+	}
+
+	return true;
+}
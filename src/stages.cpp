@@ -0,0 +1,141 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: stages.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the pipeline stages.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "stages.h"
+
+
+// Copy the frame from EVaRT, the marker arrays are reused from frame to frame
+void IngestStage::Process( PipelineFrame& frame )
+{
+	frame.raw.Set( frame.source, mMarkers );
+	frame.trc.Set( frame.source, mMarkers );
+}
+
+// Record the frame as it was received
+void RecordStage::Process( PipelineFrame& frame )
+{
+	if (mRecorder)
+	{
+		mRecorder->Add( frame.raw );
+	}
+}
+
+// Constructor, the markers past the end of the marker list stay empty
+AssembleStage::AssembleStage( FrameAssembler& assembler ) : mAssembler(assembler)
+{
+	for (int i = 0; i < MAX_MARKERS; i++)
+	{
+		mFrame.Markers[i][0] = mFrame.Markers[i][1] = mFrame.Markers[i][2] = (float) XEMPTY;
+	}
+	mFrame.iFrame = 0;
+	mCount = 0;
+}
+
+// Add the frame as it was received to the assembler
+void AssembleStage::Process( PipelineFrame& frame )
+{
+	if (!(mAssembler.Types() & TRC_DATA))	return;
+
+	int count = frame.raw.Size();
+
+	mFrame.iFrame = frame.raw.Frame();
+	for (int i = 0; i < count; i++)
+	{
+		frame.raw.GetMarkerLocation( i, mFrame.Markers[i] );
+	}
+
+	// markers beyond a shorter frame would still hold the last frame's positions
+	for (int i = count; i < mCount; i++)
+	{
+		mFrame.Markers[i][0] = mFrame.Markers[i][1] = mFrame.Markers[i][2] = (float) XEMPTY;
+	}
+	mCount = count;
+
+	mAssembler.Add( TRC_DATA, &mFrame );
+}
+
+// Check the markers before anything uses them
+void ValidateStage::Process( PipelineFrame& frame )
+{
+	mValidator.Validate( frame.trc, &mTracker );
+
+	// The validator only keeps the last frame, later stages read the status from the frame
+	for (int i = 0; i < frame.trc.Size(); i++)
+	{
+		frame.validated[i] = mValidator.Status( i );
+	}
+}
+
+// Solve the bodies from the markers
+void SolveStage::Process( PipelineFrame& frame )
+{
+	if (mTracker.Bodies() > 0)
+	{
+		mTracker.Solve( frame.trc, frame.packets[0] );
+	}
+}
+
+// Fill the empty markers, from the bodies where they could be solved
+void FillStage::Process( PipelineFrame& frame )
+{
+	mFiller.Fill( frame.trc, &mTracker, &frame.packets[0] );
+
+	for (int i = 0; i < frame.trc.Size(); i++)
+	{
+		frame.filled[i] = mFiller.Status( i );
+	}
+}
+
+// Smooth the markers and the poses
+void FilterStage::Process( PipelineFrame& frame )
+{
+	mFilter.Filter( frame.trc );
+
+	if (mTracker.Bodies() > 0)
+	{
+		mFilter.Filter( frame.packets[0] );
+	}
+}
+
+// Predict the poses ahead
+void PredictStage::Process( PipelineFrame& frame )
+{
+	if (!mEnabled || frame.packets[0].poses.empty())	return;
+
+	mPredictor.ReportLatency( mFilter.Bodies().Latency() / 1000.0 + frame.arrival.Seconds() +
+		(mScheduler.IsRunning() ? mScheduler.Delay() : 0.0) +
+		(mJitter.IsRunning() ? mJitter.Delay() : 0.0) );
+	mPredictor.Predict( frame.packets[0], frame.packets[1] );
+	frame.predicted = true;
+}
+
+// Convert the poses, and their prediction
+void TransformStage::Process( PipelineFrame& frame )
+{
+	mTransform.Apply( frame.packets[0] );
+
+	if (frame.predicted)
+	{
+		mTransform.Apply( frame.packets[1] );
+	}
+}
@@ -0,0 +1,452 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: streams.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the per data type queues and workers.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "streams.h"
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <process.h>
+
+// slots are kept a multiple of this many bytes, so the DOF doubles stay aligned
+#define STREAM_ALIGN	16
+
+
+// Names of the data types, for printing and command lines
+static const struct { int type; const char* name; } kStreamTypes[] =
+{
+	{ TRC_DATA,		"trc"		},
+	{ GTR_DATA,		"gtr"		},
+	{ HTR_DATA,		"htr"		},
+	{ HTR2_DATA,	"htr2"		},
+	{ DOF_DATA,		"dof"		},
+	{ ANALOG_DATA,	"analog"	},
+	{ FORCE_DATA,	"force"		}
+};
+
+
+// Constructor
+FrameStream::FrameStream( int type, StreamSink* sink, int slots )
+{
+	mType = type;
+	mSink = sink;
+	mItems = 0;
+	mHead = 0;
+	mTail = 0;
+	mDeepest = 0;
+	mThread = NULL;
+
+	// a power of two, so the slot index stays right when the counters wrap
+	mSlots = 1;
+	while (mSlots < slots)	mSlots *= 2;
+
+	mSlotBytes = StreamSlotBytes( type );
+
+	mBuffer = new char[mSlots * mSlotBytes];
+
+	mAvailable = CreateSemaphore( NULL, 0, mSlots, NULL );
+	mStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+}
+
+// Destructor
+FrameStream::~FrameStream()
+{
+	Stop();
+
+	CloseHandle( mStop );
+	CloseHandle( mAvailable );
+	delete [] mBuffer;
+}
+
+// How many markers or segments of the fixed size arrays to copy, 0 for all of them
+void FrameStream::SetItems( int items )
+{
+	InterlockedExchange( &mItems, items );
+}
+
+// Start the worker thread
+bool FrameStream::Start()
+{
+	if (mThread)	return true;
+
+	ResetEvent( mStop );
+	mThread = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, this, 0, NULL );
+
+	return mThread != NULL;
+}
+
+// Let the worker consume what is queued, then stop it
+void FrameStream::Stop()
+{
+	if (!mThread)	return;
+
+	SetEvent( mStop );
+	WaitForSingleObject( mThread, INFINITE );
+	CloseHandle( mThread );
+	mThread = NULL;
+}
+
+// Copy a frame into the next free slot, called from the EVaRT callback only
+bool FrameStream::Post( const void* data )
+{
+	unsigned long head = (unsigned long) mHead;
+	unsigned long depth = head - (unsigned long) mTail;
+	int bytes = FrameBytes( data );
+
+	// every EVaRT frame starts with its iFrame, checked here in the order EVaRT delivered them
+	// so a frame dropped for want of room counts as dropped only, not as a gap as well
+	mContinuity.Add( *(const int*) data );
+
+	if (bytes < 0 || depth >= (unsigned long) mSlots)
+	{
+		mContinuity.AddDropped();
+		return false;
+	}
+
+	memcpy( mBuffer + (head & (mSlots - 1)) * mSlotBytes, data, bytes );
+
+	// the interlocked write orders the copy before the slot is published
+	InterlockedExchange( &mHead, (LONG) (head + 1) );
+	ReleaseSemaphore( mAvailable, 1, NULL );
+
+	if (depth + 1 > mDeepest)	mDeepest = depth + 1;
+
+	return true;
+}
+
+// Wait until every queued frame has been consumed, called from the EVaRT callback only
+void FrameStream::Drain()
+{
+	while (mThread && mTail != mHead)
+	{
+		Sleep( 1 );
+	}
+}
+
+// EVaRT data type of the stream
+int FrameStream::Type() const
+{
+	return mType;
+}
+
+// Largest frame a slot holds, in bytes
+int FrameStream::SlotBytes() const
+{
+	return mSlotBytes;
+}
+
+// Frames copied into the queue
+unsigned long FrameStream::Posted() const
+{
+	return (unsigned long) mHead;
+}
+
+// Frames handed to the sink
+unsigned long FrameStream::Consumed() const
+{
+	return (unsigned long) mTail;
+}
+
+// Most frames that were ever waiting for the worker
+unsigned long FrameStream::Deepest() const
+{
+	return mDeepest;
+}
+
+// Frame numbers the worker saw, and frames Post() dropped
+const FrameContinuity& FrameStream::Continuity() const
+{
+	return mContinuity;
+}
+
+// Bytes of a frame to copy, -1 if it doesn't fit in a slot
+int FrameStream::FrameBytes( const void* data ) const
+{
+	return StreamFrameBytes( mType, data, (int) mItems );
+}
+
+// Thread entry point
+unsigned __stdcall FrameStream::ThreadProc( void* arg )
+{
+	((FrameStream*) arg)->Run();
+	return 0;
+}
+
+// Hand each queued frame to the sink, then the rest once told to stop
+void FrameStream::Run()
+{
+	HANDLE events[2] = { mStop, mAvailable };
+	bool stopping = false;
+
+	while (true)
+	{
+		if (!stopping)
+		{
+			stopping = WaitForMultipleObjects( 2, events, FALSE, INFINITE ) != WAIT_OBJECT_0 + 1;
+		}
+
+		unsigned long tail = (unsigned long) mTail;
+
+		if (tail == (unsigned long) mHead)
+		{
+			if (stopping)	break;
+			continue;
+		}
+
+		const char* slot = mBuffer + (tail & (mSlots - 1)) * mSlotBytes;
+
+		if (mSink)	mSink->Consume( mType, slot );
+
+		// the slot may be written again from here on
+		InterlockedExchange( &mTail, (LONG) (tail + 1) );
+	}
+}
+
+
+// Constructor
+StreamRouter::StreamRouter()
+{
+}
+
+// Destructor
+StreamRouter::~StreamRouter()
+{
+	Stop();
+
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		delete mStreams[i];
+	}
+}
+
+// Give a data type its own queue and worker, each type only once
+bool StreamRouter::Add( int type, StreamSink* sink, int slots )
+{
+	if (Find( type ))	return false;
+
+	mStreams.push_back( new FrameStream( type, sink, slots ) );
+	return true;
+}
+
+// Start the worker of every stream
+bool StreamRouter::Start()
+{
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		if (!mStreams[i]->Start())
+		{
+			Stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Stop the worker of every stream, after the frames queued
+void StreamRouter::Stop()
+{
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		mStreams[i]->Stop();
+	}
+}
+
+// Copy a frame to the stream of its type
+bool StreamRouter::Post( int type, const void* data )
+{
+	FrameStream* stream = Find( type );
+
+	return stream && stream->Post( data );
+}
+
+// Wait until the streams of some data types have consumed their frames
+void StreamRouter::Drain( int types )
+{
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		if (mStreams[i]->Type() & types)	mStreams[i]->Drain();
+	}
+}
+
+// Data types that have a stream, ORed together
+int StreamRouter::Types() const
+{
+	int types = 0;
+
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		types |= mStreams[i]->Type();
+	}
+
+	return types;
+}
+
+// Number of streams
+int StreamRouter::Streams() const
+{
+	return (int) mStreams.size();
+}
+
+// Stream i, in the order they were added
+FrameStream& StreamRouter::Stream( int i )
+{
+	return *mStreams[i];
+}
+
+// Stream of a data type, NULL if it has none
+FrameStream* StreamRouter::Find( int type )
+{
+	for (int i = 0; i < (int) mStreams.size(); i++)
+	{
+		if (mStreams[i]->Type() == type)	return mStreams[i];
+	}
+
+	return NULL;
+}
+
+
+// Bytes of a queue slot for a data type, room for its largest frame
+int StreamSlotBytes( int type )
+{
+	int bytes;
+
+	switch (type)
+	{
+	case TRC_DATA:		bytes = sizeof(sTrcFrame);		break;
+	case GTR_DATA:		bytes = sizeof(sGtrFrame);		break;
+	case HTR_DATA:		bytes = sizeof(sHtrFrame);		break;
+	case HTR2_DATA:		bytes = sizeof(sHtr2Frame);	break;
+	case DOF_DATA:		bytes = sizeof(sDofFrame);		break;
+	case ANALOG_DATA:	bytes = offsetof(sAnalogFrame, wData) + STREAM_ANALOG_WORDS * sizeof(short);	break;
+	case FORCE_DATA:	bytes = offsetof(sForceFrame, fData) + STREAM_FORCE_VALUES * sizeof(float);	break;
+	default:			bytes = sizeof(int);			break;
+	}
+
+	return (bytes + STREAM_ALIGN - 1) / STREAM_ALIGN * STREAM_ALIGN;
+}
+
+// Bytes of the used part of a frame, -1 if it is larger than a slot or malformed
+int StreamFrameBytes( int type, const void* data, int items )
+{
+	int bytes;
+
+	switch (type)
+	{
+	case TRC_DATA:
+	{
+		if (items <= 0 || items > MAX_MARKERS)		return sizeof(sTrcFrame);
+		bytes = offsetof(sTrcFrame, Markers) + items * 3 * sizeof(float);
+	}
+	break;
+	case GTR_DATA:
+	case HTR2_DATA:
+	{
+		if (items <= 0 || items > MAX_SEGMENTS)		return sizeof(sGtrFrame);
+		bytes = offsetof(sGtrFrame, Segments) + items * 7 * sizeof(float);
+	}
+	break;
+	case HTR_DATA:
+	{
+		if (items <= 0 || items > MAX_SEGMENTS)		return sizeof(sHtrFrame);
+		bytes = offsetof(sHtrFrame, Segments) + items * 4 * sizeof(float);
+	}
+	break;
+	case DOF_DATA:
+	{
+		const sDofFrame* frame = (const sDofFrame*) data;
+
+		if (frame->nDOFs < 0 || frame->nDOFs > MAX_DOFS)	return -1;
+		bytes = offsetof(sDofFrame, DOFs) + frame->nDOFs * sizeof(double);
+	}
+	break;
+	case ANALOG_DATA:
+	{
+		const sAnalogFrame* frame = (const sAnalogFrame*) data;
+
+		if (frame->nSamples < 0 || frame->nChannels < 0 ||
+			(double) frame->nSamples * frame->nChannels > STREAM_ANALOG_WORDS)
+		{
+			return -1;
+		}
+		bytes = offsetof(sAnalogFrame, wData) + frame->nSamples * frame->nChannels * sizeof(short);
+	}
+	break;
+	case FORCE_DATA:
+	{
+		const sForceFrame* frame = (const sForceFrame*) data;
+
+		if (frame->nSamples < 0 || frame->nPlates < 0 ||
+			(double) frame->nSamples * frame->nPlates * 7 > STREAM_FORCE_VALUES)
+		{
+			return -1;
+		}
+		bytes = offsetof(sForceFrame, fData) + frame->nSamples * frame->nPlates * 7 * sizeof(float);
+	}
+	break;
+	default:
+		bytes = sizeof(int);
+		break;
+	}
+
+	return bytes;
+}
+
+// Short name of a data type, for printing and command lines
+const char* StreamTypeName( int type )
+{
+	for (int i = 0; i < (int) (sizeof(kStreamTypes) / sizeof(kStreamTypes[0])); i++)
+	{
+		if (kStreamTypes[i].type == type)	return kStreamTypes[i].name;
+	}
+
+	return "unknown";
+}
+
+// Data types named in a comma separated list such as "trc,gtr,dof", ORed together
+int ParseStreamTypes( const char* names )
+{
+	std::string list( names );
+	std::string::size_type start = 0;
+	int types = 0;
+
+	while (start <= list.size())
+	{
+		std::string::size_type end = list.find( ',', start );
+		if (end == std::string::npos)	end = list.size();
+
+		std::string name = list.substr( start, end - start );
+		int type = 0;
+
+		for (int i = 0; i < (int) (sizeof(kStreamTypes) / sizeof(kStreamTypes[0])); i++)
+		{
+			if (_stricmp( name.c_str(), kStreamTypes[i].name ) == 0)	type = kStreamTypes[i].type;
+		}
+
+		if (type == 0 && !name.empty())		return -1;
+
+		types |= type;
+		start = end + 1;
+	}
+
+	return types;
+}
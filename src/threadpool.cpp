@@ -0,0 +1,157 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: threadpool.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the worker thread pool.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "threadpool.h"
+#include <process.h>
+
+
+// Constructor
+WorkerPool::WorkerPool( int numThreads )
+{
+	if (numThreads <= 0)
+	{
+		numThreads = NumProcessors();
+	}
+
+	InitializeCriticalSection( &mLock );
+	mAvailable = CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+	mIdle = CreateEvent( NULL, TRUE, TRUE, NULL );
+	mPending = 0;
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		HANDLE h = (HANDLE) _beginthreadex( NULL, 0, ThreadProc, this, 0, NULL );
+
+		if (h)
+		{
+			mThreads.push_back( h );
+		}
+	}
+}
+
+// Destructor
+WorkerPool::~WorkerPool()
+{
+	int i;
+
+	Wait();
+
+	// a NULL item tells a thread to exit
+	EnterCriticalSection( &mLock );
+	for (i = 0; i < (int) mThreads.size(); i++)
+	{
+		mQueue.push( NULL );
+	}
+	LeaveCriticalSection( &mLock );
+	ReleaseSemaphore( mAvailable, (LONG) mThreads.size(), NULL );
+
+	for (i = 0; i < (int) mThreads.size(); i++)
+	{
+		WaitForSingleObject( mThreads[i], INFINITE );
+		CloseHandle( mThreads[i] );
+	}
+
+	CloseHandle( mAvailable );
+	CloseHandle( mIdle );
+	DeleteCriticalSection( &mLock );
+}
+
+// Number of worker threads
+int WorkerPool::Size() const
+{
+	return (int) mThreads.size();
+}
+
+// Queue an item to be run on one of the worker threads
+void WorkerPool::Submit( WorkItem* item )
+{
+	if (!item)	return;
+
+	// with no threads (creation failed), run the item on the caller's thread
+	if (mThreads.empty())
+	{
+		item->Run();
+		return;
+	}
+
+	EnterCriticalSection( &mLock );
+	mQueue.push( item );
+	if (mPending++ == 0)
+	{
+		ResetEvent( mIdle );
+	}
+	LeaveCriticalSection( &mLock );
+
+	ReleaseSemaphore( mAvailable, 1, NULL );
+}
+
+// Block until every submitted item has finished running
+void WorkerPool::Wait()
+{
+	WaitForSingleObject( mIdle, INFINITE );
+}
+
+// Number of processors in this machine
+int WorkerPool::NumProcessors()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+
+	return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+}
+
+
+// Thread entry point
+unsigned __stdcall WorkerPool::ThreadProc( void* arg )
+{
+	((WorkerPool*) arg)->RunItems();
+	return 0;
+}
+
+// Run queued items until a NULL item is found
+void WorkerPool::RunItems()
+{
+	while (WaitForSingleObject( mAvailable, INFINITE ) == WAIT_OBJECT_0)
+	{
+		WorkItem* item = NULL;
+
+		EnterCriticalSection( &mLock );
+		if (!mQueue.empty())
+		{
+			item = mQueue.front();
+			mQueue.pop();
+		}
+		LeaveCriticalSection( &mLock );
+
+		if (!item)	break;
+
+		item->Run();
+
+		EnterCriticalSection( &mLock );
+		if (--mPending == 0)
+		{
+			SetEvent( mIdle );
+		}
+		LeaveCriticalSection( &mLock );
+	}
+}
@@ -0,0 +1,421 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: transform.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the capture volume to simulator transform.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "transform.h"
+#include "mathutil.h"
+#include <fstream>
+#include <sstream>
+#include <xmmintrin.h>
+
+
+// Last write time of a file, false if it doesn't exist
+static bool FileTime( const char* filename, FILETIME& time )
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+
+	if (!GetFileAttributesEx( filename, GetFileExInfoStandard, &data ))	return false;
+
+	time = data.ftLastWriteTime;
+	return true;
+}
+
+
+// Constructor
+CoordinateTransform::CoordinateTransform()
+{
+	mCurrent = 0;
+	mVersion = 0;
+	mWriteTime.dwLowDateTime = 0;
+	mWriteTime.dwHighDateTime = 0;
+
+	InitializeCriticalSection( &mLock );
+
+	double identity[4][4] = { {1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1} };
+
+	Compute( identity, 1.0, mBuffers[0] );
+	mBuffers[1] = mBuffers[0];
+}
+
+// Destructor
+CoordinateTransform::~CoordinateTransform()
+{
+	DeleteCriticalSection( &mLock );
+}
+
+// Use a matrix and scale given by the program
+bool CoordinateTransform::Set( const double matrix[4][4], double scale )
+{
+	Coefficients c;
+
+	if (!Compute( matrix, scale, c ))	return false;
+
+	Publish( c );
+	return true;
+}
+
+// Send poses in capture volume coordinates
+void CoordinateTransform::SetIdentity()
+{
+	double identity[4][4] = { {1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1} };
+
+	Set( identity, 1.0 );
+}
+
+// Read a calibration file, see transform.h for the format
+bool CoordinateTransform::Load( const char* filename )
+{
+	std::ifstream is( filename );
+	std::string line;
+	std::string text;
+	FILETIME time;
+
+	// take the time first, so a change while reading is seen by the next Reload()
+	if (!FileTime( filename, time ) || !is.is_open())	return false;
+
+	while (std::getline( is, line ))
+	{
+		std::string::size_type comment = line.find( '#' );
+		if (comment != std::string::npos)	line.erase( comment );
+
+		text += line;
+		text += ' ';
+	}
+
+	std::istringstream tokens( text );
+	std::string key;
+	double matrix[4][4] = { {1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1} };
+	double scale = 1.0;
+
+	while (tokens >> key)
+	{
+		if (key == "SCALE")
+		{
+			if (!(tokens >> scale) || scale == 0.0)	return false;
+		}
+		else if (key == "MATRIX")
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				if (!(tokens >> matrix[i / 4][i % 4]))	return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// affine only
+	if (matrix[3][0] != 0.0 || matrix[3][1] != 0.0 || matrix[3][2] != 0.0 || matrix[3][3] != 1.0)	return false;
+
+	Coefficients c;
+
+	if (!Compute( matrix, scale, c ))	return false;
+
+	EnterCriticalSection( &mLock );
+
+	Publish( c );
+	mFileName = filename;
+	mWriteTime = time;
+
+	LeaveCriticalSection( &mLock );
+
+	return true;
+}
+
+// Read the file again if it was written since it was loaded
+bool CoordinateTransform::Reload()
+{
+	std::string filename;
+	FILETIME time;
+	bool changed;
+
+	EnterCriticalSection( &mLock );
+
+	filename = mFileName;
+	changed = !filename.empty() && FileTime( filename.c_str(), time ) && CompareFileTime( &time, &mWriteTime ) != 0;
+
+	LeaveCriticalSection( &mLock );
+
+	if (!changed)	return false;
+
+	if (!Load( filename.c_str() ))
+	{
+		// don't try again until it is written again
+		EnterCriticalSection( &mLock );
+		mWriteTime = time;
+		LeaveCriticalSection( &mLock );
+
+		return false;
+	}
+
+	return true;
+}
+
+// File last loaded
+const std::string& CoordinateTransform::FileName() const
+{
+	return mFileName;
+}
+
+// Does the transform leave poses as they are
+bool CoordinateTransform::IsIdentity() const
+{
+	return mBuffers[mCurrent].identity;
+}
+
+// Number of transforms published
+long CoordinateTransform::Version() const
+{
+	return mVersion / 2;
+}
+
+// Convert the position and orientation of every pose of a packet
+void CoordinateTransform::Apply( PosePacket& packet ) const
+{
+	Coefficients c;
+
+	Current( c );
+
+	if (c.identity)		return;
+
+	__m128 p0 = _mm_loadu_ps( c.position[0] );
+	__m128 p1 = _mm_loadu_ps( c.position[1] );
+	__m128 p2 = _mm_loadu_ps( c.position[2] );
+	__m128 p3 = _mm_loadu_ps( c.position[3] );
+	__m128 r0 = _mm_loadu_ps( c.rotation[0] );
+	__m128 r1 = _mm_loadu_ps( c.rotation[1] );
+	__m128 r2 = _mm_loadu_ps( c.rotation[2] );
+	__m128 r3 = _mm_loadu_ps( c.rotation[3] );
+
+	for (int i = 0; i < (int) packet.poses.size(); i++)
+	{
+		BodyPose& pose = packet.poses[i];
+
+		// position: columns weighted by x, y and z, plus the translation
+		__m128 x = _mm_load1_ps( &pose.position[0] );
+		__m128 y = _mm_load1_ps( &pose.position[1] );
+		__m128 z = _mm_load1_ps( &pose.position[2] );
+		__m128 p = _mm_add_ps( _mm_add_ps( _mm_mul_ps( p0, x ), _mm_mul_ps( p1, y ) ),
+							   _mm_add_ps( _mm_mul_ps( p2, z ), p3 ) );
+
+		_mm_storel_pi( (__m64*) &pose.position[0], p );
+		_mm_store_ss( &pose.position[2], _mm_movehl_ps( p, p ) );
+
+		// rotation: the same for w, x, y and z of the quaternion
+		__m128 q = _mm_loadu_ps( pose.rotation );
+		__m128 r = _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( r0, _mm_shuffle_ps( q, q, _MM_SHUFFLE(0,0,0,0) ) ),
+						_mm_mul_ps( r1, _mm_shuffle_ps( q, q, _MM_SHUFFLE(1,1,1,1) ) ) ),
+			_mm_add_ps( _mm_mul_ps( r2, _mm_shuffle_ps( q, q, _MM_SHUFFLE(2,2,2,2) ) ),
+						_mm_mul_ps( r3, _mm_shuffle_ps( q, q, _MM_SHUFFLE(3,3,3,3) ) ) ) );
+
+		_mm_storeu_ps( pose.rotation, r );
+	}
+}
+
+// Convert one position
+void CoordinateTransform::Apply( Point3 position ) const
+{
+	Coefficients c;
+
+	Current( c );
+
+	if (c.identity)		return;
+
+	float x = position[0], y = position[1], z = position[2];
+
+	for (int k = 0; k < 3; k++)
+	{
+		position[k] = c.position[0][k] * x + c.position[1][k] * y + c.position[2][k] * z + c.position[3][k];
+	}
+}
+
+// Convert one direction, turned but neither scaled nor moved
+void CoordinateTransform::ApplyDirection( float direction[3] ) const
+{
+	Coefficients c;
+
+	Current( c );
+
+	if (c.identity)		return;
+
+	float x = direction[0], y = direction[1], z = direction[2];
+
+	for (int k = 0; k < 3; k++)
+	{
+		direction[k] = c.direction[0][k] * x + c.direction[1][k] * y + c.direction[2][k] * z;
+	}
+}
+
+// Convert one moment, scaled like a position and turned like a cross product
+void CoordinateTransform::ApplyMoment( float moment[3] ) const
+{
+	Coefficients c;
+
+	Current( c );
+
+	if (c.identity)		return;
+
+	float x = moment[0], y = moment[1], z = moment[2];
+
+	for (int k = 0; k < 3; k++)
+	{
+		moment[k] = c.moment[0][k] * x + c.moment[1][k] * y + c.moment[2][k] * z;
+	}
+}
+
+// Work out the coefficients of a transform, false if its 3x3 part is not a scaled rotation or reflection
+bool CoordinateTransform::Compute( const double matrix[4][4], double scale, Coefficients& c ) const
+{
+	double a[3][3];
+	int r, k;
+
+	for (r = 0; r < 3; r++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			a[r][k] = matrix[r][k];
+		}
+	}
+
+	// take out the uniform scale, and the reflection, which doesn't change a change of basis
+	double det = a[0][0] * (a[1][1]*a[2][2] - a[1][2]*a[2][1]) -
+				 a[0][1] * (a[1][0]*a[2][2] - a[1][2]*a[2][0]) +
+				 a[0][2] * (a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+
+	if (det == 0.0)		return false;
+
+	double s = (det > 0.0 ? 1.0 : -1.0) / pow( fabs( det ), 1.0 / 3.0 );
+	double b[3][3];
+
+	for (r = 0; r < 3; r++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			b[r][k] = a[r][k] * s;
+		}
+	}
+
+	// what is left must be a rotation
+	for (r = 0; r < 3; r++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			double dot = b[0][r]*b[0][k] + b[1][r]*b[1][k] + b[2][r]*b[2][k];
+
+			if (fabs( dot - (r == k ? 1.0 : 0.0) ) > TRANSFORM_ORTHO_TOLERANCE)		return false;
+		}
+	}
+
+	c.identity = (scale == 1.0);
+
+	for (r = 0; r < 4; r++)
+	{
+		for (k = 0; k < 4; k++)
+		{
+			if (matrix[r][k] != (r == k ? 1.0 : 0.0))	c.identity = false;
+		}
+	}
+
+	// columns of the scaled 3x3 part, then the translation
+	for (k = 0; k < 3; k++)
+	{
+		for (r = 0; r < 3; r++)
+		{
+			c.position[k][r] = (float) (a[r][k] * scale);
+		}
+		c.position[k][3] = 0.0f;
+	}
+	for (r = 0; r < 3; r++)
+	{
+		c.position[3][r] = (float) matrix[r][3];
+	}
+	c.position[3][3] = 0.0f;
+
+	// a direction is turned by a without its scale; a moment r x f is scaled like r and changes sign with a's handedness
+	for (k = 0; k < 3; k++)
+	{
+		for (r = 0; r < 3; r++)
+		{
+			c.direction[k][r] = (float) (a[r][k] * fabs( s ));
+			c.moment[k][r] = (float) (a[r][k] * scale * (det > 0.0 ? 1.0 : -1.0));
+		}
+	}
+
+	// the change of basis a q a* is linear in q, its columns are the images of 1, i, j and k
+	double qa[4];
+	double qc[4];
+
+	QuatFromMatrix( b, qa );
+	QuatNormalize( qa );
+	QuatConjugate( qa, qc );
+
+	for (k = 0; k < 4; k++)
+	{
+		double e[4] = { 0.0, 0.0, 0.0, 0.0 };
+		double t[4];
+
+		e[k] = 1.0;
+		QuatMultiply( qa, e, t );
+		QuatMultiply( t, qc, e );
+
+		for (r = 0; r < 4; r++)
+		{
+			c.rotation[k][r] = (float) e[r];
+		}
+	}
+
+	return true;
+}
+
+// Make a new set of coefficients current, without stopping Apply()
+void CoordinateTransform::Publish( const Coefficients& c )
+{
+	EnterCriticalSection( &mLock );
+
+	LONG next = 1 - mCurrent;
+
+	// a reader still copying the spare buffer will see the version change and copy again
+	InterlockedIncrement( &mVersion );
+	mBuffers[next] = c;
+	InterlockedExchange( &mCurrent, next );
+	InterlockedIncrement( &mVersion );
+
+	LeaveCriticalSection( &mLock );
+}
+
+// Copy the current coefficients, again if they were replaced while copying
+void CoordinateTransform::Current( Coefficients& c ) const
+{
+	LONG version;
+
+	do
+	{
+		version = mVersion;
+		MemoryBarrier();
+		c = mBuffers[mCurrent];
+		MemoryBarrier();
+	}
+	while (version != mVersion);
+}
@@ -0,0 +1,548 @@
+// This software is provided "as is" without warranties as to performance or merchantability
+// or any other warranties whether expressed or implied. Because of the various hardware
+// and software environments into which software may be put, no warranty of fitness for a
+// particular purpose is offered. Good data processing procedure dictates that any software
+// be thoroughly tested with non-critical data before relying on it. You must assume the
+// entire risk of using the software. In no event shall Motion Analysis Corp. be liable for
+// any damages in connection with or arising out of the use of the software by any person
+// whatsoever, including incidental, indirect, special or consequential damages, or any
+// damages related to loss of use, revenue or profits, even if we have been advised of the
+// possibility of such damages. Technical support is limited to those customers with an
+// on-going Motion Analysis maintenance contract.
+
+
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%
+%%% File: validator.cpp
+%%%
+%%% Description:
+%%%
+%%% Implementation of the marker validator.
+%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+#include "validator.h"
+#include "utils.h"
+#include <math.h>
+
+
+// Is any coordinate of a marker missing
+static bool IsEmpty( const float pt[3] )
+{
+	return pt[0] == (float) XEMPTY || pt[1] == (float) XEMPTY || pt[2] == (float) XEMPTY;
+}
+
+// Minimum cost assignment of n rows to n columns (Hungarian method with potentials, O(n^3)).
+// assign[r] receives the column of row r. Returns the total cost.
+static double Assign( double cost[MAX_BODY_MARKERS][MAX_BODY_MARKERS], int n, int assign[MAX_BODY_MARKERS] )
+{
+	// 1-based, column 0 is the unassigned row being placed
+	double u[MAX_BODY_MARKERS + 1];
+	double v[MAX_BODY_MARKERS + 1];
+	double minv[MAX_BODY_MARKERS + 1];
+	int p[MAX_BODY_MARKERS + 1];		// row assigned to each column
+	int way[MAX_BODY_MARKERS + 1];
+	bool used[MAX_BODY_MARKERS + 1];
+	int i, j;
+
+	for (j = 0; j <= n; j++)
+	{
+		u[j] = v[j] = 0.0;
+		p[j] = 0;
+	}
+
+	for (i = 1; i <= n; i++)
+	{
+		int j0 = 0;
+
+		p[0] = i;
+		for (j = 0; j <= n; j++)
+		{
+			minv[j] = 1e300;
+			used[j] = false;
+		}
+
+		do
+		{
+			int i0 = p[j0];
+			int j1 = 0;
+			double delta = 1e300;
+
+			used[j0] = true;
+			for (j = 1; j <= n; j++)
+			{
+				if (used[j])	continue;
+
+				double cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+
+				if (cur < minv[j])
+				{
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if (minv[j] < delta)
+				{
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			for (j = 0; j <= n; j++)
+			{
+				if (used[j])
+				{
+					u[p[j]] += delta;
+					v[j] -= delta;
+				}
+				else
+				{
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		}
+		while (p[j0] != 0);
+
+		// flip the alternating path back to the root
+		do
+		{
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		}
+		while (j0 != 0);
+	}
+
+	double total = 0.0;
+
+	for (j = 1; j <= n; j++)
+	{
+		assign[p[j] - 1] = j - 1;
+		total += cost[p[j] - 1][j - 1];
+	}
+
+	return total;
+}
+
+
+// Constructor
+MarkerValidator::MarkerValidator()
+{
+	mRate = 0.0f;
+	mMaxSpeed = VALIDATE_MAX_SPEED;
+	mMaxAccel = VALIDATE_MAX_ACCEL;
+	mTolerance = VALIDATE_TOLERANCE;
+	mBudget = VALIDATE_BUDGET;
+
+	Reset();
+}
+
+// Set the capture rate the kinematic limits are checked at
+void MarkerValidator::SetRate( float rate )
+{
+	mRate = rate > 0.0f ? rate : 0.0f;
+}
+
+// Set the largest speed and acceleration of a marker, 0 turns a check off
+void MarkerValidator::SetLimits( float maxSpeed, float maxAccel )
+{
+	mMaxSpeed = maxSpeed > 0.0f ? maxSpeed : 0.0f;
+	mMaxAccel = maxAccel > 0.0f ? maxAccel : 0.0f;
+}
+
+// Set how far the distances between a body's markers may be from the reference
+void MarkerValidator::SetTolerance( float tolerance )
+{
+	mTolerance = tolerance;
+}
+
+// Set the time per frame for the body checks
+void MarkerValidator::SetBudget( double seconds )
+{
+	mBudget = seconds;
+}
+
+// Forget the history of every marker
+void MarkerValidator::Reset()
+{
+	for (int i = 0; i < MAX_MARKERS; i++)
+	{
+		mTracks[i].count = 0;
+		mTracks[i].frame = 0;
+		mTracks[i].rejected = 0;
+		mTracks[i].status = kSampleEmpty;
+	}
+
+	mCount = 0;
+	mFrame = 0;
+	mNextBody = 0;
+	mRejected = 0;
+	mSwapped = 0;
+	mSkipped = 0;
+	mTotalRejected = 0;
+	mTotalSwapped = 0;
+	mTotalSkipped = 0;
+}
+
+// What happened to marker i of the last frame
+SampleStatus MarkerValidator::Status( int i ) const
+{
+	return (i >= 0 && i < mCount) ? mTracks[i].status : kSampleEmpty;
+}
+
+// Number of markers rejected in the last frame
+int MarkerValidator::Rejected() const
+{
+	return mRejected;
+}
+
+// Number of markers relabelled in the last frame
+int MarkerValidator::Swapped() const
+{
+	return mSwapped;
+}
+
+// Number of bodies not checked in the last frame
+int MarkerValidator::Skipped() const
+{
+	return mSkipped;
+}
+
+// Markers rejected since the last Reset()
+unsigned long MarkerValidator::TotalRejected() const
+{
+	return mTotalRejected;
+}
+
+// Markers relabelled since the last Reset()
+unsigned long MarkerValidator::TotalSwapped() const
+{
+	return mTotalSwapped;
+}
+
+// Body checks left out since the last Reset()
+unsigned long MarkerValidator::TotalSkipped() const
+{
+	return mTotalSkipped;
+}
+
+// Check the markers of a frame, rejected markers are set to XEMPTY
+void MarkerValidator::Validate( TrcFrameWrapper& frame, const BodyTracker* tracker )
+{
+	StopWatch watch;
+	Point3 pt;
+	int i;
+
+	mCount = frame.Size() < MAX_MARKERS ? frame.Size() : MAX_MARKERS;
+	mFrame = frame.Frame();
+	mRejected = 0;
+	mSwapped = 0;
+	mSkipped = 0;
+
+	// every marker against its own track
+	for (i = 0; i < mCount; i++)
+	{
+		Track& t = mTracks[i];
+
+		frame.GetMarkerLocation( i, pt );
+		mPos[i][0] = pt[0];
+		mPos[i][1] = pt[1];
+		mPos[i][2] = pt[2];
+
+		if (IsEmpty( mPos[i] ))
+		{
+			t.status = kSampleEmpty;
+		}
+		else if (Kinematic( t, mPos[i] ))
+		{
+			t.status = kSampleValid;
+		}
+		else if (t.rejected >= VALIDATE_REACQUIRE)
+		{
+			// rejected for too long, the track is what is wrong
+			t.count = 0;
+			t.status = kSampleValid;
+		}
+		else
+		{
+			t.status = kSampleRejected;
+		}
+	}
+
+	// the bodies, as many as there is time for
+	int bodies = tracker ? tracker->Bodies() : 0;
+
+	if (mNextBody >= bodies)	mNextBody = 0;
+
+	for (int n = 0; n < bodies; n++)
+	{
+		int b = (mNextBody + n) % bodies;
+
+		if (n > 0 && watch.Seconds() > mBudget)
+		{
+			mSkipped = bodies - n;
+			mNextBody = b;
+			break;
+		}
+
+		const RigidBody& body = tracker->Body( b );
+		int slot[MAX_BODY_MARKERS];
+		int index[MAX_BODY_MARKERS];
+		int count = 0;
+		bool suspect = false;
+
+		for (int j = 0; j < body.Markers(); j++)
+		{
+			int m = body.MarkerIndex( j );
+
+			if (m < 0 || m >= mCount || mTracks[m].status == kSampleEmpty)	continue;
+
+			if (mTracks[m].status == kSampleRejected)	suspect = true;
+
+			slot[count] = j;
+			index[count] = m;
+			count++;
+		}
+
+		if (suspect && count >= 2)
+		{
+			Relabel( frame, index, count );
+		}
+		if (body.IsCalibrated() && count >= 3)
+		{
+			CheckGeometry( body, slot, index, count );
+		}
+	}
+
+	// accepted markers extend their tracks, rejected ones are removed from the frame
+	for (i = 0; i < mCount; i++)
+	{
+		Track& t = mTracks[i];
+
+		switch (t.status)
+		{
+		case kSampleRejected:
+			pt[0] = pt[1] = pt[2] = (float) XEMPTY;
+			frame.SetMarkerLocation( i, pt );
+			t.rejected++;
+			mRejected++;
+			break;
+
+		case kSampleSwapped:
+			mSwapped++;
+			// fall through
+
+		case kSampleValid:
+			Push( t, mPos[i] );
+			t.rejected = 0;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	mTotalRejected += mRejected;
+	mTotalSwapped += mSwapped;
+	mTotalSkipped += mSkipped;
+}
+
+// Is a position within the speed and acceleration limits of a marker's track
+bool MarkerValidator::Kinematic( const Track& t, const float pos[3] ) const
+{
+	int gap = mFrame - t.frame;
+
+	if (t.count == 0 || mRate <= 0.0f || gap <= 0 || gap > VALIDATE_MAX_GAP)	return true;
+
+	double step = 0.0;
+	double bend = 0.0;
+
+	for (int k = 0; k < 3; k++)
+	{
+		double d = pos[k] - t.pos[0][k];
+		double a = pos[k] - 2.0 * t.pos[0][k] + t.pos[1][k];
+
+		step += d*d;
+		bend += a*a;
+	}
+
+	double dt = gap / mRate;
+
+	if (mMaxSpeed > 0.0f && step > (mMaxSpeed * dt) * (mMaxSpeed * dt))	return false;
+
+	// the acceleration needs the two frames just before this one
+	if (mMaxAccel > 0.0f && t.count >= 2 && gap == 1 && sqrt( bend ) * mRate * mRate > mMaxAccel)	return false;
+
+	return true;
+}
+
+// Where a marker's track puts it in the current frame, false if it has no recent track
+bool MarkerValidator::Predict( const Track& t, double pos[3] ) const
+{
+	int gap = mFrame - t.frame;
+
+	if (t.count == 0 || gap <= 0 || gap > VALIDATE_MAX_GAP)	return false;
+
+	for (int k = 0; k < 3; k++)
+	{
+		pos[k] = t.pos[0][k];
+		if (t.count >= 2)
+		{
+			pos[k] += (t.pos[0][k] - t.pos[1][k]) * gap;
+		}
+	}
+
+	return true;
+}
+
+// Match the measured markers of a body to their predicted positions, and swap them if that fits much better
+void MarkerValidator::Relabel( TrcFrameWrapper& frame, const int* index, int n )
+{
+	double cost[MAX_BODY_MARKERS][MAX_BODY_MARKERS];
+	double pred[MAX_BODY_MARKERS][3];
+	int marker[MAX_BODY_MARKERS];
+	int assign[MAX_BODY_MARKERS];
+	int m = 0;
+	int r, c;
+
+	// only markers with a recent track can be placed
+	for (r = 0; r < n; r++)
+	{
+		if (Predict( mTracks[index[r]], pred[m] ))
+		{
+			marker[m++] = index[r];
+		}
+	}
+
+	if (m < 2)	return;
+
+	double current = 0.0;
+
+	for (r = 0; r < m; r++)
+	{
+		for (c = 0; c < m; c++)
+		{
+			const float* p = mPos[marker[c]];
+			double dx = p[0] - pred[r][0];
+			double dy = p[1] - pred[r][1];
+			double dz = p[2] - pred[r][2];
+
+			cost[r][c] = dx*dx + dy*dy + dz*dz;
+		}
+		current += cost[r][r];
+	}
+
+	if (Assign( cost, m, assign ) >= VALIDATE_SWAP_GAIN * current)	return;
+
+	float moved[MAX_BODY_MARKERS][3];
+
+	for (r = 0; r < m; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			moved[r][k] = mPos[marker[assign[r]]][k];
+		}
+	}
+
+	for (r = 0; r < m; r++)
+	{
+		if (assign[r] == r)		continue;
+
+		Track& t = mTracks[marker[r]];
+		Point3 pt = { moved[r][0], moved[r][1], moved[r][2] };
+
+		mPos[marker[r]][0] = pt[0];
+		mPos[marker[r]][1] = pt[1];
+		mPos[marker[r]][2] = pt[2];
+		frame.SetMarkerLocation( marker[r], pt );
+
+		t.status = Kinematic( t, mPos[marker[r]] ) ? kSampleSwapped : kSampleRejected;
+	}
+}
+
+// Reject markers whose distances to the other markers of a body don't match the reference
+void MarkerValidator::CheckGeometry( const RigidBody& body, const int* slot, const int* index, int n )
+{
+	double ref[MAX_BODY_MARKERS][3];
+	int bad[MAX_BODY_MARKERS];
+	int checked = 0;
+	int a, b;
+
+	for (a = 0; a < n; a++)
+	{
+		body.GetReference( slot[a], ref[a] );
+		bad[a] = 0;
+	}
+
+	for (a = 0; a < n; a++)
+	{
+		if (mTracks[index[a]].status == kSampleRejected)	continue;
+
+		checked++;
+
+		for (b = a + 1; b < n; b++)
+		{
+			if (mTracks[index[b]].status == kSampleRejected)	continue;
+
+			const float* pa = mPos[index[a]];
+			const float* pb = mPos[index[b]];
+			double measured = sqrt( (double) (pa[0]-pb[0])*(pa[0]-pb[0]) + (pa[1]-pb[1])*(pa[1]-pb[1]) + (pa[2]-pb[2])*(pa[2]-pb[2]) );
+			double expected = sqrt( (ref[a][0]-ref[b][0])*(ref[a][0]-ref[b][0]) + (ref[a][1]-ref[b][1])*(ref[a][1]-ref[b][1]) +
+				(ref[a][2]-ref[b][2])*(ref[a][2]-ref[b][2]) );
+
+			if (fabs( measured - expected ) > mTolerance)
+			{
+				bad[a]++;
+				bad[b]++;
+			}
+		}
+	}
+
+	if (checked < 3)	return;
+
+	// a marker is only blamed when it disagrees with most of the others
+	for (a = 0; a < n; a++)
+	{
+		Track& t = mTracks[index[a]];
+
+		if (t.status != kSampleRejected && 2 * bad[a] > checked - 1)
+		{
+			t.status = kSampleRejected;
+		}
+	}
+}
+
+// Add an accepted position to a marker's track, restarting the track if a frame was skipped
+void MarkerValidator::Push( Track& t, const float pos[3] )
+{
+	if (t.count > 0 && mFrame == t.frame + 1)
+	{
+		t.pos[1][0] = t.pos[0][0];
+		t.pos[1][1] = t.pos[0][1];
+		t.pos[1][2] = t.pos[0][2];
+		t.count = 2;
+	}
+	else
+	{
+		t.count = 1;
+	}
+
+	t.pos[0][0] = pos[0];
+	t.pos[0][1] = pos[1];
+	t.pos[0][2] = pos[2];
+	t.frame = mFrame;
+}
+
+
+// Short name of a sample status, for printing
+const char* SampleStatusName( SampleStatus status )
+{
+	switch (status)
+	{
+	case kSampleValid:		return "valid";
+	case kSampleEmpty:		return "empty";
+	case kSampleRejected:	return "rejected";
+	case kSampleSwapped:	return "swapped";
+	}
+
+	return "unknown";
+}
@@ -26,6 +26,8 @@
 // Standard includes
 //
 #include "wrappers.h"
+#include "bufferpool.h"
+#include <string.h>
 
 
 
@@ -424,6 +426,126 @@ void DofNamesWrapper::Copy( const DofNamesWrapper& src )
 
 
 
+//
+// Wrapper for sAnalogNames structure
+//
+
+// Default constructor
+AnalogNamesWrapper::AnalogNamesWrapper( const sAnalogNames* src )
+{
+	Copy( src );
+}
+
+// Copy constructor
+AnalogNamesWrapper::AnalogNamesWrapper( const AnalogNamesWrapper& src )
+{
+	Copy( src );
+}
+
+// Destructor
+AnalogNamesWrapper::~AnalogNamesWrapper()
+{
+	mChannelNames.clear();
+}
+
+// Set/Reset after creation
+void AnalogNamesWrapper::Set( const sAnalogNames* src )
+{
+	Copy( src );
+}
+
+// Get number of analog channels
+int AnalogNamesWrapper::Size() const
+{
+	return (int) mChannelNames.size();
+}
+
+// Get the channel name at index i
+std::string AnalogNamesWrapper::Name( int i ) const
+{
+	std::string name = "";
+
+	if (i >= 0 && i < (int) mChannelNames.size())
+	{
+		name = mChannelNames[i];
+	}
+
+	return name;
+}
+
+// Assignment operator from a sAnalogNames*
+AnalogNamesWrapper& AnalogNamesWrapper::operator = ( const sAnalogNames* lhs )
+{
+	Copy( lhs );
+	return *this;
+}
+
+// Assignment operator from an AnalogNamesWrapper object
+AnalogNamesWrapper& AnalogNamesWrapper::operator = ( const AnalogNamesWrapper& lhs )
+{
+	Copy( lhs );
+	return *this;
+}
+
+// Equality check against sAnalogNames*
+bool AnalogNamesWrapper::operator == ( const sAnalogNames* lhs ) const
+{
+	AnalogNamesWrapper tmp(lhs);
+	return *this == tmp;
+}
+
+// Equality check against an AnalogNamesWrapper object
+bool AnalogNamesWrapper::operator == ( const AnalogNamesWrapper& lhs ) const
+{
+	return (mChannelNames == lhs.mChannelNames);
+}
+
+// Inequality check against sAnalogNames*
+bool AnalogNamesWrapper::operator != ( const sAnalogNames* lhs ) const
+{
+	return !(*this == lhs);
+}
+
+// Inequality check against an AnalogNamesWrapper object 
+bool AnalogNamesWrapper::operator != ( const AnalogNamesWrapper& lhs ) const
+{
+	return !(*this == lhs);
+}
+
+
+// Fill object with values from a sAnalogNames*
+void AnalogNamesWrapper::Copy( const sAnalogNames* src )
+{
+	// clear any previous data
+	mChannelNames.clear();
+
+	// if the pointer is valid, fill up our list
+	if (src)
+	{
+		int count = src->nChannels;
+
+		for (int i = 0; i < count; i++)
+		{
+			mChannelNames.push_back( std::string(src->szChannelNames[i]) );
+		}
+	}
+}
+
+// Fill object with values from an AnalogNamesWrapper object
+void AnalogNamesWrapper::Copy( const AnalogNamesWrapper& src )
+{
+	// clear any previous data
+	mChannelNames.clear();
+	
+	// copy contents of source object
+	for (int i = 0; i < src.Size(); i++)
+	{
+		mChannelNames.push_back( src.Name(i) );
+	}
+}
+
+
+
 //
 // Wrapper for sTrcFrame structure
 //
@@ -460,6 +582,17 @@ void TrcFrameWrapper::Set( const sTrcFrame* src, int count )
 	Copy( src, count );
 }
 
+// Replace the 3-D coordinates of the marker at the given index, the frame holds its own copy
+void TrcFrameWrapper::SetMarkerLocation( int i, const Point3 loc )
+{
+	if (i >= 0 && i < mCount && mMarkers)
+	{
+		mMarkers[i][0] = loc[0];
+		mMarkers[i][1] = loc[1];
+		mMarkers[i][2] = loc[2];
+	}
+}
+
 // Get number of markers in this frame
 int TrcFrameWrapper::Size() const
 {
@@ -485,6 +618,54 @@ void TrcFrameWrapper::GetMarkerLocation( int i, Point3 loc ) const
 	}
 }
 
+// Number of bytes needed to store this frame in a flat buffer
+int TrcFrameWrapper::PackedSize() const
+{
+	return 2*sizeof(int) + mCount*sizeof(Point3);
+}
+
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void TrcFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+
+	header[0] = mFrame;
+	header[1] = mCount;
+
+	if (mCount > 0)
+	{
+		memcpy( header + 2, mMarkers, mCount*sizeof(Point3) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void TrcFrameWrapper::Unpack( const void* src )
+{
+	const int* header = (const int*) src;
+	int count = header[1];
+
+	// keep the marker array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
+	if (count > 0)
+	{
+		if (!mMarkers)
+		{
+			mMarkers = new Point3[count];
+		}
+
+		if (mMarkers)
+		{
+			mCount = count;
+			mFrame = header[0];
+			memcpy( mMarkers, header + 2, mCount*sizeof(Point3) );
+		}
+	}
+}
+
 
 // Assignment operator from a TrcFrameWrapper object
 TrcFrameWrapper& TrcFrameWrapper::operator = ( const TrcFrameWrapper& lhs )
@@ -523,13 +704,19 @@ bool TrcFrameWrapper::operator != ( const TrcFrameWrapper& lhs ) const
 // Fill object with values from a sTrcFrame*
 void TrcFrameWrapper::Copy( const sTrcFrame* src, int count )
 {
-	// clear any previous data
-	FreeMemory();
+	// keep the marker array if it already has the right size, otherwise clear any previous data
+	if (!src || count != mCount)
+	{
+		FreeMemory();
+	}
 
 	// if the frame and count are valid, copy count number of marker slots
 	if (src && count > 0)
 	{
-		mMarkers = new Point3[count];
+		if (!mMarkers)
+		{
+			mMarkers = new Point3[count];
+		}
 
 		if (mMarkers)
 		{
@@ -549,15 +736,21 @@ void TrcFrameWrapper::Copy( const sTrcFrame* src, int count )
 // Fill object with values from a TrcFrameWrapper object
 void TrcFrameWrapper::Copy( const TrcFrameWrapper& src )
 {
-	// clear any previous data
-	FreeMemory();
-	
 	int count = src.Size();
 
+	// keep the marker array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
 	// copy contents of source object
 	if (count > 0)
 	{
-		mMarkers = new Point3[count];
+		if (!mMarkers)
+		{
+			mMarkers = new Point3[count];
+		}
 
 		if (mMarkers)
 		{
@@ -651,6 +844,54 @@ void SegmentFrameWrapper::GetSegmentInfo( int i, SegmentInfo info ) const
 	}
 }
 
+// Number of bytes needed to store this frame in a flat buffer
+int SegmentFrameWrapper::PackedSize() const
+{
+	return 2*sizeof(int) + mCount*sizeof(SegmentInfo);
+}
+
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void SegmentFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+
+	header[0] = mFrame;
+	header[1] = mCount;
+
+	if (mCount > 0)
+	{
+		memcpy( header + 2, mSegments, mCount*sizeof(SegmentInfo) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void SegmentFrameWrapper::Unpack( const void* src )
+{
+	const int* header = (const int*) src;
+	int count = header[1];
+
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
+	if (count > 0)
+	{
+		if (!mSegments)
+		{
+			mSegments = new SegmentInfo[count];
+		}
+
+		if (mSegments)
+		{
+			mCount = count;
+			mFrame = header[0];
+			memcpy( mSegments, header + 2, mCount*sizeof(SegmentInfo) );
+		}
+	}
+}
+
 
 // Assignment operator from a SegmentFrameWrapper object
 SegmentFrameWrapper& SegmentFrameWrapper::operator = ( const SegmentFrameWrapper& lhs )
@@ -693,13 +934,19 @@ bool SegmentFrameWrapper::operator != ( const SegmentFrameWrapper& lhs ) const
 // Fill object with values from a SegmentFrame*
 void SegmentFrameWrapper::Copy( const SegmentFrame* src, int count )
 {
-	// clear any previous data
-	FreeMemory();
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (!src || count != mCount)
+	{
+		FreeMemory();
+	}
 
 	// if the frame and count are valid, copy count number of segment slots
 	if (src && count > 0)
 	{
-		mSegments = new SegmentInfo[count];
+		if (!mSegments)
+		{
+			mSegments = new SegmentInfo[count];
+		}
 
 		if (mSegments)
 		{
@@ -723,15 +970,21 @@ void SegmentFrameWrapper::Copy( const SegmentFrame* src, int count )
 // Fill object with values from a SegmentFrameWrapper object
 void SegmentFrameWrapper::Copy( const SegmentFrameWrapper& src )
 {
-	// clear any previous data
-	FreeMemory();
-	
 	int count = src.Size();
 
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
 	// copy contents of source object
 	if (count > 0)
 	{
-		mSegments = new SegmentInfo[count];
+		if (!mSegments)
+		{
+			mSegments = new SegmentInfo[count];
+		}
 
 		if (mSegments)
 		{
@@ -760,119 +1013,473 @@ void SegmentFrameWrapper::FreeMemory()
 }
 
 
-
 //
-// Wrapper for sDofFrame structure
+// Wrapper for sHtrFrame structure
 //
 
 // Default constructor
-DofFrameWrapper::DofFrameWrapper( const sDofFrame* src )
+HtrFrameWrapper::HtrFrameWrapper( const sHtrFrame* src, int count )
 {
-	mDofs = NULL;
+	mSegments = NULL;
 	mCount = 0;
 	mFrame = -1;
+	mRoot[0] = mRoot[1] = mRoot[2] = XEMPTY;
 
-	Copy( src );
+	Copy( src, count );
 }
 
 // Copy constructor
-DofFrameWrapper::DofFrameWrapper( const DofFrameWrapper& src )
+HtrFrameWrapper::HtrFrameWrapper( const HtrFrameWrapper& src )
 {
-	mDofs = NULL;
+	mSegments = NULL;
 	mCount = 0;
 	mFrame = -1;
+	mRoot[0] = mRoot[1] = mRoot[2] = XEMPTY;
 
 	Copy( src );
 }
 
 // Destructor
-DofFrameWrapper::~DofFrameWrapper()
+HtrFrameWrapper::~HtrFrameWrapper()
 {
 	FreeMemory();
 }
 
 // Set/Reset after creation
-void DofFrameWrapper::Set( const sDofFrame* src )
+void HtrFrameWrapper::Set( const sHtrFrame* src, int count )
 {
-	Copy( src );
+	Copy( src, count );
 }
 
-// Get number of degrees of freedom in this frame
-int DofFrameWrapper::Size() const
+// Get number of segments in this frame
+int HtrFrameWrapper::Size() const
 {
 	return mCount;
 }
 
 // Get frame number for this frame
-int DofFrameWrapper::Frame() const
+int HtrFrameWrapper::Frame() const
 {
 	return mFrame;
 }
 
-// Get the degree of freedom value at index i
-void DofFrameWrapper::GetDofValue( int i, double& value ) const
+// Get the translation of the root of the skeleton
+void HtrFrameWrapper::GetRootPosition( Point3 loc ) const
 {
-	value = XEMPTY;
+	loc[0] = mRoot[0];
+	loc[1] = mRoot[1];
+	loc[2] = mRoot[2];
+}
 
-	if (i >= 0 && i < mCount && mDofs)
+// Get the rotation and length of the segment at the given index
+void HtrFrameWrapper::GetSegmentInfo( int i, HtrSegmentInfo info ) const
+{
+	info[0]=info[1]=info[2]=info[3] = XEMPTY;
+
+	if (i >= 0 && i < mCount && mSegments)
 	{
-		value = mDofs[i];
+		info[0] = mSegments[i][0];
+		info[1] = mSegments[i][1];
+		info[2] = mSegments[i][2];
+		info[3] = mSegments[i][3];
 	}
 }
 
-
-// Assignment operator from a DofFrameWrapper object
-DofFrameWrapper& DofFrameWrapper::operator = ( const DofFrameWrapper& lhs )
+// Get the translation of segment i from its parent, the root position if it has none.
+// The segment is taken to start at the end of its parent, the parent's length along the bone axis;
+// the frame has no offsets of its own, so siblings all get the same translation.
+bool HtrFrameWrapper::GetTranslation( const HierarchyWrapper& hierarchy, int i, Point3 loc, int axis ) const
 {
-	Copy( lhs );
-	return *this;
+	loc[0]=loc[1]=loc[2] = XEMPTY;
+
+	if (i < 0 || i >= mCount || !mSegments || axis < 0 || axis > 2)
+	{
+		return false;
+	}
+
+	int parent = hierarchy.Parent( i );
+
+	if (parent == -2)
+	{
+		// no such segment in the hierarchy
+		return false;
+	}
+
+	if (parent < 0 || parent >= mCount)
+	{
+		GetRootPosition( loc );
+	}
+	else
+	{
+		loc[0] = loc[1] = loc[2] = 0.0f;
+		loc[axis] = mSegments[parent][3];
+	}
+
+	return true;
 }
 
-// Equality check against a DofFrameWrapper object
-bool DofFrameWrapper::operator == ( const DofFrameWrapper& lhs ) const
+// Expand this frame to the layout of sHtr2Frame, with a translation for every segment
+bool HtrFrameWrapper::GetSegmentFrame( const HierarchyWrapper& hierarchy, SegmentFrame& dst, int axis ) const
 {
-	bool rc = false;
-	int i = 0;
+	bool rc = (hierarchy.Size() == mCount);
 
-	rc = (mCount == lhs.mCount);
-	rc = rc && mFrame == lhs.mFrame;
+	dst.iFrame = mFrame;
 
-	while (i < mCount && rc)
+	for (int i = 0; i < mCount && rc; i++)
 	{
-		rc = mDofs[i] == lhs.mDofs[i];
-		i++;
+		rc = GetTranslation( hierarchy, i, dst.Segments[i], axis );
+
+		dst.Segments[i][3] = mSegments[i][0];
+		dst.Segments[i][4] = mSegments[i][1];
+		dst.Segments[i][5] = mSegments[i][2];
+		dst.Segments[i][6] = mSegments[i][3];
 	}
 
 	return rc;
 }
 
-// Inequality check against a DofFrameWrapper object 
-bool DofFrameWrapper::operator != ( const DofFrameWrapper& lhs ) const
+// Number of bytes needed to store this frame in a flat buffer
+int HtrFrameWrapper::PackedSize() const
 {
-	return !(*this == lhs);
+	return 2*sizeof(int) + sizeof(Point3) + mCount*sizeof(HtrSegmentInfo);
 }
 
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void HtrFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+	float* root = (float*) (header + 2);
+
+	header[0] = mFrame;
+	header[1] = mCount;
+	root[0] = mRoot[0];
+	root[1] = mRoot[1];
+	root[2] = mRoot[2];
 
-// Fill object with values from a sDofFrame*
-void DofFrameWrapper::Copy( const sDofFrame* src )
+	if (mCount > 0)
+	{
+		memcpy( root + 3, mSegments, mCount*sizeof(HtrSegmentInfo) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void HtrFrameWrapper::Unpack( const void* src )
 {
-	// clear any previous data
-	FreeMemory();
+	const int* header = (const int*) src;
+	const float* root = (const float*) (header + 2);
+	int count = header[1];
 
-	int count;
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
 
-	// if the frame and count are valid, copy count number of DOF values
-	if (src)
+	if (count > 0)
 	{
-		count = src->nDOFs;
-		
-		if (count > 0)
+		if (!mSegments)
 		{
-			mDofs = new double[count];
-			
-			if (mDofs)
-			{
-				mCount = count;
+			mSegments = new HtrSegmentInfo[count];
+		}
+
+		if (mSegments)
+		{
+			mCount = count;
+			mFrame = header[0];
+			mRoot[0] = root[0];
+			mRoot[1] = root[1];
+			mRoot[2] = root[2];
+			memcpy( mSegments, root + 3, mCount*sizeof(HtrSegmentInfo) );
+		}
+	}
+}
+
+
+// Assignment operator from a HtrFrameWrapper object
+HtrFrameWrapper& HtrFrameWrapper::operator = ( const HtrFrameWrapper& lhs )
+{
+	Copy( lhs );
+	return *this;
+}
+
+// Equality check against a HtrFrameWrapper object
+bool HtrFrameWrapper::operator == ( const HtrFrameWrapper& lhs ) const
+{
+	bool rc = false;
+	int i = 0;
+
+	rc = (mCount == lhs.mCount);
+	rc = rc && mFrame == lhs.mFrame;
+	rc = rc && mRoot[0] == lhs.mRoot[0] && mRoot[1] == lhs.mRoot[1] && mRoot[2] == lhs.mRoot[2];
+
+	while (i < mCount && rc)
+	{
+		rc = ( mSegments[i][0] == lhs.mSegments[i][0] &&
+			   mSegments[i][1] == lhs.mSegments[i][1] &&
+			   mSegments[i][2] == lhs.mSegments[i][2] &&
+			   mSegments[i][3] == lhs.mSegments[i][3] );
+		i++;
+	}
+
+	return rc;
+}
+
+// Inequality check against a HtrFrameWrapper object 
+bool HtrFrameWrapper::operator != ( const HtrFrameWrapper& lhs ) const
+{
+	return !(*this == lhs);
+}
+
+
+// Fill object with values from a sHtrFrame*
+void HtrFrameWrapper::Copy( const sHtrFrame* src, int count )
+{
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (!src || count != mCount)
+	{
+		FreeMemory();
+	}
+
+	// if the frame and count are valid, copy the root and count number of segment slots
+	if (src && count > 0)
+	{
+		if (!mSegments)
+		{
+			mSegments = new HtrSegmentInfo[count];
+		}
+
+		if (mSegments)
+		{
+			mCount = count;
+			mFrame = src->iFrame;
+			mRoot[0] = src->RootPosition[0];
+			mRoot[1] = src->RootPosition[1];
+			mRoot[2] = src->RootPosition[2];
+
+			for (int i = 0; i < mCount; i++)
+			{
+				mSegments[i][0] = src->Segments[i][0];
+				mSegments[i][1] = src->Segments[i][1];
+				mSegments[i][2] = src->Segments[i][2];
+				mSegments[i][3] = src->Segments[i][3];
+			}
+		}
+	}
+}
+
+// Fill object with values from a HtrFrameWrapper object
+void HtrFrameWrapper::Copy( const HtrFrameWrapper& src )
+{
+	int count = src.Size();
+
+	// keep the segment array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
+	// copy contents of source object
+	if (count > 0)
+	{
+		if (!mSegments)
+		{
+			mSegments = new HtrSegmentInfo[count];
+		}
+
+		if (mSegments)
+		{
+			mCount = count;
+			mFrame = src.Frame();
+			src.GetRootPosition( mRoot );
+
+			for (int i = 0; i < mCount; i++)
+			{
+				src.GetSegmentInfo( i, mSegments[i] );
+			}
+		}
+	}
+}
+
+// Deallocates any previously allocated memory
+void HtrFrameWrapper::FreeMemory()
+{
+	if (mSegments)
+	{
+		delete[] mSegments;
+	}
+
+	mSegments = NULL;
+	mCount = 0;
+	mFrame = -1;
+	mRoot[0] = mRoot[1] = mRoot[2] = XEMPTY;
+}
+
+
+
+//
+// Wrapper for sDofFrame structure
+//
+
+// Default constructor
+DofFrameWrapper::DofFrameWrapper( const sDofFrame* src )
+{
+	mDofs = NULL;
+	mCount = 0;
+	mFrame = -1;
+
+	Copy( src );
+}
+
+// Copy constructor
+DofFrameWrapper::DofFrameWrapper( const DofFrameWrapper& src )
+{
+	mDofs = NULL;
+	mCount = 0;
+	mFrame = -1;
+
+	Copy( src );
+}
+
+// Destructor
+DofFrameWrapper::~DofFrameWrapper()
+{
+	FreeMemory();
+}
+
+// Set/Reset after creation
+void DofFrameWrapper::Set( const sDofFrame* src )
+{
+	Copy( src );
+}
+
+// Get number of degrees of freedom in this frame
+int DofFrameWrapper::Size() const
+{
+	return mCount;
+}
+
+// Get frame number for this frame
+int DofFrameWrapper::Frame() const
+{
+	return mFrame;
+}
+
+// Get the degree of freedom value at index i
+void DofFrameWrapper::GetDofValue( int i, double& value ) const
+{
+	value = XEMPTY;
+
+	if (i >= 0 && i < mCount && mDofs)
+	{
+		value = mDofs[i];
+	}
+}
+
+// Number of bytes needed to store this frame in a flat buffer
+int DofFrameWrapper::PackedSize() const
+{
+	return 2*sizeof(int) + mCount*sizeof(double);
+}
+
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void DofFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+
+	header[0] = mFrame;
+	header[1] = mCount;
+
+	if (mCount > 0)
+	{
+		memcpy( header + 2, mDofs, mCount*sizeof(double) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void DofFrameWrapper::Unpack( const void* src )
+{
+	const int* header = (const int*) src;
+	int count = header[1];
+
+	// keep the DOF array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
+	if (count > 0)
+	{
+		if (!mDofs)
+		{
+			mDofs = new double[count];
+		}
+
+		if (mDofs)
+		{
+			mCount = count;
+			mFrame = header[0];
+			memcpy( mDofs, header + 2, mCount*sizeof(double) );
+		}
+	}
+}
+
+
+// Assignment operator from a DofFrameWrapper object
+DofFrameWrapper& DofFrameWrapper::operator = ( const DofFrameWrapper& lhs )
+{
+	Copy( lhs );
+	return *this;
+}
+
+// Equality check against a DofFrameWrapper object
+bool DofFrameWrapper::operator == ( const DofFrameWrapper& lhs ) const
+{
+	bool rc = false;
+	int i = 0;
+
+	rc = (mCount == lhs.mCount);
+	rc = rc && mFrame == lhs.mFrame;
+
+	while (i < mCount && rc)
+	{
+		rc = mDofs[i] == lhs.mDofs[i];
+		i++;
+	}
+
+	return rc;
+}
+
+// Inequality check against a DofFrameWrapper object 
+bool DofFrameWrapper::operator != ( const DofFrameWrapper& lhs ) const
+{
+	return !(*this == lhs);
+}
+
+
+// Fill object with values from a sDofFrame*
+void DofFrameWrapper::Copy( const sDofFrame* src )
+{
+	int count = src ? src->nDOFs : 0;
+
+	// keep the DOF array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
+	// if the frame and count are valid, copy count number of DOF values
+	if (src)
+	{
+		if (count > 0)
+		{
+			if (!mDofs)
+			{
+				mDofs = new double[count];
+			}
+			
+			if (mDofs)
+			{
+				mCount = count;
 				mFrame = src->iFrame;
 				
 				for (int i = 0; i < mCount; i++)
@@ -887,15 +1494,21 @@ void DofFrameWrapper::Copy( const sDofFrame* src )
 // Fill object with values from a DofFrameWrapper object
 void DofFrameWrapper::Copy( const DofFrameWrapper& src )
 {
-	// clear any previous data
-	FreeMemory();
-	
 	int count = src.Size();
 
+	// keep the DOF array if it already has the right size, otherwise clear any previous data
+	if (count != mCount)
+	{
+		FreeMemory();
+	}
+
 	// copy contents of source object
 	if (count > 0)
 	{
-		mDofs = new double[count];
+		if (!mDofs)
+		{
+			mDofs = new double[count];
+		}
 
 		if (mDofs)
 		{
@@ -922,3 +1535,382 @@ void DofFrameWrapper::FreeMemory()
 	mCount = 0;
 	mFrame = -1;
 }
+
+
+//
+// Wrapper for sAnalogFrame structure
+//
+
+// Default constructor
+AnalogFrameWrapper::AnalogFrameWrapper( const sAnalogFrame* src )
+{
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mChannels = 0;
+
+	Set( src );
+}
+
+// Copy constructor
+AnalogFrameWrapper::AnalogFrameWrapper( const AnalogFrameWrapper& src )
+{
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mChannels = 0;
+
+	Copy( src.mFrame, src.mSamples, src.mChannels, src.mData );
+}
+
+// Destructor
+AnalogFrameWrapper::~AnalogFrameWrapper()
+{
+	FreeMemory();
+}
+
+// Set/Reset after creation
+void AnalogFrameWrapper::Set( const sAnalogFrame* src )
+{
+	if (src)
+	{
+		Copy( src->iFrame, src->nSamples, src->nChannels, src->wData );
+	}
+	else
+	{
+		Copy( -1, 0, 0, NULL );
+	}
+}
+
+// Set from samples laid out as in sAnalogFrame::wData
+void AnalogFrameWrapper::Set( int frame, int samples, int channels, const short* data )
+{
+	Copy( frame, samples, channels, data );
+}
+
+// Get frame number for this frame
+int AnalogFrameWrapper::Frame() const
+{
+	return mFrame;
+}
+
+// Get number of samples of each channel
+int AnalogFrameWrapper::Samples() const
+{
+	return mSamples;
+}
+
+// Get number of analog channels
+int AnalogFrameWrapper::Channels() const
+{
+	return mChannels;
+}
+
+// Get one sample of one channel
+short AnalogFrameWrapper::Value( int sample, int channel ) const
+{
+	short value = 0;
+
+	if (sample >= 0 && sample < mSamples && channel >= 0 && channel < mChannels)
+	{
+		value = mData[sample*mChannels + channel];
+	}
+
+	return value;
+}
+
+// Get all samples, sample major
+const short* AnalogFrameWrapper::Data() const
+{
+	return (mSamples*mChannels > 0) ? mData : NULL;
+}
+
+// Number of bytes needed to store this frame in a flat buffer
+int AnalogFrameWrapper::PackedSize() const
+{
+	return 3*sizeof(int) + mSamples*mChannels*sizeof(short);
+}
+
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void AnalogFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+
+	header[0] = mFrame;
+	header[1] = mSamples;
+	header[2] = mChannels;
+
+	if (mSamples*mChannels > 0)
+	{
+		memcpy( header + 3, mData, mSamples*mChannels*sizeof(short) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void AnalogFrameWrapper::Unpack( const void* src )
+{
+	const int* header = (const int*) src;
+
+	Copy( header[0], header[1], header[2], (const short*)(header + 3) );
+}
+
+
+// Assignment operator from an AnalogFrameWrapper object
+AnalogFrameWrapper& AnalogFrameWrapper::operator = ( const AnalogFrameWrapper& lhs )
+{
+	if (this != &lhs)
+	{
+		Copy( lhs.mFrame, lhs.mSamples, lhs.mChannels, lhs.mData );
+	}
+	return *this;
+}
+
+// Equality check against an AnalogFrameWrapper object
+bool AnalogFrameWrapper::operator == ( const AnalogFrameWrapper& lhs ) const
+{
+	bool rc = false;
+
+	rc = (mSamples == lhs.mSamples);
+	rc = rc && mChannels == lhs.mChannels;
+	rc = rc && mFrame == lhs.mFrame;
+	rc = rc && (mSamples*mChannels == 0 || memcmp( mData, lhs.mData, mSamples*mChannels*sizeof(short) ) == 0);
+
+	return rc;
+}
+
+// Inequality check against an AnalogFrameWrapper object 
+bool AnalogFrameWrapper::operator != ( const AnalogFrameWrapper& lhs ) const
+{
+	return !(*this == lhs);
+}
+
+
+// Fill object with the given samples, reusing the block if they fit
+void AnalogFrameWrapper::Copy( int frame, int samples, int channels, const short* data )
+{
+	int count = (samples > 0 && channels > 0) ? samples*channels : 0;
+
+	mFrame = frame;
+	mSamples = 0;
+	mChannels = 0;
+
+	if (count > 0 && data && Reserve( count*sizeof(short) ))
+	{
+		mSamples = samples;
+		mChannels = channels;
+		memcpy( mData, data, count*sizeof(short) );
+	}
+}
+
+// Make sure the block holds at least the given number of bytes
+bool AnalogFrameWrapper::Reserve( int bytes )
+{
+	if (bytes > mCapacity)
+	{
+		BufferPool::ReleaseShared( mData );
+		mData = (short*) BufferPool::Shared().Acquire( bytes, mCapacity );
+	}
+
+	return mData != NULL;
+}
+
+// Gives the block back to the pool
+void AnalogFrameWrapper::FreeMemory()
+{
+	BufferPool::ReleaseShared( mData );
+
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mChannels = 0;
+}
+
+
+
+//
+// Wrapper for sForceFrame structure
+//
+
+// Default constructor
+ForceFrameWrapper::ForceFrameWrapper( const sForceFrame* src )
+{
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mPlates = 0;
+
+	Set( src );
+}
+
+// Copy constructor
+ForceFrameWrapper::ForceFrameWrapper( const ForceFrameWrapper& src )
+{
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mPlates = 0;
+
+	Copy( src.mFrame, src.mSamples, src.mPlates, src.mData );
+}
+
+// Destructor
+ForceFrameWrapper::~ForceFrameWrapper()
+{
+	FreeMemory();
+}
+
+// Set/Reset after creation
+void ForceFrameWrapper::Set( const sForceFrame* src )
+{
+	if (src)
+	{
+		Copy( src->iFrame, src->nSamples, src->nPlates, src->fData );
+	}
+	else
+	{
+		Copy( -1, 0, 0, NULL );
+	}
+}
+
+// Get frame number for this frame
+int ForceFrameWrapper::Frame() const
+{
+	return mFrame;
+}
+
+// Get number of samples of each plate
+int ForceFrameWrapper::Samples() const
+{
+	return mSamples;
+}
+
+// Get number of force plates
+int ForceFrameWrapper::Plates() const
+{
+	return mPlates;
+}
+
+// Get one value of one plate in one sample
+float ForceFrameWrapper::Value( int sample, int plate, int value ) const
+{
+	float result = (float) XEMPTY;
+
+	if (sample >= 0 && sample < mSamples && plate >= 0 && plate < mPlates && value >= 0 && value < FORCE_VALUES)
+	{
+		result = mData[(sample*mPlates + plate)*FORCE_VALUES + value];
+	}
+
+	return result;
+}
+
+// Get all values, sample major
+const float* ForceFrameWrapper::Data() const
+{
+	return (mSamples*mPlates > 0) ? mData : NULL;
+}
+
+// Number of bytes needed to store this frame in a flat buffer
+int ForceFrameWrapper::PackedSize() const
+{
+	return 3*sizeof(int) + mSamples*mPlates*FORCE_VALUES*sizeof(float);
+}
+
+// Copy this frame into a flat buffer of at least PackedSize() bytes
+void ForceFrameWrapper::Pack( void* dst ) const
+{
+	int* header = (int*) dst;
+
+	header[0] = mFrame;
+	header[1] = mSamples;
+	header[2] = mPlates;
+
+	if (mSamples*mPlates > 0)
+	{
+		memcpy( header + 3, mData, mSamples*mPlates*FORCE_VALUES*sizeof(float) );
+	}
+}
+
+// Fill object from a buffer written by Pack()
+void ForceFrameWrapper::Unpack( const void* src )
+{
+	const int* header = (const int*) src;
+
+	Copy( header[0], header[1], header[2], (const float*)(header + 3) );
+}
+
+
+// Assignment operator from a ForceFrameWrapper object
+ForceFrameWrapper& ForceFrameWrapper::operator = ( const ForceFrameWrapper& lhs )
+{
+	if (this != &lhs)
+	{
+		Copy( lhs.mFrame, lhs.mSamples, lhs.mPlates, lhs.mData );
+	}
+	return *this;
+}
+
+// Equality check against a ForceFrameWrapper object
+bool ForceFrameWrapper::operator == ( const ForceFrameWrapper& lhs ) const
+{
+	bool rc = false;
+
+	rc = (mSamples == lhs.mSamples);
+	rc = rc && mPlates == lhs.mPlates;
+	rc = rc && mFrame == lhs.mFrame;
+	rc = rc && (mSamples*mPlates == 0 || memcmp( mData, lhs.mData, mSamples*mPlates*FORCE_VALUES*sizeof(float) ) == 0);
+
+	return rc;
+}
+
+// Inequality check against a ForceFrameWrapper object 
+bool ForceFrameWrapper::operator != ( const ForceFrameWrapper& lhs ) const
+{
+	return !(*this == lhs);
+}
+
+
+// Fill object with the given values, reusing the block if they fit
+void ForceFrameWrapper::Copy( int frame, int samples, int plates, const float* data )
+{
+	int count = (samples > 0 && plates > 0) ? samples*plates*FORCE_VALUES : 0;
+
+	mFrame = frame;
+	mSamples = 0;
+	mPlates = 0;
+
+	if (count > 0 && data && Reserve( count*sizeof(float) ))
+	{
+		mSamples = samples;
+		mPlates = plates;
+		memcpy( mData, data, count*sizeof(float) );
+	}
+}
+
+// Make sure the block holds at least the given number of bytes
+bool ForceFrameWrapper::Reserve( int bytes )
+{
+	if (bytes > mCapacity)
+	{
+		BufferPool::ReleaseShared( mData );
+		mData = (float*) BufferPool::Shared().Acquire( bytes, mCapacity );
+	}
+
+	return mData != NULL;
+}
+
+// Gives the block back to the pool
+void ForceFrameWrapper::FreeMemory()
+{
+	BufferPool::ReleaseShared( mData );
+
+	mData = NULL;
+	mCapacity = 0;
+	mFrame = -1;
+	mSamples = 0;
+	mPlates = 0;
+}